@@ -0,0 +1,48 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+#include "log2_hist.h"
+
+void log2_hist_reset(log2_hist_t *hist) {
+	w_assert(hist);
+	memset(hist, 0, sizeof(log2_hist_t));
+}
+
+uint8_t log2_hist_bucket(uint32_t value) {
+	uint8_t bucket = 0;
+	while (value != 0) {
+		value >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+void log2_hist_add(log2_hist_t *hist, uint32_t value) {
+	w_assert(hist);
+
+	if ((hist->count == 0) || (value < hist->min)) {
+		hist->min = value;
+	}
+	if ((hist->count == 0) || (value > hist->max)) {
+		hist->max = value;
+	}
+	if (hist->count != UINT32_MAX) {
+		hist->count++;
+	}
+	hist->sum += value;
+
+	uint8_t bucket = log2_hist_bucket(value);
+	if (hist->buckets[bucket] != UINT32_MAX) {
+		hist->buckets[bucket]++;
+	}
+}
+
+uint32_t log2_hist_mean(const log2_hist_t *hist) {
+	w_assert(hist);
+
+	if (hist->count == 0) {
+		return 0;
+	}
+	return (uint32_t)(hist->sum / hist->count);
+}
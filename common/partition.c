@@ -0,0 +1,307 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+#include "partition.h"
+
+#define SECTOR_SIZE 512
+
+#define MBR_TABLE_OFFSET 0x1BE
+#define MBR_ENTRY_SIZE 16
+#define MBR_NUM_ENTRIES 4
+// partition table and boot signature
+#define MBR_TABLE_READ_SIZE (MBR_ENTRY_SIZE * MBR_NUM_ENTRIES + 2)
+#define MBR_TYPE_OFF 4
+#define MBR_LBA_OFF 8
+#define MBR_SIZE_OFF 12
+
+#define MBR_TYPE_EXTENDED_CHS 0x05
+#define MBR_TYPE_EXTENDED_LBA 0x0F
+#define MBR_TYPE_EXTENDED_LINUX 0x85
+#define MBR_TYPE_GPT_PROTECTIVE 0xEE
+
+// Guard against EBR chains that loop back on themselves
+#define EBR_MAX_CHAIN 64
+
+#define GPT_HEADER_LBA 1
+#define GPT_HEADER_SIZE 92
+#define GPT_SIGNATURE_OFF 0
+#define GPT_HEADER_SIZE_OFF 12
+#define GPT_HEADER_CRC_OFF 16
+#define GPT_ENTRIES_LBA_OFF 72
+#define GPT_NUM_ENTRIES_OFF 80
+#define GPT_ENTRY_SIZE_OFF 84
+// type GUID, unique GUID, first LBA, last LBA
+#define GPT_ENTRY_READ_SIZE 48
+#define GPT_ENTRY_FIRST_LBA_OFF 32
+#define GPT_ENTRY_LAST_LBA_OFF 40
+// Entries of the 16 KiB minimum entry array, bounds the reads of a corrupt entry count
+#define GPT_MAX_ENTRIES 128
+
+const uint8_t partition_gpt_type_linux[PARTITION_GUID_SIZE] = {
+	0xaf, 0x3d, 0xc6, 0x0f, 0x83, 0x84, 0x72, 0x47, 0x8e, 0x79, 0x3d, 0x69, 0xd8, 0x47, 0x7d, 0xe4};
+
+// Output array of the enumeration
+typedef struct {
+	partition_entry_t *entries;
+	uint8_t max_entries;
+	uint8_t num_entries;
+	uint32_t align_sectors;
+	bool overflow;
+} partition_list_t;
+
+static uint32_t read_le32(const uint8_t *p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t read_le64(const uint8_t *p) {
+	return (uint64_t)read_le32(p) | ((uint64_t)read_le32(p + 4) << 32);
+}
+
+// Bitwise CRC-32 (IEEE 802.3) as used by GPT, slow but without a 1 KiB table
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, uint16_t size) {
+	while (size-- > 0) {
+		crc ^= *data++;
+		for (uint8_t bit = 0; bit < 8; bit++) {
+			crc = (crc >> 1) ^ (0xEDB88320UL & (0UL - (crc & 1UL)));
+		}
+	}
+	return crc;
+}
+
+static void add_entry(partition_list_t *list, const partition_entry_t *entry) {
+	if (list->num_entries >= list->max_entries) {
+		list->overflow = true;
+		return;
+	}
+
+	partition_entry_t *out = &list->entries[list->num_entries++];
+	*out = *entry;
+	out->align_offset = 0;
+	if (list->align_sectors > 1) {
+		out->align_offset = (uint32_t)(entry->start_lba % list->align_sectors);
+	}
+	out->aligned = (out->align_offset == 0);
+}
+
+static bool is_extended(uint8_t type) {
+	return (type == MBR_TYPE_EXTENDED_CHS) || (type == MBR_TYPE_EXTENDED_LBA) ||
+		   (type == MBR_TYPE_EXTENDED_LINUX);
+}
+
+/**
+ * @brief Read the partition table of an MBR or EBR and check its boot signature
+ */
+static w_status_t read_mbr_table(partition_read_t read, void *read_arg, uint64_t lba,
+								 uint8_t table[MBR_TABLE_READ_SIZE]) {
+	w_status_t status = read(read_arg, lba, MBR_TABLE_OFFSET, table, MBR_TABLE_READ_SIZE);
+	if (status != W_SUCCESS) {
+		return status;
+	}
+
+	const uint8_t *signature = &table[MBR_ENTRY_SIZE * MBR_NUM_ENTRIES];
+	if ((signature[0] != 0x55) || (signature[1] != 0xAA)) {
+		return W_DATA_FORMAT_ERROR;
+	}
+	return W_SUCCESS;
+}
+
+/**
+ * @brief Walk the EBR chain of an extended partition
+ *
+ * Each EBR holds the logical partition relative to itself and a link to the next EBR relative to
+ * the start of the extended partition.
+ */
+static w_status_t enumerate_ebr(partition_read_t read, void *read_arg, uint32_t extended_start,
+								partition_list_t *list) {
+	uint8_t table[MBR_TABLE_READ_SIZE];
+	uint32_t ebr = extended_start;
+
+	for (uint8_t i = 0; i < EBR_MAX_CHAIN; i++) {
+		w_status_t status = read_mbr_table(read, read_arg, ebr, table);
+		if (status != W_SUCCESS) {
+			return status;
+		}
+
+		const uint8_t *logical = table;
+		const uint8_t *next = table + MBR_ENTRY_SIZE;
+
+		if ((logical[MBR_TYPE_OFF] != 0) && (read_le32(&logical[MBR_SIZE_OFF]) != 0)) {
+			partition_entry_t entry;
+			memset(&entry, 0, sizeof(entry));
+			entry.scheme = PARTITION_SCHEME_EBR;
+			entry.mbr_type = logical[MBR_TYPE_OFF];
+			entry.start_lba = (uint64_t)ebr + read_le32(&logical[MBR_LBA_OFF]);
+			entry.num_sectors = read_le32(&logical[MBR_SIZE_OFF]);
+			add_entry(list, &entry);
+		}
+
+		if (!is_extended(next[MBR_TYPE_OFF])) {
+			return W_SUCCESS;
+		}
+		ebr = extended_start + read_le32(&next[MBR_LBA_OFF]);
+	}
+
+	return W_DATA_FORMAT_ERROR;
+}
+
+/**
+ * @brief Read the primary GPT header and its entry array
+ */
+static w_status_t enumerate_gpt(partition_read_t read, void *read_arg, partition_list_t *list) {
+	uint8_t header[GPT_HEADER_SIZE];
+	w_status_t status = read(read_arg, GPT_HEADER_LBA, 0, header, GPT_HEADER_SIZE);
+	if (status != W_SUCCESS) {
+		return status;
+	}
+
+	uint32_t header_size = read_le32(&header[GPT_HEADER_SIZE_OFF]);
+	if ((memcmp(&header[GPT_SIGNATURE_OFF], "EFI PART", 8) != 0) ||
+		(header_size < GPT_HEADER_SIZE) || (header_size > SECTOR_SIZE)) {
+		return W_DATA_FORMAT_ERROR;
+	}
+
+	// The header CRC is computed with the CRC field zeroed and covers header_size bytes, which
+	// may extend past the fields known here
+	uint32_t header_crc = read_le32(&header[GPT_HEADER_CRC_OFF]);
+	memset(&header[GPT_HEADER_CRC_OFF], 0, 4);
+	uint32_t crc = crc32_update(0xFFFFFFFFUL, header, GPT_HEADER_SIZE);
+	for (uint16_t off = GPT_HEADER_SIZE; off < header_size;) {
+		uint8_t chunk[16];
+		uint16_t n = (uint16_t)(header_size - off);
+		if (n > sizeof(chunk)) {
+			n = sizeof(chunk);
+		}
+		status = read(read_arg, GPT_HEADER_LBA, off, chunk, n);
+		if (status != W_SUCCESS) {
+			return status;
+		}
+		crc = crc32_update(crc, chunk, n);
+		off += n;
+	}
+	if ((uint32_t)~crc != header_crc) {
+		return W_DATA_FORMAT_ERROR;
+	}
+
+	uint64_t entries_lba = read_le64(&header[GPT_ENTRIES_LBA_OFF]);
+	uint32_t num_entries = read_le32(&header[GPT_NUM_ENTRIES_OFF]);
+	uint32_t entry_size = read_le32(&header[GPT_ENTRY_SIZE_OFF]);
+	// Entry size is 128 * 2^n, so entries never straddle a sector
+	if ((entry_size < 128) || (entry_size > SECTOR_SIZE) ||
+		((entry_size & (entry_size - 1)) != 0)) {
+		return W_DATA_FORMAT_ERROR;
+	}
+
+	if (num_entries > GPT_MAX_ENTRIES) {
+		num_entries = GPT_MAX_ENTRIES;
+	}
+
+	// Stops at the first used entry that does not fit, which is only needed to report the overflow
+	uint32_t entries_per_sector = SECTOR_SIZE / entry_size;
+	for (uint32_t i = 0; (i < num_entries) && !list->overflow; i++) {
+		uint8_t raw[GPT_ENTRY_READ_SIZE];
+		status = read(read_arg,
+					  entries_lba + (i / entries_per_sector),
+					  (uint16_t)((i % entries_per_sector) * entry_size),
+					  raw,
+					  GPT_ENTRY_READ_SIZE);
+		if (status != W_SUCCESS) {
+			return status;
+		}
+
+		// Unused entries have an all zero type GUID, they may appear between used ones
+		bool used = false;
+		for (uint8_t b = 0; b < PARTITION_GUID_SIZE; b++) {
+			used = used || (raw[b] != 0);
+		}
+		if (!used) {
+			continue;
+		}
+
+		partition_entry_t entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.scheme = PARTITION_SCHEME_GPT;
+		memcpy(entry.gpt_type, raw, PARTITION_GUID_SIZE);
+		entry.start_lba = read_le64(&raw[GPT_ENTRY_FIRST_LBA_OFF]);
+		uint64_t last_lba = read_le64(&raw[GPT_ENTRY_LAST_LBA_OFF]);
+		// A partition cannot overlap the MBR or the GPT header, or end before it starts
+		if ((entry.start_lba <= GPT_HEADER_LBA) || (last_lba < entry.start_lba)) {
+			return W_DATA_FORMAT_ERROR;
+		}
+		entry.num_sectors = last_lba - entry.start_lba + 1;
+		add_entry(list, &entry);
+	}
+
+	return W_SUCCESS;
+}
+
+w_status_t partition_enumerate(partition_read_t read, void *read_arg, uint32_t align_sectors,
+							   partition_entry_t *entries, uint8_t max_entries,
+							   uint8_t *num_entries) {
+	if (!read || !entries || !num_entries) {
+		return W_INVALID_PARAM;
+	}
+
+	partition_list_t list = {
+		.entries = entries, .max_entries = max_entries, .align_sectors = align_sectors};
+	*num_entries = 0;
+
+	uint8_t table[MBR_TABLE_READ_SIZE];
+	w_status_t status = read_mbr_table(read, read_arg, 0, table);
+	if (status != W_SUCCESS) {
+		return status;
+	}
+
+	// A protective MBR (also a hybrid one) means the GPT is authoritative
+	for (uint8_t i = 0; i < MBR_NUM_ENTRIES; i++) {
+		if (table[i * MBR_ENTRY_SIZE + MBR_TYPE_OFF] == MBR_TYPE_GPT_PROTECTIVE) {
+			status = enumerate_gpt(read, read_arg, &list);
+			*num_entries = list.num_entries;
+			if ((status == W_SUCCESS) && list.overflow) {
+				return W_OVERFLOW;
+			}
+			return status;
+		}
+	}
+
+	for (uint8_t i = 0; i < MBR_NUM_ENTRIES; i++) {
+		const uint8_t *raw = &table[i * MBR_ENTRY_SIZE];
+		uint8_t type = raw[MBR_TYPE_OFF];
+		uint32_t size = read_le32(&raw[MBR_SIZE_OFF]);
+		if ((type == 0) || (size == 0)) {
+			continue;
+		}
+
+		if (is_extended(type)) {
+			status = enumerate_ebr(read, read_arg, read_le32(&raw[MBR_LBA_OFF]), &list);
+			if (status != W_SUCCESS) {
+				break;
+			}
+			continue;
+		}
+
+		partition_entry_t entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.scheme = PARTITION_SCHEME_MBR;
+		entry.mbr_type = type;
+		entry.start_lba = read_le32(&raw[MBR_LBA_OFF]);
+		entry.num_sectors = size;
+		add_entry(&list, &entry);
+	}
+
+	*num_entries = list.num_entries;
+	if ((status == W_SUCCESS) && list.overflow) {
+		return W_OVERFLOW;
+	}
+	return status;
+}
+
+bool partition_is_linux(const partition_entry_t *entry) {
+	w_assert(entry);
+
+	if (entry->scheme == PARTITION_SCHEME_GPT) {
+		return memcmp(entry->gpt_type, partition_gpt_type_linux, PARTITION_GUID_SIZE) == 0;
+	}
+	return entry->mbr_type == PARTITION_MBR_TYPE_LINUX;
+}
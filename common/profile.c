@@ -0,0 +1,65 @@
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+
+w_profile_stats_t w_profile_table[W_PROFILE_SCOPES];
+
+void w_profile_init(void) {
+	for (uint8_t i = 0; i < W_PROFILE_SCOPES; i++) {
+		w_profile_table[i].count = 0;
+		w_profile_table[i].min = 0;
+		w_profile_table[i].max = 0;
+		w_profile_table[i].total = 0;
+	}
+	w_profile_counter_init();
+}
+
+void w_profile_record(uint8_t id, w_profile_count_t duration) {
+	if (id >= W_PROFILE_SCOPES) {
+		return;
+	}
+
+	w_profile_stats_t *stats = &w_profile_table[id];
+	if ((stats->count == 0) || (duration < stats->min)) {
+		stats->min = duration;
+	}
+	if (duration > stats->max) {
+		stats->max = duration;
+	}
+	if (stats->count != UINT32_MAX) {
+		stats->count++;
+	}
+	stats->total += duration;
+}
+
+w_status_t w_profile_get(uint8_t id, w_profile_stats_t *stats) {
+	if ((id >= W_PROFILE_SCOPES) || !stats) {
+		return W_INVALID_PARAM;
+	}
+	*stats = w_profile_table[id];
+	return W_SUCCESS;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+// Host builds count nanoseconds of the monotonic clock, targets implement these in their drivers
+
+void w_profile_counter_init(void) {}
+
+w_profile_count_t w_profile_counter(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (w_profile_count_t)((uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec);
+}
+
+uint32_t w_profile_counter_hz(void) {
+	return 1000000000u;
+}
+
+#endif
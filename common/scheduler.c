@@ -0,0 +1,148 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "scheduler.h"
+#include "timer_wheel.h"
+
+/**
+ * @brief Timer wheel callback, queues the task of the timer
+ *
+ * @param timer Timer of the released task
+ */
+static void scheduler_release(timer_wheel_timer_t *timer) {
+	scheduler_task_t *task = (scheduler_task_t *)timer->arg;
+	scheduler_t *sched = task->sched;
+
+	task->stats.overruns += timer->missed;
+	if (task->ready) {
+		task->stats.overruns++;
+		return;
+	}
+
+	task->ready = true;
+	task->next_ready = NULL;
+	if (sched->ready_tail) {
+		sched->ready_tail->next_ready = task;
+	} else {
+		sched->ready_head = task;
+	}
+	sched->ready_tail = task;
+}
+
+void scheduler_init(scheduler_t *sched, uint32_t now, uint32_t (*clock)(void)) {
+	w_assert(sched);
+
+	timer_wheel_init(&sched->wheel, now);
+	sched->clock = clock;
+	sched->ready_head = NULL;
+	sched->ready_tail = NULL;
+}
+
+void scheduler_task_init(scheduler_task_t *task) {
+	w_assert(task);
+
+	task->fn = NULL;
+	task->arg = NULL;
+	task->sched = NULL;
+	task->ready = false;
+	task->next_ready = NULL;
+	task->stats.runs = 0;
+	task->stats.overruns = 0;
+	task->stats.max_run_time = 0;
+	task->stats.total_run_time = 0;
+	timer_wheel_timer_init(&task->timer, NULL, NULL);
+}
+
+w_status_t scheduler_add(scheduler_t *sched, scheduler_task_t *task, scheduler_fn_t fn, void *arg,
+						 uint32_t period, uint32_t delay) {
+	if (!sched || !task || !fn || (period == 0) || (period > INT32_MAX) || (delay == 0) ||
+		(delay > INT32_MAX)) {
+		return W_INVALID_PARAM;
+	}
+
+	// Unlinked from the wheel and the ready queue before its links are reset
+	if (task->sched) {
+		scheduler_remove(task->sched, task);
+	}
+
+	task->fn = fn;
+	task->arg = arg;
+	task->sched = sched;
+	task->ready = false;
+	task->next_ready = NULL;
+	task->stats.runs = 0;
+	task->stats.overruns = 0;
+	task->stats.max_run_time = 0;
+	task->stats.total_run_time = 0;
+	timer_wheel_timer_init(&task->timer, scheduler_release, task);
+	return timer_wheel_start(&sched->wheel, &task->timer, delay, period);
+}
+
+void scheduler_remove(scheduler_t *sched, scheduler_task_t *task) {
+	w_assert(sched && task);
+
+	timer_wheel_stop(&task->timer);
+	task->sched = NULL;
+	if (!task->ready) {
+		return;
+	}
+
+	// Unlink from the ready queue, which only holds the tasks released since the last run
+	scheduler_task_t *previous = NULL;
+	for (scheduler_task_t *t = sched->ready_head; t; t = t->next_ready) {
+		if (t != task) {
+			previous = t;
+			continue;
+		}
+		if (previous) {
+			previous->next_ready = task->next_ready;
+		} else {
+			sched->ready_head = task->next_ready;
+		}
+		if (sched->ready_tail == task) {
+			sched->ready_tail = previous;
+		}
+		break;
+	}
+	task->ready = false;
+	task->next_ready = NULL;
+}
+
+uint32_t scheduler_run(scheduler_t *sched, uint32_t now) {
+	w_assert(sched);
+
+	timer_wheel_advance(&sched->wheel, now);
+
+	uint32_t runs = 0;
+	while (sched->ready_head) {
+		scheduler_task_t *task = sched->ready_head;
+		sched->ready_head = task->next_ready;
+		if (!sched->ready_head) {
+			sched->ready_tail = NULL;
+		}
+		task->next_ready = NULL;
+		task->ready = false;
+
+		uint32_t start = sched->clock ? sched->clock() : 0;
+		task->fn(task->arg);
+		if (sched->clock) {
+			uint32_t run_time = sched->clock() - start;
+			if (run_time > task->stats.max_run_time) {
+				task->stats.max_run_time = run_time;
+			}
+			task->stats.total_run_time += run_time;
+		}
+		task->stats.runs++;
+		runs++;
+	}
+	return runs;
+}
+
+w_status_t scheduler_get_stats(const scheduler_task_t *task, scheduler_stats_t *stats) {
+	if (!task || !stats) {
+		return W_INVALID_PARAM;
+	}
+	*stats = task->stats;
+	return W_SUCCESS;
+}
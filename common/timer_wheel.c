@@ -0,0 +1,147 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "timer_wheel.h"
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+/**
+ * @brief Link a stopped timer at the head of a list
+ *
+ * @param head Head of the list
+ * @param timer Timer to link
+ */
+static void timer_link(timer_wheel_timer_t **head, timer_wheel_timer_t *timer) {
+	timer->next = *head;
+	if (timer->next) {
+		timer->next->pprev = &timer->next;
+	}
+	*head = timer;
+	timer->pprev = head;
+}
+
+static void timer_unlink(timer_wheel_timer_t *timer) {
+	*timer->pprev = timer->next;
+	if (timer->next) {
+		timer->next->pprev = timer->pprev;
+	}
+	timer->next = NULL;
+	timer->pprev = NULL;
+}
+
+void timer_wheel_init(timer_wheel_t *wheel, uint32_t now) {
+	w_assert(wheel);
+
+	for (uint16_t i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+		wheel->slots[i] = NULL;
+	}
+	wheel->now = now;
+}
+
+void timer_wheel_timer_init(timer_wheel_timer_t *timer, timer_wheel_callback_t callback,
+							void *arg) {
+	w_assert(timer);
+
+	timer->callback = callback;
+	timer->arg = arg;
+	timer->expiry = 0;
+	timer->period = 0;
+	timer->missed = 0;
+	timer->next = NULL;
+	timer->pprev = NULL;
+}
+
+w_status_t timer_wheel_start(timer_wheel_t *wheel, timer_wheel_timer_t *timer, uint32_t delay,
+							 uint32_t period) {
+	if (!wheel || !timer || !timer->callback || (delay == 0) || (delay > INT32_MAX)) {
+		return W_INVALID_PARAM;
+	}
+
+	if (timer->pprev) {
+		timer_unlink(timer);
+	}
+	timer->expiry = wheel->now + delay;
+	timer->period = period;
+	timer->missed = 0;
+	timer_link(&wheel->slots[timer->expiry & SLOT_MASK], timer);
+	return W_SUCCESS;
+}
+
+void timer_wheel_stop(timer_wheel_timer_t *timer) {
+	w_assert(timer);
+
+	if (timer->pprev) {
+		timer_unlink(timer);
+	}
+}
+
+bool timer_wheel_running(const timer_wheel_timer_t *timer) {
+	w_assert(timer);
+
+	return timer->pprev != NULL;
+}
+
+/**
+ * @brief Expire the timers of the slot of the current tick
+ *
+ * The slot is moved to a local list first, callbacks may then start and stop any timer. Timers
+ * started into this slot again expire a whole revolution later at the earliest.
+ *
+ * @param wheel Wheel at the tick to process
+ * @param now Tick the wheel is advanced to, periodic timers restart after it
+ * @return Number of expired timers
+ */
+static uint32_t timer_wheel_expire(timer_wheel_t *wheel, uint32_t now) {
+	timer_wheel_timer_t **slot = &wheel->slots[wheel->now & SLOT_MASK];
+	timer_wheel_timer_t *pending = NULL;
+	uint32_t expired = 0;
+
+	// Timers are linked at the head, reversing the slot puts the first started first
+	while (*slot) {
+		timer_wheel_timer_t *timer = *slot;
+		timer_unlink(timer);
+		timer_link(&pending, timer);
+	}
+
+	while (pending) {
+		timer_wheel_timer_t *timer = pending;
+		timer_unlink(timer);
+		if ((int32_t)(timer->expiry - wheel->now) > 0) {
+			// Expires on a later revolution
+			timer_link(slot, timer);
+			continue;
+		}
+
+		timer->missed = 0;
+		if (timer->period != 0) {
+			timer->expiry += timer->period;
+			if ((int32_t)(timer->expiry - now) <= 0) {
+				timer->missed = (now - timer->expiry) / timer->period + 1;
+				timer->expiry += timer->missed * timer->period;
+			}
+			timer_link(&wheel->slots[timer->expiry & SLOT_MASK], timer);
+		}
+		expired++;
+		timer->callback(timer);
+	}
+	return expired;
+}
+
+uint32_t timer_wheel_advance(timer_wheel_t *wheel, uint32_t now) {
+	w_assert(wheel);
+
+	uint32_t ticks = now - wheel->now;
+	if (ticks > TIMER_WHEEL_SLOTS) {
+		// Every slot once, ending at now
+		wheel->now = now - TIMER_WHEEL_SLOTS;
+		ticks = TIMER_WHEEL_SLOTS;
+	}
+
+	uint32_t expired = 0;
+	while (ticks-- > 0) {
+		wheel->now++;
+		expired += timer_wheel_expire(wheel, now);
+	}
+	return expired;
+}
@@ -17,11 +17,20 @@ CPP_SRCS := \
 	$(ROCKETTEST_SRCS) \
 	$(TEST_SRCS)
 
+# The profiling sources only hold the scope implementation, leave them out unless it is enabled
+ifneq ($(filter -DW_PROFILE -DW_PROFILE=%,$(EXTRA_C_CXX_FLAGS)),)
+	COMMON_C_SRCS += $(COMMON_PROFILE_C_SRCS)
+	PIC18_C_SRCS += $(PIC18_PROFILE_C_SRCS)
+	STM32H7_C_SRCS += $(STM32H7_PROFILE_C_SRCS)
+endif
+
 ###########################
 # Common Build Variables
 ###########################
 
 INCLUDE_PATHS_C_CXX_FLAGS := $(foreach inc, $(INCLUDE_PATHS), $(addprefix -I, $(inc)))
+SIM_INCLUDE_PATHS_C_CXX_FLAGS := $(foreach inc, $(SIM_INCLUDE_PATHS), $(addprefix -I, $(inc)))
+SIM_DEFINES_C_CXX_FLAGS := $(foreach def, $(SIM_DEFINES), $(addprefix -D, $(def)))
 
 C_CXX_FLAGS += \
 	$(INCLUDE_PATHS_C_CXX_FLAGS) \
@@ -43,6 +52,10 @@ ifeq ($(filter run-test,$(MAKECMDGOALS)),run-test)
 	BUILD_DIR := build/test
 endif
 
+ifeq ($(filter sim-default-build,$(MAKECMDGOALS)),sim-default-build)
+	BUILD_DIR := build/sim-default
+endif
+
 ifneq ($(filter run-test-cov gen-cov-html,$(MAKECMDGOALS)),)
 	BUILD_DIR := build/test-cov
 
@@ -121,9 +134,15 @@ CLANG_FORMAT := clang-format
 COMMON_C_OBJS = $(patsubst %.c,$(BUILD_DIR)/%.o,$(COMMON_C_SRCS))
 COMMON_C_DEPS = $(COMMON_C_SRCS:.c=.d)
 
+COMMON_PROFILE_C_OBJS = $(patsubst %.c,$(BUILD_DIR)/%.o,$(COMMON_PROFILE_C_SRCS))
+COMMON_PROFILE_C_DEPS = $(COMMON_PROFILE_C_SRCS:.c=.d)
+
 PIC18_C_OBJS = $(patsubst %.c,$(BUILD_DIR)/%.o,$(PIC18_C_SRCS))
 PIC18_C_DEPS = $(PIC18_C_SRCS:.c=.d)
 
+SIM_C_OBJS = $(patsubst %.c,$(BUILD_DIR)/%.o,$(SIM_C_SRCS))
+SIM_C_DEPS = $(SIM_C_SRCS:.c=.d)
+
 CPP_OBJS = $(patsubst %.cpp,$(BUILD_DIR)/%.o,$(CPP_SRCS))
 CPP_DEPS = $(CPP_SRCS:.cpp=.d)
 
@@ -143,7 +162,11 @@ $(BUILD_DIR)/%.o: %.cpp
 # Unit Test Build
 ####################
 
-$(BUILD_DIR)/unit_test: $(COMMON_C_OBJS) $(CPP_OBJS)
+# Unit tests build target drivers against the host stand-ins of their vendor headers, with the
+# optional features the tests exercise
+$(BUILD_DIR)/unit_test: CFLAGS += $(SIM_INCLUDE_PATHS_C_CXX_FLAGS) $(SIM_DEFINES_C_CXX_FLAGS)
+$(BUILD_DIR)/unit_test: CXXFLAGS += $(SIM_INCLUDE_PATHS_C_CXX_FLAGS) $(SIM_DEFINES_C_CXX_FLAGS)
+$(BUILD_DIR)/unit_test: $(sort $(COMMON_C_OBJS) $(COMMON_PROFILE_C_OBJS)) $(SIM_C_OBJS) $(CPP_OBJS)
 	@mkdir -p $(dir $@)
 	$(CXX) $^ $(LDFLAGS) -o $@
 
@@ -172,6 +195,17 @@ $(BUILD_DIR)/html: $(BUILD_DIR)/coverage-filtered.info
 gen-cov-html: $(BUILD_DIR)/html
 	true
 
+#########################
+# Default Features Build
+#########################
+
+# Drivers built against the host stand-ins with the optional features left at their defaults,
+# covers the compiled-out paths and default buffer sizes the unit tests do not build
+.PHONY: sim-default-build
+sim-default-build: CFLAGS += $(SIM_INCLUDE_PATHS_C_CXX_FLAGS) -Werror
+sim-default-build: $(COMMON_C_OBJS) $(SIM_C_OBJS)
+	true
+
 ####################
 # XC8 Build
 ####################
@@ -188,6 +222,55 @@ xc8-build: $(COMMON_C_OBJS) $(PIC18_C_OBJS)
 xc16-build: $(COMMON_C_OBJS)
 	true
 
+####################
+# Host Tools
+####################
+
+# littlefs checkout (2.7 or newer) the SD image tool is built against
+LITTLEFS_PATH ?=
+
+HOST_TOOLS_BUILD_DIR := build/tools
+
+$(HOST_TOOLS_BUILD_DIR)/sdextract: $(SDEXTRACT_C_SRCS) $(COMMON_C_SRCS)
+	$(if $(LITTLEFS_PATH),,$(error LITTLEFS_PATH must point to a littlefs checkout))
+	@mkdir -p $(dir $@)
+	$(CC) -std=c99 -O2 -Wall -Wextra -pedantic -D_FILE_OFFSET_BITS=64 -DLFS_NO_DEBUG \
+		$(INCLUDE_PATHS_C_CXX_FLAGS) -I$(LITTLEFS_PATH) \
+		$^ $(LITTLEFS_PATH)/lfs.c $(LITTLEFS_PATH)/lfs_util.c -pthread -o $@
+
+.PHONY: sdextract
+sdextract: $(HOST_TOOLS_BUILD_DIR)/sdextract
+
+SDEXTRACT_TEST_BUILD_DIR := $(HOST_TOOLS_BUILD_DIR)/sdextract-test
+
+# The real littlefs header goes before the simulator include path holding its unit test stand-in
+SDEXTRACT_TEST_C_CXX_FLAGS = -O2 -Wall -Wextra -DLFS_NO_DEBUG -DLFSSHIM_SD_CACHE_SIZE=4096 \
+	-DLFSSHIM_SD_LOOKAHEAD_SIZE=4096 -I$(LITTLEFS_PATH) $(INCLUDE_PATHS_C_CXX_FLAGS) \
+	$(SIM_INCLUDE_PATHS_C_CXX_FLAGS)
+
+$(SDEXTRACT_TEST_BUILD_DIR)/write_test_image: $(SDEXTRACT_TEST_C_SRCS) $(SDEXTRACT_TEST_CPP_SRCS) \
+	$(SDEXTRACT_TEST_SIM_CPP_SRCS) $(COMMON_C_SRCS)
+	$(if $(LITTLEFS_PATH),,$(error LITTLEFS_PATH must point to a littlefs checkout))
+	@mkdir -p $@.objs
+	for src in $(SDEXTRACT_TEST_C_SRCS) $(COMMON_C_SRCS) $(LITTLEFS_PATH)/lfs.c \
+		$(LITTLEFS_PATH)/lfs_util.c; do \
+		$(CC) -std=c99 $(SDEXTRACT_TEST_C_CXX_FLAGS) -c $$src -o $@.objs/$$(basename $$src .c).o \
+			|| exit 1; \
+	done
+	$(CXX) -std=c++20 $(SDEXTRACT_TEST_C_CXX_FLAGS) $(SDEXTRACT_TEST_CPP_SRCS) \
+		$(SDEXTRACT_TEST_SIM_CPP_SRCS) $@.objs/*.o -o $@
+
+# Writes an image per geometry profile and checks that sdextract gets every file back unchanged
+.PHONY: sdextract-test
+sdextract-test: $(HOST_TOOLS_BUILD_DIR)/sdextract $(SDEXTRACT_TEST_BUILD_DIR)/write_test_image
+	for geometry in $(SDEXTRACT_TEST_GEOMETRIES); do \
+		dir=$(SDEXTRACT_TEST_BUILD_DIR)/$$geometry; \
+		rm -rf $$dir && mkdir -p $$dir && \
+		$(SDEXTRACT_TEST_BUILD_DIR)/write_test_image $$geometry $$dir && \
+		$(HOST_TOOLS_BUILD_DIR)/sdextract -r 32 $$dir/card.img $$dir/extracted && \
+		diff -r $$dir/expected $$dir/extracted || exit 1; \
+	done
+
 ####################
 # Linting
 ####################
@@ -202,13 +285,15 @@ lint:
 
 .PHONY: format
 format:
-	$(CLANG_FORMAT) -i $(COMMON_C_SRCS) $(COMMON_C_HEADERS) $(PIC18_C_SRCS) $(PIC18_C_HEADERS) $(STM32H7_C_SRCS) $(STM32H7_C_HEADERS) $(TEST_SRCS) $(ROCKETTEST_SRCS) $(ROCKETTEST_HEADERS)
+	$(CLANG_FORMAT) -i $(COMMON_C_SRCS) $(COMMON_PROFILE_C_SRCS) $(COMMON_C_HEADERS) $(PIC18_C_SRCS) $(PIC18_PROFILE_C_SRCS) $(PIC18_C_HEADERS) $(STM32H7_C_SRCS) $(STM32H7_PROFILE_C_SRCS) $(STM32H7_C_HEADERS) $(SDEXTRACT_C_SRCS) $(SDEXTRACT_TEST_CPP_SRCS) $(SIM_HEADERS) $(TEST_SRCS) $(ROCKETTEST_SRCS) $(ROCKETTEST_HEADERS)
 
 .PHONY: format-check
 format-check:
-	$(CLANG_FORMAT) --dry-run -Werror --style=file:$(ROCKETLIB_SUBMODULE_PATH)/.clang-format $(COMMON_C_SRCS) $(COMMON_C_HEADERS) $(PIC18_C_SRCS) $(PIC18_C_HEADERS) $(STM32H7_C_SRCS) $(STM32H7_C_HEADERS) $(TEST_SRCS) $(ROCKETTEST_SRCS) $(ROCKETTEST_HEADERS)
+	$(CLANG_FORMAT) --dry-run -Werror --style=file:$(ROCKETLIB_SUBMODULE_PATH)/.clang-format $(COMMON_C_SRCS) $(COMMON_PROFILE_C_SRCS) $(COMMON_C_HEADERS) $(PIC18_C_SRCS) $(PIC18_PROFILE_C_SRCS) $(PIC18_C_HEADERS) $(STM32H7_C_SRCS) $(STM32H7_PROFILE_C_SRCS) $(STM32H7_C_HEADERS) $(SDEXTRACT_C_SRCS) $(SDEXTRACT_TEST_CPP_SRCS) $(SIM_HEADERS) $(TEST_SRCS) $(ROCKETTEST_SRCS) $(ROCKETTEST_HEADERS)
 
 -include $(COMMON_C_DEPS)
+-include $(COMMON_PROFILE_C_DEPS)
+-include $(SIM_C_DEPS)
 -include $(CPP_DEPS)
 
 ####################
@@ -114,4 +114,112 @@ extern void rocketlib_assert_fail_c(const char *file, int line, const char *stat
 
 #endif
 
+// Profiling scopes
+
+#ifdef W_PROFILE
+
+#include <stdint.h>
+
+#ifndef W_PROFILE_SCOPES
+/// @brief Number of profiling scopes, ids are 0 to W_PROFILE_SCOPES - 1
+#define W_PROFILE_SCOPES 16
+#endif
+
+#ifdef __XC8
+/// @brief Timer1 count on PIC18, scopes must be shorter than a Timer1 rollover
+typedef uint16_t w_profile_count_t;
+#else
+/// @brief DWT cycle count on STM32H7, nanoseconds on hosts
+typedef uint32_t w_profile_count_t;
+#endif
+
+/// @brief Durations recorded by a profiling scope, in w_profile_counter() units
+typedef struct {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t total;
+} w_profile_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief Durations of all scopes, zero until the scope first ended, e.g. for telemetry
+extern w_profile_stats_t w_profile_table[W_PROFILE_SCOPES];
+
+/**
+ * @brief Clear the scope table and start the target counter if needed
+ *
+ * Starts DWT CYCCNT on STM32H7. On PIC18 Timer1 is started with the configuration of the I2C
+ * timeouts (Fosc/4, 1:8 prescaler) unless it already runs, then it is used as configured.
+ */
+void w_profile_init(void);
+
+/**
+ * @brief Start the counter read by w_profile_counter(), implemented by the target drivers
+ */
+void w_profile_counter_init(void);
+
+/**
+ * @brief Read the free running counter of the target, implemented by the target drivers
+ *
+ * @return Counter value
+ */
+w_profile_count_t w_profile_counter(void);
+
+/**
+ * @brief Frequency of the counter, converts the recorded durations to time
+ *
+ * Read from the running configuration, so it is right whoever started the counter: the Timer1
+ * clock source and prescaler on PIC18, the core clock on STM32H7, 1 GHz on hosts.
+ *
+ * @return Counter ticks per second, 0 if Timer1 is off or runs from another clock than Fosc/4 or
+ * Fosc
+ */
+uint32_t w_profile_counter_hz(void);
+
+/**
+ * @brief Record the duration of a scope, called by W_PROFILE_END()
+ *
+ * Each id must only be used from one context, e.g. the main loop or one interrupt priority.
+ *
+ * @param id Scope id, ignored if out of range
+ * @param duration Duration in counter units
+ */
+void w_profile_record(uint8_t id, w_profile_count_t duration);
+
+/**
+ * @brief Get the durations of a scope
+ *
+ * @param id Scope id
+ * @param stats Set to the durations
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on an id out of range or a
+ * NULL pointer
+ */
+w_status_t w_profile_get(uint8_t id, w_profile_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @brief Start a profiling scope, ended by W_PROFILE_END() with the same id in the same block
+ *
+ * Only active when `W_PROFILE` is defined, otherwise both macros compile to nothing. The id must
+ * be a single token, a number or an enum constant.
+ */
+#define W_PROFILE_BEGIN(id) w_profile_count_t w_profile_start_##id = w_profile_counter()
+
+/// @brief End a profiling scope and record its duration
+#define W_PROFILE_END(id)                                                                          \
+	w_profile_record((id), (w_profile_count_t)(w_profile_counter() - w_profile_start_##id))
+
+#else
+
+#define W_PROFILE_BEGIN(id)
+#define W_PROFILE_END(id)
+
+#endif
+
 #endif
@@ -0,0 +1,67 @@
+#ifndef ROCKETLIB_LOG2_HIST_H
+#define ROCKETLIB_LOG2_HIST_H
+
+#include <stdint.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief Number of buckets, enough for any 32 bit value
+#define LOG2_HIST_BUCKETS 33
+
+/**
+ * @brief Histogram with power of two bucket widths plus count, min, max and sum
+ *
+ * Bucket 0 counts the value 0, bucket i (i >= 1) counts values from 2^(i-1) to 2^i - 1. Meant for
+ * latencies, where the order of magnitude matters more than the exact value. A zero initialized
+ * histogram is empty.
+ */
+typedef struct {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t buckets[LOG2_HIST_BUCKETS];
+} log2_hist_t;
+
+/**
+ * @brief Empty a histogram
+ *
+ * @param hist Histogram to reset
+ */
+void log2_hist_reset(log2_hist_t *hist);
+
+/**
+ * @brief Add one value to a histogram
+ *
+ * Bucket counters saturate instead of wrapping.
+ *
+ * @param hist Histogram to update
+ * @param value Value to add
+ */
+void log2_hist_add(log2_hist_t *hist, uint32_t value);
+
+/**
+ * @brief Get the bucket a value is counted in
+ *
+ * @param value Value to look up
+ * @return Bucket index, 0 to LOG2_HIST_BUCKETS - 1
+ */
+uint8_t log2_hist_bucket(uint32_t value);
+
+/**
+ * @brief Get the mean of all values added to a histogram
+ *
+ * @param hist Histogram to read
+ * @return Mean value rounded down, 0 if the histogram is empty
+ */
+uint32_t log2_hist_mean(const log2_hist_t *hist);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
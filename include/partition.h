@@ -0,0 +1,108 @@
+#ifndef ROCKETLIB_PARTITION_H
+#define ROCKETLIB_PARTITION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief MBR partition type of Linux filesystems, used for littlefs partitions
+#define PARTITION_MBR_TYPE_LINUX 0x83
+
+/// @brief Size of a GPT partition type GUID in bytes
+#define PARTITION_GUID_SIZE 16
+
+/// @brief GPT type GUID of Linux filesystem data (0FC63DAF-8483-4772-8E79-3D69D8477DE4), on-disk
+/// byte order
+extern const uint8_t partition_gpt_type_linux[PARTITION_GUID_SIZE];
+
+/**
+ * @brief Partition table a partition was found in
+ */
+typedef enum {
+	/// @brief Primary entry of the MBR
+	PARTITION_SCHEME_MBR = 0,
+	/// @brief Logical partition in an extended partition (EBR chain)
+	PARTITION_SCHEME_EBR,
+	/// @brief GPT entry
+	PARTITION_SCHEME_GPT
+} partition_scheme_t;
+
+/**
+ * @brief One partition found by `partition_enumerate()`
+ */
+typedef struct {
+	partition_scheme_t scheme;
+	/// @brief MBR/EBR partition type, 0 for GPT partitions
+	uint8_t mbr_type;
+	/// @brief GPT partition type GUID in on-disk byte order, all zero for MBR/EBR partitions
+	uint8_t gpt_type[PARTITION_GUID_SIZE];
+	/// @brief First sector of the partition
+	uint64_t start_lba;
+	/// @brief Size of the partition in sectors
+	uint64_t num_sectors;
+	/// @brief Start sector modulo the alignment passed to `partition_enumerate()`, 0 if aligned
+	uint32_t align_offset;
+	/// @brief Partition start is a multiple of the alignment
+	bool aligned;
+} partition_entry_t;
+
+/**
+ * @brief Read part of a sector of the disk
+ *
+ * Called several times per sector with small byte ranges, an implementation backed by a block
+ * device should keep the last sector it read in a buffer it owns.
+ *
+ * @param arg Argument passed to `partition_enumerate()`
+ * @param lba Sector address
+ * @param offset Byte offset within the sector
+ * @param buffer Destination
+ * @param size Number of bytes to read, offset + size never exceeds 512
+ * @return w_status_t W_SUCCESS on success, any other value aborts the enumeration
+ */
+typedef w_status_t (*partition_read_t)(void *arg, uint64_t lba, uint16_t offset, uint8_t *buffer,
+									   uint16_t size);
+
+/**
+ * @brief List all partitions of a disk
+ *
+ * Reads the MBR, follows extended partitions through their EBR chain, and reads the primary GPT
+ * header and entry array when the MBR is a protective MBR. Only the sectors holding partition
+ * tables are read, through the callback and in small pieces, so no sector sized buffer is needed
+ * on the stack. The GPT header CRC is checked, the backup GPT is not used. At most the first 128
+ * entries of the GPT entry array are read.
+ *
+ * @param read Callback reading from the disk
+ * @param read_arg Argument passed to the callback
+ * @param align_sectors Alignment to check partition starts against in sectors, usually the
+ * allocation unit of the card, 0 or 1 to skip the check
+ * @param entries Array filled with the partitions in table order
+ * @param max_entries Size of the array
+ * @param num_entries Set to the number of entries filled in
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on NULL arguments,
+ * W_DATA_FORMAT_ERROR if there is no valid MBR, the GPT header is corrupt or a GPT entry has an
+ * invalid sector range (the entries before it are returned), W_OVERFLOW if the disk has more
+ * than max_entries partitions (the first max_entries are returned), or the error of the read
+ * callback
+ */
+w_status_t partition_enumerate(partition_read_t read, void *read_arg, uint32_t align_sectors,
+							   partition_entry_t *entries, uint8_t max_entries,
+							   uint8_t *num_entries);
+
+/**
+ * @brief Check if a partition holds a Linux filesystem (MBR type 0x83 or GPT Linux data)
+ *
+ * @param entry Partition to check
+ * @return true for Linux filesystem partitions
+ */
+bool partition_is_linux(const partition_entry_t *entry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,18 @@
+/**
+ * @file
+ * @brief PIC18 oscillator frequency shared by the drivers
+ *
+ * The I2C timeouts and clock, and the profiling counter frequency are all derived from
+ * `_XTAL_FREQ`, the Fosc the application runs at. Define it through EXTRA_C_CXX_FLAGS, e.g.
+ * `-D_XTAL_FREQ=64000000`, every driver then agrees on the same value.
+ */
+
+#ifndef ROCKETLIB_PIC18_CLOCK_H
+#define ROCKETLIB_PIC18_CLOCK_H
+
+#ifndef _XTAL_FREQ
+// Define crystal frequency for delay macros (default: 16 MHz)
+#define _XTAL_FREQ 16000000
+#endif
+
+#endif
@@ -5,16 +5,35 @@
  * This module provides I2C master functionality for the PIC18F26K83 microcontroller.
  * It supports standard I2C operations including read/write data and register read/write
  * operations for 8-bit and 16-bit registers.
+ *
+ * Besides the blocking functions, an interrupt driven engine runs queued transactions in the
+ * background. The blocking functions must not be used while queued transactions are pending.
+ *
+ * Optionally, DMA1 moves the data of long transfers between memory and the I2C1 buffers, so only
+ * the end of a transfer needs the CPU.
+ *
+ * Timeouts are measured with Timer1, which the driver runs from Fosc/4 with a 1:8 prescaler, see
+ * `I2C_TIMER_T1CON`. A transfer may take I2C_TIMEOUT_BASE_US plus I2C_TIMEOUT_BYTE_US per data
+ * byte. A bus held low by a target is recovered by clocking SCL until SDA is released, on the
+ * default I2C1 pins RC3 and RC4.
+ *
+ * The timeouts replace the polling iteration limit `I2C_POLL_TIMEOUT` and the fixed clock stretch
+ * delay `I2C_STRETCH_DELAY` of earlier versions, both macros are gone. Code overriding them sets
+ * `I2C_TIMEOUT_BASE_US` and `I2C_TIMEOUT_BYTE_US` instead.
+ *
+ * With `I2C_STATS` defined to 1 the driver counts transactions, errors and bus time per device
+ * address, see `i2c_stats_t`.
  */
 
 #ifndef ROCKETLIB_I2C_H
 #define ROCKETLIB_I2C_H
 
 #include "common.h"
+#include <stdbool.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
-#error "C++ is not supported"
+extern "C" {
 #endif
 
 /**
@@ -22,10 +41,105 @@
  *
  * These define the behavior and timing characteristics of the I2C interface
  */
-#define I2C_POLL_TIMEOUT 2000 ///< Maximum cycles to wait during I2C operations
-#define I2C_STRETCH_DELAY 100 ///< Microseconds to delay during clock stretching
 #define I2C_CLOCK_FREQ 100000 ///< Default I2C clock frequency (100 kHz)
 
+#ifndef I2C_TIMEOUT_BASE_US
+#define I2C_TIMEOUT_BASE_US 1000 ///< Time allowed for a transfer besides its data bytes
+#endif
+
+#ifndef I2C_TIMEOUT_BYTE_US
+#define I2C_TIMEOUT_BYTE_US 1000 ///< Time allowed per data byte, including clock stretching
+#endif
+
+/**
+ * @brief Timer1 clock source and control register value of the timeouts
+ *
+ * Fosc/4, 1:8 prescaler, 16-bit reads, on. Timer1 may be shared with the application as long as
+ * it runs with exactly this configuration, the init functions fail with W_FAILURE instead of
+ * reconfiguring a Timer1 that is already on with any other.
+ */
+#define I2C_TIMER_T1CLK 0x01
+#define I2C_TIMER_T1CON 0x33
+
+#ifndef I2C_BUS_FREE_TIMEOUT_US
+#define I2C_BUS_FREE_TIMEOUT_US 1000 ///< Time the bus may stay busy before it is recovered
+#endif
+
+/**
+ * @brief Record per-device bus statistics, 1 to enable
+ *
+ * Durations are measured with Timer1, extended to 32 bits by the driver, so they do not wrap as
+ * long as `i2c_check_timeout()` is called as documented. When 0 the statistics and their API are
+ * compiled out.
+ */
+#ifndef I2C_STATS
+#define I2C_STATS 0
+#endif
+
+#ifndef I2C_STATS_MAX_DEVICES
+#define I2C_STATS_MAX_DEVICES 8 ///< Device addresses with their own statistics
+#endif
+
+#ifndef I2C_QUEUE_SIZE
+#define I2C_QUEUE_SIZE 4 ///< Transactions that can wait in the queue of the interrupt driven engine
+#endif
+
+typedef struct i2c_transaction i2c_transaction_t;
+
+/**
+ * @brief Completion callback of a queued transaction, called from the I2C interrupt
+ */
+typedef void (*i2c_callback_t)(i2c_transaction_t *transaction);
+
+/**
+ * @brief Descriptor of a transaction run by the interrupt driven engine
+ *
+ * Writes `write_len` bytes, then reads `read_len` bytes from the device after a repeated start.
+ * Either length may be 0, a transaction with both lengths 0 only checks that the device
+ * acknowledges its address. The
+ * descriptor and buffers are owned by the caller and must stay valid until `done` is set.
+ */
+struct i2c_transaction {
+	uint8_t address; ///< I2C device address (7-bit, will be shifted left by 1)
+	const uint8_t *write_data; ///< Bytes to write
+	uint8_t write_len; ///< Number of bytes to write
+	uint8_t *read_data; ///< Buffer for the bytes read
+	uint8_t read_len; ///< Number of bytes to read
+	i2c_callback_t callback; ///< Called from the interrupt on completion, may be NULL
+	void *arg; ///< Free for the caller, e.g. for the callback
+	volatile bool done; ///< Set by the engine when the transaction finished
+	volatile w_status_t status; ///< Result, valid once done is set
+};
+
+#if I2C_STATS
+/**
+ * @brief Statistics of one device address
+ */
+typedef struct {
+	uint8_t address; ///< I2C device address (7-bit)
+	uint16_t transactions; ///< Transactions addressed to the device, including failed ones
+	uint16_t nacks; ///< Transactions ended by a NACK of the address or a data byte
+	uint16_t bus_collisions; ///< Transactions lost to a bus collision
+	uint16_t timeouts; ///< Transactions aborted after their timeout
+	uint16_t stretches; ///< Transactions longer than their bits plus two byte times
+	uint32_t max_duration_us; ///< Longest transaction, not counting timeouts
+	uint32_t bytes; ///< Data bytes of successful transactions
+} i2c_device_stats_t;
+
+/**
+ * @brief Bus statistics, blocking and queued transactions
+ *
+ * The bus utilization over a telemetry period is `busy_us` of a cleared snapshot divided by the
+ * period.
+ */
+typedef struct {
+	uint32_t busy_us; ///< Time spent in transactions
+	uint16_t transactions; ///< Transactions on the bus
+	uint16_t untracked; ///< Transactions to addresses that did not fit in `devices`
+	i2c_device_stats_t devices[I2C_STATS_MAX_DEVICES]; ///< In order of first use
+} i2c_stats_t;
+#endif
+
 /**
  * @brief Initialize I2C controller with specified clock settings
  *
@@ -37,10 +151,26 @@
  * - etc.
  *
  * @param clkdiv Clock divider (0-7) that determines I2C frequency
- * @return w_status_t Returns W_SUCCESS on success, W_IO_ERROR if initialization fails
+ * @return w_status_t Returns W_SUCCESS on success, W_FAILURE if Timer1 already runs with another
+ * configuration than `I2C_TIMER_T1CON`, W_IO_ERROR if initialization fails
  */
 w_status_t i2c_init(uint8_t clkdiv);
 
+/**
+ * @brief Initialize I2C controller for a bus frequency
+ *
+ * Picks the clock reference source (MFINTOSC or Fosc, `_XTAL_FREQ`) and divider giving the
+ * fastest bus clock not above `bus_freq`, e.g. 100 kHz (standard mode), 400 kHz (fast mode) or
+ * 1 MHz (fast mode plus). The SDA hold time and the I2C slew rate limiting and input thresholds of
+ * the default I2C1 pins RC3 and RC4 are set for the resulting mode.
+ *
+ * @param bus_freq Target SCL frequency in Hz, at most 1 MHz
+ * @param actual_freq Set to the SCL frequency achieved, may be NULL
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM if the frequency is out of
+ * range, W_FAILURE on a Timer1 conflict like `i2c_init()`, W_IO_ERROR if initialization fails
+ */
+w_status_t i2c_init_freq(uint32_t bus_freq, uint32_t *actual_freq);
+
 /**
  * @brief Write data to an I2C device
  *
@@ -92,7 +222,8 @@ w_status_t i2c_write_reg16(uint8_t address, uint8_t reg, uint16_t val);
 /**
  * @brief Read an 8-bit value from a register on an I2C device
  *
- * This function reads a single 8-bit value from a specific register address on the I2C device.
+ * This function reads a single 8-bit value from a specific register address on the I2C device,
+ * using a repeated start between the register address and the value.
  *
  * @param address I2C device address (7-bit, will be shifted left by 1)
  * @param reg Register address to read from
@@ -105,7 +236,7 @@ w_status_t i2c_read_reg8(uint8_t address, uint8_t reg, uint8_t *value);
  * @brief Read a 16-bit value from a register on an I2C device
  *
  * This function reads a 16-bit value (MSB first) from a specific register address on the I2C
- * device.
+ * device, using a repeated start between the register address and the value.
  *
  * @param address I2C device address (7-bit, will be shifted left by 1)
  * @param reg Register address to read from
@@ -114,4 +245,118 @@ w_status_t i2c_read_reg8(uint8_t address, uint8_t reg, uint8_t *value);
  */
 w_status_t i2c_read_reg16(uint8_t address, uint8_t reg, uint16_t *value);
 
+/**
+ * @brief Write to and then read from an I2C device in one transaction
+ *
+ * The read follows the write with a repeated start instead of a stop and a new start, as required
+ * by devices that reset their register pointer on a stop.
+ *
+ * @param address I2C device address (7-bit, will be shifted left by 1)
+ * @param write_data Bytes to write, e.g. the register address
+ * @param write_len Number of bytes to write
+ * @param read_data Buffer for the bytes read
+ * @param read_len Number of bytes to read
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on NULL buffers or zero lengths,
+ * W_IO_ERROR on error, W_IO_TIMEOUT on timeout
+ */
+w_status_t i2c_write_read_data(uint8_t address, const uint8_t *write_data, uint8_t write_len,
+							   uint8_t *read_data, uint8_t read_len);
+
+/**
+ * @brief Read consecutive registers from an I2C device in one transaction
+ *
+ * Writes the first register address and reads `len` bytes after a repeated start, relying on the
+ * device to auto-increment its register pointer, e.g. for all axes of an IMU sample at once.
+ *
+ * @param address I2C device address (7-bit, will be shifted left by 1)
+ * @param reg First register address
+ * @param data Buffer for the register values
+ * @param len Number of registers to read
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on NULL buffer or zero length,
+ * W_IO_ERROR on error, W_IO_TIMEOUT on timeout
+ */
+w_status_t i2c_read_regs(uint8_t address, uint8_t reg, uint8_t *data, uint8_t len);
+
+/**
+ * @brief Let DMA1 move the data of long transfers
+ *
+ * Transfers (the write or read phase of a transaction, or a blocking i2c_write_data() or
+ * i2c_read_data() call) of at least `min_len` bytes are then run by DMA1 instead of the CPU. DMA1
+ * must not be used by anything else. Enabling it locks the system arbiter priorities (DMA1 above
+ * interrupts above the main context) if they are not locked yet, they cannot change afterwards.
+ * The buffers of DMA transfers must be in data memory, not in program memory.
+ *
+ * @param min_len Minimum transfer length for DMA, 0 turns DMA off
+ * @return w_status_t Returns W_SUCCESS on success, W_FAILURE if queued transactions are pending
+ */
+w_status_t i2c_dma_init(uint8_t min_len);
+
+/**
+ * @brief Queue a transaction on the interrupt driven engine
+ *
+ * Returns immediately, the transaction runs from the I2C interrupts once the transactions queued
+ * before it finished. Completion and errors are reported through the descriptor: `status` is
+ * W_SUCCESS, or W_IO_ERROR if the device did not acknowledge or the bus failed. Can be called from
+ * a completion callback.
+ *
+ * @param transaction Transaction to run, `done` and `status` are reset
+ * @return w_status_t Returns W_SUCCESS if queued, W_INVALID_PARAM on NULL buffers, W_OVERFLOW if
+ * the queue is full, W_IO_ERROR if the module is not initialized
+ */
+w_status_t i2c_submit(i2c_transaction_t *transaction);
+
+/**
+ * @brief Function should be called from main ISR when an I2C1 interrupt is triggered
+ *
+ * Call it when any of `PIR3bits.I2C1IF`, `I2C1EIF`, `I2C1TXIF` or `I2C1RXIF` is set. The I2C1 flags
+ * in PIR3 are read-only, the handler clears their sources in the module.
+ */
+void i2c_handle_interrupt(void);
+
+/**
+ * @brief Release a bus held by a target
+ *
+ * Takes RC3 (SCL) and RC4 (SDA) from the module, clocks SCL up to 9 times until the target
+ * releases SDA, then sends a stop condition. Called automatically when the bus stays busy for
+ * I2C_BUS_FREE_TIMEOUT_US, e.g. after a reset of the controller in the middle of a read. The
+ * peripheral pin select must not be locked.
+ *
+ * @return w_status_t Returns W_SUCCESS if both lines are high afterwards, W_IO_ERROR if the bus is
+ * still held, W_FAILURE if PPS is locked
+ */
+w_status_t i2c_recover_bus(void);
+
+/**
+ * @brief Abort a queued transaction that ran out of time
+ *
+ * Call it periodically from the main loop while queued transactions are pending, at least once
+ * per Timer1 period (32 ms at 64 MHz). A transaction running longer than its timeout finishes
+ * with status W_IO_TIMEOUT, the bus is recovered if needed and the queue continues.
+ *
+ * @return w_status_t Returns W_IO_TIMEOUT if a transaction was aborted, W_SUCCESS otherwise
+ */
+w_status_t i2c_check_timeout(void);
+
+/**
+ * @brief Check if the interrupt driven engine has no queued transactions
+ *
+ * @return true if no transaction is queued or running
+ */
+bool i2c_idle(void);
+
+#if I2C_STATS
+/**
+ * @brief Copy the bus statistics
+ *
+ * @param stats Filled with a copy of the statistics
+ * @param clear Clear the statistics after copying them, e.g. once per telemetry period
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM if stats is NULL
+ */
+w_status_t i2c_get_stats(i2c_stats_t *stats, bool clear);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
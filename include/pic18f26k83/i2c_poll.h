@@ -0,0 +1,102 @@
+/**
+ * @file
+ * @brief PIC18 periodic I2C sensor polling
+ *
+ * Polls a static table of sensors, each with its own register block and period, on the interrupt
+ * driven I2C engine. Reads that are due together are queued back-to-back, so the bus does not idle
+ * between them. Completed samples are handed to the decode callback of their device from
+ * i2c_poll_run(), in the main context, with the `millis()` time the read was started.
+ *
+ * Requires the I2C driver (initialized) and the Timer0 driver providing `millis()`. The blocking
+ * I2C functions must not be used while reads are queued.
+ */
+
+#ifndef ROCKETLIB_I2C_POLL_H
+#define ROCKETLIB_I2C_POLL_H
+
+#include "common.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef I2C_POLL_MAX_DEVICES
+#define I2C_POLL_MAX_DEVICES 8 ///< Maximum number of devices in a polling table
+#endif
+
+typedef struct i2c_poll_device i2c_poll_device_t;
+
+/**
+ * @brief Called from i2c_poll_run() with a new sample of a device
+ *
+ * @param device Descriptor of the device
+ * @param data `device->len` bytes read from the register block
+ * @param timestamp_ms `millis()` when the read was started
+ */
+typedef void (*i2c_poll_decode_t)(const i2c_poll_device_t *device, const uint8_t *data,
+								  uint32_t timestamp_ms);
+
+/**
+ * @brief Descriptor of a polled device, usually in a const table
+ */
+struct i2c_poll_device {
+	uint8_t address; ///< I2C device address (7-bit, will be shifted left by 1)
+	uint8_t reg; ///< First register of the block, read with a repeated start burst
+	uint8_t len; ///< Number of registers to read
+	uint8_t *data; ///< Buffer of `len` bytes in data memory for the sample
+	uint16_t period_ms; ///< Polling period
+	i2c_poll_decode_t decode; ///< Called with every sample
+	void *arg; ///< Free for the caller, e.g. for the decode callback
+};
+
+/**
+ * @brief Statistics of a polled device
+ */
+typedef struct {
+	uint32_t samples; ///< Samples read and decoded
+	uint32_t errors; ///< Reads that failed (NACK, bus error or timeout)
+	uint32_t deadline_misses; ///< Periods skipped because the device was polled too late
+} i2c_poll_stats_t;
+
+/**
+ * @brief Start polling the devices of a table
+ *
+ * All devices are due at once, the first i2c_poll_run() reads them. Replaces the previous table,
+ * which must not have reads queued.
+ *
+ * @param devices Table of devices, must stay valid while polling
+ * @param count Number of devices, at most I2C_POLL_MAX_DEVICES
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on a NULL table or buffer, a
+ * zero length or period, or too many devices, W_FAILURE if reads of the previous table are queued
+ */
+w_status_t i2c_poll_init(const i2c_poll_device_t *devices, uint8_t count);
+
+/**
+ * @brief Decode completed samples and queue the reads that are due
+ *
+ * Call it from the main loop at least as often as the shortest period. A device is late when it
+ * becomes due while its previous read is still queued, or when i2c_poll_run() was not called for
+ * a whole period, each skipped period counts as a deadline miss. Also checks the I2C engine for
+ * timed out transactions.
+ *
+ * @return w_status_t Returns W_SUCCESS, W_IO_ERROR if the I2C module is not initialized
+ */
+w_status_t i2c_poll_run(void);
+
+/**
+ * @brief Get the statistics of a device
+ *
+ * @param index Index of the device in the table
+ * @param stats Set to the statistics
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on a NULL pointer or an index
+ * outside the table
+ */
+w_status_t i2c_poll_get_stats(uint8_t index, i2c_poll_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -5,6 +5,9 @@
  * This module provides PWM functionality using the PIC18 Capture/Compare/PWM (CCP) modules.
  * It supports up to 4 CCP modules (CCP1-CCP4) and uses Timer2 as the timebase for PWM
  * generation.
+ *
+ * `pwm_update_duty_cycles()` updates every channel at once, the new duty cycles all take effect at
+ * the same period boundary, e.g. for several servos.
  */
 
 #ifndef ROCKETLIB_PWM_H
@@ -15,9 +18,12 @@
 #include "common.h"
 
 #ifdef __cplusplus
-#error "C++ is not supported"
+extern "C" {
 #endif
 
+/// @brief Number of CCP modules, CCP1 to CCP4
+#define PWM_CCP_MODULES 4
+
 /**
  * @brief Structure to hold the configuration details for a PWM pin
  */
@@ -109,4 +115,28 @@ w_status_t pwm_init(uint8_t ccp_module, pwm_pin_config_t pin_config, uint16_t pw
  */
 w_status_t pwm_update_duty_cycle(uint8_t ccp_module, uint16_t duty_cycle);
 
+/**
+ * @brief Updates the duty cycles of all initialized CCP modules on the same period boundary
+ *
+ * Separate `pwm_update_duty_cycle()` calls can straddle the end of a Timer2 period, one period
+ * then runs with some channels updated and others not, or with half of a duty cycle written. This
+ * function writes every channel with interrupts disabled in a part of the period at least 64
+ * Timer2 counts away from its end, waiting for the next period if needed, so the new duty cycles
+ * are all latched at the same period boundary.
+ *
+ * Blocks for at most 64 Timer2 counts, the period (PR2) must be longer than that. The end of the
+ * period is detected by polling TMR2, `PIR4bits.TMR2IF` is left for the application.
+ *
+ * @param duty_cycles Duty cycle values (0-1023) of CCP1 to CCP4, entries of modules not
+ * initialized by pwm_init() are ignored
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM if duty_cycles is NULL, a
+ * duty cycle exceeds 1023 or the period (PR2) is not longer than 64 Timer2 counts, nothing is
+ * updated then
+ */
+w_status_t pwm_update_duty_cycles(const uint16_t duty_cycles[PWM_CCP_MODULES]);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* ROCKETLIB_PWM_H */
@@ -0,0 +1,143 @@
+/**
+ * @file
+ * @brief Cooperative run-to-completion task scheduler
+ *
+ * Periodic tasks released by a timer wheel and run from the main loop, replacing
+ * `millis() - last > period` checks. Releases are drift free, a task is due every `period` ticks
+ * from its first release no matter when it actually ran. Tasks run to completion, one after the
+ * other, in the order they were released.
+ *
+ * The tick is any monotonic count, e.g. `millis()` polled from the main loop or a counter
+ * incremented next to `timer0_handle_interrupt()`. Run times are measured with an optional clock,
+ * e.g. `micros()` or a cycle counter.
+ */
+
+#ifndef ROCKETLIB_SCHEDULER_H
+#define ROCKETLIB_SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "timer_wheel.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Body of a task, runs to completion
+ *
+ * @param arg Argument given to scheduler_add()
+ */
+typedef void (*scheduler_fn_t)(void *arg);
+
+/**
+ * @brief Statistics of a task
+ */
+typedef struct {
+	uint32_t runs; ///< Completed runs
+	uint32_t overruns; ///< Releases dropped because the task had not run since the previous one
+	uint32_t max_run_time; ///< Longest run, in clock units
+	uint64_t total_run_time; ///< All runs, in clock units
+} scheduler_stats_t;
+
+typedef struct scheduler scheduler_t;
+typedef struct scheduler_task scheduler_task_t;
+
+/**
+ * @brief Task, owned by the caller and set up by scheduler_add()
+ *
+ * Initialized by scheduler_task_init() before its first scheduler_add(), a zero initialized task is
+ * initialized as well.
+ */
+struct scheduler_task {
+	scheduler_fn_t fn;
+	void *arg;
+	scheduler_t *sched; ///< Scheduler the task is added to, NULL if none
+	timer_wheel_timer_t timer; ///< Releases the task
+	bool ready; ///< Released and queued to run
+	scheduler_task_t *next_ready;
+	scheduler_stats_t stats;
+};
+
+/**
+ * @brief Scheduler, set up by scheduler_init()
+ */
+struct scheduler {
+	timer_wheel_t wheel;
+	uint32_t (*clock)(void);
+	scheduler_task_t *ready_head; ///< Queue of released tasks, in release order
+	scheduler_task_t *ready_tail;
+};
+
+/**
+ * @brief Initialize a scheduler without tasks
+ *
+ * @param sched Scheduler to initialize
+ * @param now Current tick
+ * @param clock Clock measuring the run times, NULL to not measure them
+ */
+void scheduler_init(scheduler_t *sched, uint32_t now, uint32_t (*clock)(void));
+
+/**
+ * @brief Initialize a task, not added to any scheduler
+ *
+ * @param task Task to initialize
+ */
+void scheduler_task_init(scheduler_task_t *task);
+
+/**
+ * @brief Add a periodic task
+ *
+ * A task already added, to this or another scheduler, is removed first and starts over with a new
+ * first release and cleared statistics. Nothing changes if the parameters are invalid.
+ *
+ * @param sched Scheduler
+ * @param task Task initialized by scheduler_task_init() or added before, must stay valid until
+ * removed
+ * @param fn Body of the task
+ * @param arg Passed to `fn`
+ * @param period Ticks between releases
+ * @param delay Ticks from the current tick to the first release, at least 1. Different delays
+ * spread tasks with the same period over different ticks.
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on a NULL pointer, a zero or
+ * too long period or delay
+ */
+w_status_t scheduler_add(scheduler_t *sched, scheduler_task_t *task, scheduler_fn_t fn, void *arg,
+						 uint32_t period, uint32_t delay);
+
+/**
+ * @brief Remove a task, also drops a pending release
+ *
+ * @param sched Scheduler
+ * @param task Task added to the scheduler, can be added again afterwards
+ */
+void scheduler_remove(scheduler_t *sched, scheduler_task_t *task);
+
+/**
+ * @brief Release the tasks due up to a tick and run the released tasks
+ *
+ * Call it from the main loop. A task released again before it ran, e.g. because a long task
+ * delayed it, runs once and counts an overrun per dropped release.
+ *
+ * @param sched Scheduler
+ * @param now Current tick
+ * @return Number of tasks run
+ */
+uint32_t scheduler_run(scheduler_t *sched, uint32_t now);
+
+/**
+ * @brief Get the statistics of a task
+ *
+ * @param task Task
+ * @param stats Set to the statistics
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on a NULL pointer
+ */
+w_status_t scheduler_get_stats(const scheduler_task_t *task, scheduler_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+/**
+ * @file
+ * @brief littlefs geometry profiles of the STM32H7 SD card shim
+ *
+ * Shared by the shim and the host tools reading its cards, so both agree on the block sizes a
+ * card may be formatted with. Only depends on the littlefs header.
+ */
+
+#ifndef ROCKETLIB_LITTLEFS_SD_GEOMETRY_H
+#define ROCKETLIB_LITTLEFS_SD_GEOMETRY_H
+
+#include <stdint.h>
+
+#include "lfs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief SD card sector size in bytes
+#define LFSSHIM_SD_SECTOR_SIZE 512
+
+/**
+ * @brief littlefs geometry of a context
+ *
+ * Larger blocks reduce the metadata littlefs has to maintain and let a full prog cache reach the
+ * card as one multi-block write. A larger lookahead lets one allocator scan cover more blocks of a
+ * large card. Use one of the predefined profiles or a board specific one, the sizes must fit the
+ * buffers chosen with `LFSSHIM_SD_CACHE_SIZE` and `LFSSHIM_SD_LOOKAHEAD_SIZE`.
+ */
+typedef struct {
+	/// @brief Profile name for logging
+	const char *name;
+	/// @brief littlefs block size in bytes, a multiple of the sector size
+	lfs_size_t block_size;
+	/// @brief littlefs cache size in bytes, a multiple of the sector size dividing the block size
+	lfs_size_t cache_size;
+	/// @brief littlefs lookahead buffer size in bytes, a multiple of 8
+	lfs_size_t lookahead_size;
+	/// @brief littlefs block_cycles, -1 leaves wear levelling to the card
+	int32_t block_cycles;
+} lfsshim_sd_geometry_t;
+
+/// @brief Initializer of `lfsshim_sd_geometry_sector`: one sector per block, smallest RAM use
+#define LFSSHIM_SD_GEOMETRY_SECTOR                                                                 \
+	{.name = "sector",                                                                             \
+	 .block_size = LFSSHIM_SD_SECTOR_SIZE,                                                         \
+	 .cache_size = LFSSHIM_SD_SECTOR_SIZE,                                                         \
+	 .lookahead_size = 512,                                                                        \
+	 .block_cycles = -1}
+
+/// @brief Initializer of `lfsshim_sd_geometry_4k`: 4 KiB blocks of 8 sectors, block sized cache
+#define LFSSHIM_SD_GEOMETRY_4K                                                                     \
+	{.name = "4k",                                                                                 \
+	 .block_size = 8 * LFSSHIM_SD_SECTOR_SIZE,                                                     \
+	 .cache_size = 8 * LFSSHIM_SD_SECTOR_SIZE,                                                     \
+	 .lookahead_size = 512,                                                                        \
+	 .block_cycles = -1}
+
+/// @brief Initializer of `lfsshim_sd_geometry_4k_large_card`: 4 KiB blocks, 4 KiB lookahead
+#define LFSSHIM_SD_GEOMETRY_4K_LARGE_CARD                                                          \
+	{.name = "4k-large-card",                                                                      \
+	 .block_size = 8 * LFSSHIM_SD_SECTOR_SIZE,                                                     \
+	 .cache_size = 8 * LFSSHIM_SD_SECTOR_SIZE,                                                     \
+	 .lookahead_size = 4096,                                                                       \
+	 .block_cycles = -1}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
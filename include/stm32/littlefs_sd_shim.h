@@ -1,16 +1,597 @@
+/**
+ * @file
+ * @brief littlefs block device shim for STM32H7 SDMMC
+ *
+ * Maps littlefs blocks onto SD card sectors through the STM32 HAL. Every mount is described by a
+ * `lfsshim_sd_ctx_t` that owns its littlefs configuration and buffers, so several independent
+ * filesystems can be mounted at the same time. A context can also be backed by two cards, in which
+ * case every write is mirrored to both of them.
+ *
+ * How the shim waits for a card to finish programming is configurable per context, see
+ * `lfsshim_sd_wait_config_t`.
+ *
+ * Erases requested by littlefs can be forwarded to the card as discards (CMD32/33/38) so the
+ * card's flash translation layer learns which regions are free, and a free region can be
+ * pre-erased in the background after boot so the card stays in its fast write state.
+ *
+ * Sequential reads, such as downloading a log after flight, can be served from a read-ahead
+ * buffer that is filled with one multi-block read, see `lfsshim_sd_set_readahead()`.
+ *
+ * On large cards the first allocation after mount makes littlefs traverse the whole filesystem to
+ * find free blocks. An allocator checkpoint written at clean unmount lets the next mount skip that
+ * traversal, see `lfsshim_sd_set_checkpoint()`.
+ *
+ * Cards differ a lot in how their write latency grows with the write size. `lfsshim_sd_probe()`
+ * measures a card at startup and `lfsshim_sd_apply_probe()` adapts the flush size and write
+ * timeout of a context to it.
+ *
+ * With `LFSSHIM_SD_STATS` defined to 1 every context records latency statistics of its block
+ * device operations, see `lfsshim_sd_stats_t`.
+ *
+ * Migrating from the single mount API: the exported `cfg` littlefs configuration is gone, each
+ * context now owns its configuration in `ctx->cfg`. `lfsshim_sd_mount(lfs, hsd, offset)` and
+ * `lfsshim_sd_mount_mbr(lfs, hsd)` take the context as an additional first argument and return a
+ * `w_status_t` instead of an int. Code calling `lfs_format(lfs, &cfg)` uses `lfsshim_sd_format()`.
+ */
+
 #ifndef ROCKETLIB_LITTLEFS_SHIM_H
 #define ROCKETLIB_LITTLEFS_SHIM_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common.h"
 #include "lfs.h"
+#include "log2_hist.h"
+#include "stm32/littlefs_sd_geometry.h"
 #include "stm32h7xx_hal_sd.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// LittleFS-compatible SD card interface functions
-int lfsshim_sd_mount(lfs_t *lfs, SD_HandleTypeDef *hsd, uint32_t first_block_offset);
-int lfsshim_sd_mount_mbr(lfs_t *lfs, SD_HandleTypeDef *hsd);
+/**
+ * @brief Size in bytes of the littlefs read and prog cache buffers owned by each context
+ *
+ * Must be at least the cache size of the largest geometry used by the board, for example 4096 for
+ * `lfsshim_sd_geometry_4k`. Override through EXTRA_C_CXX_FLAGS.
+ */
+#ifndef LFSSHIM_SD_CACHE_SIZE
+#define LFSSHIM_SD_CACHE_SIZE 512
+#endif
+
+/**
+ * @brief Size in bytes of the littlefs lookahead buffer owned by each context
+ *
+ * Must be at least the lookahead size of the largest geometry used by the board.
+ */
+#ifndef LFSSHIM_SD_LOOKAHEAD_SIZE
+#define LFSSHIM_SD_LOOKAHEAD_SIZE 512
+#endif
+
+/// @brief Maximum number of cards backing one context
+#define LFSSHIM_SD_MAX_CARDS 2
+
+/// @brief Number of partition table entries searched by `lfsshim_sd_find_partition()`
+#define LFSSHIM_SD_MAX_PARTITIONS 8
+
+/// @brief Maximum number of sectors discarded by one erase command
+#define LFSSHIM_SD_DISCARD_MAX_BLOCKS 8192
+
+/// @brief Number of erase units (allocation units) erased by each pre-erase step
+#define LFSSHIM_SD_PRE_ERASE_UNITS_PER_STEP 1
+
+/**
+ * @brief Number of sectors fetched by one read-ahead
+ *
+ * Every context owns a read-ahead buffer of this many sectors. Define as 0 (for example through
+ * EXTRA_C_CXX_FLAGS) to remove the buffer and the read-ahead code.
+ */
+#ifndef LFSSHIM_SD_READAHEAD_BLOCKS
+#define LFSSHIM_SD_READAHEAD_BLOCKS 16
+#endif
+
+/// @brief Number of sectors of the allocator checkpoint area, header plus lookahead bitmap
+#define LFSSHIM_SD_CHECKPOINT_SECTORS \
+	(1 + ((LFSSHIM_SD_LOOKAHEAD_SIZE + LFSSHIM_SD_SECTOR_SIZE - 1) / LFSSHIM_SD_SECTOR_SIZE))
+
+/// @brief Maximum number of write sizes measured by `lfsshim_sd_probe()`
+#define LFSSHIM_SD_PROBE_MAX_SIZES 8
+
+/// @brief Number of writes of each size done by `lfsshim_sd_probe()`
+#define LFSSHIM_SD_PROBE_WRITES 8
+
+/**
+ * @brief Record latency statistics, 1 to enable
+ *
+ * Timestamps come from the DWT cycle counter, which is enabled at mount. When 0 the statistics and
+ * their API are compiled out.
+ */
+#ifndef LFSSHIM_SD_STATS
+#define LFSSHIM_SD_STATS 0
+#endif
+
+/**
+ * @brief One SD card backing a shim context
+ */
+typedef struct {
+	/// @brief HAL handle of the SDMMC instance the card is attached to
+	SD_HandleTypeDef *hsd;
+	/// @brief Sector address of littlefs block 0 on this card
+	uint32_t first_block_offset;
+	/// @brief Set when a mirrored write failed on this card, the card is not used afterwards
+	bool failed;
+	/// @brief A write was issued and the card was not yet seen leaving programming state
+	bool busy;
+	/// @brief The HAL rejected the last write or erase issued to this card
+	bool write_error;
+	/// @brief Timeout of the outstanding write or erase
+	uint32_t busy_timeout_ms;
+	/// @brief Set by `lfsshim_sd_notify_ready()` from the SDMMC interrupt
+	volatile bool ready_notified;
+} lfsshim_sd_card_t;
+
+/**
+ * @brief Strategy used while waiting for a card to finish programming
+ *
+ * The default (all fields zero) spins on the card state after every write, like a plain blocking
+ * driver.
+ */
+typedef struct {
+	/**
+	 * @brief Called repeatedly while the card is busy, NULL to spin
+	 *
+	 * Typically yields to other RTOS tasks, runs cooperative tasks or sleeps until the next
+	 * interrupt. Must not access the filesystem that is being waited on.
+	 */
+	void (*yield)(void *arg);
+	/// @brief Argument passed to `yield`
+	void *yield_arg;
+	/**
+	 * @brief Return from prog without waiting for the card to finish programming
+	 *
+	 * The wait is moved to the start of the next read, prog or sync, so programming overlaps with
+	 * whatever the application does between filesystem calls. A write error that only shows up
+	 * while programming is reported by that next call.
+	 */
+	bool deferred_busy;
+	/**
+	 * @brief Only poll the card state after the card signalled ready
+	 *
+	 * The firmware calls `lfsshim_sd_notify_ready()` from the SDMMC busy end interrupt (or
+	 * `HAL_SD_TxCpltCallback`), until then the shim only calls `yield` instead of sending status
+	 * commands to the card. If the notification does not arrive within the timeout the card state
+	 * is polled once more before the write is reported as failed.
+	 */
+	bool ready_notify;
+	/**
+	 * @brief Clock measuring the timeouts in microseconds, NULL to use `HAL_GetTick()`
+	 *
+	 * Typically `timebase_us()`, which keeps counting while the SysTick interrupt is masked or
+	 * preempted, for example when the shim is used from an interrupt handler.
+	 */
+	uint64_t (*clock_us)(void);
+} lfsshim_sd_wait_config_t;
+
+/**
+ * @brief Write latency of a card measured by `lfsshim_sd_probe()` and the settings derived from it
+ */
+typedef struct {
+	/// @brief Number of write sizes measured
+	uint8_t num_sizes;
+	/// @brief Write size in sectors, powers of two up to the cache size
+	uint32_t sectors[LFSSHIM_SD_PROBE_MAX_SIZES];
+	/// @brief Mean latency of a write including programming, in microseconds
+	uint32_t mean_us[LFSSHIM_SD_PROBE_MAX_SIZES];
+	/// @brief Worst latency of a write including programming, in microseconds
+	uint32_t max_us[LFSSHIM_SD_PROBE_MAX_SIZES];
+	/// @brief Write throughput in kB/s
+	uint32_t kbytes_per_s[LFSSHIM_SD_PROBE_MAX_SIZES];
+	/// @brief Chosen flush size in bytes: the smallest size reaching 90 % of the best throughput
+	uint32_t flush_size;
+	/// @brief Chosen write timeout in milliseconds: four times the worst latency seen
+	uint32_t write_timeout_ms;
+} lfsshim_sd_probe_result_t;
+
+/// @brief One sector per block, smallest RAM use (default)
+extern const lfsshim_sd_geometry_t lfsshim_sd_geometry_sector;
+/// @brief 4 KiB blocks of 8 sectors with a block sized cache
+extern const lfsshim_sd_geometry_t lfsshim_sd_geometry_4k;
+/// @brief 4 KiB blocks with a 4 KiB lookahead (32768 blocks per scan), for cards of 16 GB and more
+extern const lfsshim_sd_geometry_t lfsshim_sd_geometry_4k_large_card;
+
+/**
+ * @brief Discard and pre-erase state of a context
+ */
+typedef struct {
+	/// @brief Forward littlefs erases to the card as discards
+	bool discard;
+	/// @brief First sector of the discard range not sent to the card yet
+	uint32_t pending_start;
+	/// @brief Number of sectors in the pending discard range
+	uint32_t pending_count;
+	/// @brief Next sector of the pre-erase region
+	uint32_t pre_erase_next;
+	/// @brief End (exclusive) of the pre-erase region
+	uint32_t pre_erase_end;
+	/// @brief Number of sectors erased by each pre-erase step
+	uint32_t pre_erase_chunk;
+} lfsshim_sd_erase_state_t;
+
+#if LFSSHIM_SD_READAHEAD_BLOCKS > 0
+/**
+ * @brief Sequential read-ahead state of a context, addresses are partition relative sectors
+ */
+typedef struct {
+	/// @brief Prefetch when a read continues where the previous read ended
+	bool enabled;
+	/// @brief First sector held by the buffer
+	uint32_t start;
+	/// @brief Number of valid sectors in the buffer, 0 if empty
+	uint32_t count;
+	/// @brief Sector following the previous read
+	uint32_t next;
+	/// @brief End (exclusive) of the filesystem, 0 while unknown
+	uint32_t end;
+	uint8_t buffer[LFSSHIM_SD_READAHEAD_BLOCKS * LFSSHIM_SD_SECTOR_SIZE];
+} lfsshim_sd_readahead_t;
+#endif
+
+#if LFSSHIM_SD_STATS
+/**
+ * @brief Latency statistics of a context, all times in microseconds
+ */
+typedef struct {
+	/// @brief Duration of littlefs read calls, including reads served from the read-ahead buffer
+	log2_hist_t read_us;
+	/// @brief Duration of littlefs prog calls, including waits for a previous deferred write
+	log2_hist_t prog_us;
+	/// @brief Time spent waiting for cards to finish programming or erasing
+	log2_hist_t busy_wait_us;
+	/// @brief Time waited before a card was given up on, one entry per timeout
+	log2_hist_t timeout_us;
+	/// @brief Bytes returned to littlefs by read calls
+	uint64_t read_bytes;
+	/// @brief Bytes passed to prog calls
+	uint64_t prog_bytes;
+} lfsshim_sd_stats_t;
+#endif
+
+/**
+ * @brief State of one littlefs mount
+ *
+ * Contains the littlefs configuration and all buffers littlefs needs, so littlefs does not
+ * allocate memory at mount. Contexts are large and should be statically allocated, they must be
+ * zero initialized before first use. The content is private to the shim, settings are changed
+ * through the functions below.
+ */
+typedef struct {
+	struct lfs_config cfg;
+	const lfsshim_sd_geometry_t *geometry;
+	lfsshim_sd_wait_config_t wait;
+	lfsshim_sd_erase_state_t erase;
+	/// @brief Allocator checkpoint enabled
+	bool checkpoint;
+	/// @brief The last mount restored the allocator from the checkpoint
+	bool checkpoint_restored;
+	/// @brief Card sector address of the checkpoint area
+	uint32_t checkpoint_sector;
+	/// @brief Write timeout chosen by the probe, 0 for the default
+	uint32_t write_timeout_ms;
+	/// @brief Cache size chosen by the probe, 0 to use the geometry
+	lfs_size_t flush_size;
+	lfsshim_sd_card_t cards[LFSSHIM_SD_MAX_CARDS];
+	uint8_t num_cards;
+	uint8_t read_buffer[LFSSHIM_SD_CACHE_SIZE];
+	uint8_t prog_buffer[LFSSHIM_SD_CACHE_SIZE];
+	uint32_t lookahead_buffer[LFSSHIM_SD_LOOKAHEAD_SIZE / sizeof(uint32_t)];
+#if LFSSHIM_SD_READAHEAD_BLOCKS > 0
+	lfsshim_sd_readahead_t readahead;
+#endif
+#if LFSSHIM_SD_STATS
+	lfsshim_sd_stats_t stats;
+#endif
+} lfsshim_sd_ctx_t;
+
+/**
+ * @brief Mount littlefs from a single SD card
+ *
+ * @param ctx Context to use for this mount, must stay valid until the filesystem is unmounted
+ * @param lfs littlefs instance to mount
+ * @param hsd HAL handle of the SD card
+ * @param first_block_offset Sector address of the start of the littlefs partition
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on NULL arguments or if the
+ * geometry does not fit the buffers of the context, W_IO_ERROR if littlefs fails to mount
+ */
+w_status_t lfsshim_sd_mount(lfsshim_sd_ctx_t *ctx, lfs_t *lfs, SD_HandleTypeDef *hsd,
+							uint32_t first_block_offset);
+
+/**
+ * @brief Mount littlefs from the first Linux partition (MBR or GPT) of a single SD card
+ *
+ * @param ctx Context to use for this mount, must stay valid until the filesystem is unmounted
+ * @param lfs littlefs instance to mount
+ * @param hsd HAL handle of the SD card
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM like `lfsshim_sd_mount()`,
+ * W_FAILURE if the partition cannot be found, W_IO_ERROR if the card cannot be read or littlefs
+ * fails to mount
+ */
+w_status_t lfsshim_sd_mount_mbr(lfsshim_sd_ctx_t *ctx, lfs_t *lfs, SD_HandleTypeDef *hsd);
+
+/**
+ * @brief Mount littlefs mirrored across two SD cards
+ *
+ * Writes are issued to both cards before waiting for either of them to finish programming, so the
+ * busy periods of the two cards overlap and a mirrored write costs about the latency of the slower
+ * card. Reads are served by the primary card and fall back to the secondary card on error. If a
+ * write fails on only one card, that card is marked as failed and the context keeps running on the
+ * remaining card.
+ *
+ * Both partitions must hold identical littlefs images, for example by formatting both through
+ * this context with `lfsshim_sd_format()`.
+ *
+ * @param ctx Context to use for this mount, must stay valid until the filesystem is unmounted
+ * @param lfs littlefs instance to mount
+ * @param hsd_primary HAL handle of the primary SD card
+ * @param primary_offset Sector address of the littlefs partition on the primary card
+ * @param hsd_secondary HAL handle of the secondary SD card, must be a different SDMMC instance
+ * @param secondary_offset Sector address of the littlefs partition on the secondary card
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on NULL or identical handles
+ * or if the geometry does not fit the buffers of the context, W_IO_ERROR if littlefs fails to
+ * mount
+ */
+w_status_t lfsshim_sd_mount_mirrored(lfsshim_sd_ctx_t *ctx, lfs_t *lfs,
+									 SD_HandleTypeDef *hsd_primary, uint32_t primary_offset,
+									 SD_HandleTypeDef *hsd_secondary, uint32_t secondary_offset);
+
+/**
+ * @brief Format littlefs on the cards of a context
+ *
+ * Uses the cards and geometry of the last mount call on the context, which may have failed because
+ * the cards hold no filesystem yet. Both cards of a mirrored context are formatted at once. The
+ * filesystem is left unmounted, mount it again afterwards:
+ *
+ * @code
+ * if (lfsshim_sd_mount(&ctx, &lfs, &hsd1, offset) == W_IO_ERROR) {
+ *     lfsshim_sd_format(&ctx, &lfs, block_count);
+ *     lfsshim_sd_mount(&ctx, &lfs, &hsd1, offset);
+ * }
+ * @endcode
+ *
+ * @param ctx Context set up by a mount call
+ * @param lfs littlefs instance used for formatting
+ * @param block_count Size of the filesystem in littlefs blocks of the context's geometry
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on NULL arguments, a context
+ * without cards, a block count of 0 or a geometry not fitting the buffers of the context,
+ * W_IO_ERROR if littlefs fails to format
+ */
+w_status_t lfsshim_sd_format(lfsshim_sd_ctx_t *ctx, lfs_t *lfs, lfs_size_t block_count);
+
+/**
+ * @brief Find the sector address of the first Linux partition on an SD card
+ *
+ * Searches primary and logical MBR partitions for type 0x83, or the GPT for the Linux filesystem
+ * data type when the card has a protective MBR.
+ *
+ * @param hsd HAL handle of the SD card
+ * @param first_block_offset Set to the start sector of the partition
+ * @return w_status_t Returns W_SUCCESS on success, W_FAILURE if the partition cannot be found,
+ * W_IO_ERROR if the card cannot be read
+ */
+w_status_t lfsshim_sd_find_partition(SD_HandleTypeDef *hsd, uint32_t *first_block_offset);
+
+/**
+ * @brief Select how the shim waits for cards to finish programming
+ *
+ * May be called before or after mount. Switching away from deferred busy mode does not wait for a
+ * write that is still in progress, it is waited for by the next filesystem call.
+ *
+ * @param ctx Context to configure
+ * @param wait Wait strategy, copied into the context
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on NULL arguments
+ */
+w_status_t lfsshim_sd_set_wait_config(lfsshim_sd_ctx_t *ctx, const lfsshim_sd_wait_config_t *wait);
+
+/**
+ * @brief Signal that a card finished programming
+ *
+ * Safe to call from interrupt context. Only needed when `ready_notify` is enabled.
+ *
+ * @param ctx Context the card belongs to
+ * @param hsd HAL handle of the card that raised the interrupt
+ */
+void lfsshim_sd_notify_ready(lfsshim_sd_ctx_t *ctx, SD_HandleTypeDef *hsd);
+
+/**
+ * @brief Select the littlefs geometry of a context
+ *
+ * Takes effect at the next mount, a filesystem must always be mounted with the geometry it was
+ * formatted with. Contexts without a geometry use `lfsshim_sd_geometry_sector`.
+ *
+ * @param ctx Context to configure
+ * @param geometry Geometry profile, must stay valid while the context is used
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on NULL arguments or if the
+ * geometry is invalid or does not fit the buffers of the context
+ */
+w_status_t lfsshim_sd_set_geometry(lfsshim_sd_ctx_t *ctx, const lfsshim_sd_geometry_t *geometry);
+
+/**
+ * @brief Measure the write latency of a card
+ *
+ * Writes `LFSSHIM_SD_PROBE_WRITES` times each power of two size from one sector up to
+ * `LFSSHIM_SD_CACHE_SIZE` into a scratch area, and derives the flush size and write timeout from
+ * the results. Uses the buffers of the context, so it must be called before the context is mounted.
+ * Timestamps come from the DWT cycle counter.
+ *
+ * @warning Overwrites the scratch area.
+ *
+ * @param ctx Unmounted context, its buffers are used as write data
+ * @param hsd HAL handle of the card to measure
+ * @param scratch_sector Card sector address of the scratch area
+ * @param scratch_sectors Size of the scratch area, at least `LFSSHIM_SD_CACHE_SIZE` bytes
+ * @param result Filled with the measurements
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on NULL arguments or a too
+ * small scratch area, W_IO_ERROR if a write fails or times out
+ */
+w_status_t lfsshim_sd_probe(lfsshim_sd_ctx_t *ctx, SD_HandleTypeDef *hsd, uint32_t scratch_sector,
+							uint32_t scratch_sectors, lfsshim_sd_probe_result_t *result);
+
+/**
+ * @brief Use the flush size and write timeout chosen by a probe
+ *
+ * The flush size replaces the cache size of the geometry at the next mount, if it divides the
+ * block size. For mirrored contexts probe both cards and apply the result with the larger
+ * timeout.
+ *
+ * @param ctx Context to configure
+ * @param result Result of `lfsshim_sd_probe()`, NULL to go back to the defaults
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM if ctx is NULL or the flush
+ * size is not a multiple of the sector size or larger than `LFSSHIM_SD_CACHE_SIZE`
+ */
+w_status_t lfsshim_sd_apply_probe(lfsshim_sd_ctx_t *ctx, const lfsshim_sd_probe_result_t *result);
+
+/**
+ * @brief Enable or disable the persisted allocator checkpoint
+ *
+ * When enabled, `lfsshim_sd_unmount()` stores the littlefs lookahead window (position and free
+ * block bitmap) in `LFSSHIM_SD_CHECKPOINT_SECTORS` sectors starting at `sector`, protected by a
+ * CRC and the filesystem geometry, and bound to the filesystem state through the revision counts
+ * and CRC of the superblock pair. The next mount validates it, invalidates it on the card and
+ * hands the window back to littlefs, so the first allocations do not traverse the filesystem. A
+ * missing, stale or corrupt checkpoint is ignored and littlefs scans as usual, a checkpoint is
+ * never used twice. When disabled with a non-zero `sector`, every mount invalidates the checkpoint
+ * instead, as the filesystem may be modified without a new checkpoint being written.
+ *
+ * The checkpoint area must lie outside of the littlefs partition, for example in the gap between
+ * the MBR and a 1 MiB aligned partition. In mirrored mode the same sector address is used on both
+ * cards. Requires littlefs 2.9 or newer, the only version whose allocator state is restored.
+ *
+ * @warning Other hosts writing to the filesystem are only detected if they change the superblock
+ * pair, which holds the root directory. Such hosts should clear the checkpoint sector.
+ *
+ * @param ctx Context to configure
+ * @param enable true to write and use the checkpoint
+ * @param sector Card sector address of the checkpoint area, 0 for none
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM if ctx is NULL, W_FAILURE if
+ * the littlefs version is not supported
+ */
+w_status_t lfsshim_sd_set_checkpoint(lfsshim_sd_ctx_t *ctx, bool enable, uint32_t sector);
+
+/**
+ * @brief Check if the last mount restored the allocator from the checkpoint
+ *
+ * @param ctx Mounted context
+ * @return true if the checkpoint was valid and used
+ */
+bool lfsshim_sd_checkpoint_restored(const lfsshim_sd_ctx_t *ctx);
+
+/**
+ * @brief Unmount littlefs and write the allocator checkpoint
+ *
+ * All files must be closed. Without checkpoint this is the same as `lfs_unmount()`.
+ *
+ * @param ctx Context the filesystem was mounted with
+ * @param lfs Mounted littlefs instance
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on NULL arguments, W_IO_ERROR
+ * if littlefs fails to unmount or the checkpoint cannot be written
+ */
+w_status_t lfsshim_sd_unmount(lfsshim_sd_ctx_t *ctx, lfs_t *lfs);
+
+/**
+ * @brief Enable or disable forwarding littlefs erases to the card as discards
+ *
+ * Consecutive erased blocks are collected into one range and sent as a single erase command when
+ * the range stops growing, reaches `LFSSHIM_SD_DISCARD_MAX_BLOCKS`, is about to be written, or on
+ * sync. Reads do not send it, littlefs never reads an erased block before programming it, so a
+ * read of a pending block may still return its old contents. Disabled by default.
+ *
+ * @param ctx Context to configure
+ * @param enable true to issue discards
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM if ctx is NULL
+ */
+w_status_t lfsshim_sd_set_discard(lfsshim_sd_ctx_t *ctx, bool enable);
+
+/**
+ * @brief Start pre-erasing a region of the filesystem
+ *
+ * The region is shrunk to whole erase units of the (primary) card, partial units at either end
+ * are left alone because erasing them costs the card a read-modify-write. The erase itself is
+ * done by `lfsshim_sd_pre_erase_step()`.
+ *
+ * @warning The region must not hold live data, for example the card was freshly formatted or the
+ * region is reserved for logging outside of littlefs' allocator.
+ *
+ * @param ctx Mounted context
+ * @param first_block First littlefs block of the region
+ * @param block_count Number of blocks in the region
+ * @param erase_unit_blocks Erase unit of the card in sectors, usually the allocation unit size
+ * reported in the SD status register (for example 8192 for 4 MiB)
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on NULL context or zero erase
+ * unit
+ */
+w_status_t lfsshim_sd_pre_erase_start(lfsshim_sd_ctx_t *ctx, lfs_block_t first_block,
+									  lfs_size_t block_count, uint32_t erase_unit_blocks);
+
+/**
+ * @brief Run one step of the background pre-erase
+ *
+ * Never waits for the card: if the previous erase is still in progress the call returns
+ * immediately, otherwise it issues the erase of the next `LFSSHIM_SD_PRE_ERASE_UNITS_PER_STEP`
+ * erase units. Call it from the main loop until `done` is set. Filesystem calls made in between
+ * wait for an outstanding erase before accessing the card.
+ *
+ * @param ctx Mounted context
+ * @param done Set to true once the whole region was erased
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on NULL arguments, W_IO_ERROR
+ * if the card rejected the erase
+ */
+w_status_t lfsshim_sd_pre_erase_step(lfsshim_sd_ctx_t *ctx, bool *done);
+
+/**
+ * @brief Enable or disable sequential read-ahead
+ *
+ * When a read starts at the block following the previous read, the shim reads
+ * `LFSSHIM_SD_READAHEAD_BLOCKS` sectors with one multi-block command and serves the following reads
+ * from memory. Random reads go to the card unchanged. Writes and erases invalidate the overlapping
+ * part of the buffer. Disabled by default, always fails with W_FAILURE if the read-ahead buffer was
+ * compiled out.
+ *
+ * @param ctx Context to configure
+ * @param enable true to prefetch sequential reads
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM if ctx is NULL, W_FAILURE if
+ * read-ahead is not available
+ */
+w_status_t lfsshim_sd_set_readahead(lfsshim_sd_ctx_t *ctx, bool enable);
+
+#if LFSSHIM_SD_STATS
+/**
+ * @brief Copy the statistics of a context
+ *
+ * Statistics are updated by filesystem calls, call this from the thread that uses the filesystem
+ * or while holding the filesystem lock to get a consistent snapshot.
+ *
+ * @param ctx Context to read
+ * @param stats Filled with a copy of the statistics
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on NULL arguments
+ */
+w_status_t lfsshim_sd_get_stats(const lfsshim_sd_ctx_t *ctx, lfsshim_sd_stats_t *stats);
+
+/**
+ * @brief Clear the statistics of a context
+ *
+ * @param ctx Context to reset
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM if ctx is NULL
+ */
+w_status_t lfsshim_sd_reset_stats(lfsshim_sd_ctx_t *ctx);
+#endif
+
+/**
+ * @brief Check if a mirrored context lost one of its cards
+ *
+ * @param ctx Mounted context
+ * @return true if any card of the context has been marked as failed
+ */
+bool lfsshim_sd_is_degraded(const lfsshim_sd_ctx_t *ctx);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,76 @@
+/**
+ * @file
+ * @brief STM32H7 64-bit microsecond timebase
+ *
+ * Monotonic microsecond clock for sample timestamps and timeouts, finer than the `HAL_GetTick()`
+ * milliseconds. A 32-bit general purpose timer (TIM2 or TIM5) counts microseconds and its update
+ * interrupt extends the count to 64 bits, which never wraps around.
+ *
+ * The timer is selected at compile time with `TIMEBASE_TIM`. The application enables the timer's
+ * bus clock and its interrupt in the NVIC, and calls `timebase_handle_interrupt()` from the
+ * interrupt handler, e.g. `TIM2_IRQHandler()`.
+ */
+
+#ifndef ROCKETLIB_TIMEBASE_H
+#define ROCKETLIB_TIMEBASE_H
+
+#include <stdint.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Timer instance counting the microseconds, must be a 32-bit timer
+ *
+ * Override through EXTRA_C_CXX_FLAGS, e.g. `-DTIMEBASE_TIM=TIM5`.
+ */
+#ifndef TIMEBASE_TIM
+#define TIMEBASE_TIM TIM2
+#endif
+
+/**
+ * @brief Start the timer counting microseconds from 0
+ *
+ * Runs the timer up to its full 32-bit range with the update interrupt enabled.
+ *
+ * @param timer_clock_hz Kernel clock of the timer, e.g. twice the APB1 clock for TIM2, a multiple
+ * of 1 MHz
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM if the clock can not be
+ * prescaled to 1 MHz
+ */
+w_status_t timebase_init(uint32_t timer_clock_hz);
+
+/**
+ * @brief Count a timer overflow, call from the timer's interrupt handler
+ *
+ * Checks and clears the update flag itself.
+ */
+void timebase_handle_interrupt(void);
+
+/**
+ * @brief Microseconds since `timebase_init()`
+ *
+ * Lock-free, the overflow count is read again until it did not change during the read. Can be
+ * called with interrupts disabled and from any interrupt handler, including ones preempting
+ * `timebase_handle_interrupt()`: an overflow whose interrupt has not run yet is accounted for, one
+ * held off for more than a whole timer period (71 minutes) is not.
+ *
+ * @return Microseconds, monotonic
+ */
+uint64_t timebase_us(void);
+
+/**
+ * @brief Milliseconds since `timebase_init()`, like `timebase_us()`
+ *
+ * @return Milliseconds, wraps around after 49 days like `HAL_GetTick()`
+ */
+uint32_t timebase_ms(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
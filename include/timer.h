@@ -4,15 +4,44 @@
  *
  * This module provides basic timer functionalities, such as initializing Timer0, handling
  * interrupts, and tracking milliseconds since the timer was started.
+ *
+ * With `TIMER0_LATENCY_STATS` defined to 1 the interrupt handler measures its own latency from the
+ * Timer0 count at entry, see `timer0_latency_stats_t`.
  */
 
 #ifndef ROCKETLIB_TIMER_H
 #define ROCKETLIB_TIMER_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "common.h"
+
+#ifndef TIMER0_LATENCY_STATS
+#define TIMER0_LATENCY_STATS 0
+#endif
+
+#if TIMER0_LATENCY_STATS
+#include "log2_hist.h"
+#endif
+
 #ifdef __cplusplus
-#error "C++ is not supported"
+extern "C" {
+#endif
+
+#if TIMER0_LATENCY_STATS
+/**
+ * @brief Timer0 interrupt latency, in microseconds
+ *
+ * The latency is the Timer0 count read by `timer0_handle_interrupt()`, the time since the rollover
+ * raised the interrupt, with the resolution of `micros()`. Rollovers are periodic, so the jitter of
+ * the interval between two interrupts is the difference between their latencies. A latency longer
+ * than a whole Timer0 period can not be told apart from a short one.
+ */
+typedef struct {
+	log2_hist_t latency; ///< Rollover to handler entry
+	log2_hist_t jitter; ///< Deviation of the interval between two handler entries from the period
+} timer0_latency_stats_t;
 #endif
 
 /**
@@ -23,9 +52,25 @@
  * - Sets the timer to 8-bit mode.
  * - Driven by a 500 kHz clock.
  * - Ensures the timer is synchronized to the system clock.
+ *
+ * The timer rolls over every 512 us, nearly 2000 interrupts per second, and `millis()` is kept with
+ * Bresenham's algorithm. See `timer0_init_tick()` for a lower interrupt rate.
  */
 void timer0_init(void);
 
+/**
+ * @brief Initializes Timer0 to interrupt exactly every `period_ms` milliseconds
+ *
+ * Alternative to `timer0_init()`. The 500 kHz clock is prescaled to 250 kHz / `period_ms` and
+ * Timer0 runs in 8-bit mode with a period match at 250 counts, the 16-bit mode has no period
+ * register. Between interrupts `millis()` and `micros()` are interpolated from the TMR0 count, the
+ * `micros()` resolution is 4 us times the period.
+ *
+ * @param period_ms Interrupt period, a power of two up to 32
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM if the period is not supported
+ */
+w_status_t timer0_init_tick(uint8_t period_ms);
+
 /**
  * @brief Function should be called from main ISR when Timer0 interrupt is triggered
  *
@@ -34,15 +79,52 @@ void timer0_init(void);
  *
  * @warning This function does **not** clear the interrupt flag (`PIR3bits.TMR0IF`), This is the
  * responsibility of the top level ISR.
+ *
+ * With `TIMER0_LATENCY_STATS` the latency measured includes everything the top level ISR runs
+ * before this function, call it first to measure the latency of the interrupt itself.
  */
 void timer0_handle_interrupt(void);
 
 /**
  * @brief Returns the number of milliseconds since `timer0_init()` was called
  *
- * Returns the number of milliseconds since `timer0_init()` was called. This is a safe function that
- * disables interrupts momentarily to return a consistent value.
+ * Returns the number of milliseconds since `timer0_init()` was called. Lock-free, the counter is
+ * read again until two copies match, so interrupts are never masked. Can be called with interrupts
+ * disabled and from interrupt handlers.
  */
 uint32_t millis(void);
 
+/**
+ * @brief Returns the number of microseconds since `timer0_init()` was called
+ *
+ * Combines the rollovers counted by the Timer0 interrupt with the live TMR0 count, the resolution
+ * is 2 us (`timer0_init()`) and the value wraps around after about 71 minutes. Lock-free like
+ * `millis()`. A rollover whose interrupt is held off, e.g. when called with interrupts disabled, is
+ * accounted for, one held off for more than a whole Timer0 period is not.
+ *
+ * Counts independently of `millis()`, the two may differ by a fraction of a millisecond.
+ *
+ * @warning Must not be called from the Timer0 interrupt between `timer0_handle_interrupt()` and
+ * clearing `PIR3bits.TMR0IF`, the rollover would be counted twice.
+ */
+uint32_t micros(void);
+
+#if TIMER0_LATENCY_STATS
+/**
+ * @brief Copy the interrupt latency statistics
+ *
+ * The statistics are cleared by `timer0_init()` and `timer0_init_tick()`. Interrupts are disabled
+ * while copying, which delays a rollover landing in the copy.
+ *
+ * @param stats Filled with a copy of the statistics
+ * @param clear Clear the statistics after copying them, e.g. once per telemetry period
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM if stats is NULL
+ */
+w_status_t timer0_get_latency_stats(timer0_latency_stats_t *stats, bool clear);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* ROCKETLIB_TIMER_H */
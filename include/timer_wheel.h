@@ -0,0 +1,131 @@
+/**
+ * @file
+ * @brief Hashed timer wheel
+ *
+ * One-shot and periodic software timers counted in ticks of any timebase, e.g. `millis()` or the
+ * count of a timer interrupt. Timers are hashed into TIMER_WHEEL_SLOTS lists by their expiry tick,
+ * starting and stopping one is O(1), and advancing the wheel by a tick only looks at the timers
+ * hashed to that tick's slot.
+ *
+ * The wheel is not thread safe. It can be advanced from an interrupt handler, e.g. next to
+ * `timer0_handle_interrupt()`, as long as the timers are only started and stopped there too.
+ */
+
+#ifndef ROCKETLIB_TIMER_WHEEL_H
+#define ROCKETLIB_TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef TIMER_WHEEL_SLOTS
+#define TIMER_WHEEL_SLOTS 32 ///< Number of slots, a power of two
+#endif
+
+STATIC_ASSERT((TIMER_WHEEL_SLOTS & (TIMER_WHEEL_SLOTS - 1)) == 0,
+			  "TIMER_WHEEL_SLOTS must be a power of two")
+
+typedef struct timer_wheel_timer timer_wheel_timer_t;
+
+/**
+ * @brief Called when a timer expires, from timer_wheel_advance()
+ *
+ * May start and stop any timer of the wheel, including the expired one.
+ *
+ * @param timer Expired timer, a periodic one is already started again
+ */
+typedef void (*timer_wheel_callback_t)(timer_wheel_timer_t *timer);
+
+/**
+ * @brief Software timer, owned by the caller and linked into the wheel while running
+ */
+struct timer_wheel_timer {
+	timer_wheel_callback_t callback; ///< Called on expiry
+	void *arg; ///< Free for the caller, e.g. for the callback
+	uint32_t expiry; ///< Tick the timer expires at
+	uint32_t period; ///< Ticks between expiries of a periodic timer, 0 for a one-shot timer
+	uint32_t missed; ///< Periods skipped at the last expiry because the wheel advanced past them
+
+	// Slot list links, pprev is NULL while the timer is stopped
+	timer_wheel_timer_t *next;
+	timer_wheel_timer_t **pprev;
+};
+
+/**
+ * @brief Timer wheel, a zero initialized wheel is empty and at tick 0
+ */
+typedef struct {
+	timer_wheel_timer_t *slots[TIMER_WHEEL_SLOTS];
+	uint32_t now; ///< Last tick processed
+} timer_wheel_t;
+
+/**
+ * @brief Empty a wheel
+ *
+ * @param wheel Wheel to initialize
+ * @param now Current tick
+ */
+void timer_wheel_init(timer_wheel_t *wheel, uint32_t now);
+
+/**
+ * @brief Initialize a timer, stopped
+ *
+ * @param timer Timer to initialize
+ * @param callback Called on expiry
+ * @param arg Free for the caller
+ */
+void timer_wheel_timer_init(timer_wheel_timer_t *timer, timer_wheel_callback_t callback,
+							void *arg);
+
+/**
+ * @brief Start or restart a timer
+ *
+ * @param wheel Wheel to run the timer on
+ * @param timer Initialized timer
+ * @param delay Ticks from the current tick to the first expiry, 1 to 2^31 - 1
+ * @param period Ticks between later expiries, 0 for a one-shot timer
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM on a NULL pointer, a missing
+ * callback or a delay out of range
+ */
+w_status_t timer_wheel_start(timer_wheel_t *wheel, timer_wheel_timer_t *timer, uint32_t delay,
+							 uint32_t period);
+
+/**
+ * @brief Stop a timer, nothing happens if it is not running
+ *
+ * @param timer Timer to stop
+ */
+void timer_wheel_stop(timer_wheel_timer_t *timer);
+
+/**
+ * @brief Check if a timer is running
+ *
+ * @param timer Timer to check
+ * @return true if the timer is started and has not expired yet
+ */
+bool timer_wheel_running(const timer_wheel_timer_t *timer);
+
+/**
+ * @brief Advance the wheel to a tick and call the callbacks of the expired timers
+ *
+ * Usually called with every tick, timers expire in the order they were started within a tick.
+ * Jumps of more than TIMER_WHEEL_SLOTS ticks visit every slot once, the late timers then expire in
+ * slot order. A periodic timer expires at most once per call, with the periods it skipped in
+ * `missed`.
+ *
+ * @param wheel Wheel to advance
+ * @param now Current tick, at or after the last one
+ * @return Number of expired timers
+ */
+uint32_t timer_wheel_advance(timer_wheel_t *wheel, uint32_t now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,10 +1,210 @@
+#include <string.h>
 #include <xc.h>
 
+#include "pic18f26k83/clock.h"
 #include "pic18f26k83/i2c.h"
 
-#ifndef _XTAL_FREQ
-// Define crystal frequency for delay macros (default: 16 MHz)
-#define _XTAL_FREQ 16000000
+// I2C1ERR error flags and their interrupt enables
+#define I2C_ERR_FLAGS 0x70
+#define I2C_ERR_NACKIF 0x10
+#define I2C_ERR_BCLIF 0x20
+#define I2C_ERR_ENABLES 0x07
+
+// Clock reference sources (CLKRCLK) used for the I2C1 clock
+#define I2C_CLKREF_FOSC 0x00
+#define I2C_CLKREF_MFINTOSC 0x03
+#define I2C_MFINTOSC_FREQ 500000UL
+
+// Bus speed limits and the matching I2C1CON2 timing and pad settings
+#define I2C_FAST_MODE_FREQ 400000UL
+#define I2C_FAST_MODE_PLUS_FREQ 1000000UL
+#define I2C_CON2_FME 0x20 // SCL period of 4 instead of 5 module clocks
+#define I2C_CON2_SDAHT_100NS 0x04 // SDA hold time, 300 ns otherwise
+#define I2C_PAD_SLEW_FAST 0x40 // I2C slew rate limiting up to 400 kHz
+#define I2C_PAD_SLEW_FAST_PLUS 0xC0 // I2C slew rate limiting for 1 MHz
+#define I2C_PAD_TH_I2C 0x01 // I2C input thresholds
+
+// Timer1 runs free from Fosc/4 with a 1:8 prescaler as the time base of the timeouts
+#define I2C_TIMER_TICKS_PER_MS ((uint32_t)(_XTAL_FREQ / 32000UL))
+
+// Bus recovery clocks the default I2C1 pins RC3 (SCL) and RC4 (SDA) through LATC at 100 kHz
+#define I2C_RECOVERY_CLOCKS 9
+#define I2C_RECOVERY_HALF_PERIOD_US 5
+
+// DMA trigger sources, interrupt request numbers of I2C1RXIF and I2C1TXIF
+#define I2C_DMA_IRQ_RX 0x18
+#define I2C_DMA_IRQ_TX 0x19
+
+// Transfers of at least this many bytes run on DMA1, 0 when DMA is off
+static uint8_t dma_min_len = 0;
+
+// Interrupt driven engine, the queue is shared between i2c_submit() and the I2C interrupt
+static i2c_transaction_t *queue[I2C_QUEUE_SIZE];
+static volatile uint8_t queue_head = 0;
+static volatile uint8_t queue_count = 0;
+// Phase of the running transaction, bytes of the phase moved so far and the result
+static bool engine_reading = false;
+static uint8_t engine_index = 0;
+static bool engine_dma = false;
+static w_status_t engine_status = W_SUCCESS;
+
+// Timer1 extended to 32 bits by timer_ticks(), and its value at the previous call
+static uint32_t timer_count = 0;
+static uint16_t timer_last = 0;
+
+/**
+ * @brief Read Timer1 extended to 32 bits
+ *
+ * The ticks since the previous call are accumulated, so differences of two reads are exact as long
+ * as the reads in between are less than a Timer1 period apart. The deadline checks of the blocking
+ * transfers and i2c_check_timeout() read it that often while a transaction runs. Called from the
+ * main context and the I2C interrupt, which never run a transaction at the same time.
+ *
+ * @return Timer1 ticks
+ */
+static uint32_t timer_ticks(void) {
+	uint16_t now = TMR1;
+	timer_count += (uint16_t)(now - timer_last);
+	timer_last = now;
+	return timer_count;
+}
+
+/**
+ * @brief Timeout measured with Timer1
+ *
+ * Uses the extended count of timer_ticks(), so the timeout may be longer than the 16-bit timer
+ * period as long as it is checked more often than Timer1 overflows.
+ */
+typedef struct {
+	uint32_t start; ///< Extended Timer1 count at the start
+	uint32_t ticks; ///< Timeout in Timer1 ticks
+} i2c_deadline_t;
+
+// Deadline of the transaction run by the interrupt driven engine
+static i2c_deadline_t engine_deadline;
+
+/**
+ * @brief Start a timeout
+ *
+ * @param deadline Deadline to start
+ * @param timeout_us Timeout in microseconds, at most about 2 s
+ */
+static void deadline_start(i2c_deadline_t *deadline, uint32_t timeout_us) {
+	deadline->start = timer_ticks();
+	deadline->ticks = timeout_us * I2C_TIMER_TICKS_PER_MS / 1000;
+}
+
+/**
+ * @brief Check if a timeout passed
+ *
+ * @param deadline Started deadline
+ * @return true once the timeout passed
+ */
+static bool deadline_expired(const i2c_deadline_t *deadline) {
+	return (timer_ticks() - deadline->start) >= deadline->ticks;
+}
+
+/**
+ * @brief Timeout of a transfer, including the clock stretching allowed to the target
+ *
+ * @param bytes Number of data bytes of the transfer
+ * @return Timeout in microseconds
+ */
+static uint32_t transfer_timeout_us(uint16_t bytes) {
+	return I2C_TIMEOUT_BASE_US + (uint32_t)bytes * I2C_TIMEOUT_BYTE_US;
+}
+
+#if I2C_STATS
+// Statistics, durations in Timer1 ticks until copied out by i2c_get_stats()
+static i2c_stats_t bus_stats;
+// Timer1 ticks per SCL period
+static uint16_t stats_bit_ticks = 0;
+// Start and error flags of the transaction run by the interrupt driven engine
+static uint32_t engine_stats_start;
+static uint8_t engine_stats_err;
+
+/**
+ * @brief Record a finished transaction
+ *
+ * @param address I2C device address
+ * @param bytes Number of data bytes, both phases
+ * @param phases 1 for a write or read, 2 for a write and read with a repeated start
+ * @param status Result of the transaction
+ * @param err I2C1ERR flags of the transaction
+ * @param start timer_ticks() at the start of the transaction
+ */
+static void stats_record(uint8_t address, uint16_t bytes, uint8_t phases, w_status_t status,
+						 uint8_t err, uint32_t start) {
+	if ((status == W_FAILURE) || (status == W_INVALID_PARAM)) {
+		return; // Nothing was sent
+	}
+
+	uint32_t duration = timer_ticks() - start;
+	bus_stats.busy_us += duration;
+	bus_stats.transactions++;
+
+	// Addresses get the first free entry when they are first seen
+	i2c_device_stats_t *device = NULL;
+	for (uint8_t i = 0; i < I2C_STATS_MAX_DEVICES; i++) {
+		if (bus_stats.devices[i].transactions == 0) {
+			device = &bus_stats.devices[i];
+			device->address = address;
+			break;
+		}
+		if (bus_stats.devices[i].address == address) {
+			device = &bus_stats.devices[i];
+			break;
+		}
+	}
+	if (!device) {
+		bus_stats.untracked++;
+		return;
+	}
+
+	device->transactions++;
+	if (status == W_IO_TIMEOUT) {
+		device->timeouts++;
+		return;
+	}
+	if (duration > device->max_duration_us) {
+		device->max_duration_us = duration;
+	}
+	if (status != W_SUCCESS) {
+		if (err & I2C_ERR_NACKIF) {
+			device->nacks++;
+		} else if (err & I2C_ERR_BCLIF) {
+			device->bus_collisions++;
+		}
+		return;
+	}
+
+	device->bytes += bytes;
+	// Start, address and data bytes, repeated start and stop, with two byte times of margin
+	uint32_t nominal_bits = 9UL * (bytes + phases) + 1 + phases + 18;
+	if (duration > nominal_bits * stats_bit_ticks) {
+		device->stretches++;
+	}
+}
+
+/**
+ * @brief Convert Timer1 ticks to microseconds
+ *
+ * @param ticks Timer1 ticks
+ * @return Microseconds
+ */
+static uint32_t stats_ticks_to_us(uint32_t ticks) {
+	return (ticks / I2C_TIMER_TICKS_PER_MS) * 1000 +
+		   (ticks % I2C_TIMER_TICKS_PER_MS) * 1000 / I2C_TIMER_TICKS_PER_MS;
+}
+
+// Declares a Timer1 timestamp for I2C_STATS_RECORD()
+#define I2C_STATS_TIMESTAMP(var) uint32_t var = timer_ticks()
+// Records a blocking transaction started at the timestamp
+#define I2C_STATS_RECORD(address, bytes, phases, status, var)                                     \
+	stats_record(address, bytes, phases, status, I2C1ERR, var)
+#else
+#define I2C_STATS_TIMESTAMP(var)
+#define I2C_STATS_RECORD(address, bytes, phases, status, var) ((void)0)
 #endif
 
 /**
@@ -27,13 +227,17 @@ static void clear_i2c_buffers(void) {
  * If errors are detected, they are cleared before returning.
  *
  * @return w_status_t Returns W_SUCCESS if module is ready, W_IO_ERROR if module is disabled or
- * errors detected
+ * errors detected, W_FAILURE if the interrupt driven engine has transactions queued
  */
 static w_status_t check_i2c_state(void) {
 	if (!I2C1CON0bits.EN) {
 		return W_IO_ERROR; // Module not enabled
 	}
 
+	if (queue_count != 0) {
+		return W_FAILURE; // Module owned by the interrupt driven engine
+	}
+
 	// Check for any error conditions
 	if (I2C1ERRbits.BCLIF || // Bus collision
 		I2C1ERRbits.BTOIF || // Bus timeout
@@ -46,44 +250,167 @@ static w_status_t check_i2c_state(void) {
 	return W_SUCCESS;
 }
 
+w_status_t i2c_recover_bus(void) {
+	if (PPSLOCKbits.PPSLOCKED) {
+		return W_FAILURE;
+	}
+
+	// Take the pins from the module, both as open drain outputs released high
+	uint8_t enabled = I2C1CON0bits.EN;
+	uint8_t scl_pps = RC3PPS;
+	uint8_t sda_pps = RC4PPS;
+	uint8_t tris = TRISC;
+	I2C1CON0bits.EN = 0;
+	ODCONCbits.ODCC3 = 1;
+	ODCONCbits.ODCC4 = 1;
+	LATCbits.LATC3 = 1;
+	LATCbits.LATC4 = 1;
+	RC3PPS = 0;
+	RC4PPS = 0;
+	TRISCbits.TRISC3 = 0;
+	TRISCbits.TRISC4 = 0;
+	__delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+
+	// Clock out the rest of the byte the target is sending, until it releases SDA
+	for (uint8_t i = 0; (i < I2C_RECOVERY_CLOCKS) && !PORTCbits.RC4; i++) {
+		LATCbits.LATC3 = 0;
+		__delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+		LATCbits.LATC3 = 1;
+		__delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+	}
+
+	// Stop condition, SDA rises while SCL is high
+	LATCbits.LATC3 = 0;
+	__delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+	LATCbits.LATC4 = 0;
+	__delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+	LATCbits.LATC3 = 1;
+	__delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+	LATCbits.LATC4 = 1;
+	__delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+	bool released = PORTCbits.RC3 && PORTCbits.RC4;
+
+	TRISC = tris;
+	RC3PPS = scl_pps;
+	RC4PPS = sda_pps;
+	I2C1CON0bits.EN = enabled;
+
+	return released ? W_SUCCESS : W_IO_ERROR;
+}
+
 /**
  * @brief Wait for the I2C bus to become idle
  *
  * This function monitors the Bus Free bit with timeout protection to ensure the I2C bus
- * is available before starting a new transaction.
+ * is available before starting a new transaction. If the bus stays busy, it is recovered with
+ * i2c_recover_bus().
  *
  * @return w_status_t Returns W_SUCCESS when bus is idle, W_IO_TIMEOUT if timeout occurs
  */
 static w_status_t wait_for_idle(void) {
-	unsigned int timeout = 0;
+	bool recovered = false;
+	i2c_deadline_t deadline;
+	deadline_start(&deadline, I2C_BUS_FREE_TIMEOUT_US);
 	while (!I2C1STAT0bits.BFRE) {
-		if (timeout++ >= I2C_POLL_TIMEOUT) {
-			return W_IO_TIMEOUT;
+		if (deadline_expired(&deadline)) {
+			// A target holds the bus, e.g. after a reset in the middle of a read
+			if (recovered || (i2c_recover_bus() != W_SUCCESS)) {
+				return W_IO_TIMEOUT;
+			}
+			recovered = true;
+			deadline_start(&deadline, I2C_BUS_FREE_TIMEOUT_US);
 		}
 	}
 	return W_SUCCESS;
 }
 
 /**
- * @brief Initialize I2C controller with specified clock settings
+ * @brief Abort a blocking transfer that ran out of time
  *
- * This function initializes the I2C module in master mode with the specified clock divider.
- * The clock divider determines the I2C bus frequency:
- * - 0 = 100kHz (standard mode)
- * - 1 = 50kHz
- * - 2 = 25kHz
- * - etc.
+ * Resetting the module releases SCL and SDA, a target still holding the bus is recovered.
  *
- * @param clkdiv Clock divider (0-7) that determines I2C frequency
- * @return w_status_t Returns W_SUCCESS on success, W_IO_ERROR if initialization fails
+ * @return w_status_t Always W_IO_TIMEOUT
  */
-w_status_t i2c_init(uint8_t clkdiv) {
+static w_status_t i2c_timeout(void) {
+	if (dma_min_len != 0) {
+		DMA1CON0 = 0;
+	}
+	I2C1CON0bits.RSEN = 0;
+	I2C1CON0bits.EN = 0;
+	I2C1CON0bits.EN = 1;
+	(void)wait_for_idle();
+	return W_IO_TIMEOUT;
+}
+
+/**
+ * @brief Check if a transfer runs on DMA1
+ *
+ * @param len Number of bytes of the transfer
+ * @return true if DMA is enabled and the transfer is long enough
+ */
+static bool dma_used(uint8_t len) {
+	return (dma_min_len != 0) && (len >= dma_min_len);
+}
+
+/**
+ * @brief Configure DMA1 for a transfer between a buffer and the I2C1 data registers
+ *
+ * The channel stays disabled, dma_arm() enables it once the I2C1 byte count is set.
+ *
+ * @param read Move bytes from I2C1RXB to the buffer instead of from the buffer to I2C1TXB
+ * @param data Buffer in data memory
+ * @param len Number of bytes
+ */
+static void dma_setup(bool read, const uint8_t *data, uint8_t len) {
+	DMA1CON0 = 0;
+
+	if (read) {
+		DMA1CON1 = 0x60; // Destination incremented and stop at its end, source fixed
+		DMA1SSA = (uintptr_t)&I2C1RXB;
+		DMA1SSZ = 1;
+		DMA1DSA = (uintptr_t)data;
+		DMA1DSZ = len;
+		DMA1SIRQ = I2C_DMA_IRQ_RX;
+	} else {
+		DMA1CON1 = 0x03; // Destination fixed, source incremented in data memory and stop at its end
+		DMA1SSA = (uintptr_t)data;
+		DMA1SSZ = len;
+		DMA1DSA = (uintptr_t)&I2C1TXB;
+		DMA1DSZ = 1;
+		DMA1SIRQ = I2C_DMA_IRQ_TX;
+	}
+	DMA1AIRQ = 0;
+}
+
+/**
+ * @brief Enable DMA1, every I2C1 buffer interrupt flag now moves one byte
+ */
+static void dma_arm(void) {
+	DMA1CON0 = 0xC0; // Enable, start transfers on the trigger source
+}
+
+/**
+ * @brief Configure and enable the module with the clock reference as its clock
+ *
+ * @param clkref_source Clock reference source (CLKRCLK)
+ * @param clkdiv Clock reference divider (0-7), the source is divided by 2^clkdiv
+ * @param con2 I2C1CON2 value with the bus timing
+ * @return w_status_t Returns W_SUCCESS on success, W_FAILURE if Timer1 is in use with another
+ * configuration, W_IO_ERROR if initialization fails
+ */
+static w_status_t i2c_configure(uint8_t clkref_source, uint8_t clkdiv, uint8_t con2) {
+	// Timer1 already used by the application with another configuration, leave it alone
+	if (T1CONbits.ON &&
+		((T1CLK != I2C_TIMER_T1CLK) || ((T1CON & I2C_TIMER_T1CON) != I2C_TIMER_T1CON))) {
+		return W_FAILURE;
+	}
+
 	// Disable module for configuration
 	I2C1CON0bits.EN = 0;
 
 	// Setup and verify clock configuration
-	CLKRCON = 0b10010000 | (clkdiv & 0x07);
-	CLKRCLK = 0b00000011; // MFINTOSC source
+	CLKRCON = 0x90 | (clkdiv & 0x07);
+	CLKRCLK = clkref_source;
 
 	// Wait for clock to stabilize
 	unsigned int timeout = 1000;
@@ -96,10 +423,21 @@ w_status_t i2c_init(uint8_t clkdiv) {
 	// Select I2C clock source
 	I2C1CLK = 0x04; // Clock reference
 
+	// Time base of the timeouts
+	T1CLK = I2C_TIMER_T1CLK;
+	T1CON = I2C_TIMER_T1CON;
+
+#if I2C_STATS
+	uint32_t source_freq =
+		(clkref_source == I2C_CLKREF_MFINTOSC) ? I2C_MFINTOSC_FREQ : (uint32_t)_XTAL_FREQ;
+	uint32_t bus_freq = (source_freq >> (clkdiv & 0x07)) / ((con2 & I2C_CON2_FME) ? 4 : 5);
+	stats_bit_ticks = (uint16_t)(I2C_TIMER_TICKS_PER_MS * 1000 / bus_freq);
+#endif
+
 	// Configure I2C module registers
 	I2C1CON0 = 0x04; // 7-bit master mode
 	I2C1CON1 = 0x80; // Enable ACK, clock stretching
-	I2C1CON2 = 0x00; // Standard timing
+	I2C1CON2 = con2;
 
 	// Clear all flags
 	I2C1PIR = 0;
@@ -110,6 +448,196 @@ w_status_t i2c_init(uint8_t clkdiv) {
 	return wait_for_idle();
 }
 
+/**
+ * @brief Initialize I2C controller with specified clock settings
+ *
+ * This function initializes the I2C module in master mode with the specified clock divider.
+ * The clock divider determines the I2C bus frequency:
+ * - 0 = 100kHz (standard mode)
+ * - 1 = 50kHz
+ * - 2 = 25kHz
+ * - etc.
+ *
+ * @param clkdiv Clock divider (0-7) that determines I2C frequency
+ * @return w_status_t Returns W_SUCCESS on success, W_FAILURE if Timer1 already runs with another
+ * configuration than `I2C_TIMER_T1CON`, W_IO_ERROR if initialization fails
+ */
+w_status_t i2c_init(uint8_t clkdiv) {
+	return i2c_configure(I2C_CLKREF_MFINTOSC, clkdiv, 0x00);
+}
+
+w_status_t i2c_init_freq(uint32_t bus_freq, uint32_t *actual_freq) {
+	if ((bus_freq == 0) || (bus_freq > I2C_FAST_MODE_PLUS_FREQ)) {
+		return W_INVALID_PARAM;
+	}
+
+	// Fastest rate not above the target. The clock reference divides MFINTOSC or Fosc by a power
+	// of two, one SCL period takes 5 module clocks, or 4 with FME.
+	uint32_t best_freq = 0;
+	uint8_t best_source = 0;
+	uint8_t best_div = 0;
+	bool best_fme = false;
+	for (uint8_t i = 0; i < 2; i++) {
+		uint8_t source = (i == 0) ? I2C_CLKREF_MFINTOSC : I2C_CLKREF_FOSC;
+		uint32_t source_freq = (i == 0) ? I2C_MFINTOSC_FREQ : (uint32_t)_XTAL_FREQ;
+		for (uint8_t div = 0; div < 8; div++) {
+			for (uint8_t fme = 0; fme < 2; fme++) {
+				uint32_t freq = (source_freq >> div) / (fme ? 4 : 5);
+				if ((freq <= bus_freq) && (freq > best_freq)) {
+					best_freq = freq;
+					best_source = source;
+					best_div = div;
+					best_fme = fme;
+				}
+			}
+		}
+	}
+	if (best_freq == 0) {
+		return W_INVALID_PARAM;
+	}
+
+	uint8_t con2 = best_fme ? I2C_CON2_FME : 0x00;
+	uint8_t pad = I2C_PAD_TH_I2C;
+	if (best_freq > I2C_FAST_MODE_FREQ) {
+		con2 |= I2C_CON2_SDAHT_100NS;
+		pad |= I2C_PAD_SLEW_FAST_PLUS;
+	} else {
+		pad |= I2C_PAD_SLEW_FAST;
+	}
+	RC3I2C = pad;
+	RC4I2C = pad;
+
+	if (actual_freq) {
+		*actual_freq = best_freq;
+	}
+	return i2c_configure(best_source, best_div, con2);
+}
+
+/**
+ * @brief Feed the bytes of a write to the transmit buffer
+ *
+ * @param data Bytes to send
+ * @param len Number of bytes
+ * @param deadline Deadline of the transfer
+ * @return w_status_t Returns W_SUCCESS once the last byte is loaded, W_IO_ERROR on error,
+ * W_IO_TIMEOUT on timeout
+ */
+static w_status_t send_bytes(const uint8_t *data, uint8_t len, i2c_deadline_t *deadline) {
+	// Send each byte
+	while (len--) {
+		// Wait for transmit buffer to be ready, the target may stretch the clock
+		while (!I2C1STAT1bits.TXBE) {
+			if (I2C1ERRbits.NACKIF || I2C1ERRbits.BCLIF) {
+				return W_IO_ERROR;
+			}
+			if (deadline_expired(deadline)) {
+				return i2c_timeout();
+			}
+		}
+
+		I2C1TXB = *data++;
+	}
+
+	return W_SUCCESS;
+}
+
+/**
+ * @brief Collect the bytes of a read from the receive buffer
+ *
+ * @param data Buffer for the bytes
+ * @param len Number of bytes
+ * @param deadline Deadline of the transfer
+ * @return w_status_t Returns W_SUCCESS once the last byte arrived, W_IO_ERROR on error,
+ * W_IO_TIMEOUT on timeout
+ */
+static w_status_t receive_bytes(uint8_t *data, uint8_t len, i2c_deadline_t *deadline) {
+	// Receive each byte
+	while (len--) {
+		// Wait for receive buffer to have data, the target may stretch the clock
+		while (!I2C1STAT1bits.RXBF) {
+			if (I2C1ERRbits.NACKIF || I2C1ERRbits.BCLIF) {
+				return W_IO_ERROR;
+			}
+			if (deadline_expired(deadline)) {
+				return i2c_timeout();
+			}
+		}
+
+		*data++ = I2C1RXB;
+	}
+
+	return W_SUCCESS;
+}
+
+/**
+ * @brief Wait until the stop condition ends a transfer run by DMA1, then release the channel
+ *
+ * @param deadline Deadline of the transfer
+ * @return w_status_t Returns W_SUCCESS on success, W_IO_ERROR on error, W_IO_TIMEOUT on timeout
+ */
+static w_status_t dma_wait(i2c_deadline_t *deadline) {
+	// Wait for transfer completion
+	while (!I2C1PIRbits.PCIF) {
+		if (I2C1ERRbits.NACKIF || I2C1ERRbits.BCLIF) {
+			DMA1CON0 = 0;
+			return W_IO_ERROR;
+		}
+		if (deadline_expired(deadline)) {
+			return i2c_timeout();
+		}
+	}
+
+	DMA1CON0 = 0;
+	I2C1PIRbits.PCIF = 0;
+	I2C1STAT1bits.CLRBF = 1;
+
+	if ((I2C1ERR & I2C_ERR_FLAGS) != 0) {
+		return W_IO_ERROR;
+	}
+
+	return W_SUCCESS;
+}
+
+/**
+ * @brief Internal function to run a write or read on DMA1
+ *
+ * The CPU only waits for the stop condition, the data bytes are moved by DMA1.
+ *
+ * @param address I2C device address (7-bit, will be shifted left by 1)
+ * @param data Pointer to the data buffer in data memory, DMA1 stores into it for a read
+ * @param len Number of bytes to transfer
+ * @param read Read from the device instead of writing to it
+ * @return w_status_t Returns W_SUCCESS on success, W_IO_ERROR on error, W_IO_TIMEOUT on timeout
+ */
+static w_status_t i2c_transfer_dma(uint8_t address, const uint8_t *data, uint8_t len, bool read) {
+	// Verify bus state and prepare for transfer
+	w_status_t status = check_i2c_state();
+	if (status != W_SUCCESS) {
+		return status;
+	}
+
+	i2c_deadline_t deadline;
+	deadline_start(&deadline, transfer_timeout_us(len));
+
+	dma_setup(read, data, len);
+	clear_i2c_buffers();
+	I2C1PIR = 0;
+	I2C1ERR = 0;
+
+	// Configure transfer
+	I2C1ADB1 = (uint8_t)((address << 1) | (read ? 0x01 : 0x00));
+	I2C1CNT = len;
+	if (read) {
+		I2C1CON1bits.ACKDT = 0; // ACK bytes
+	}
+
+	// Start transfer
+	dma_arm();
+	I2C1CON0bits.S = 1;
+
+	return dma_wait(&deadline);
+}
+
 /**
  * @brief Internal function to write data to an I2C device
  *
@@ -122,12 +650,19 @@ w_status_t i2c_init(uint8_t clkdiv) {
  * @return w_status_t Returns W_SUCCESS on success, W_IO_ERROR on error, W_IO_TIMEOUT on timeout
  */
 static w_status_t i2c_write(uint8_t address, const uint8_t *data, uint8_t len) {
+	if (dma_used(len)) {
+		return i2c_transfer_dma(address, data, len, false);
+	}
+
 	// Verify bus state and prepare for transfer
 	w_status_t status = check_i2c_state();
 	if (status != W_SUCCESS) {
 		return status;
 	}
 
+	i2c_deadline_t deadline;
+	deadline_start(&deadline, transfer_timeout_us(len));
+
 	clear_i2c_buffers();
 	I2C1PIR = 0;
 	I2C1ERR = 0;
@@ -139,40 +674,22 @@ static w_status_t i2c_write(uint8_t address, const uint8_t *data, uint8_t len) {
 	// Start transfer
 	I2C1CON0bits.S = 1;
 
-	// Send each byte
-	while (len--) {
-		unsigned int timeout = 0;
-		// Wait for transmit buffer to be ready
-		while (!I2C1STAT1bits.TXBE) {
-			if (I2C1ERRbits.NACKIF || I2C1ERRbits.BCLIF) {
-				return W_IO_ERROR;
-			}
-
-			// Handle clock stretching
-			if (I2C1CON0bits.CSTR) {
-				__delay_us(I2C_STRETCH_DELAY);
-				timeout = 0;
-			} else if (timeout++ >= I2C_POLL_TIMEOUT) {
-				return W_IO_TIMEOUT;
-			}
-		}
-
-		I2C1TXB = *data++;
+	status = send_bytes(data, len, &deadline);
+	if (status != W_SUCCESS) {
+		return status;
 	}
 
 	// Wait for transfer completion
-	unsigned int timeout = 0;
 	while (!I2C1PIRbits.PCIF) {
-		if (timeout++ >= I2C_POLL_TIMEOUT) {
-			return W_IO_TIMEOUT;
+		if (deadline_expired(&deadline)) {
+			return i2c_timeout();
 		}
-		timeout++;
 	}
 
 	I2C1PIRbits.PCIF = 0;
 	I2C1STAT1bits.CLRBF = 1;
 
-	if ((I2C1ERR & 0x70) != 0) {
+	if ((I2C1ERR & I2C_ERR_FLAGS) != 0) {
 		return W_IO_ERROR;
 	}
 
@@ -191,12 +708,19 @@ static w_status_t i2c_write(uint8_t address, const uint8_t *data, uint8_t len) {
  * @return w_status_t Returns W_SUCCESS on success, W_IO_ERROR on error, W_IO_TIMEOUT on timeout
  */
 static w_status_t i2c_read(uint8_t address, uint8_t *data, uint8_t len) {
+	if (dma_used(len)) {
+		return i2c_transfer_dma(address, data, len, true);
+	}
+
 	// Verify bus state and prepare for transfer
 	w_status_t status = check_i2c_state();
 	if (status != W_SUCCESS) {
 		return status;
 	}
 
+	i2c_deadline_t deadline;
+	deadline_start(&deadline, transfer_timeout_us(len));
+
 	clear_i2c_buffers();
 	I2C1PIR = 0;
 	I2C1ERR = 0;
@@ -214,35 +738,99 @@ static w_status_t i2c_read(uint8_t address, uint8_t *data, uint8_t len) {
 	// Start transfer
 	I2C1CON0bits.S = 1;
 
-	// Receive each byte
-	while (len--) {
-		unsigned int timeout = 0;
-		// Wait for receive buffer to have data
-		while (!I2C1STAT1bits.RXBF) {
-			if (I2C1ERRbits.NACKIF || I2C1ERRbits.BCLIF) {
-				return W_IO_ERROR;
-			}
+	status = receive_bytes(data, len, &deadline);
+	if (status != W_SUCCESS) {
+		return status;
+	}
 
-			// Handle clock stretching
-			if (I2C1CON0bits.CSTR) {
-				__delay_us(I2C_STRETCH_DELAY);
-				timeout = 0;
-			} else if (timeout++ >= I2C_POLL_TIMEOUT) {
-				return W_IO_TIMEOUT;
-			}
+	// Wait for transfer completion
+	while (!I2C1PIRbits.PCIF) {
+		if (deadline_expired(&deadline)) {
+			return i2c_timeout();
 		}
+	}
 
-		*data++ = I2C1RXB;
+	return W_SUCCESS;
+}
+
+/**
+ * @brief Internal function to write to and then read from an I2C device
+ *
+ * The module holds the bus after the write phase (RSEN) and the read phase follows with a repeated
+ * start, so the device sees a single transaction ending with one stop.
+ *
+ * @param address I2C device address (7-bit, will be shifted left by 1)
+ * @param write_data Bytes to write, e.g. the register address
+ * @param write_len Number of bytes to write, at least 1
+ * @param read_data Buffer for the bytes read
+ * @param read_len Number of bytes to read, at least 1
+ * @return w_status_t Returns W_SUCCESS on success, W_IO_ERROR on error, W_IO_TIMEOUT on timeout
+ */
+static w_status_t i2c_write_read(uint8_t address, const uint8_t *write_data, uint8_t write_len,
+								 uint8_t *read_data, uint8_t read_len) {
+	// Verify bus state and prepare for transfer
+	w_status_t status = check_i2c_state();
+	if (status != W_SUCCESS) {
+		return status;
+	}
+
+	i2c_deadline_t deadline;
+	deadline_start(&deadline, transfer_timeout_us((uint16_t)write_len + read_len));
+
+	bool dma = dma_used(read_len);
+	if (dma) {
+		dma_setup(true, read_data, read_len);
+	}
+	clear_i2c_buffers();
+	I2C1PIR = 0;
+	I2C1ERR = 0;
+
+	// Write phase, ends holding the clock instead of sending a stop
+	I2C1ADB1 = (uint8_t)(address << 1); // Write address
+	I2C1CNT = write_len;
+	I2C1CON0bits.RSEN = 1;
+	I2C1CON0bits.S = 1;
+
+	status = send_bytes(write_data, write_len, &deadline);
+	while ((status == W_SUCCESS) && !I2C1PIRbits.CNTIF) {
+		if (I2C1ERRbits.NACKIF || I2C1ERRbits.BCLIF) {
+			status = W_IO_ERROR;
+		} else if (deadline_expired(&deadline)) {
+			status = i2c_timeout();
+		}
+	}
+	I2C1CON0bits.RSEN = 0;
+	if (status != W_SUCCESS) {
+		return status;
+	}
+
+	// Read phase after the repeated start
+	I2C1PIRbits.CNTIF = 0;
+	I2C1ADB1 = (uint8_t)((address << 1) | 0x01); // Read address
+	I2C1CNT = read_len;
+	I2C1CON1bits.ACKDT = 0; // ACK bytes
+	if (dma) {
+		dma_arm();
+	}
+	I2C1CON0bits.S = 1;
+
+	if (dma) {
+		return dma_wait(&deadline);
+	}
+
+	status = receive_bytes(read_data, read_len, &deadline);
+	if (status != W_SUCCESS) {
+		return status;
 	}
 
 	// Wait for transfer completion
-	unsigned int timeout = 0;
 	while (!I2C1PIRbits.PCIF) {
-		if (timeout++ >= I2C_POLL_TIMEOUT) {
-			return W_IO_TIMEOUT;
+		if (deadline_expired(&deadline)) {
+			return i2c_timeout();
 		}
 	}
 
+	I2C1PIRbits.PCIF = 0;
 	return W_SUCCESS;
 }
 
@@ -257,7 +845,10 @@ static w_status_t i2c_read(uint8_t address, uint8_t *data, uint8_t len) {
  * @return w_status_t Returns W_SUCCESS on success, W_IO_ERROR on error, W_IO_TIMEOUT on timeout
  */
 w_status_t i2c_write_data(uint8_t address, const uint8_t *data, uint8_t len) {
-	return i2c_write(address, data, len);
+	I2C_STATS_TIMESTAMP(start);
+	w_status_t status = i2c_write(address, data, len);
+	I2C_STATS_RECORD(address, len, 1, status, start);
+	return status;
 }
 
 /**
@@ -271,7 +862,10 @@ w_status_t i2c_write_data(uint8_t address, const uint8_t *data, uint8_t len) {
  * @return w_status_t Returns W_SUCCESS on success, W_IO_ERROR on error, W_IO_TIMEOUT on timeout
  */
 w_status_t i2c_read_data(uint8_t address, uint8_t *data, uint8_t len) {
-	return i2c_read(address, data, len);
+	I2C_STATS_TIMESTAMP(start);
+	w_status_t status = i2c_read(address, data, len);
+	I2C_STATS_RECORD(address, len, 1, status, start);
+	return status;
 }
 
 /**
@@ -285,8 +879,11 @@ w_status_t i2c_read_data(uint8_t address, uint8_t *data, uint8_t len) {
  * @return w_status_t Returns W_SUCCESS on success, W_IO_ERROR on error, W_IO_TIMEOUT on timeout
  */
 w_status_t i2c_write_reg8(uint8_t address, uint8_t reg, uint8_t val) {
+	I2C_STATS_TIMESTAMP(start);
 	uint8_t data[2] = {reg, val};
-	return i2c_write(address, data, 2);
+	w_status_t status = i2c_write(address, data, 2);
+	I2C_STATS_RECORD(address, 2, 1, status, start);
+	return status;
 }
 
 /**
@@ -300,18 +897,22 @@ w_status_t i2c_write_reg8(uint8_t address, uint8_t reg, uint8_t val) {
  * @return w_status_t Returns W_SUCCESS on success, W_IO_ERROR on error, W_IO_TIMEOUT on timeout
  */
 w_status_t i2c_write_reg16(uint8_t address, uint8_t reg, uint16_t val) {
+	I2C_STATS_TIMESTAMP(start);
 	uint8_t data[3] = {
 		reg,
 		(uint8_t)(val >> 8), // MSB first
 		(uint8_t)(val & 0xFF) // LSB second
 	};
-	return i2c_write(address, data, 3);
+	w_status_t status = i2c_write(address, data, 3);
+	I2C_STATS_RECORD(address, 3, 1, status, start);
+	return status;
 }
 
 /**
  * @brief Read an 8-bit value from a register on an I2C device
  *
- * This function reads a single 8-bit value from a specific register address on the I2C device.
+ * This function reads a single 8-bit value from a specific register address on the I2C device,
+ * using a repeated start between the register address and the value.
  *
  * @param address I2C device address (7-bit, will be shifted left by 1)
  * @param reg Register address to read from
@@ -319,21 +920,17 @@ w_status_t i2c_write_reg16(uint8_t address, uint8_t reg, uint16_t val) {
  * @return w_status_t Returns W_SUCCESS on success, W_IO_ERROR on error, W_IO_TIMEOUT on timeout
  */
 w_status_t i2c_read_reg8(uint8_t address, uint8_t reg, uint8_t *value) {
-	// Write register address
-	w_status_t status = i2c_write(address, &reg, 1);
-	if (status != W_SUCCESS) {
-		return status;
-	}
-
-	// Read register value
-	return i2c_read(address, value, 1);
+	I2C_STATS_TIMESTAMP(start);
+	w_status_t status = i2c_write_read(address, &reg, 1, value, 1);
+	I2C_STATS_RECORD(address, 2, 2, status, start);
+	return status;
 }
 
 /**
  * @brief Read a 16-bit value from a register on an I2C device
  *
  * This function reads a 16-bit value (MSB first) from a specific register address on the I2C
- * device.
+ * device, using a repeated start between the register address and the value.
  *
  * @param address I2C device address (7-bit, will be shifted left by 1)
  * @param reg Register address to read from
@@ -341,15 +938,10 @@ w_status_t i2c_read_reg8(uint8_t address, uint8_t reg, uint8_t *value) {
  * @return w_status_t Returns W_SUCCESS on success, W_IO_ERROR on error, W_IO_TIMEOUT on timeout
  */
 w_status_t i2c_read_reg16(uint8_t address, uint8_t reg, uint16_t *value) {
-	// Write register address
-	w_status_t status = i2c_write(address, &reg, 1);
-	if (status != W_SUCCESS) {
-		return status;
-	}
-
-	// Read register value
+	I2C_STATS_TIMESTAMP(start);
 	uint8_t data[2];
-	status = i2c_read(address, data, 2);
+	w_status_t status = i2c_write_read(address, &reg, 1, data, 2);
+	I2C_STATS_RECORD(address, 3, 2, status, start);
 	if (status != W_SUCCESS) {
 		return status;
 	}
@@ -358,3 +950,287 @@ w_status_t i2c_read_reg16(uint8_t address, uint8_t reg, uint16_t *value) {
 	*value = ((uint16_t)data[0] << 8) | data[1];
 	return W_SUCCESS;
 }
+
+w_status_t i2c_write_read_data(uint8_t address, const uint8_t *write_data, uint8_t write_len,
+							   uint8_t *read_data, uint8_t read_len) {
+	if (!write_data || !read_data || (write_len == 0) || (read_len == 0)) {
+		return W_INVALID_PARAM;
+	}
+	I2C_STATS_TIMESTAMP(start);
+	w_status_t status = i2c_write_read(address, write_data, write_len, read_data, read_len);
+	I2C_STATS_RECORD(address, (uint16_t)write_len + read_len, 2, status, start);
+	return status;
+}
+
+w_status_t i2c_read_regs(uint8_t address, uint8_t reg, uint8_t *data, uint8_t len) {
+	if (!data || (len == 0)) {
+		return W_INVALID_PARAM;
+	}
+	I2C_STATS_TIMESTAMP(start);
+	w_status_t status = i2c_write_read(address, &reg, 1, data, len);
+	I2C_STATS_RECORD(address, (uint16_t)len + 1, 2, status, start);
+	return status;
+}
+
+/**
+ * @brief Start one phase (write or read) of a queued transaction
+ *
+ * The first byte of a write is loaded before the start condition, the rest is fed from the
+ * transmit interrupt, or by DMA1 for long phases. A write phase followed by a read phase ends
+ * holding the bus, its CNTIF starts the read phase with a repeated start. Otherwise the module
+ * sends a stop after the last byte and PCIF ends the transaction.
+ *
+ * @param transaction Running transaction
+ * @param read Start the read phase instead of the write phase
+ */
+static void engine_start_phase(i2c_transaction_t *transaction, bool read) {
+	uint8_t len = read ? transaction->read_len : transaction->write_len;
+	bool restart = !read && (transaction->read_len > 0);
+	engine_reading = read;
+	engine_index = 0;
+	engine_dma = dma_used(len);
+
+	if (engine_dma) {
+		dma_setup(read, read ? transaction->read_data : transaction->write_data, len);
+	}
+
+	I2C1STAT1bits.CLRBF = 1;
+	I2C1PIR = 0;
+	I2C1ERR = I2C_ERR_ENABLES;
+
+	I2C1ADB1 = (uint8_t)((transaction->address << 1) | (read ? 0x01 : 0x00));
+	I2C1CNT = len;
+	if (engine_dma) {
+		dma_arm();
+	} else if (!read && (len > 0)) {
+		I2C1TXB = transaction->write_data[engine_index++];
+	}
+
+	PIE3bits.I2C1TXIE = !read && !engine_dma;
+	PIE3bits.I2C1RXIE = read && !engine_dma;
+	I2C1PIEbits.CNTIE = restart;
+	I2C1CON0bits.RSEN = restart;
+	I2C1CON0bits.S = 1;
+}
+
+/**
+ * @brief Start the transaction at the head of the queue
+ */
+static void engine_start(void) {
+	i2c_transaction_t *transaction = queue[queue_head];
+	engine_status = W_SUCCESS;
+	deadline_start(&engine_deadline,
+				   transfer_timeout_us((uint16_t)transaction->write_len + transaction->read_len));
+#if I2C_STATS
+	engine_stats_start = timer_ticks();
+	engine_stats_err = 0;
+#endif
+
+	I2C1PIEbits.PCIE = 1;
+	PIE3bits.I2C1IE = 1;
+	PIE3bits.I2C1EIE = 1;
+	engine_start_phase(transaction, (transaction->write_len == 0) && (transaction->read_len > 0));
+}
+
+/**
+ * @brief Complete the running transaction and start the next one
+ */
+static void engine_finish(void) {
+	i2c_transaction_t *transaction = queue[queue_head];
+	if (engine_dma) {
+		DMA1CON0 = 0;
+		engine_dma = false;
+	}
+
+#if I2C_STATS
+	stats_record(transaction->address,
+				 (uint16_t)transaction->write_len + transaction->read_len,
+				 ((transaction->write_len > 0) && (transaction->read_len > 0)) ? 2 : 1,
+				 engine_status,
+				 engine_stats_err,
+				 engine_stats_start);
+#endif
+
+	transaction->status = engine_status;
+	transaction->done = true;
+
+	queue_head = (uint8_t)((queue_head + 1) % I2C_QUEUE_SIZE);
+	queue_count--;
+	if (queue_count != 0) {
+		engine_start();
+	} else {
+		PIE3bits.I2C1TXIE = 0;
+		PIE3bits.I2C1RXIE = 0;
+		PIE3bits.I2C1IE = 0;
+		PIE3bits.I2C1EIE = 0;
+	}
+
+	// Last, so the callback can queue a follow-up transaction
+	if (transaction->callback) {
+		transaction->callback(transaction);
+	}
+}
+
+w_status_t i2c_dma_init(uint8_t min_len) {
+	if (queue_count != 0) {
+		return W_FAILURE;
+	}
+
+	DMA1CON0 = 0;
+	if ((min_len != 0) && !PRLOCKbits.PRLOCKED) {
+		// Lower values win, DMA1 stalls the CPU for its bus cycles
+		DMA1PR = 0;
+		ISRPR = 1;
+		MAINPR = 2;
+
+		// Unlock sequence, must not be interrupted
+		uint8_t gie = INTCON0bits.GIE;
+		INTCON0bits.GIE = 0;
+		PRLOCK = 0x55;
+		PRLOCK = 0xAA;
+		PRLOCKbits.PRLOCKED = 1;
+		INTCON0bits.GIE = gie;
+	}
+
+	dma_min_len = min_len;
+	return W_SUCCESS;
+}
+
+w_status_t i2c_submit(i2c_transaction_t *transaction) {
+	if (!transaction || ((transaction->write_len > 0) && !transaction->write_data) ||
+		((transaction->read_len > 0) && !transaction->read_data)) {
+		return W_INVALID_PARAM;
+	}
+
+	if (!I2C1CON0bits.EN) {
+		return W_IO_ERROR;
+	}
+
+	transaction->done = false;
+	transaction->status = W_SUCCESS;
+
+	// Keeps the caller's interrupt state, this may run inside a completion callback
+	uint8_t gie = INTCON0bits.GIE;
+	INTCON0bits.GIE = 0;
+
+	if (queue_count >= I2C_QUEUE_SIZE) {
+		INTCON0bits.GIE = gie;
+		return W_OVERFLOW;
+	}
+
+	queue[(queue_head + queue_count) % I2C_QUEUE_SIZE] = transaction;
+	queue_count++;
+	if (queue_count == 1) {
+		engine_start();
+	}
+
+	INTCON0bits.GIE = gie;
+	return W_SUCCESS;
+}
+
+void i2c_handle_interrupt(void) {
+	if (queue_count == 0) {
+		I2C1ERR = 0;
+		I2C1PIR = 0;
+		return;
+	}
+
+	i2c_transaction_t *transaction = queue[queue_head];
+
+	uint8_t err = I2C1ERR;
+	if (err & I2C_ERR_FLAGS) {
+		I2C1ERR = err & I2C_ERR_ENABLES;
+		engine_status = W_IO_ERROR;
+#if I2C_STATS
+		engine_stats_err |= err;
+#endif
+		if (err & I2C_ERR_FLAGS & ~I2C_ERR_NACKIF) {
+			// Bus collision or timeout, the module does not send a stop, reset it
+			I2C1CON0bits.EN = 0;
+			I2C1CON0bits.EN = 1;
+			engine_finish();
+			return;
+		}
+		// A NACK makes the module send a stop, the transaction ends on PCIF
+	}
+
+	if (engine_dma) {
+		// DMA1 moves the data bytes
+	} else if (engine_reading) {
+		if (PIR3bits.I2C1RXIF && (engine_index < transaction->read_len)) {
+			transaction->read_data[engine_index++] = I2C1RXB;
+		}
+	} else if (PIR3bits.I2C1TXIF && (engine_index < transaction->write_len)) {
+		I2C1TXB = transaction->write_data[engine_index++];
+	}
+
+	if (I2C1PIRbits.CNTIF && I2C1PIEbits.CNTIE) {
+		// Write phase done, the module holds the bus for the repeated start
+		if (engine_dma) {
+			DMA1CON0 = 0;
+		}
+		engine_start_phase(transaction, true);
+	}
+
+	if (I2C1PIRbits.PCIF) {
+		I2C1PIRbits.PCIF = 0;
+		engine_finish();
+	}
+}
+
+w_status_t i2c_check_timeout(void) {
+	uint8_t gie = INTCON0bits.GIE;
+	INTCON0bits.GIE = 0;
+	if ((queue_count == 0) || !deadline_expired(&engine_deadline)) {
+		INTCON0bits.GIE = gie;
+		return W_SUCCESS;
+	}
+
+	// Stop the engine and release the bus, the target may still hold it
+	PIE3bits.I2C1TXIE = 0;
+	PIE3bits.I2C1RXIE = 0;
+	PIE3bits.I2C1IE = 0;
+	PIE3bits.I2C1EIE = 0;
+	if (engine_dma) {
+		DMA1CON0 = 0;
+	}
+	I2C1CON0bits.RSEN = 0;
+	I2C1CON0bits.EN = 0;
+	I2C1CON0bits.EN = 1;
+	INTCON0bits.GIE = gie;
+
+	(void)wait_for_idle();
+
+	INTCON0bits.GIE = 0;
+	engine_status = W_IO_TIMEOUT;
+	engine_finish();
+	INTCON0bits.GIE = gie;
+	return W_IO_TIMEOUT;
+}
+
+bool i2c_idle(void) {
+	return queue_count == 0;
+}
+
+#if I2C_STATS
+w_status_t i2c_get_stats(i2c_stats_t *stats, bool clear) {
+	if (!stats) {
+		return W_INVALID_PARAM;
+	}
+
+	// The engine records from the I2C interrupt
+	uint8_t gie = INTCON0bits.GIE;
+	INTCON0bits.GIE = 0;
+	*stats = bus_stats;
+	if (clear) {
+		memset(&bus_stats, 0, sizeof(bus_stats));
+	}
+	INTCON0bits.GIE = gie;
+
+	stats->busy_us = stats_ticks_to_us(stats->busy_us);
+	for (uint8_t i = 0; i < I2C_STATS_MAX_DEVICES; i++) {
+		stats->devices[i].max_duration_us = stats_ticks_to_us(stats->devices[i].max_duration_us);
+	}
+	return W_SUCCESS;
+}
+#endif
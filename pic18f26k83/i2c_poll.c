@@ -0,0 +1,162 @@
+#include <stddef.h>
+#include <xc.h>
+
+#include "pic18f26k83/i2c.h"
+#include "pic18f26k83/i2c_poll.h"
+#include "timer.h"
+
+// Read state of a device, i2c_poll_run() moves it out of idle and back, the I2C interrupt from
+// waiting to queued
+#define POLL_IDLE 0 // Not due
+#define POLL_WAITING 1 // Due, waiting for room in the I2C queue
+#define POLL_QUEUED 2 // Read queued or running
+
+typedef struct {
+	i2c_transaction_t transaction;
+	volatile uint8_t phase;
+	uint8_t reg; // Copy of the first register, the table may be in program memory
+	uint32_t due_ms;
+	uint32_t sample_ms;
+	i2c_poll_stats_t stats;
+} poll_state_t;
+
+static const i2c_poll_device_t *poll_devices = NULL;
+static uint8_t poll_count = 0;
+static poll_state_t poll_state[I2C_POLL_MAX_DEVICES];
+
+/**
+ * @brief Queue the reads of waiting devices while the I2C queue has room
+ *
+ * Runs with interrupts disabled or from the I2C interrupt. Devices earlier in the table go first.
+ */
+static void poll_submit_waiting(void) {
+	for (uint8_t i = 0; i < poll_count; i++) {
+		poll_state_t *state = &poll_state[i];
+		if (state->phase != POLL_WAITING) {
+			continue;
+		}
+		if (i2c_submit(&state->transaction) != W_SUCCESS) {
+			return;
+		}
+		state->phase = POLL_QUEUED;
+	}
+}
+
+/**
+ * @brief Completion callback of a read, keeps the bus busy with the next waiting device
+ *
+ * @param transaction Completed read
+ */
+static void poll_complete(i2c_transaction_t *transaction) {
+	(void)transaction;
+	poll_submit_waiting();
+}
+
+w_status_t i2c_poll_init(const i2c_poll_device_t *devices, uint8_t count) {
+	if (!devices || (count == 0) || (count > I2C_POLL_MAX_DEVICES)) {
+		return W_INVALID_PARAM;
+	}
+	for (uint8_t i = 0; i < count; i++) {
+		if (!devices[i].data || (devices[i].len == 0) || (devices[i].period_ms == 0)) {
+			return W_INVALID_PARAM;
+		}
+	}
+	for (uint8_t i = 0; i < poll_count; i++) {
+		if (poll_state[i].phase != POLL_IDLE) {
+			return W_FAILURE;
+		}
+	}
+
+	uint32_t now = millis();
+	for (uint8_t i = 0; i < count; i++) {
+		poll_state_t *state = &poll_state[i];
+		state->phase = POLL_IDLE;
+		state->reg = devices[i].reg;
+		state->due_ms = now;
+		state->stats.samples = 0;
+		state->stats.errors = 0;
+		state->stats.deadline_misses = 0;
+
+		i2c_transaction_t *transaction = &state->transaction;
+		transaction->address = devices[i].address;
+		transaction->write_data = &state->reg;
+		transaction->write_len = 1;
+		transaction->read_data = devices[i].data;
+		transaction->read_len = devices[i].len;
+		transaction->callback = poll_complete;
+		transaction->arg = NULL;
+	}
+	poll_devices = devices;
+	poll_count = count;
+	return W_SUCCESS;
+}
+
+w_status_t i2c_poll_run(void) {
+	if (!I2C1CON0bits.EN) {
+		return W_IO_ERROR;
+	}
+	(void)i2c_check_timeout();
+
+	// Completed reads, the engine does not touch them anymore once done is set
+	for (uint8_t i = 0; i < poll_count; i++) {
+		poll_state_t *state = &poll_state[i];
+		if ((state->phase != POLL_QUEUED) || !state->transaction.done) {
+			continue;
+		}
+		state->phase = POLL_IDLE;
+		if (state->transaction.status != W_SUCCESS) {
+			state->stats.errors++;
+			continue;
+		}
+		state->stats.samples++;
+		const i2c_poll_device_t *device = &poll_devices[i];
+		if (device->decode) {
+			device->decode(device, device->data, state->sample_ms);
+		}
+	}
+
+	// Due reads, all of them are queued at once to run back-to-back
+	uint32_t now = millis();
+	bool due = false;
+	for (uint8_t i = 0; i < poll_count; i++) {
+		poll_state_t *state = &poll_state[i];
+		uint32_t late = now - state->due_ms;
+		if ((int32_t)late < 0) {
+			continue;
+		}
+
+		uint16_t period = poll_devices[i].period_ms;
+		if (late >= period) {
+			// Whole periods passed without a poll, restart the schedule from now
+			state->stats.deadline_misses += late / period;
+			state->due_ms = now + period;
+		} else {
+			state->due_ms += period;
+		}
+
+		if (state->phase != POLL_IDLE) {
+			// The previous read did not complete in time, skip this one
+			state->stats.deadline_misses++;
+			continue;
+		}
+		state->sample_ms = now;
+		state->phase = POLL_WAITING;
+		due = true;
+	}
+
+	if (due) {
+		uint8_t gie = INTCON0bits.GIE;
+		INTCON0bits.GIE = 0;
+		poll_submit_waiting();
+		INTCON0bits.GIE = gie;
+	}
+	return W_SUCCESS;
+}
+
+w_status_t i2c_poll_get_stats(uint8_t index, i2c_poll_stats_t *stats) {
+	if (!stats || (index >= poll_count)) {
+		return W_INVALID_PARAM;
+	}
+	*stats = poll_state[index].stats;
+	return W_SUCCESS;
+}
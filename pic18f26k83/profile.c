@@ -0,0 +1,36 @@
+#include <stdint.h>
+#include <xc.h>
+
+#include "common.h"
+#include "pic18f26k83/clock.h"
+#include "pic18f26k83/i2c.h"
+
+// Timer1 clock sources (T1CLK) the counter frequency is known for
+#define PROFILE_T1CLK_FOSC4 0x01
+#define PROFILE_T1CLK_FOSC 0x02
+
+void w_profile_counter_init(void) {
+	// Same configuration as the I2C timeouts, so both share Timer1 in either init order
+	if (!T1CONbits.ON) {
+		T1CLK = I2C_TIMER_T1CLK;
+		T1CON = I2C_TIMER_T1CON;
+	}
+}
+
+w_profile_count_t w_profile_counter(void) {
+	return TMR1;
+}
+
+uint32_t w_profile_counter_hz(void) {
+	uint32_t clock_hz;
+	if (!T1CONbits.ON) {
+		return 0;
+	} else if (T1CLK == PROFILE_T1CLK_FOSC4) {
+		clock_hz = _XTAL_FREQ / 4;
+	} else if (T1CLK == PROFILE_T1CLK_FOSC) {
+		clock_hz = _XTAL_FREQ;
+	} else {
+		return 0;
+	}
+	return clock_hz >> T1CONbits.CKPS;
+}
@@ -2,6 +2,13 @@
 
 #include "pic18f26k83/pwm.h"
 
+// Timer2 counts before the end of the period a batch update must start, covers writing every
+// channel with interrupts disabled
+#define PWM_BATCH_MARGIN 64
+
+// Bit x - 1 is set once CCPx is initialized by pwm_init()
+static uint8_t pwm_modules = 0;
+
 /**
  * @brief Helper function to configure PPS registers using direct register access
  *
@@ -68,10 +75,12 @@ w_status_t pwm_init(uint8_t ccp_module, pwm_pin_config_t pin_config, uint16_t pw
 			return W_INVALID_PARAM;
 	}
 	*ccp_con = 0x8C; // Enable CCP module in PWM mode (PWM mode selection)
+	pwm_modules |= 1 << (ccp_module - 1);
 
 	// Set PWM period using Timer2
 	PR2 = pwm_period & 0xFF; // Load lower 8 bits of PWM period into PR2 register
 	TMR2 = 0; // Reset Timer2 count to 0
+	T2CLKCON = 0x01; // Clock Timer2 from Fosc/4, the clock the PWM period is based on
 	T2CONbits.T2CKPS = 0; // Set Timer2 prescaler to 1:1 (no prescaling)
 	T2CONbits.T2OUTPS = 0; // Set Timer2 postscaler to 1:1 (no postscaling)
 	T2CONbits.TMR2ON = 1; // Start Timer2 to begin PWM operation
@@ -134,3 +143,64 @@ w_status_t pwm_update_duty_cycle(uint8_t ccp_module, uint16_t duty_cycle) {
 
 	return W_SUCCESS; // Return success status after updating duty cycle
 }
+
+/**
+ * @brief Updates the duty cycles of all initialized CCP modules on the same period boundary
+ *
+ * The CCPRx registers are latched at the end of every Timer2 period. All channels are written
+ * with interrupts disabled, early enough in a period that the end of the period can not land
+ * between two writes, waiting for the next period if needed. The writes are straight-line code
+ * with the registers addressed directly, which is cheaper on the PIC18 than going through
+ * pointers.
+ *
+ * @param duty_cycles Duty cycle values (0-1023) of CCP1 to CCP4, entries of modules not
+ * initialized by pwm_init() are ignored
+ * @return w_status_t Returns W_SUCCESS on success, W_INVALID_PARAM if duty_cycles is NULL, a
+ * duty cycle exceeds 1023 or the period (PR2) is not longer than 64 Timer2 counts, nothing is
+ * updated then
+ */
+w_status_t pwm_update_duty_cycles(const uint16_t duty_cycles[PWM_CCP_MODULES]) {
+	// The period must leave room for the writes before its end
+	if (!duty_cycles || (PR2 <= PWM_BATCH_MARGIN)) {
+		return W_INVALID_PARAM;
+	}
+	for (uint8_t i = 0; i < PWM_CCP_MODULES; i++) {
+		if (duty_cycles[i] > 1023) {
+			return W_INVALID_PARAM;
+		}
+	}
+
+	uint8_t gie = INTCON0bits.GIE;
+	INTCON0bits.GIE = 0;
+
+	// Too close to the end of the period, start at the beginning of the next one. The wrap around
+	// is seen in TMR2 itself, TMR2IF belongs to the application's Timer2 interrupt.
+	uint8_t count = TMR2;
+	if ((uint16_t)count + PWM_BATCH_MARGIN > PR2) {
+		uint8_t previous;
+		do {
+			previous = count;
+			count = TMR2;
+		} while (count >= previous);
+	}
+
+	if (pwm_modules & 0x01) {
+		CCPR_L(1) = duty_cycles[0] & 0xFF;
+		CCPR_H(1) = (duty_cycles[0] >> 8) & 0x03;
+	}
+	if (pwm_modules & 0x02) {
+		CCPR_L(2) = duty_cycles[1] & 0xFF;
+		CCPR_H(2) = (duty_cycles[1] >> 8) & 0x03;
+	}
+	if (pwm_modules & 0x04) {
+		CCPR_L(3) = duty_cycles[2] & 0xFF;
+		CCPR_H(3) = (duty_cycles[2] >> 8) & 0x03;
+	}
+	if (pwm_modules & 0x08) {
+		CCPR_L(4) = duty_cycles[3] & 0xFF;
+		CCPR_H(4) = (duty_cycles[3] >> 8) & 0x03;
+	}
+
+	INTCON0bits.GIE = gie;
+	return W_SUCCESS;
+}
@@ -1,3 +1,5 @@
+#include <stdbool.h>
+#include <string.h>
 #include <xc.h>
 
 #include "timer.h"
@@ -18,16 +20,109 @@
 #define MILLIS_REMAINDER 64
 #define MILLIS_INCREMENT_CAP 125
 
-volatile static uint32_t millis_counter = 0;
+// Timer0 counts per interrupt in tick mode, 250 kHz / tick_ms makes it exactly tick_ms
+#define TICK_COUNTS 250
+#define TICK_MAX_MS 32
+
+static volatile uint32_t millis_counter = 0;
+static volatile uint32_t micros_counter = 0; // Microseconds at the last counted rollover
+
+// Timebase selected by the init function, 0 for the 512 us rollover with Bresenham millis
+static uint8_t tick_ms = 0;
+static uint8_t micros_per_count = 2;
+static uint16_t micros_per_rollover = 512;
+
+#if TIMER0_LATENCY_STATS
+static timer0_latency_stats_t latency_stats;
+static uint16_t last_latency_us;
+static bool last_latency_valid = false;
+
+/**
+ * @brief Clear the latency statistics, the next interrupt has no previous one to measure jitter to
+ */
+static void latency_reset(void) {
+	memset(&latency_stats, 0, sizeof(latency_stats));
+	last_latency_valid = false;
+}
+
+/**
+ * @brief Record the latency of the running interrupt
+ *
+ * @param count TMR0L at handler entry, counts since the rollover
+ */
+static void latency_record(uint8_t count) {
+	uint16_t latency_us = (uint16_t)count * micros_per_count;
+	log2_hist_add(&latency_stats.latency, latency_us);
+	if (last_latency_valid) {
+		uint16_t jitter_us = (latency_us > last_latency_us) ? (latency_us - last_latency_us)
+															: (last_latency_us - latency_us);
+		log2_hist_add(&latency_stats.jitter, jitter_us);
+	}
+	last_latency_us = latency_us;
+	last_latency_valid = true;
+}
+#endif
+
+/**
+ * @brief Consistent copy of a Timer0 interrupt counter and the TMR0L count that goes with it
+ *
+ * The counters are updated by the Timer0 interrupt, a copy taken while the interrupt hits in the
+ * middle of the multi-byte read differs from the next one. Interrupts are at least one rollover
+ * apart, so two equal copies in a row are consistent.
+ *
+ * @param counter millis_counter or micros_counter
+ * @param value Set to the counter
+ * @param count Set to the TMR0L count past the counter
+ * @return true if a rollover is not counted yet, the caller has interrupts disabled
+ */
+static bool timer0_snapshot(const volatile uint32_t *counter, uint32_t *value, uint8_t *count) {
+	uint8_t pending;
+	do {
+		*value = *counter;
+		*count = TMR0L;
+		pending = PIR3bits.TMR0IF;
+		if (pending) {
+			// The count read again is past the rollover
+			*count = TMR0L;
+		}
+	} while (*value != *counter);
+	return pending;
+}
 
 uint32_t millis(void) {
-	INTCON0bits.GIE = 0;
-	uint32_t res = millis_counter;
-	INTCON0bits.GIE = 1;
-	return res;
+	uint32_t res;
+	if (tick_ms <= 1) {
+		do {
+			res = millis_counter;
+		} while (res != millis_counter);
+		return res;
+	}
+
+	// Interpolated between the interrupts
+	uint8_t count;
+	if (timer0_snapshot(&millis_counter, &res, &count)) {
+		res += tick_ms;
+	}
+	return res + (uint16_t)count * tick_ms / TICK_COUNTS;
+}
+
+uint32_t micros(void) {
+	uint32_t base;
+	uint8_t count;
+	if (timer0_snapshot(&micros_counter, &base, &count)) {
+		base += micros_per_rollover;
+	}
+	return base + (uint16_t)count * micros_per_count;
 }
 
 void timer0_init(void) {
+	tick_ms = 0;
+	micros_per_count = 2;
+	micros_per_rollover = 512;
+#if TIMER0_LATENCY_STATS
+	latency_reset();
+#endif
+
 	PIE3bits.TMR0IE = 1; // enable timer 0 interrupt
 
 	T0CON0bits.EN = 0; // disable timer module
@@ -43,12 +138,54 @@ void timer0_init(void) {
 	T0CON0bits.EN = 1;
 }
 
+w_status_t timer0_init_tick(uint8_t period_ms) {
+	if ((period_ms == 0) || (period_ms > TICK_MAX_MS) || (period_ms & (period_ms - 1))) {
+		return W_INVALID_PARAM;
+	}
+
+	// 500 kHz divided by 2 * period_ms
+	uint8_t prescale = 1;
+	while ((1 << (prescale - 1)) < period_ms) {
+		prescale++;
+	}
+
+	T0CON0bits.EN = 0;
+	tick_ms = period_ms;
+	micros_per_count = 4 * period_ms;
+	micros_per_rollover = (uint16_t)TICK_COUNTS * micros_per_count;
+#if TIMER0_LATENCY_STATS
+	latency_reset();
+#endif
+
+	PIE3bits.TMR0IE = 1;
+	T0CON0bits.MD16 = 0; // 8 bits, TMR0H is the period
+	T0CON0bits.OUTPS = 0;
+	T0CON1bits.CKPS = prescale;
+	T0CON1bits.CS = 0x5; // 500 kHz MFINTOSC
+	T0CON1bits.ASYNC = 0;
+	TMR0H = TICK_COUNTS - 1;
+	TMR0L = 0;
+	T0CON0bits.EN = 1;
+	return W_SUCCESS;
+}
+
 /*
  * Based on Bresenham's algorithm and described here: http://romanblack.com/one_sec.htm
  */
 void timer0_handle_interrupt() {
 	static uint8_t internal_count = 0;
 
+#if TIMER0_LATENCY_STATS
+	// First, the count keeps running while the handler does
+	latency_record(TMR0L);
+#endif
+
+	micros_counter += micros_per_rollover;
+	if (tick_ms != 0) {
+		millis_counter += tick_ms;
+		return;
+	}
+
 	millis_counter += MILLIS_INCREMENT;
 	internal_count += MILLIS_REMAINDER;
 	if (internal_count > MILLIS_INCREMENT_CAP) {
@@ -56,3 +193,20 @@ void timer0_handle_interrupt() {
 		millis_counter++;
 	}
 }
+
+#if TIMER0_LATENCY_STATS
+w_status_t timer0_get_latency_stats(timer0_latency_stats_t *stats, bool clear) {
+	if (!stats) {
+		return W_INVALID_PARAM;
+	}
+
+	uint8_t gie = INTCON0bits.GIE;
+	INTCON0bits.GIE = 0;
+	*stats = latency_stats;
+	if (clear) {
+		memset(&latency_stats, 0, sizeof(latency_stats));
+	}
+	INTCON0bits.GIE = gie;
+	return W_SUCCESS;
+}
+#endif
@@ -1,89 +1,507 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
 #include "common.h"
+#include "crc8.h"
 #include "lfs.h"
-#include "mbr.h"
+#include "partition.h"
+#include "stm32/littlefs_sd_shim.h"
 #include "stm32h7xx_hal.h"
 
 #define SD_RW_TIMEOUT_MS 50
+// Bounds of the write timeout chosen by the probe, the upper bound is the SDHC/SDXC write timeout
+#define SD_PROBE_MIN_TIMEOUT_MS 10
+#define SD_PROBE_MAX_TIMEOUT_MS 250
+// Erase timeout is specified per allocation unit and can be much longer than a write
+#define SD_ERASE_TIMEOUT_MS 1000
+
+// The allocator state restored from the checkpoint has this layout since littlefs 2.9
+#define LFSSHIM_SD_CHECKPOINT_SUPPORTED (LFS_VERSION >= 0x00020009)
+#define LFSSHIM_SD_CHECKPOINT_MAGIC 0x4b43464cUL // "LFCK"
+
+/**
+ * @brief Allocator checkpoint header, stored in the first sector of the checkpoint area
+ *
+ * The lookahead bitmap follows in the next sectors.
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t partition_offset;
+	uint32_t block_size;
+	uint32_t block_count;
+	uint32_t lookahead_size;
+	uint32_t start;
+	uint32_t size;
+	uint32_t next;
+	// Filesystem state the checkpoint belongs to, see lfsshim_sd_superblock_generation()
+	uint32_t superblock_rev[2];
+	uint8_t superblock_crc;
+	// CRC of the fields above followed by the bitmap
+	uint8_t crc;
+} lfsshim_sd_checkpoint_t;
+
+#if LFSSHIM_SD_STATS
+// Declares a timestamp for LFSSHIM_SD_STATS_RECORD()
+#define LFSSHIM_SD_STATS_TIMESTAMP(var) uint32_t var = DWT->CYCCNT
+// Adds the microseconds elapsed since a timestamp to one of the histograms of a context
+#define LFSSHIM_SD_STATS_RECORD(ctx, hist, var) \
+	log2_hist_add(&(ctx)->stats.hist, (DWT->CYCCNT - (var)) / (SystemCoreClock / 1000000U))
+#define LFSSHIM_SD_STATS_ADD(ctx, field, n) ((ctx)->stats.field += (n))
+#else
+#define LFSSHIM_SD_STATS_TIMESTAMP(var)
+#define LFSSHIM_SD_STATS_RECORD(ctx, hist, var) ((void)0)
+#define LFSSHIM_SD_STATS_ADD(ctx, field, n) ((void)0)
+#endif
+
+/**
+ * @brief Read the clock of a wait strategy
+ *
+ * @param wait Wait strategy
+ * @return Microseconds of the configured clock, or milliseconds of `HAL_GetTick()`
+ */
+static uint64_t lfsshim_sd_timestamp(const lfsshim_sd_wait_config_t *wait) {
+	return wait->clock_us ? wait->clock_us() : HAL_GetTick();
+}
+
+/**
+ * @brief Check if a timeout passed since a timestamp
+ *
+ * @param wait Wait strategy the timestamp was taken with
+ * @param start Timestamp from lfsshim_sd_timestamp()
+ * @param timeout_ms Timeout in milliseconds
+ * @return true once more than the timeout passed
+ */
+static bool lfsshim_sd_timed_out(const lfsshim_sd_wait_config_t *wait, uint64_t start,
+								 uint32_t timeout_ms) {
+	if (wait->clock_us) {
+		return (wait->clock_us() - start) > (uint64_t)timeout_ms * 1000;
+	}
+	// The millisecond tick wraps around after 49 days
+	return (uint32_t)(HAL_GetTick() - (uint32_t)start) > timeout_ms;
+}
+
+/**
+ * @brief Wait until the card finished programming and is back in transfer state
+ *
+ * Uses the wait strategy of the context: calls the yield hook between polls and, after a write
+ * with ready notification enabled, only polls the card once the interrupt signalled ready.
+ * Outstanding writes and erases use the timeout recorded when they were issued.
+ *
+ * @param wait Wait strategy
+ * @param card Card to wait for
+ * @return 0 when the card is ready, LFS_ERR_IO on timeout
+ */
+static int lfsshim_sd_wait_ready(const lfsshim_sd_wait_config_t *wait, lfsshim_sd_card_t *card) {
+	// Only a card that was written to signals the end of programming through the interrupt
+	bool use_notify = wait->ready_notify && card->busy;
+	uint32_t timeout_ms = card->busy ? card->busy_timeout_ms : SD_RW_TIMEOUT_MS;
+
+	uint64_t start = lfsshim_sd_timestamp(wait);
+	while (true) {
+		if (!use_notify || card->ready_notified) {
+			if (HAL_SD_GetCardState(card->hsd) == HAL_SD_CARD_TRANSFER) {
+				card->busy = false;
+				return 0;
+			}
+		}
+
+		if (lfsshim_sd_timed_out(wait, start, timeout_ms)) {
+			if (!use_notify) {
+				return LFS_ERR_IO; // timeout
+			}
+			// Notification may have been lost, poll the card once more before giving up
+			use_notify = false;
+			continue;
+		}
+
+		if (wait->yield) {
+			wait->yield(wait->yield_arg);
+		}
+	}
+}
+
+/**
+ * @brief Get the timeout of a write issued by a context
+ */
+static uint32_t lfsshim_sd_write_timeout(const lfsshim_sd_ctx_t *ctx) {
+	return ctx->write_timeout_ms ? ctx->write_timeout_ms : SD_RW_TIMEOUT_MS;
+}
+
+/**
+ * @brief Check if any card is still busy with an outstanding write or erase, without waiting
+ */
+static bool lfsshim_sd_cards_busy(lfsshim_sd_ctx_t *ctx) {
+	for (uint8_t i = 0; i < ctx->num_cards; i++) {
+		lfsshim_sd_card_t *card = &ctx->cards[i];
+		if (card->busy && !card->write_error &&
+			(HAL_SD_GetCardState(card->hsd) != HAL_SD_CARD_TRANSFER)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Wait for the outstanding write on every card
+ *
+ * In mirrored mode a card that did not complete the write while another card did is marked as
+ * failed.
+ *
+ * @param ctx Context to wait for
+ * @return 0 if there was no outstanding write or it completed on at least one card, LFS_ERR_IO
+ * otherwise
+ */
+static int lfsshim_sd_complete_writes(lfsshim_sd_ctx_t *ctx) {
+	bool waited = false;
+	bool ok[LFSSHIM_SD_MAX_CARDS] = {false};
+	uint8_t num_ok = 0;
+	LFSSHIM_SD_STATS_TIMESTAMP(wait_start);
+
+	for (uint8_t i = 0; i < ctx->num_cards; i++) {
+		lfsshim_sd_card_t *card = &ctx->cards[i];
+		if (!card->busy) {
+			continue;
+		}
+
+		waited = true;
+		if (card->write_error) {
+			continue;
+		}
+		if (lfsshim_sd_wait_ready(&ctx->wait, card) == 0) {
+			ok[i] = true;
+			num_ok++;
+		} else {
+			LFSSHIM_SD_STATS_RECORD(ctx, timeout_us, wait_start);
+		}
+	}
+
+	if (!waited) {
+		return 0;
+	}
+	LFSSHIM_SD_STATS_RECORD(ctx, busy_wait_us, wait_start);
+
+	for (uint8_t i = 0; i < ctx->num_cards; i++) {
+		lfsshim_sd_card_t *card = &ctx->cards[i];
+		// A card that missed a write no longer holds the same image as its mirror, stop using it
+		if (card->busy && !ok[i] && (num_ok > 0)) {
+			card->failed = true;
+		}
+		card->busy = false;
+		card->write_error = false;
+	}
+
+	return (num_ok > 0) ? 0 : LFS_ERR_IO;
+}
+
+/**
+ * @brief Get the partition relative sector address of a littlefs block and offset
+ */
+static uint32_t lfsshim_sd_sector(const struct lfs_config *c, lfs_block_t block, lfs_off_t off) {
+	return (block * (c->block_size / LFSSHIM_SD_SECTOR_SIZE)) + (off / LFSSHIM_SD_SECTOR_SIZE);
+}
 
-static SD_HandleTypeDef *lfsshim_sd_hsd;
-static uint32_t lfsshim_sd_first_block_offset = 0;
+/**
+ * @brief Read sectors from the first healthy card, mirrors are only used as a fallback
+ */
+static int lfsshim_sd_read_sectors(lfsshim_sd_ctx_t *ctx, uint32_t sector, uint8_t *buffer,
+								   uint32_t num_sectors) {
+	for (uint8_t i = 0; i < ctx->num_cards; i++) {
+		lfsshim_sd_card_t *card = &ctx->cards[i];
+		if (card->failed) {
+			continue;
+		}
+
+		LFSSHIM_SD_STATS_TIMESTAMP(read_start);
+		HAL_StatusTypeDef hal = HAL_SD_ReadBlocks(
+			card->hsd, buffer, sector + card->first_block_offset, num_sectors, SD_RW_TIMEOUT_MS);
+		if (hal == HAL_OK) {
+			if (lfsshim_sd_wait_ready(&ctx->wait, card) == 0) {
+				return 0;
+			}
+			LFSSHIM_SD_STATS_RECORD(ctx, timeout_us, read_start);
+		}
+	}
+
+	return LFS_ERR_IO;
+}
+
+#if LFSSHIM_SD_READAHEAD_BLOCKS > 0
+/**
+ * @brief Drop the read-ahead buffer if it overlaps sectors that are about to change
+ */
+static void lfsshim_sd_readahead_invalidate(lfsshim_sd_ctx_t *ctx, uint32_t sector,
+											uint32_t count) {
+	lfsshim_sd_readahead_t *ra = &ctx->readahead;
+	if ((sector < ra->start + ra->count) && (ra->start < sector + count)) {
+		ra->count = 0;
+	}
+}
+#endif
+
+static int lfsshim_sd_read_cached(const struct lfs_config *c, lfs_block_t block, lfs_off_t off,
+								  void *buffer, lfs_size_t size) {
+	lfsshim_sd_ctx_t *ctx = (lfsshim_sd_ctx_t *)c->context;
+
+	w_assert((size % LFSSHIM_SD_SECTOR_SIZE) == 0);
+	w_assert((off % LFSSHIM_SD_SECTOR_SIZE) == 0);
+
+	uint32_t sector = lfsshim_sd_sector(c, block, off);
+	uint32_t num_sectors = size / LFSSHIM_SD_SECTOR_SIZE;
+
+#if LFSSHIM_SD_READAHEAD_BLOCKS > 0
+	lfsshim_sd_readahead_t *ra = &ctx->readahead;
+	bool sequential = (sector == ra->next);
+	ra->next = sector + num_sectors;
+
+	if (ra->enabled && (sector >= ra->start) && (sector + num_sectors <= ra->start + ra->count)) {
+		memcpy(buffer,
+			   &ra->buffer[(sector - ra->start) * LFSSHIM_SD_SECTOR_SIZE],
+			   num_sectors * LFSSHIM_SD_SECTOR_SIZE);
+		return 0;
+	}
+#endif
+
+	// The card cannot be read while it is still programming a deferred write
+	int err = lfsshim_sd_complete_writes(ctx);
+	if (err) {
+		return err;
+	}
+
+#if LFSSHIM_SD_READAHEAD_BLOCKS > 0
+	if (ra->enabled && sequential && (num_sectors < LFSSHIM_SD_READAHEAD_BLOCKS)) {
+		uint32_t fetch = LFSSHIM_SD_READAHEAD_BLOCKS;
+		// The configuration leaves the block count to the superblock, the mount records the end
+		if ((ra->end > 0) && (sector + fetch > ra->end)) {
+			fetch = (sector < ra->end) ? ra->end - sector : 0;
+		}
+
+		ra->count = 0;
+		if ((fetch >= num_sectors) &&
+			(lfsshim_sd_read_sectors(ctx, sector, ra->buffer, fetch) == 0)) {
+			ra->start = sector;
+			ra->count = fetch;
+			memcpy(buffer, ra->buffer, num_sectors * LFSSHIM_SD_SECTOR_SIZE);
+			return 0;
+		}
+		// Prefetch failed, for example past the end of the card, read only what was asked for
+	}
+#endif
+
+	return lfsshim_sd_read_sectors(ctx, sector, (uint8_t *)buffer, num_sectors);
+}
 
 static int lfsshim_sd_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off,
 						   void *buffer, lfs_size_t size) {
-	uint32_t block_addr = block + lfsshim_sd_first_block_offset;
+	LFSSHIM_SD_STATS_TIMESTAMP(start);
+	int err = lfsshim_sd_read_cached(c, block, off, buffer, size);
+	if (!err) {
+		LFSSHIM_SD_STATS_RECORD((lfsshim_sd_ctx_t *)c->context, read_us, start);
+		LFSSHIM_SD_STATS_ADD((lfsshim_sd_ctx_t *)c->context, read_bytes, size);
+	}
+	return err;
+}
+
+/**
+ * @brief Issue an erase of a range of sectors on every healthy card, without waiting
+ *
+ * The caller must have completed outstanding writes. Completion of the erase is checked like a
+ * write, by `lfsshim_sd_complete_writes()`.
+ */
+static void lfsshim_sd_issue_erase(lfsshim_sd_ctx_t *ctx, uint32_t start, uint32_t count) {
+#if LFSSHIM_SD_READAHEAD_BLOCKS > 0
+	lfsshim_sd_readahead_invalidate(ctx, start, count);
+#endif
+
+	for (uint8_t i = 0; i < ctx->num_cards; i++) {
+		lfsshim_sd_card_t *card = &ctx->cards[i];
+		if (card->failed) {
+			continue;
+		}
+
+		uint32_t first = start + card->first_block_offset;
+		card->ready_notified = false;
+		HAL_StatusTypeDef hal = HAL_SD_Erase(card->hsd, first, first + count - 1);
+		card->busy = true;
+		card->write_error = (hal != HAL_OK);
+		card->busy_timeout_ms = SD_ERASE_TIMEOUT_MS;
+	}
+}
+
+/**
+ * @brief Send the first `count` sectors of the pending discard range to the cards
+ */
+static int lfsshim_sd_flush_discard(lfsshim_sd_ctx_t *ctx, uint32_t count) {
+	lfsshim_sd_erase_state_t *erase = &ctx->erase;
+	if (count == 0) {
+		return 0;
+	}
+
+	int err = lfsshim_sd_complete_writes(ctx);
+	if (err) {
+		return err;
+	}
 
-	w_assert((size % c->block_size) == 0);
-	w_assert(off == 0);
+	lfsshim_sd_issue_erase(ctx, erase->pending_start, count);
+	erase->pending_start += count;
+	erase->pending_count -= count;
 
-	uint32_t num_blocks = size / c->block_size;
+	if (ctx->wait.deferred_busy) {
+		return 0;
+	}
+	return lfsshim_sd_complete_writes(ctx);
+}
 
-	HAL_StatusTypeDef hal = HAL_SD_ReadBlocks(
-		lfsshim_sd_hsd, (uint8_t *)buffer, block_addr, num_blocks, SD_RW_TIMEOUT_MS);
-	if (hal != HAL_OK) {
-		return -1; // LFS_ERR_IO
+/**
+ * @brief Remove sectors about to be written from the pending discard range
+ *
+ * littlefs erases a block right before programming it, there is no point in discarding what is
+ * overwritten anyway. Sectors of the range in front of the write are sent to the cards first, so
+ * a discard never reaches the card after the write to the same sector.
+ */
+static int lfsshim_sd_trim_discard(lfsshim_sd_ctx_t *ctx, uint32_t sector, uint32_t count) {
+	lfsshim_sd_erase_state_t *erase = &ctx->erase;
+	uint32_t pending_end = erase->pending_start + erase->pending_count;
+	uint32_t end = sector + count;
+
+	if ((erase->pending_count == 0) || (end <= erase->pending_start) || (sector >= pending_end)) {
+		return 0;
 	}
 
-	// Wait for card to be ready (polling)
-	uint32_t start = HAL_GetTick();
-	while (HAL_SD_GetCardState(lfsshim_sd_hsd) != HAL_SD_CARD_TRANSFER) {
-		if ((HAL_GetTick() - start) > SD_RW_TIMEOUT_MS) {
-			return -1; // timeout -> LFS_ERR_IO
+	if (sector > erase->pending_start) {
+		if (end >= pending_end) {
+			// write covers the tail of the range
+			erase->pending_count = sector - erase->pending_start;
+			return 0;
+		}
+		int err = lfsshim_sd_flush_discard(ctx, sector - erase->pending_start);
+		if (err) {
+			return err;
 		}
 	}
 
-	return 0; // success
+	// write covers the front of the remaining range
+	uint32_t new_start = (end < pending_end) ? end : pending_end;
+	erase->pending_count = pending_end - new_start;
+	erase->pending_start = new_start;
+	return 0;
 }
 
-static int lfsshim_sd_write(const struct lfs_config *c, lfs_block_t block, lfs_off_t off,
-							const void *buffer, lfs_size_t size) {
-	uint32_t block_addr = block + lfsshim_sd_first_block_offset;
+static int lfsshim_sd_write_blocks(const struct lfs_config *c, lfs_block_t block, lfs_off_t off,
+								   const void *buffer, lfs_size_t size) {
+	lfsshim_sd_ctx_t *ctx = (lfsshim_sd_ctx_t *)c->context;
 
-	w_assert((size % c->block_size) == 0);
-	w_assert(off == 0);
+	w_assert((size % LFSSHIM_SD_SECTOR_SIZE) == 0);
+	w_assert((off % LFSSHIM_SD_SECTOR_SIZE) == 0);
 
-	uint32_t num_blocks = size / c->block_size;
+	uint32_t sector = lfsshim_sd_sector(c, block, off);
+	uint32_t num_sectors = size / LFSSHIM_SD_SECTOR_SIZE;
+
+	int err = lfsshim_sd_trim_discard(ctx, sector, num_sectors);
+	if (err) {
+		return err;
+	}
 
-	HAL_StatusTypeDef hal = HAL_SD_WriteBlocks(
-		lfsshim_sd_hsd, (uint8_t *)buffer, block_addr, num_blocks, SD_RW_TIMEOUT_MS);
-	if (hal != HAL_OK) {
-		return -1; // LFS_ERR_IO
+	err = lfsshim_sd_complete_writes(ctx);
+	if (err) {
+		return err;
 	}
 
-	// Wait for card to be ready (polling)
-	uint32_t start = HAL_GetTick();
-	while (HAL_SD_GetCardState(lfsshim_sd_hsd) != HAL_SD_CARD_TRANSFER) {
-		if ((HAL_GetTick() - start) > SD_RW_TIMEOUT_MS) {
-			return -1; // timeout -> LFS_ERR_IO
+#if LFSSHIM_SD_READAHEAD_BLOCKS > 0
+	lfsshim_sd_readahead_invalidate(ctx, sector, num_sectors);
+#endif
+
+	// Start the write on every card before waiting for any of them, so the cards program in
+	// parallel
+	for (uint8_t i = 0; i < ctx->num_cards; i++) {
+		lfsshim_sd_card_t *card = &ctx->cards[i];
+		if (card->failed) {
+			continue;
 		}
+
+		card->ready_notified = false;
+		HAL_StatusTypeDef hal = HAL_SD_WriteBlocks(card->hsd,
+												   (uint8_t *)buffer,
+												   sector + card->first_block_offset,
+												   num_sectors,
+												   SD_RW_TIMEOUT_MS);
+		card->busy = true;
+		card->write_error = (hal != HAL_OK);
+		card->busy_timeout_ms = lfsshim_sd_write_timeout(ctx);
 	}
 
-	return 0; // success
+	if (ctx->wait.deferred_busy) {
+		return 0; // completion is checked by the next operation
+	}
+
+	return lfsshim_sd_complete_writes(ctx);
+}
+
+static int lfsshim_sd_write(const struct lfs_config *c, lfs_block_t block, lfs_off_t off,
+							const void *buffer, lfs_size_t size) {
+	LFSSHIM_SD_STATS_TIMESTAMP(start);
+	int err = lfsshim_sd_write_blocks(c, block, off, buffer, size);
+	if (!err) {
+		LFSSHIM_SD_STATS_RECORD((lfsshim_sd_ctx_t *)c->context, prog_us, start);
+		LFSSHIM_SD_STATS_ADD((lfsshim_sd_ctx_t *)c->context, prog_bytes, size);
+	}
+	return err;
 }
 
 static int lfsshim_sd_erase(const struct lfs_config *c, lfs_block_t block) {
-	return 0; // SD does not require explicit erase
+	lfsshim_sd_ctx_t *ctx = (lfsshim_sd_ctx_t *)c->context;
+	lfsshim_sd_erase_state_t *erase = &ctx->erase;
+
+	// SD cards do not require an explicit erase before writing, the erase only tells the card
+	// which sectors no longer hold data
+	if (!erase->discard) {
+		return 0;
+	}
+
+	uint32_t sector = lfsshim_sd_sector(c, block, 0);
+	uint32_t num_sectors = c->block_size / LFSSHIM_SD_SECTOR_SIZE;
+
+	if ((erase->pending_count > 0) && (sector == erase->pending_start + erase->pending_count) &&
+		(erase->pending_count + num_sectors <= LFSSHIM_SD_DISCARD_MAX_BLOCKS)) {
+		erase->pending_count += num_sectors;
+		return 0;
+	}
+
+	int err = lfsshim_sd_flush_discard(ctx, erase->pending_count);
+	if (err) {
+		return err;
+	}
+
+	erase->pending_start = sector;
+	erase->pending_count = num_sectors;
+	return 0;
 }
 
 static int lfsshim_sd_sync(const struct lfs_config *c) {
-	return 0;
+	lfsshim_sd_ctx_t *ctx = (lfsshim_sd_ctx_t *)c->context;
+
+	int err = lfsshim_sd_flush_discard(ctx, ctx->erase.pending_count);
+	if (err) {
+		return err;
+	}
+
+	// Data is only durable once the cards finished programming
+	return lfsshim_sd_complete_writes(ctx);
 }
 
-// configuration of the filesystem is provided by this struct
-const struct lfs_config cfg = {
+// configuration template of the filesystem, copied into each context at mount
+static const struct lfs_config lfsshim_sd_cfg_template = {
 	// block device operations
 	.read = lfsshim_sd_read,
 	.prog = lfsshim_sd_write,
 	.erase = lfsshim_sd_erase,
 	.sync = lfsshim_sd_sync,
 
-	// block device configuration
-	.read_size = 512,
-	.prog_size = 512,
-	.block_size = 512,
+	// block device configuration, block, cache and lookahead sizes come from the geometry
+	.read_size = LFSSHIM_SD_SECTOR_SIZE,
+	.prog_size = LFSSHIM_SD_SECTOR_SIZE,
 	.block_count = 0,
-	.block_cycles = -1,
-	.cache_size = 512,
-	.lookahead_size = 512,
 	.compact_thresh = -1,
 	.name_max = 0,
 	.file_max = 0,
@@ -91,35 +509,698 @@ const struct lfs_config cfg = {
 	.metadata_max = 0,
 	.inline_max = -1};
 
-w_status_t lfsshim_sd_mount(lfs_t *lfs, SD_HandleTypeDef *hsd, uint32_t first_block_offset) {
+// Used when no geometry is selected, must fit the smallest buffers a build can configure
+STATIC_ASSERT(LFSSHIM_SD_CACHE_SIZE >= LFSSHIM_SD_SECTOR_SIZE,
+			  "LFSSHIM_SD_CACHE_SIZE must hold the sector geometry")
+STATIC_ASSERT(LFSSHIM_SD_LOOKAHEAD_SIZE >= 512,
+			  "LFSSHIM_SD_LOOKAHEAD_SIZE must hold the sector geometry")
+
+const lfsshim_sd_geometry_t lfsshim_sd_geometry_sector = LFSSHIM_SD_GEOMETRY_SECTOR;
+const lfsshim_sd_geometry_t lfsshim_sd_geometry_4k = LFSSHIM_SD_GEOMETRY_4K;
+const lfsshim_sd_geometry_t lfsshim_sd_geometry_4k_large_card = LFSSHIM_SD_GEOMETRY_4K_LARGE_CARD;
+
+#if LFSSHIM_SD_CHECKPOINT_SUPPORTED
+/**
+ * @brief Read one sector by card address, from the first healthy card
+ */
+static int lfsshim_sd_read_raw(lfsshim_sd_ctx_t *ctx, uint32_t sector, uint8_t *buffer) {
+	for (uint8_t i = 0; i < ctx->num_cards; i++) {
+		lfsshim_sd_card_t *card = &ctx->cards[i];
+		if (card->failed) {
+			continue;
+		}
+
+		HAL_StatusTypeDef hal = HAL_SD_ReadBlocks(card->hsd, buffer, sector, 1, SD_RW_TIMEOUT_MS);
+		if ((hal == HAL_OK) && (lfsshim_sd_wait_ready(&ctx->wait, card) == 0)) {
+			return 0;
+		}
+	}
+	return LFS_ERR_IO;
+}
+
+/**
+ * @brief Write one sector by card address to every healthy card and wait for it
+ */
+static int lfsshim_sd_write_raw(lfsshim_sd_ctx_t *ctx, uint32_t sector, const uint8_t *buffer) {
+	int err = lfsshim_sd_complete_writes(ctx);
+	if (err) {
+		return err;
+	}
+
+	for (uint8_t i = 0; i < ctx->num_cards; i++) {
+		lfsshim_sd_card_t *card = &ctx->cards[i];
+		if (card->failed) {
+			continue;
+		}
+
+		card->ready_notified = false;
+		HAL_StatusTypeDef hal =
+			HAL_SD_WriteBlocks(card->hsd, (uint8_t *)buffer, sector, 1, SD_RW_TIMEOUT_MS);
+		card->busy = true;
+		card->write_error = (hal != HAL_OK);
+		card->busy_timeout_ms = lfsshim_sd_write_timeout(ctx);
+	}
+
+	return lfsshim_sd_complete_writes(ctx);
+}
+
+/**
+ * @brief Identify the filesystem state by its superblock pair
+ *
+ * littlefs keeps the superblock in the root metadata pair, blocks 0 and 1. Their revision counts
+ * change whenever the pair is rewritten and every commit appended to it changes their content, so
+ * a filesystem modified without the checkpoint being invalidated no longer matches it.
+ */
+static int lfsshim_sd_superblock_generation(lfsshim_sd_ctx_t *ctx, uint8_t *scratch,
+											uint32_t revision[2], uint8_t *crc) {
+	int err = lfsshim_sd_complete_writes(ctx);
+	if (err) {
+		return err;
+	}
+
+	*crc = 0;
+	for (lfs_block_t block = 0; block < 2; block++) {
+		for (lfs_off_t off = 0; off < ctx->cfg.block_size; off += LFSSHIM_SD_SECTOR_SIZE) {
+			uint32_t sector = lfsshim_sd_sector(&ctx->cfg, block, off);
+			err = lfsshim_sd_read_sectors(ctx, sector, scratch, 1);
+			if (err) {
+				return err;
+			}
+			if (off == 0) {
+				memcpy(&revision[block], scratch, sizeof(uint32_t));
+			}
+			*crc = crc8_checksum(scratch, LFSSHIM_SD_SECTOR_SIZE, *crc);
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Hand a valid allocator checkpoint to littlefs after mount
+ *
+ * Leaves the allocator untouched if the checkpoint cannot be read, does not match the filesystem
+ * or cannot be invalidated, littlefs then scans for free blocks as usual.
+ */
+static void lfsshim_sd_load_checkpoint(lfsshim_sd_ctx_t *ctx, lfs_t *lfs, uint8_t *scratch) {
+	uint8_t *bitmap = (uint8_t *)ctx->lookahead_buffer;
+	lfsshim_sd_checkpoint_t header;
+	uint32_t revision[2];
+	uint8_t superblock_crc;
+
+	if (lfsshim_sd_read_raw(ctx, ctx->checkpoint_sector, scratch) != 0) {
+		return;
+	}
+	memcpy(&header, scratch, sizeof(header));
+
+	if ((header.magic != LFSSHIM_SD_CHECKPOINT_MAGIC) ||
+		(header.partition_offset != ctx->cards[0].first_block_offset) ||
+		(header.block_size != ctx->cfg.block_size) || (header.block_count != lfs->block_count) ||
+		(header.lookahead_size != ctx->cfg.lookahead_size) ||
+		(header.size > 8 * header.lookahead_size) || (header.next > header.size) ||
+		(header.start >= header.block_count)) {
+		return;
+	}
+
+	if ((lfsshim_sd_superblock_generation(ctx, scratch, revision, &superblock_crc) != 0) ||
+		(header.superblock_rev[0] != revision[0]) || (header.superblock_rev[1] != revision[1]) ||
+		(header.superblock_crc != superblock_crc)) {
+		return;
+	}
+
+	uint8_t crc =
+		crc8_checksum((const uint8_t *)&header, offsetof(lfsshim_sd_checkpoint_t, crc), 0);
+	for (uint32_t off = 0; off < header.lookahead_size; off += LFSSHIM_SD_SECTOR_SIZE) {
+		uint32_t n = header.lookahead_size - off;
+		if (n > LFSSHIM_SD_SECTOR_SIZE) {
+			n = LFSSHIM_SD_SECTOR_SIZE;
+		}
+		if (lfsshim_sd_read_raw(
+				ctx, ctx->checkpoint_sector + 1 + (off / LFSSHIM_SD_SECTOR_SIZE), scratch) != 0) {
+			return;
+		}
+		memcpy(&bitmap[off], scratch, n);
+		crc = crc8_checksum(scratch, n, crc);
+	}
+	if (crc != header.crc) {
+		return;
+	}
+
+	// The checkpoint is stale as soon as the filesystem allocates, it must never be used twice
+	memset(scratch, 0, LFSSHIM_SD_SECTOR_SIZE);
+	if (lfsshim_sd_write_raw(ctx, ctx->checkpoint_sector, scratch) != 0) {
+		return;
+	}
+
+	lfs->lookahead.start = header.start;
+	lfs->lookahead.size = header.size;
+	lfs->lookahead.next = header.next;
+	ctx->checkpoint_restored = true;
+}
+
+/**
+ * @brief Restore the allocator checkpoint after mount, or invalidate it if disabled
+ *
+ * A mount with the checkpoint disabled may modify the filesystem, its checkpoint area is cleared
+ * so a later mount with the checkpoint enabled does not restore a stale allocator.
+ */
+static void lfsshim_sd_restore_checkpoint(lfsshim_sd_ctx_t *ctx, lfs_t *lfs) {
+	// littlefs' prog cache is empty right after mount, it is used as the sector buffer and
+	// returned in the erased state littlefs keeps it in
+	uint8_t *scratch = ctx->prog_buffer;
+
+	if (ctx->checkpoint) {
+		lfsshim_sd_load_checkpoint(ctx, lfs, scratch);
+	} else if (ctx->checkpoint_sector != 0) {
+		memset(scratch, 0, LFSSHIM_SD_SECTOR_SIZE);
+		(void)lfsshim_sd_write_raw(ctx, ctx->checkpoint_sector, scratch);
+	}
+
+	memset(scratch, 0xff, ctx->cfg.cache_size);
+}
+#endif
+
+/**
+ * @brief Check that littlefs accepts a geometry and that it fits the buffers of a context
+ *
+ * littlefs requires the cache to divide the block and the lookahead to be whole bytes of 8 blocks.
+ */
+static bool lfsshim_sd_geometry_valid(const lfsshim_sd_geometry_t *geometry) {
+	return (geometry->block_size > 0) && ((geometry->block_size % LFSSHIM_SD_SECTOR_SIZE) == 0) &&
+		   (geometry->cache_size > 0) && ((geometry->cache_size % LFSSHIM_SD_SECTOR_SIZE) == 0) &&
+		   ((geometry->block_size % geometry->cache_size) == 0) &&
+		   (geometry->cache_size <= LFSSHIM_SD_CACHE_SIZE) && (geometry->lookahead_size > 0) &&
+		   ((geometry->lookahead_size % 8) == 0) &&
+		   (geometry->lookahead_size <= LFSSHIM_SD_LOOKAHEAD_SIZE);
+}
+
+/**
+ * @brief Set up the littlefs configuration of a context for its cards
+ *
+ * `ctx->cards` and `ctx->num_cards` must be filled in by the caller.
+ *
+ * @return w_status_t Returns W_INVALID_PARAM if the geometry does not fit the context's buffers
+ */
+static w_status_t lfsshim_sd_configure(lfsshim_sd_ctx_t *ctx) {
+	const lfsshim_sd_geometry_t *geometry =
+		ctx->geometry ? ctx->geometry : &lfsshim_sd_geometry_sector;
+	if (!lfsshim_sd_geometry_valid(geometry)) {
+		return W_INVALID_PARAM;
+	}
+
+	ctx->cfg = lfsshim_sd_cfg_template;
+	ctx->cfg.block_size = geometry->block_size;
+	ctx->cfg.cache_size = geometry->cache_size;
+	if ((ctx->flush_size > 0) && (ctx->flush_size <= LFSSHIM_SD_CACHE_SIZE) &&
+		((geometry->block_size % ctx->flush_size) == 0)) {
+		ctx->cfg.cache_size = ctx->flush_size;
+	}
+	ctx->cfg.lookahead_size = geometry->lookahead_size;
+	ctx->cfg.block_cycles = geometry->block_cycles;
+	ctx->cfg.context = ctx;
+	ctx->cfg.read_buffer = ctx->read_buffer;
+	ctx->cfg.prog_buffer = ctx->prog_buffer;
+	ctx->cfg.lookahead_buffer = ctx->lookahead_buffer;
+
+	ctx->erase.pending_count = 0;
+	ctx->erase.pre_erase_next = 0;
+	ctx->erase.pre_erase_end = 0;
+
+#if LFSSHIM_SD_READAHEAD_BLOCKS > 0
+	ctx->readahead.count = 0;
+	ctx->readahead.next = 0;
+	ctx->readahead.end = 0;
+#endif
+
+#if LFSSHIM_SD_STATS
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+	return W_SUCCESS;
+}
+
+/**
+ * @brief Set up the littlefs configuration of a context and mount it
+ *
+ * `ctx->cards` and `ctx->num_cards` must be filled in by the caller.
+ */
+static w_status_t lfsshim_sd_mount_ctx(lfsshim_sd_ctx_t *ctx, lfs_t *lfs) {
+	memset(lfs, 0, sizeof(lfs_t));
+	w_status_t status = lfsshim_sd_configure(ctx);
+	if (status != W_SUCCESS) {
+		return status;
+	}
+
+	if (lfs_mount(lfs, &ctx->cfg) != 0) {
+		return W_IO_ERROR;
+	}
+
+#if LFSSHIM_SD_READAHEAD_BLOCKS > 0
+	ctx->readahead.end = lfsshim_sd_sector(&ctx->cfg, lfs->block_count, 0);
+#endif
+
+	ctx->checkpoint_restored = false;
+#if LFSSHIM_SD_CHECKPOINT_SUPPORTED
+	lfsshim_sd_restore_checkpoint(ctx, lfs);
+#endif
+
+	return W_SUCCESS;
+}
+
+w_status_t lfsshim_sd_format(lfsshim_sd_ctx_t *ctx, lfs_t *lfs, lfs_size_t block_count) {
+	if (!ctx || !lfs || (ctx->num_cards == 0) || (block_count == 0)) {
+		return W_INVALID_PARAM;
+	}
+
 	memset(lfs, 0, sizeof(lfs_t));
+	w_status_t status = lfsshim_sd_configure(ctx);
+	if (status != W_SUCCESS) {
+		return status;
+	}
+
+	// Mounts take the block count from the superblock, only formatting needs it
+	ctx->cfg.block_count = block_count;
+#if LFSSHIM_SD_READAHEAD_BLOCKS > 0
+	ctx->readahead.end = lfsshim_sd_sector(&ctx->cfg, block_count, 0);
+#endif
+	int err = lfs_format(lfs, &ctx->cfg);
+	ctx->cfg.block_count = 0;
+	if (err != 0) {
+		return W_IO_ERROR;
+	}
+
+	return W_SUCCESS;
+}
+
+w_status_t lfsshim_sd_unmount(lfsshim_sd_ctx_t *ctx, lfs_t *lfs) {
+	if (!ctx || !lfs) {
+		return W_INVALID_PARAM;
+	}
+
+#if LFSSHIM_SD_CHECKPOINT_SUPPORTED
+	lfsshim_sd_checkpoint_t header;
+	memset(&header, 0, sizeof(header));
+	header.magic = LFSSHIM_SD_CHECKPOINT_MAGIC;
+	header.partition_offset = ctx->cards[0].first_block_offset;
+	header.block_size = ctx->cfg.block_size;
+	header.block_count = lfs->block_count;
+	header.lookahead_size = ctx->cfg.lookahead_size;
+	header.start = lfs->lookahead.start;
+	header.size = lfs->lookahead.size;
+	header.next = lfs->lookahead.next;
+#endif
+
+	if (lfs_unmount(lfs) != 0) {
+		return W_IO_ERROR;
+	}
+
+#if LFSSHIM_SD_CHECKPOINT_SUPPORTED
+	// Nothing worth saving if the lookahead window is used up
+	if (!ctx->checkpoint || (header.next >= header.size)) {
+		return W_SUCCESS;
+	}
 
-	lfsshim_sd_hsd = hsd;
-	lfsshim_sd_first_block_offset = first_block_offset;
+	// Bitmap first, header last, an interrupted unmount leaves no valid checkpoint behind
+	uint8_t *scratch = ctx->prog_buffer;
+	const uint8_t *bitmap = (const uint8_t *)ctx->lookahead_buffer;
+	if (lfsshim_sd_superblock_generation(
+			ctx, scratch, header.superblock_rev, &header.superblock_crc) != 0) {
+		return W_IO_ERROR;
+	}
+	uint8_t crc =
+		crc8_checksum((const uint8_t *)&header, offsetof(lfsshim_sd_checkpoint_t, crc), 0);
+	for (uint32_t off = 0; off < header.lookahead_size; off += LFSSHIM_SD_SECTOR_SIZE) {
+		uint32_t n = header.lookahead_size - off;
+		if (n > LFSSHIM_SD_SECTOR_SIZE) {
+			n = LFSSHIM_SD_SECTOR_SIZE;
+		}
+		memset(scratch, 0, LFSSHIM_SD_SECTOR_SIZE);
+		memcpy(scratch, &bitmap[off], n);
+		crc = crc8_checksum(scratch, n, crc);
+		if (lfsshim_sd_write_raw(
+				ctx, ctx->checkpoint_sector + 1 + (off / LFSSHIM_SD_SECTOR_SIZE), scratch) != 0) {
+			return W_IO_ERROR;
+		}
+	}
 
-	if (lfs_mount(lfs, &cfg) != 0) {
+	header.crc = crc;
+	memset(scratch, 0, LFSSHIM_SD_SECTOR_SIZE);
+	memcpy(scratch, &header, sizeof(header));
+	if (lfsshim_sd_write_raw(ctx, ctx->checkpoint_sector, scratch) != 0) {
 		return W_IO_ERROR;
 	}
+#endif
+
+	return W_SUCCESS;
+}
+
+w_status_t lfsshim_sd_mount(lfsshim_sd_ctx_t *ctx, lfs_t *lfs, SD_HandleTypeDef *hsd,
+							uint32_t first_block_offset) {
+	if (!ctx || !lfs || !hsd) {
+		return W_INVALID_PARAM;
+	}
+
+	memset(ctx->cards, 0, sizeof(ctx->cards));
+	ctx->cards[0].hsd = hsd;
+	ctx->cards[0].first_block_offset = first_block_offset;
+	ctx->num_cards = 1;
+
+	return lfsshim_sd_mount_ctx(ctx, lfs);
+}
+
+w_status_t lfsshim_sd_mount_mirrored(lfsshim_sd_ctx_t *ctx, lfs_t *lfs,
+									 SD_HandleTypeDef *hsd_primary, uint32_t primary_offset,
+									 SD_HandleTypeDef *hsd_secondary, uint32_t secondary_offset) {
+	if (!ctx || !lfs || !hsd_primary || !hsd_secondary || (hsd_primary == hsd_secondary)) {
+		return W_INVALID_PARAM;
+	}
+
+	memset(ctx->cards, 0, sizeof(ctx->cards));
+	ctx->cards[0].hsd = hsd_primary;
+	ctx->cards[0].first_block_offset = primary_offset;
+	ctx->cards[1].hsd = hsd_secondary;
+	ctx->cards[1].first_block_offset = secondary_offset;
+	ctx->num_cards = 2;
+
+	return lfsshim_sd_mount_ctx(ctx, lfs);
+}
+
+// Partition table reads through the HAL, keeping the last sector read
+typedef struct {
+	lfsshim_sd_card_t card;
+	uint64_t lba;
+	bool valid;
+	uint8_t sector[LFSSHIM_SD_SECTOR_SIZE];
+} lfsshim_sd_partition_reader_t;
+
+static w_status_t lfsshim_sd_partition_read(void *arg, uint64_t lba, uint16_t offset,
+											uint8_t *buffer, uint16_t size) {
+	static const lfsshim_sd_wait_config_t poll = {0};
+	lfsshim_sd_partition_reader_t *reader = (lfsshim_sd_partition_reader_t *)arg;
+
+	if (!reader->valid || (reader->lba != lba)) {
+		if (lba > UINT32_MAX) {
+			return W_IO_ERROR;
+		}
+		reader->valid = false;
+		HAL_StatusTypeDef hal = HAL_SD_ReadBlocks(
+			reader->card.hsd, reader->sector, (uint32_t)lba, 1, SD_RW_TIMEOUT_MS);
+		if ((hal != HAL_OK) || (lfsshim_sd_wait_ready(&poll, &reader->card) != 0)) {
+			return W_IO_ERROR;
+		}
+		reader->lba = lba;
+		reader->valid = true;
+	}
 
+	memcpy(buffer, &reader->sector[offset], size);
 	return W_SUCCESS;
 }
 
-w_status_t lfsshim_sd_mount_mbr(lfs_t *lfs, SD_HandleTypeDef *hsd) {
-	uint8_t mbr_sector[512];
+w_status_t lfsshim_sd_find_partition(SD_HandleTypeDef *hsd, uint32_t *first_block_offset) {
+	lfsshim_sd_partition_reader_t reader = {.card = {.hsd = hsd}};
+	partition_entry_t entries[LFSSHIM_SD_MAX_PARTITIONS];
+	uint8_t num_entries = 0;
+
+	if (!hsd || !first_block_offset) {
+		return W_INVALID_PARAM;
+	}
+
+	w_status_t status = partition_enumerate(
+		lfsshim_sd_partition_read, &reader, 0, entries, LFSSHIM_SD_MAX_PARTITIONS, &num_entries);
+	if (status == W_IO_ERROR) {
+		return W_IO_ERROR;
+	}
 
-	HAL_StatusTypeDef hal = HAL_SD_ReadBlocks(hsd, mbr_sector, 0, 1, 50U);
-	if (hal != HAL_OK) {
-		return W_FAILURE;
+	// On overflow the first entries are still valid, search them
+	for (uint8_t i = 0; i < num_entries; i++) {
+		if (partition_is_linux(&entries[i]) && (entries[i].start_lba <= UINT32_MAX)) {
+			*first_block_offset = (uint32_t)entries[i].start_lba;
+			return W_SUCCESS;
+		}
 	}
 
+	return W_FAILURE;
+}
+
+w_status_t lfsshim_sd_mount_mbr(lfsshim_sd_ctx_t *ctx, lfs_t *lfs, SD_HandleTypeDef *hsd) {
 	uint32_t first_block_offset = 0;
 	w_status_t status;
-	if ((status = mbr_parse(mbr_sector, 0x83, &first_block_offset)) != W_SUCCESS) {
+	if ((status = lfsshim_sd_find_partition(hsd, &first_block_offset)) != W_SUCCESS) {
 		return status;
 	}
 
-	if (lfsshim_sd_mount(lfs, hsd, first_block_offset) != 0) {
+	return lfsshim_sd_mount(ctx, lfs, hsd, first_block_offset);
+}
+
+w_status_t lfsshim_sd_set_wait_config(lfsshim_sd_ctx_t *ctx, const lfsshim_sd_wait_config_t *wait) {
+	if (!ctx || !wait) {
+		return W_INVALID_PARAM;
+	}
+
+	ctx->wait = *wait;
+	return W_SUCCESS;
+}
+
+void lfsshim_sd_notify_ready(lfsshim_sd_ctx_t *ctx, SD_HandleTypeDef *hsd) {
+	for (uint8_t i = 0; i < ctx->num_cards; i++) {
+		if (ctx->cards[i].hsd == hsd) {
+			ctx->cards[i].ready_notified = true;
+		}
+	}
+}
+
+w_status_t lfsshim_sd_set_geometry(lfsshim_sd_ctx_t *ctx, const lfsshim_sd_geometry_t *geometry) {
+	if (!ctx || !geometry || !lfsshim_sd_geometry_valid(geometry)) {
+		return W_INVALID_PARAM;
+	}
+
+	ctx->geometry = geometry;
+	return W_SUCCESS;
+}
+
+w_status_t lfsshim_sd_probe(lfsshim_sd_ctx_t *ctx, SD_HandleTypeDef *hsd, uint32_t scratch_sector,
+							uint32_t scratch_sectors, lfsshim_sd_probe_result_t *result) {
+	static const lfsshim_sd_wait_config_t poll = {0};
+	const uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+	const uint32_t max_sectors = LFSSHIM_SD_CACHE_SIZE / LFSSHIM_SD_SECTOR_SIZE;
+
+	if (!ctx || !hsd || !result || (scratch_sectors < max_sectors)) {
+		return W_INVALID_PARAM;
+	}
+
+	memset(result, 0, sizeof(*result));
+	memset(ctx->prog_buffer, 0x5a, sizeof(ctx->prog_buffer));
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	lfsshim_sd_card_t card = {.hsd = hsd};
+	uint32_t worst_us = 0;
+	uint32_t best_rate = 0;
+	uint32_t offset = 0;
+
+	for (uint32_t sectors = 1;
+		 (sectors <= max_sectors) && (result->num_sizes < LFSSHIM_SD_PROBE_MAX_SIZES);
+		 sectors *= 2) {
+		uint8_t i = result->num_sizes++;
+		uint64_t total_us = 0;
+		result->sectors[i] = sectors;
+
+		for (uint8_t n = 0; n < LFSSHIM_SD_PROBE_WRITES; n++) {
+			if (offset + sectors > scratch_sectors) {
+				offset = 0;
+			}
+
+			uint32_t start = DWT->CYCCNT;
+			HAL_StatusTypeDef hal = HAL_SD_WriteBlocks(
+				hsd, ctx->prog_buffer, scratch_sector + offset, sectors, SD_RW_TIMEOUT_MS);
+			card.busy = true;
+			card.busy_timeout_ms = SD_PROBE_MAX_TIMEOUT_MS;
+			if ((hal != HAL_OK) || (lfsshim_sd_wait_ready(&poll, &card) != 0)) {
+				return W_IO_ERROR;
+			}
+			uint32_t us = (DWT->CYCCNT - start) / cycles_per_us;
+
+			total_us += us;
+			if (us > result->max_us[i]) {
+				result->max_us[i] = us;
+			}
+			offset += sectors;
+		}
+
+		result->mean_us[i] = (uint32_t)(total_us / LFSSHIM_SD_PROBE_WRITES);
+		if (result->mean_us[i] > 0) {
+			// bytes per microsecond times 1000 is kB/s
+			result->kbytes_per_s[i] =
+				(sectors * LFSSHIM_SD_SECTOR_SIZE * 1000U) / result->mean_us[i];
+		}
+		if (result->kbytes_per_s[i] > best_rate) {
+			best_rate = result->kbytes_per_s[i];
+		}
+		if (result->max_us[i] > worst_us) {
+			worst_us = result->max_us[i];
+		}
+	}
+
+	// Larger flushes cost RAM and latency per flush, stop once most of the throughput is reached
+	for (uint8_t i = 0; i < result->num_sizes; i++) {
+		if (result->kbytes_per_s[i] * 10 >= best_rate * 9) {
+			result->flush_size = result->sectors[i] * LFSSHIM_SD_SECTOR_SIZE;
+			break;
+		}
+	}
+
+	uint32_t timeout_ms = (worst_us * 4 + 999) / 1000;
+	if (timeout_ms < SD_PROBE_MIN_TIMEOUT_MS) {
+		timeout_ms = SD_PROBE_MIN_TIMEOUT_MS;
+	}
+	if (timeout_ms > SD_PROBE_MAX_TIMEOUT_MS) {
+		timeout_ms = SD_PROBE_MAX_TIMEOUT_MS;
+	}
+	result->write_timeout_ms = timeout_ms;
+
+	return W_SUCCESS;
+}
+
+w_status_t lfsshim_sd_apply_probe(lfsshim_sd_ctx_t *ctx, const lfsshim_sd_probe_result_t *result) {
+	if (!ctx) {
+		return W_INVALID_PARAM;
+	}
+
+	if (result && (((result->flush_size % LFSSHIM_SD_SECTOR_SIZE) != 0) ||
+				   (result->flush_size > LFSSHIM_SD_CACHE_SIZE))) {
+		return W_INVALID_PARAM;
+	}
+
+	ctx->write_timeout_ms = result ? result->write_timeout_ms : 0;
+	ctx->flush_size = result ? result->flush_size : 0;
+	return W_SUCCESS;
+}
+
+w_status_t lfsshim_sd_set_checkpoint(lfsshim_sd_ctx_t *ctx, bool enable, uint32_t sector) {
+	if (!ctx) {
+		return W_INVALID_PARAM;
+	}
+
+#if LFSSHIM_SD_CHECKPOINT_SUPPORTED
+	ctx->checkpoint = enable;
+	ctx->checkpoint_sector = sector;
+	return W_SUCCESS;
+#else
+	(void)enable;
+	(void)sector;
+	return W_FAILURE;
+#endif
+}
+
+bool lfsshim_sd_checkpoint_restored(const lfsshim_sd_ctx_t *ctx) {
+	return ctx->checkpoint_restored;
+}
+
+w_status_t lfsshim_sd_set_discard(lfsshim_sd_ctx_t *ctx, bool enable) {
+	if (!ctx) {
+		return W_INVALID_PARAM;
+	}
+
+	ctx->erase.discard = enable;
+	return W_SUCCESS;
+}
+
+w_status_t lfsshim_sd_pre_erase_start(lfsshim_sd_ctx_t *ctx, lfs_block_t first_block,
+									  lfs_size_t block_count, uint32_t erase_unit_blocks) {
+	if (!ctx || (erase_unit_blocks == 0)) {
+		return W_INVALID_PARAM;
+	}
+
+	// Align on physical sector addresses of the primary card
+	uint32_t offset = ctx->cards[0].first_block_offset;
+	uint32_t start = lfsshim_sd_sector(&ctx->cfg, first_block, 0) + offset;
+	uint32_t end = lfsshim_sd_sector(&ctx->cfg, first_block + block_count, 0) + offset;
+	start = ((start + erase_unit_blocks - 1) / erase_unit_blocks) * erase_unit_blocks;
+	end = (end / erase_unit_blocks) * erase_unit_blocks;
+
+	if (end <= start) {
+		// region does not contain a whole erase unit
+		ctx->erase.pre_erase_next = 0;
+		ctx->erase.pre_erase_end = 0;
+		return W_SUCCESS;
+	}
+
+	ctx->erase.pre_erase_next = start - offset;
+	ctx->erase.pre_erase_end = end - offset;
+	ctx->erase.pre_erase_chunk = erase_unit_blocks * LFSSHIM_SD_PRE_ERASE_UNITS_PER_STEP;
+	return W_SUCCESS;
+}
+
+w_status_t lfsshim_sd_pre_erase_step(lfsshim_sd_ctx_t *ctx, bool *done) {
+	if (!ctx || !done) {
+		return W_INVALID_PARAM;
+	}
+
+	lfsshim_sd_erase_state_t *erase = &ctx->erase;
+	*done = false;
+
+	if (lfsshim_sd_cards_busy(ctx)) {
+		return W_SUCCESS; // previous erase or write still in progress
+	}
+	// Cards are idle, this only collects the result of the previous command
+	if (lfsshim_sd_complete_writes(ctx) != 0) {
 		return W_IO_ERROR;
 	}
+
+	if (erase->pre_erase_next >= erase->pre_erase_end) {
+		*done = true;
+		return W_SUCCESS;
+	}
+
+	uint32_t count = erase->pre_erase_end - erase->pre_erase_next;
+	if (count > erase->pre_erase_chunk) {
+		count = erase->pre_erase_chunk;
+	}
+	lfsshim_sd_issue_erase(ctx, erase->pre_erase_next, count);
+	erase->pre_erase_next += count;
 	return W_SUCCESS;
 }
+
+w_status_t lfsshim_sd_set_readahead(lfsshim_sd_ctx_t *ctx, bool enable) {
+	if (!ctx) {
+		return W_INVALID_PARAM;
+	}
+
+#if LFSSHIM_SD_READAHEAD_BLOCKS > 0
+	ctx->readahead.enabled = enable;
+	ctx->readahead.count = 0;
+	return W_SUCCESS;
+#else
+	(void)enable;
+	return W_FAILURE;
+#endif
+}
+
+#if LFSSHIM_SD_STATS
+w_status_t lfsshim_sd_get_stats(const lfsshim_sd_ctx_t *ctx, lfsshim_sd_stats_t *stats) {
+	if (!ctx || !stats) {
+		return W_INVALID_PARAM;
+	}
+
+	*stats = ctx->stats;
+	return W_SUCCESS;
+}
+
+w_status_t lfsshim_sd_reset_stats(lfsshim_sd_ctx_t *ctx) {
+	if (!ctx) {
+		return W_INVALID_PARAM;
+	}
+
+	memset(&ctx->stats, 0, sizeof(ctx->stats));
+	return W_SUCCESS;
+}
+#endif
+
+bool lfsshim_sd_is_degraded(const lfsshim_sd_ctx_t *ctx) {
+	for (uint8_t i = 0; i < ctx->num_cards; i++) {
+		if (ctx->cards[i].failed) {
+			return true;
+		}
+	}
+	return false;
+}
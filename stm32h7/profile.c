@@ -0,0 +1,19 @@
+#include <stdint.h>
+
+#include "common.h"
+#include "stm32h7xx_hal.h"
+
+void w_profile_counter_init(void) {
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->LAR = 0xC5ACCE55; // Unlock the DWT, required on the Cortex-M7
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+w_profile_count_t w_profile_counter(void) {
+	return DWT->CYCCNT;
+}
+
+uint32_t w_profile_counter_hz(void) {
+	return SystemCoreClock;
+}
@@ -0,0 +1,71 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "stm32/timebase.h"
+#include "stm32h7xx_hal.h"
+
+#define TIMEBASE_HZ 1000000UL
+
+// Overflows counted by the update interrupt, the upper 32 bits of the count
+static volatile uint32_t overflows = 0;
+// Overflows when the handler last cleared the update flag, differs from overflows while a
+// preempted handler has counted an overflow but not cleared its flag yet
+static volatile uint32_t acknowledged = 0;
+
+w_status_t timebase_init(uint32_t timer_clock_hz) {
+	uint32_t prescale = timer_clock_hz / TIMEBASE_HZ;
+	if ((prescale == 0) || (prescale > 0x10000) || (timer_clock_hz % TIMEBASE_HZ != 0)) {
+		return W_INVALID_PARAM;
+	}
+
+	TIMEBASE_TIM->CR1 = 0; // stopped, upcounting
+	TIMEBASE_TIM->DIER = 0;
+	TIMEBASE_TIM->PSC = prescale - 1;
+	TIMEBASE_TIM->ARR = 0xffffffff;
+	TIMEBASE_TIM->CNT = 0;
+	TIMEBASE_TIM->CR1 = TIM_CR1_URS; // only overflows raise the update flag
+	TIMEBASE_TIM->EGR = TIM_EGR_UG; // load the prescaler
+	TIMEBASE_TIM->SR = 0;
+
+	overflows = 0;
+	acknowledged = 0;
+	TIMEBASE_TIM->DIER = TIM_DIER_UIE;
+	TIMEBASE_TIM->CR1 = TIM_CR1_URS | TIM_CR1_CEN;
+	return W_SUCCESS;
+}
+
+void timebase_handle_interrupt(void) {
+	if (!(TIMEBASE_TIM->SR & TIM_SR_UIF)) {
+		return;
+	}
+
+	// Counted before the flag is cleared, timebase_us() tells the two steps apart
+	overflows = overflows + 1;
+	TIMEBASE_TIM->SR = (uint32_t)~TIM_SR_UIF;
+	acknowledged = overflows;
+}
+
+uint64_t timebase_us(void) {
+	uint32_t high;
+	uint32_t upper;
+	uint32_t count;
+	do {
+		high = overflows;
+		upper = high;
+		bool counted = (high != acknowledged);
+		count = TIMEBASE_TIM->CNT;
+		if (TIMEBASE_TIM->SR & TIM_SR_UIF) {
+			// The count read again is past the overflow
+			count = TIMEBASE_TIM->CNT;
+			if (!counted) {
+				upper++;
+			}
+		}
+	} while (high != overflows);
+	return ((uint64_t)upper << 32) | count;
+}
+
+uint32_t timebase_ms(void) {
+	return (uint32_t)(timebase_us() / 1000);
+}
@@ -0,0 +1,147 @@
+/**
+ * Writes an SD card image through the littlefs SD shim for the sdextract round trip test
+ *
+ * Usage: write_test_image geometry output_dir
+ *
+ * A simulated card gets an MBR with one Linux partition, which is formatted and filled through the
+ * shim with the given geometry profile. The card is saved as output_dir/card.img and every file is
+ * also written to output_dir/expected, which sdextract has to reproduce.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "crc8.h"
+#include "lfs.h"
+#include "sd_card_sim.hpp"
+#include "stm32/littlefs_sd_shim.h"
+
+#define CARD_BLOCKS 32768
+#define PARTITION_OFFSET 2048
+#define RECORD_SIZE 32
+
+namespace fs = std::filesystem;
+
+static void put_partition(sd_card_sim &card) {
+	std::uint8_t *entry = card.block(0) + 0x1BE;
+	entry[4] = 0x83;
+	std::uint32_t lba = PARTITION_OFFSET;
+	std::uint32_t size = CARD_BLOCKS - PARTITION_OFFSET;
+	std::memcpy(entry + 8, &lba, sizeof(lba));
+	std::memcpy(entry + 12, &size, sizeof(size));
+	card.block(0)[0x1FE] = 0x55;
+	card.block(0)[0x1FF] = 0xAA;
+}
+
+// Records like the ones of a flight log, the last one cut short by extra_bytes < RECORD_SIZE
+static std::vector<std::uint8_t> make_records(std::uint32_t count, std::uint32_t extra_bytes,
+											  std::uint32_t seed) {
+	std::vector<std::uint8_t> data;
+	std::uint32_t state = seed;
+	for (std::uint32_t i = 0; i <= count; i++) {
+		std::uint8_t record[RECORD_SIZE];
+		for (std::uint32_t j = 0; j < RECORD_SIZE - 1; j++) {
+			state = state * 1103515245u + 12345u;
+			record[j] = static_cast<std::uint8_t>(state >> 16);
+		}
+		record[RECORD_SIZE - 1] = crc8_checksum(record, RECORD_SIZE - 1, 0);
+		std::uint32_t len = (i < count) ? RECORD_SIZE : extra_bytes;
+		data.insert(data.end(), record, record + len);
+	}
+	return data;
+}
+
+static bool write_file(lfs_t *lfs, const fs::path &expected, const char *path,
+					   const std::vector<std::uint8_t> &data) {
+	lfs_file_t file;
+	if (lfs_file_open(lfs, &file, path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) < 0) {
+		return false;
+	}
+	// Written in chunks like a logger appending records
+	bool ok = true;
+	for (std::size_t off = 0; ok && (off < data.size()); off += 1000) {
+		std::size_t len = std::min<std::size_t>(1000, data.size() - off);
+		ok = lfs_file_write(lfs, &file, data.data() + off, len) == static_cast<lfs_ssize_t>(len);
+	}
+	ok = (lfs_file_close(lfs, &file) == 0) && ok;
+
+	std::ofstream out(expected / (path + 1), std::ios::binary);
+	out.write(reinterpret_cast<const char *>(data.data()),
+			  static_cast<std::streamsize>(data.size()));
+	return ok && out.good();
+}
+
+static bool make_dir(lfs_t *lfs, const fs::path &expected, const char *path) {
+	fs::create_directories(expected / (path + 1));
+	return lfs_mkdir(lfs, path) == 0;
+}
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::fprintf(stderr, "usage: %s geometry output_dir\n", argv[0]);
+		return 2;
+	}
+
+	const lfsshim_sd_geometry_t *geometries[] = {
+		&lfsshim_sd_geometry_sector, &lfsshim_sd_geometry_4k, &lfsshim_sd_geometry_4k_large_card};
+	const lfsshim_sd_geometry_t *geometry = nullptr;
+	for (const lfsshim_sd_geometry_t *g : geometries) {
+		if (std::strcmp(g->name, argv[1]) == 0) {
+			geometry = g;
+		}
+	}
+	if (!geometry) {
+		std::fprintf(stderr, "unknown geometry %s\n", argv[1]);
+		return 2;
+	}
+
+	fs::path out_dir(argv[2]);
+	fs::path expected = out_dir / "expected";
+	fs::remove_all(expected);
+	fs::create_directories(expected);
+
+	sd_card_sim card(CARD_BLOCKS);
+	put_partition(card);
+
+	static lfsshim_sd_ctx_t ctx;
+	lfs_t lfs;
+	lfs_size_t block_count =
+		(CARD_BLOCKS - PARTITION_OFFSET) / (geometry->block_size / LFSSHIM_SD_SECTOR_SIZE);
+	if ((lfsshim_sd_set_geometry(&ctx, geometry) != W_SUCCESS) ||
+		(lfsshim_sd_mount_mbr(&ctx, &lfs, card.handle()) != W_IO_ERROR) ||
+		(lfsshim_sd_format(&ctx, &lfs, block_count) != W_SUCCESS) ||
+		(lfsshim_sd_mount_mbr(&ctx, &lfs, card.handle()) != W_SUCCESS)) {
+		std::fprintf(stderr, "cannot format the card with the %s geometry\n", geometry->name);
+		return 1;
+	}
+
+	bool ok = make_dir(&lfs, expected, "/flight") && make_dir(&lfs, expected, "/flight/sensors") &&
+			  make_dir(&lfs, expected, "/empty") &&
+			  write_file(&lfs, expected, "/flight/log.bin", make_records(4000, 0, 1)) &&
+			  write_file(&lfs, expected, "/flight/sensors/imu.bin", make_records(20000, 0, 2)) &&
+			  write_file(&lfs, expected, "/flight/sensors/baro.bin", make_records(300, 7, 3)) &&
+			  write_file(&lfs, expected, "/config.txt", {'r', 'a', 't', 'e', '=', '1', '0', '0'}) &&
+			  write_file(&lfs, expected, "/flight/empty.bin", {});
+	if (!ok || (lfsshim_sd_unmount(&ctx, &lfs) != W_SUCCESS)) {
+		std::fprintf(stderr, "cannot write the test files\n");
+		return 1;
+	}
+
+	std::ofstream image(out_dir / "card.img", std::ios::binary);
+	image.write(reinterpret_cast<const char *>(card.data.data()),
+				static_cast<std::streamsize>(card.data.size()));
+	if (!image.good()) {
+		std::fprintf(stderr, "cannot write the image\n");
+		return 1;
+	}
+
+	std::printf("wrote %u sector image with the %s geometry\n", CARD_BLOCKS, geometry->name);
+	return 0;
+}
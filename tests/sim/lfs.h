@@ -0,0 +1,84 @@
+/**
+ * @file
+ * @brief Host stand-in for the littlefs public header
+ *
+ * Declares the subset of the littlefs API used by the SD shim so the shim can be compiled into the
+ * unit test binary. The functions are implemented in lfs_sim.cpp.
+ */
+
+#ifndef ROCKETLIB_SIM_LFS_H
+#define ROCKETLIB_SIM_LFS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LFS_VERSION 0x0002000a
+
+typedef uint32_t lfs_size_t;
+typedef uint32_t lfs_off_t;
+typedef int32_t lfs_ssize_t;
+typedef int32_t lfs_soff_t;
+typedef uint32_t lfs_block_t;
+
+enum lfs_error {
+	LFS_ERR_OK = 0,
+	LFS_ERR_IO = -5,
+	LFS_ERR_CORRUPT = -84,
+	LFS_ERR_NOENT = -2,
+	LFS_ERR_INVAL = -22,
+	LFS_ERR_NOSPC = -28
+};
+
+struct lfs_config {
+	void *context;
+	int (*read)(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer,
+				lfs_size_t size);
+	int (*prog)(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer,
+				lfs_size_t size);
+	int (*erase)(const struct lfs_config *c, lfs_block_t block);
+	int (*sync)(const struct lfs_config *c);
+	lfs_size_t read_size;
+	lfs_size_t prog_size;
+	lfs_size_t block_size;
+	lfs_size_t block_count;
+	int32_t block_cycles;
+	lfs_size_t cache_size;
+	lfs_size_t lookahead_size;
+	lfs_size_t compact_thresh;
+	void *read_buffer;
+	void *prog_buffer;
+	void *lookahead_buffer;
+	lfs_size_t name_max;
+	lfs_size_t file_max;
+	lfs_size_t attr_max;
+	lfs_size_t metadata_max;
+	lfs_size_t inline_max;
+};
+
+// Allocator state as in littlefs 2.9 and newer
+typedef struct lfs {
+	const struct lfs_config *cfg;
+	lfs_size_t block_count;
+	uint32_t seed;
+
+	struct lfs_lookahead {
+		lfs_block_t start;
+		lfs_block_t size;
+		lfs_block_t next;
+		lfs_block_t ckpoint;
+		uint8_t *buffer;
+	} lookahead;
+} lfs_t;
+
+int lfs_format(lfs_t *lfs, const struct lfs_config *config);
+int lfs_mount(lfs_t *lfs, const struct lfs_config *config);
+int lfs_unmount(lfs_t *lfs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
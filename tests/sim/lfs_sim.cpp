@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "lfs.h"
+#include "lfs_sim.hpp"
+
+// Minimal littlefs stand-in: mount reads the superblock pair through the block device callbacks,
+// so the SD shim is exercised the same way littlefs starts up, but no filesystem is interpreted.
+
+lfs_size_t lfs_sim::superblock_block_count = 0;
+std::vector<lfs_block_t> lfs_sim::used_blocks;
+
+extern "C" int lfs_format(lfs_t *lfs, const struct lfs_config *config) {
+	if (config->block_count == 0) {
+		return LFS_ERR_INVAL;
+	}
+	lfs->cfg = config;
+
+	// Write the superblock pair, the magic sits at the same offset as in littlefs
+	std::uint8_t *buffer = static_cast<std::uint8_t *>(config->prog_buffer);
+	std::memset(buffer, 0xff, config->prog_size);
+	std::memcpy(&buffer[lfs_sim::superblock_magic_offset], "littlefs", 8);
+	for (lfs_block_t block = 0; block < 2; block++) {
+		int err = config->erase(config, block);
+		if (!err) {
+			err = config->prog(config, block, 0, buffer, config->prog_size);
+		}
+		if (err) {
+			return err;
+		}
+	}
+	std::memset(buffer, 0xff, config->prog_size);
+
+	lfs_sim::superblock_block_count = config->block_count;
+	lfs->cfg = nullptr;
+	return config->sync(config);
+}
+
+extern "C" int lfs_mount(lfs_t *lfs, const struct lfs_config *config) {
+	lfs->cfg = config;
+	lfs->block_count = config->block_count ? config->block_count : lfs_sim::superblock_block_count;
+
+	for (lfs_block_t block = 0; block < 2; block++) {
+		int err = config->read(config, block, 0, config->read_buffer, config->read_size);
+		if (err) {
+			return err;
+		}
+	}
+
+	// Like littlefs, start allocating at a pseudo random block with an empty lookahead window
+	lfs->seed = 0x1234;
+	lfs->lookahead.buffer = static_cast<uint8_t *>(config->lookahead_buffer);
+	lfs->lookahead.start = lfs->block_count ? lfs->seed % lfs->block_count : 0;
+	lfs->lookahead.size = 0;
+	lfs->lookahead.next = 0;
+	lfs->lookahead.ckpoint = lfs->block_count;
+	return LFS_ERR_OK;
+}
+
+extern "C" int lfs_unmount(lfs_t *lfs) {
+	lfs->cfg = nullptr;
+	return LFS_ERR_OK;
+}
+
+// Fill the lookahead window by traversing the filesystem
+static int scan(lfs_t *lfs) {
+	const struct lfs_config *cfg = lfs->cfg;
+
+	lfs->lookahead.start = (lfs->lookahead.start + lfs->lookahead.next) % lfs->block_count;
+	lfs->lookahead.next = 0;
+	lfs->lookahead.size = std::min(static_cast<lfs_block_t>(8 * cfg->lookahead_size),
+								   static_cast<lfs_block_t>(lfs->lookahead.ckpoint));
+	std::memset(lfs->lookahead.buffer, 0, cfg->lookahead_size);
+
+	for (lfs_block_t block : lfs_sim::used_blocks) {
+		int err = cfg->read(cfg, block, 0, cfg->read_buffer, cfg->read_size);
+		if (err) {
+			return err;
+		}
+
+		lfs_block_t off = (block + lfs->block_count - lfs->lookahead.start) % lfs->block_count;
+		if (off < lfs->lookahead.size) {
+			lfs->lookahead.buffer[off / 8] |= static_cast<uint8_t>(1U << (off % 8));
+		}
+	}
+	return LFS_ERR_OK;
+}
+
+int lfs_sim::alloc(lfs_t *lfs, lfs_block_t *block) {
+	while (true) {
+		while (lfs->lookahead.next < lfs->lookahead.size) {
+			lfs_block_t off = lfs->lookahead.next++;
+			if (!(lfs->lookahead.buffer[off / 8] & (1U << (off % 8)))) {
+				*block = (lfs->lookahead.start + off) % lfs->block_count;
+				lfs->lookahead.ckpoint--;
+				return LFS_ERR_OK;
+			}
+		}
+
+		if (lfs->lookahead.ckpoint == 0) {
+			return LFS_ERR_NOSPC;
+		}
+
+		int err = scan(lfs);
+		if (err) {
+			return err;
+		}
+	}
+}
@@ -0,0 +1,29 @@
+#ifndef ROCKETLIB_SIM_LFS_SIM_HPP
+#define ROCKETLIB_SIM_LFS_SIM_HPP
+
+#include <vector>
+
+#include "lfs.h"
+
+/**
+ * Test controls of the littlefs stand-in
+ *
+ * The stand-in models the littlefs block allocator: when the lookahead window is used up, the
+ * next allocation traverses the filesystem, which reads every block in use through the block
+ * device, and fills the lookahead bitmap.
+ */
+namespace lfs_sim {
+	// Offset of the "littlefs" magic in the superblocks written by lfs_format()
+	constexpr lfs_off_t superblock_magic_offset = 8;
+
+	// Block count stored in the superblock, used when the configuration leaves it at 0, set by
+	// lfs_format()
+	extern lfs_size_t superblock_block_count;
+	// Blocks in use by the filesystem, found by the traversal
+	extern std::vector<lfs_block_t> used_blocks;
+
+	// Allocate a block like lfs_alloc()
+	int alloc(lfs_t *lfs, lfs_block_t *block);
+} // namespace lfs_sim
+
+#endif
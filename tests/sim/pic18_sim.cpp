@@ -0,0 +1,1217 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "pic18_sim.hpp"
+#include "xc.h"
+
+// Register level PIC18F26K83 model. Register storage is shared with the firmware through
+// pic18_sim_access(), a shadow copy detects what the firmware wrote since the previous access.
+
+namespace {
+
+constexpr std::uint64_t never = UINT64_MAX;
+constexpr std::uint32_t hfintosc_hz = 64000000;
+constexpr std::uint32_t mfintosc_hz = 500000;
+constexpr std::uint32_t lfintosc_hz = 31000;
+constexpr std::uint32_t sosc_hz = 32768;
+
+constexpr std::uint8_t INTCON0_GIE = 0x80;
+
+constexpr std::uint8_t PIR3_I2C1RXIF = 0x01;
+constexpr std::uint8_t PIR3_I2C1TXIF = 0x02;
+constexpr std::uint8_t PIR3_I2C1IF = 0x04;
+constexpr std::uint8_t PIR3_I2C1EIF = 0x08;
+constexpr std::uint8_t PIR3_I2C1_FLAGS = 0x0f;
+constexpr std::uint8_t PIR3_TMR0IF = 0x80;
+constexpr std::uint8_t PIR4_TMR2IF = 0x02;
+
+constexpr std::uint8_t CLKRCON_EN = 0x80;
+constexpr std::uint8_t CLKRCON_DIV = 0x07;
+
+constexpr std::uint8_t CON0_EN = 0x80;
+constexpr std::uint8_t CON0_RSEN = 0x40;
+constexpr std::uint8_t CON0_S = 0x20;
+constexpr std::uint8_t CON0_CSTR = 0x10;
+constexpr std::uint8_t CON0_MDR = 0x08;
+constexpr std::uint8_t CON0_MODE = 0x07;
+constexpr std::uint8_t CON0_MODE_HOST_7BIT = 0x04;
+
+constexpr std::uint8_t CON1_ACKCNT = 0x80;
+constexpr std::uint8_t CON1_ACKDT = 0x40;
+constexpr std::uint8_t CON1_ACKSTAT = 0x20;
+
+constexpr std::uint8_t CON2_FME = 0x20;
+
+constexpr std::uint8_t ERR_NACKIF = 0x10;
+constexpr std::uint8_t ERR_BCLIF = 0x20;
+constexpr std::uint8_t ERR_FLAGS = 0x70;
+
+constexpr std::uint8_t STAT0_BFRE = 0x80;
+constexpr std::uint8_t STAT0_MMA = 0x20;
+constexpr std::uint8_t STAT0_R = 0x10;
+
+constexpr std::uint8_t STAT1_TXBE = 0x20;
+constexpr std::uint8_t STAT1_CLRBF = 0x04;
+constexpr std::uint8_t STAT1_RXBF = 0x01;
+
+constexpr std::uint8_t PIR_CNTIF = 0x80;
+constexpr std::uint8_t PIR_PCIF = 0x04;
+constexpr std::uint8_t PIR_RSCIF = 0x02;
+constexpr std::uint8_t PIR_SCIF = 0x01;
+
+constexpr std::uint8_t PORTC_SCL = 0x08;
+constexpr std::uint8_t PORTC_SDA = 0x10;
+
+constexpr std::uint8_t T1CON_ON = 0x01;
+constexpr std::uint8_t T1CON_CKPS_SHIFT = 4;
+constexpr std::uint8_t T1CLK_FOSC4 = 0x01;
+
+constexpr std::uint8_t T0CON0_EN = 0x80;
+constexpr std::uint8_t T0CON0_MD16 = 0x10;
+constexpr std::uint8_t T0CON0_OUTPS = 0x0f;
+constexpr std::uint8_t T0CON1_CS_SHIFT = 5;
+constexpr std::uint8_t T0CON1_CKPS = 0x0f;
+
+constexpr std::uint8_t T2CON_ON = 0x80;
+constexpr std::uint8_t T2CON_CKPS_SHIFT = 4;
+constexpr std::uint8_t T2CON_OUTPS = 0x0f;
+
+constexpr std::uint8_t CCPCON_EN = 0x80;
+constexpr std::uint8_t CCPCON_FMT = 0x10;
+constexpr std::uint8_t CCPCON_MODE = 0x0f;
+constexpr std::uint8_t CCPCON_MODE_PWM = 0x0c;
+constexpr int num_ccps = 4;
+
+constexpr std::uint8_t PRLOCK_UNLOCK1 = 0x55;
+constexpr std::uint8_t PRLOCK_UNLOCK2 = 0xaa;
+constexpr std::uint8_t PRLOCK_PRLOCKED = 0x01;
+
+constexpr std::uint8_t DMACON0_EN = 0x80;
+constexpr std::uint8_t DMACON0_SIRQEN = 0x40;
+constexpr std::uint8_t DMACON1_DMODE_SHIFT = 6;
+constexpr std::uint8_t DMACON1_DSTP = 0x20;
+constexpr std::uint8_t DMACON1_SMODE_SHIFT = 1;
+constexpr std::uint8_t DMACON1_SSTP = 0x01;
+// Bus cycles the DMA takes from the CPU per byte, one read and one write
+constexpr std::uint32_t dma_byte_cycles = 2;
+// Interrupt request numbers of the PIR3 flags, the register index times 8 plus the bit
+constexpr std::uint8_t irq_pir3_base = 0x18;
+
+enum class i2c_state { idle, start, addr, tx, tx_wait, rx, rx_wait, restart_wait, restart, stop };
+
+struct i2c_model {
+	i2c_state state = i2c_state::idle;
+	std::uint64_t next_event = never;
+	std::uint8_t shift = 0;
+	bool read = false;
+	pic18_sim_i2c_device *target = nullptr;
+	std::uint32_t starts = 0;
+	std::uint32_t restarts = 0;
+	std::uint32_t stops = 0;
+	std::uint32_t bytes = 0;
+};
+
+struct bus_lines_model {
+	bool scl = true;
+	bool sda = true;
+	std::uint32_t scl_pulses = 0;
+	std::uint32_t stops = 0;
+};
+
+struct timer1_model {
+	std::uint64_t base_cycles = 0;
+	std::uint16_t base_value = 0;
+	bool running = false;
+	std::uint8_t prescale_shift = 0;
+};
+
+// Counter clocked through a 1:prescale prescaler, wrapping after `period` counts. Every wrap is a
+// period match, the postscaler turns every `postscale` matches into an interrupt flag.
+struct counter_model {
+	std::uint64_t clk_hz = 0; // Stopped at 0
+	std::uint64_t prescale = 1;
+	std::uint32_t period = 256;
+	std::uint32_t postscale = 1;
+	std::uint32_t postscale_count = 0;
+	std::uint64_t anchor = 0; // Cycle the count was last set
+	std::uint32_t start = 0; // Count at the anchor
+	std::uint64_t matches = 0; // Period matches since the anchor
+	std::uint64_t next_event = never;
+	std::uint32_t flags = 0; // Interrupt flags raised since reset
+};
+
+struct dma_model {
+	std::uint8_t unlock = 0;
+	bool locked = false;
+	std::uint64_t cycles = 0;
+	std::uint32_t bytes = 0;
+};
+
+std::uint64_t slots[PIC18_SIM_NUM_REGS];
+std::uint64_t shadow[PIC18_SIM_NUM_REGS];
+// Data register accessed by the firmware, its read or write is committed at the next access
+pic18_sim_reg_t pending_access = PIC18_SIM_NUM_REGS;
+
+std::uint32_t fosc = pic18_sim::default_fosc_hz;
+std::uint64_t now = 0;
+void (*isr)(void) = nullptr;
+bool inside_isr = false;
+std::uint64_t isr_cycle_count = 0;
+std::uint32_t isr_calls = 0;
+
+i2c_model i2c;
+bus_lines_model lines;
+timer1_model timer1;
+counter_model timer0;
+counter_model timer2;
+std::uint16_t ccp_duty[num_ccps];
+std::function<void(const std::array<std::uint16_t, 4> &)> pwm_period_hook;
+dma_model dma;
+std::vector<pic18_sim_i2c_device *> devices;
+
+std::uint8_t get(pic18_sim_reg_t r) {
+	return static_cast<std::uint8_t>(slots[r]);
+}
+
+// Hardware side register update, not seen as a firmware write
+void set(pic18_sim_reg_t r, std::uint8_t value) {
+	slots[r] = (slots[r] & ~static_cast<std::uint64_t>(0xff)) | value;
+	shadow[r] = slots[r];
+}
+
+void set_bits(pic18_sim_reg_t r, std::uint8_t mask, bool on) {
+	set(r, on ? (get(r) | mask) : (get(r) & static_cast<std::uint8_t>(~mask)));
+}
+
+bool has(pic18_sim_reg_t r, std::uint8_t mask) {
+	return (get(r) & mask) != 0;
+}
+
+void step_to(std::uint64_t target);
+void dispatch();
+
+// I2C1
+
+std::uint32_t clkref_hz() {
+	if (!has(PIC18_SIM_CLKRCON, CLKRCON_EN)) {
+		return 0;
+	}
+
+	std::uint32_t src;
+	switch (get(PIC18_SIM_CLKRCLK) & 0x0f) {
+		case 0:
+			src = fosc;
+			break;
+		case 1:
+			src = hfintosc_hz;
+			break;
+		case 2:
+			src = lfintosc_hz;
+			break;
+		case 3:
+			src = mfintosc_hz;
+			break;
+		default:
+			return 0;
+	}
+	return src >> (get(PIC18_SIM_CLKRCON) & CLKRCON_DIV);
+}
+
+std::uint32_t i2c_clock_hz() {
+	switch (get(PIC18_SIM_I2C1CLK) & 0x0f) {
+		case 0:
+			return fosc / 4;
+		case 1:
+			return fosc;
+		case 2:
+			return hfintosc_hz;
+		case 3:
+			return mfintosc_hz;
+		case 4:
+			return clkref_hz();
+		default:
+			return 0;
+	}
+}
+
+// Bus lines driven through the port while the I2C1 outputs are unmapped, e.g. for bus recovery
+bool port_drives_low(std::uint8_t mask, pic18_sim_reg_t pps) {
+	return (get(pps) == 0) && !has(PIC18_SIM_TRISC, mask) && !has(PIC18_SIM_LATC, mask);
+}
+
+bool target_holds_sda() {
+	return std::any_of(devices.begin(), devices.end(), [](pic18_sim_i2c_device *d) {
+		return d->hold_sda_clocks > 0;
+	});
+}
+
+bool i2c_bus_free() {
+	return lines.scl && lines.sda;
+}
+
+void update_lines() {
+	bool scl = !port_drives_low(PORTC_SCL, PIC18_SIM_RC3PPS);
+	if (scl && !lines.scl) {
+		lines.scl_pulses++;
+	} else if (!scl && lines.scl) {
+		// Targets shift their data while SCL is low
+		for (pic18_sim_i2c_device *d : devices) {
+			if (d->hold_sda_clocks > 0) {
+				d->hold_sda_clocks--;
+			}
+		}
+	}
+	lines.scl = scl;
+
+	bool sda = !port_drives_low(PORTC_SDA, PIC18_SIM_RC4PPS) && !target_holds_sda();
+	if (sda && !lines.sda && lines.scl) {
+		lines.stops++;
+	}
+	lines.sda = sda;
+
+	std::uint8_t portc = get(PIC18_SIM_PORTC) & static_cast<std::uint8_t>(~(PORTC_SCL | PORTC_SDA));
+	set(PIC18_SIM_PORTC, portc | (lines.scl ? PORTC_SCL : 0) | (lines.sda ? PORTC_SDA : 0));
+}
+
+std::uint64_t i2c_bit_cycles() {
+	double scl = pic18_sim::i2c_scl_hz();
+	if (scl <= 0) {
+		return never / 1024;
+	}
+	return static_cast<std::uint64_t>(std::llround(fosc / 4.0 / scl));
+}
+
+void i2c_schedule(std::uint32_t bits, std::uint32_t stretch_us = 0) {
+	i2c.next_event = now + bits * i2c_bit_cycles() + pic18_sim::cycles_from_us(stretch_us);
+}
+
+void i2c_begin_stop() {
+	i2c.state = i2c_state::stop;
+	i2c_schedule(1);
+}
+
+void i2c_end_of_count() {
+	set_bits(PIC18_SIM_I2C1PIR, PIR_CNTIF, true);
+	if (has(PIC18_SIM_I2C1CON0, CON0_RSEN)) {
+		// Hold the clock low until the firmware sets S for the repeated start
+		i2c.state = i2c_state::restart_wait;
+		i2c.next_event = never;
+		set_bits(PIC18_SIM_I2C1CON0, CON0_MDR, true);
+	} else {
+		i2c_begin_stop();
+	}
+}
+
+void i2c_begin_tx() {
+	if (has(PIC18_SIM_I2C1STAT1, STAT1_TXBE)) {
+		i2c.state = i2c_state::tx_wait;
+		i2c.next_event = never;
+		set_bits(PIC18_SIM_I2C1CON0, CON0_CSTR, true);
+		return;
+	}
+
+	i2c.shift = get(PIC18_SIM_I2C1TXB);
+	set_bits(PIC18_SIM_I2C1STAT1, STAT1_TXBE, true);
+	set(PIC18_SIM_I2C1CNT, get(PIC18_SIM_I2C1CNT) - 1);
+	i2c.state = i2c_state::tx;
+	i2c_schedule(9, i2c.target->stretch_us);
+}
+
+void i2c_begin_rx() {
+	i2c.shift = i2c.target->read();
+	i2c.target->bytes_read++;
+	i2c.state = i2c_state::rx;
+	i2c_schedule(9, i2c.target->stretch_us);
+}
+
+void i2c_continue() {
+	if (get(PIC18_SIM_I2C1CNT) == 0) {
+		i2c_end_of_count();
+	} else if (i2c.read) {
+		i2c_begin_rx();
+	} else {
+		i2c_begin_tx();
+	}
+}
+
+void i2c_deliver_rx() {
+	set(PIC18_SIM_I2C1RXB, i2c.shift);
+	set_bits(PIC18_SIM_I2C1STAT1, STAT1_RXBF, true);
+	set(PIC18_SIM_I2C1CNT, get(PIC18_SIM_I2C1CNT) - 1);
+	i2c.bytes++;
+	i2c_continue();
+}
+
+void i2c_nack() {
+	set_bits(PIC18_SIM_I2C1CON1, CON1_ACKSTAT, true);
+	set_bits(PIC18_SIM_I2C1ERR, ERR_NACKIF, true);
+	i2c_begin_stop();
+}
+
+void i2c_event() {
+	switch (i2c.state) {
+		case i2c_state::start:
+		case i2c_state::restart: {
+			set_bits(PIC18_SIM_I2C1CON0, CON0_S, false);
+			std::uint8_t flag = (i2c.state == i2c_state::start) ? PIR_SCIF : PIR_RSCIF;
+			set_bits(PIC18_SIM_I2C1PIR, flag, true);
+			i2c.shift = get(PIC18_SIM_I2C1ADB1);
+			i2c.read = (i2c.shift & 1) != 0;
+			set_bits(PIC18_SIM_I2C1STAT0, STAT0_R, i2c.read);
+			i2c.state = i2c_state::addr;
+			i2c_schedule(9);
+			break;
+		}
+		case i2c_state::addr: {
+			std::uint8_t address = i2c.shift >> 1;
+			auto it = std::find_if(devices.begin(), devices.end(), [&](pic18_sim_i2c_device *d) {
+				return d->address == address;
+			});
+			i2c.target = (it != devices.end()) ? *it : nullptr;
+			if (i2c.target && i2c.target->collide_address) {
+				// Another controller wins the arbitration, the module drops off the bus
+				i2c.target = nullptr;
+				set_bits(PIC18_SIM_I2C1ERR, ERR_BCLIF, true);
+				set_bits(PIC18_SIM_I2C1STAT0, STAT0_BFRE, true);
+				set_bits(PIC18_SIM_I2C1STAT0, STAT0_MMA, false);
+				set_bits(PIC18_SIM_I2C1CON0, CON0_MDR | CON0_CSTR, false);
+				i2c.state = i2c_state::idle;
+				i2c.next_event = never;
+				break;
+			}
+			if (!i2c.target || i2c.target->nack_address || !i2c.target->start(i2c.read)) {
+				i2c.target = nullptr;
+				i2c_nack();
+				break;
+			}
+			set_bits(PIC18_SIM_I2C1CON1, CON1_ACKSTAT, false);
+			i2c_continue();
+			break;
+		}
+		case i2c_state::tx:
+			i2c.bytes++;
+			i2c.target->bytes_written++;
+			if (!i2c.target->write(i2c.shift)) {
+				i2c_nack();
+				break;
+			}
+			set_bits(PIC18_SIM_I2C1CON1, CON1_ACKSTAT, false);
+			i2c_continue();
+			break;
+		case i2c_state::rx:
+			// The next byte cannot be acknowledged while the previous one is not read
+			if (has(PIC18_SIM_I2C1STAT1, STAT1_RXBF)) {
+				i2c.state = i2c_state::rx_wait;
+				i2c.next_event = never;
+				set_bits(PIC18_SIM_I2C1CON0, CON0_CSTR, true);
+				break;
+			}
+			i2c_deliver_rx();
+			break;
+		case i2c_state::stop:
+			set_bits(PIC18_SIM_I2C1PIR, PIR_PCIF, true);
+			set_bits(PIC18_SIM_I2C1STAT0, STAT0_BFRE, true);
+			set_bits(PIC18_SIM_I2C1STAT0, STAT0_MMA, false);
+			set_bits(PIC18_SIM_I2C1CON0, CON0_MDR | CON0_CSTR, false);
+			if (i2c.target) {
+				i2c.target->stops++;
+				i2c.target->stop();
+			}
+			i2c.target = nullptr;
+			i2c.stops++;
+			i2c.state = i2c_state::idle;
+			break;
+		default:
+			break;
+	}
+}
+
+void i2c_start_request() {
+	std::uint8_t con0 = get(PIC18_SIM_I2C1CON0);
+	if (!(con0 & CON0_EN) || ((con0 & CON0_MODE) != CON0_MODE_HOST_7BIT)) {
+		return;
+	}
+
+	if ((i2c.state == i2c_state::idle) && !i2c_bus_free()) {
+		// Waits for the bus to become free, S stays set
+		return;
+	}
+
+	if (i2c.state == i2c_state::idle) {
+		set_bits(PIC18_SIM_I2C1STAT0, STAT0_BFRE, false);
+		set_bits(PIC18_SIM_I2C1STAT0, STAT0_MMA, true);
+		i2c.state = i2c_state::start;
+		i2c.starts++;
+		i2c_schedule(1);
+	} else if (i2c.state == i2c_state::restart_wait) {
+		set_bits(PIC18_SIM_I2C1CON0, CON0_MDR, false);
+		i2c.state = i2c_state::restart;
+		i2c.restarts++;
+		i2c_schedule(1);
+	}
+}
+
+void i2c_disable() {
+	if (i2c.target) {
+		i2c.target->stop();
+	}
+	i2c.target = nullptr;
+	i2c.state = i2c_state::idle;
+	i2c.next_event = never;
+	set_bits(PIC18_SIM_I2C1CON0, CON0_S | CON0_CSTR | CON0_MDR, false);
+	set_bits(PIC18_SIM_I2C1STAT0, STAT0_BFRE, true);
+	set_bits(PIC18_SIM_I2C1STAT0, STAT0_MMA, false);
+}
+
+void i2c_tx_written() {
+	set_bits(PIC18_SIM_I2C1STAT1, STAT1_TXBE, false);
+	if (i2c.state == i2c_state::tx_wait) {
+		set_bits(PIC18_SIM_I2C1CON0, CON0_CSTR, false);
+		i2c_begin_tx();
+	}
+}
+
+void i2c_rx_read() {
+	set_bits(PIC18_SIM_I2C1STAT1, STAT1_RXBF, false);
+	if (i2c.state == i2c_state::rx_wait) {
+		set_bits(PIC18_SIM_I2C1CON0, CON0_CSTR, false);
+		i2c_deliver_rx();
+	}
+}
+
+// Timer1
+
+std::uint16_t timer1_value() {
+	if (!timer1.running) {
+		return timer1.base_value;
+	}
+	return static_cast<std::uint16_t>(timer1.base_value +
+									  ((now - timer1.base_cycles) >> timer1.prescale_shift));
+}
+
+void timer1_rebase(std::uint16_t value) {
+	timer1.base_value = value;
+	timer1.base_cycles = now;
+	std::uint8_t con = get(PIC18_SIM_T1CON);
+	timer1.running = (con & T1CON_ON) && ((get(PIC18_SIM_T1CLK) & 0x0f) == T1CLK_FOSC4);
+	timer1.prescale_shift = (con >> T1CON_CKPS_SHIFT) & 3;
+}
+
+// Timer0 and Timer2
+
+std::uint64_t counter_ticks(const counter_model &c) {
+	if (c.clk_hz == 0) {
+		return 0;
+	}
+	return (now - c.anchor) * c.clk_hz / (fosc / 4 * c.prescale);
+}
+
+std::uint32_t counter_value(const counter_model &c) {
+	return static_cast<std::uint32_t>((c.start + counter_ticks(c)) % c.period);
+}
+
+void counter_schedule(counter_model &c) {
+	if (c.clk_hz == 0) {
+		c.next_event = never;
+		return;
+	}
+	// First cycle at which the tick count reaches the next wrap
+	std::uint64_t ticks = (c.matches + 1) * c.period - c.start;
+	std::uint64_t cycles_per_ticks = fosc / 4 * c.prescale;
+	c.next_event = c.anchor + (ticks * cycles_per_ticks + c.clk_hz - 1) / c.clk_hz;
+}
+
+void counter_set(counter_model &c, std::uint32_t value) {
+	c.anchor = now;
+	c.start = value % c.period;
+	c.matches = 0;
+	counter_schedule(c);
+}
+
+// Period match, returns true when the postscaler raises the interrupt flag
+bool counter_match(counter_model &c) {
+	c.matches++;
+	counter_schedule(c);
+	if (++c.postscale_count < c.postscale) {
+		return false;
+	}
+	c.postscale_count = 0;
+	c.flags++;
+	return true;
+}
+
+std::uint64_t timer0_clock_hz(std::uint8_t cs) {
+	switch (cs) {
+		case 2:
+			return fosc / 4;
+		case 3:
+			return hfintosc_hz;
+		case 4:
+			return lfintosc_hz;
+		case 5:
+			return mfintosc_hz;
+		case 6:
+			return sosc_hz;
+		default:
+			// Pin and CLC inputs, nothing drives them
+			return 0;
+	}
+}
+
+// Apply the Timer0 configuration registers, counting on from `value`
+void timer0_configure(std::uint32_t value) {
+	std::uint8_t con0 = get(PIC18_SIM_T0CON0);
+	std::uint8_t con1 = get(PIC18_SIM_T0CON1);
+	timer0.clk_hz = (con0 & T0CON0_EN) ? timer0_clock_hz(con1 >> T0CON1_CS_SHIFT) : 0;
+	timer0.prescale = std::uint64_t{1} << (con1 & T0CON1_CKPS);
+	timer0.postscale = (con0 & T0CON0_OUTPS) + 1u;
+	timer0.period = (con0 & T0CON0_MD16) ? 65536u : get(PIC18_SIM_TMR0H) + 1u;
+	counter_set(timer0, value);
+}
+
+void timer0_event() {
+	if (counter_match(timer0)) {
+		set_bits(PIC18_SIM_PIR3, PIR3_TMR0IF, true);
+	}
+}
+
+// TMR0L read, in 16-bit mode it also latches the high byte into TMR0H
+void timer0_read() {
+	std::uint32_t value = counter_value(timer0);
+	set(PIC18_SIM_TMR0L, static_cast<std::uint8_t>(value));
+	if (has(PIC18_SIM_T0CON0, T0CON0_MD16)) {
+		set(PIC18_SIM_TMR0H, static_cast<std::uint8_t>(value >> 8));
+	}
+}
+
+std::uint64_t timer2_clock_hz() {
+	switch (get(PIC18_SIM_T2CLKCON) & 0x0f) {
+		case 1:
+			return fosc / 4;
+		case 2:
+			return fosc;
+		case 3:
+			return hfintosc_hz;
+		case 4:
+			return lfintosc_hz;
+		case 5:
+			return mfintosc_hz;
+		default:
+			// Pin, SOSC and peripheral inputs, nothing drives them
+			return 0;
+	}
+}
+
+void timer2_configure(std::uint32_t value) {
+	std::uint8_t con = get(PIC18_SIM_T2CON);
+	timer2.clk_hz = (con & T2CON_ON) ? timer2_clock_hz() : 0;
+	timer2.prescale = std::uint64_t{1} << ((con >> T2CON_CKPS_SHIFT) & 0x07);
+	timer2.postscale = (con & T2CON_OUTPS) + 1u;
+	timer2.period = get(PIC18_SIM_T2PR) + 1u;
+	counter_set(timer2, value);
+}
+
+// CCP
+
+const pic18_sim_reg_t ccp_con[num_ccps] = {
+	PIC18_SIM_CCP1CON, PIC18_SIM_CCP2CON, PIC18_SIM_CCP3CON, PIC18_SIM_CCP4CON};
+const pic18_sim_reg_t ccpr_l[num_ccps] = {
+	PIC18_SIM_CCPR1L, PIC18_SIM_CCPR2L, PIC18_SIM_CCPR3L, PIC18_SIM_CCPR4L};
+const pic18_sim_reg_t ccpr_h[num_ccps] = {
+	PIC18_SIM_CCPR1H, PIC18_SIM_CCPR2H, PIC18_SIM_CCPR3H, PIC18_SIM_CCPR4H};
+
+bool ccp_pwm(int i) {
+	return (get(ccp_con[i]) & (CCPCON_EN | CCPCON_MODE)) == (CCPCON_EN | CCPCON_MODE_PWM);
+}
+
+// End of a Timer2 period, the PWMs take their new duty cycles
+void ccp_latch() {
+	for (int i = 0; i < num_ccps; i++) {
+		if (!ccp_pwm(i)) {
+			continue;
+		}
+		std::uint8_t low = get(ccpr_l[i]);
+		std::uint8_t high = get(ccpr_h[i]);
+		if (has(ccp_con[i], CCPCON_FMT)) {
+			ccp_duty[i] = static_cast<std::uint16_t>((high << 2) | (low >> 6));
+		} else {
+			ccp_duty[i] = static_cast<std::uint16_t>(((high & 0x03) << 8) | low);
+		}
+	}
+}
+
+void timer2_event() {
+	ccp_latch();
+	if (pwm_period_hook) {
+		std::array<std::uint16_t, 4> duty;
+		std::copy(ccp_duty, ccp_duty + num_ccps, duty.begin());
+		pwm_period_hook(duty);
+	}
+	if (counter_match(timer2)) {
+		set_bits(PIC18_SIM_PIR4, PIR4_TMR2IF, true);
+	}
+}
+
+// DMA1
+
+std::uint16_t get16(pic18_sim_reg_t r) {
+	return static_cast<std::uint16_t>(slots[r]);
+}
+
+void set_wide(pic18_sim_reg_t r, std::uint64_t value) {
+	slots[r] = value;
+	shadow[r] = value;
+}
+
+void dma_reload_source() {
+	set_wide(PIC18_SIM_DMA1SPTR, slots[PIC18_SIM_DMA1SSA]);
+	set_wide(PIC18_SIM_DMA1SCNT, get16(PIC18_SIM_DMA1SSZ));
+}
+
+void dma_reload_destination() {
+	set_wide(PIC18_SIM_DMA1DPTR, slots[PIC18_SIM_DMA1DSA]);
+	set_wide(PIC18_SIM_DMA1DCNT, get16(PIC18_SIM_DMA1DSZ));
+}
+
+std::uint64_t dma_step_pointer(std::uint64_t pointer, unsigned mode) {
+	if (mode == 1) {
+		return pointer + 1;
+	}
+	if (mode == 2) {
+		return pointer - 1;
+	}
+	return pointer;
+}
+
+// Move one byte if the channel is triggered, returns false if it is not
+bool dma_transfer() {
+	std::uint8_t con0 = get(PIC18_SIM_DMA1CON0);
+	if (!dma.locked || !(con0 & DMACON0_EN) || !(con0 & DMACON0_SIRQEN)) {
+		return false;
+	}
+	std::uint8_t irq = get(PIC18_SIM_DMA1SIRQ);
+	if ((irq < irq_pir3_base) || (irq >= irq_pir3_base + 8) ||
+		!has(PIC18_SIM_PIR3, static_cast<std::uint8_t>(1 << (irq - irq_pir3_base)))) {
+		return false;
+	}
+
+	std::uint64_t source = slots[PIC18_SIM_DMA1SPTR];
+	std::uint64_t destination = slots[PIC18_SIM_DMA1DPTR];
+	std::uint8_t byte;
+	if (source == reinterpret_cast<std::uintptr_t>(&slots[PIC18_SIM_I2C1RXB])) {
+		byte = get(PIC18_SIM_I2C1RXB);
+		i2c_rx_read();
+	} else {
+		byte = *reinterpret_cast<std::uint8_t *>(static_cast<std::uintptr_t>(source));
+	}
+	if (destination == reinterpret_cast<std::uintptr_t>(&slots[PIC18_SIM_I2C1TXB])) {
+		set(PIC18_SIM_I2C1TXB, byte);
+		i2c_tx_written();
+	} else {
+		*reinterpret_cast<std::uint8_t *>(static_cast<std::uintptr_t>(destination)) = byte;
+	}
+	now += dma_byte_cycles;
+	dma.cycles += dma_byte_cycles;
+	dma.bytes++;
+
+	std::uint8_t con1 = get(PIC18_SIM_DMA1CON1);
+	set_wide(PIC18_SIM_DMA1SPTR, dma_step_pointer(source, (con1 >> DMACON1_SMODE_SHIFT) & 3));
+	set_wide(PIC18_SIM_DMA1DPTR, dma_step_pointer(destination, (con1 >> DMACON1_DMODE_SHIFT) & 3));
+	set_wide(PIC18_SIM_DMA1SCNT, get16(PIC18_SIM_DMA1SCNT) - 1);
+	set_wide(PIC18_SIM_DMA1DCNT, get16(PIC18_SIM_DMA1DCNT) - 1);
+
+	bool stop = false;
+	if (get16(PIC18_SIM_DMA1SCNT) == 0) {
+		dma_reload_source();
+		stop = stop || (con1 & DMACON1_SSTP);
+	}
+	if (get16(PIC18_SIM_DMA1DCNT) == 0) {
+		dma_reload_destination();
+		stop = stop || (con1 & DMACON1_DSTP);
+	}
+	if (stop) {
+		set_bits(PIC18_SIM_DMA1CON0, DMACON0_SIRQEN, false);
+	}
+	return true;
+}
+
+void dma_lock_write(std::uint8_t value) {
+	if ((dma.unlock == 0) && (value == PRLOCK_UNLOCK1)) {
+		dma.unlock = 1;
+	} else if ((dma.unlock == 1) && (value == PRLOCK_UNLOCK2)) {
+		dma.unlock = 2;
+	} else if (dma.unlock == 2) {
+		dma.locked = (value & PRLOCK_PRLOCKED) != 0;
+		dma.unlock = 0;
+	} else {
+		dma.unlock = 0;
+	}
+	set(PIC18_SIM_PRLOCK, dma.locked ? PRLOCK_PRLOCKED : 0);
+}
+
+// Interrupts
+
+void update_flags() {
+	update_lines();
+	if (i2c.state == i2c_state::idle) {
+		set_bits(PIC18_SIM_I2C1STAT0, STAT0_BFRE, i2c_bus_free());
+		if (has(PIC18_SIM_I2C1CON0, CON0_S) && i2c_bus_free()) {
+			// Start requested while the bus was busy
+			i2c_start_request();
+		}
+	}
+
+	std::uint8_t pir3 = get(PIC18_SIM_PIR3) & static_cast<std::uint8_t>(~PIR3_I2C1_FLAGS);
+	std::uint8_t stat1 = get(PIC18_SIM_I2C1STAT1);
+	std::uint8_t err = get(PIC18_SIM_I2C1ERR);
+
+	if (stat1 & STAT1_RXBF) {
+		pir3 |= PIR3_I2C1RXIF;
+	}
+	if ((stat1 & STAT1_TXBE) && (get(PIC18_SIM_I2C1CNT) != 0) &&
+		has(PIC18_SIM_I2C1CON0, CON0_EN)) {
+		pir3 |= PIR3_I2C1TXIF;
+	}
+	if (get(PIC18_SIM_I2C1PIR) & get(PIC18_SIM_I2C1PIE)) {
+		pir3 |= PIR3_I2C1IF;
+	}
+	if ((err >> 4) & err & 0x07) {
+		pir3 |= PIR3_I2C1EIF;
+	}
+	set(PIC18_SIM_PIR3, pir3);
+}
+
+void update_irq() {
+	update_flags();
+	while (dma_transfer()) {
+		update_flags();
+	}
+}
+
+bool irq_pending() {
+	return has(PIC18_SIM_INTCON0, INTCON0_GIE) &&
+		   (((get(PIC18_SIM_PIR3) & get(PIC18_SIM_PIE3)) != 0) ||
+			((get(PIC18_SIM_PIR4) & get(PIC18_SIM_PIE4)) != 0));
+}
+
+// Firmware write to a register, old and new value differ
+void on_write(pic18_sim_reg_t r, std::uint8_t old, std::uint8_t value) {
+	switch (r) {
+		case PIC18_SIM_PIR3:
+			set(r, (value & static_cast<std::uint8_t>(~PIR3_I2C1_FLAGS)) | (old & PIR3_I2C1_FLAGS));
+			break;
+		case PIC18_SIM_I2C1CON0: {
+			const std::uint8_t hw = CON0_CSTR | CON0_MDR;
+			value = (value & static_cast<std::uint8_t>(~hw)) | (old & hw);
+			set(r, value);
+			if ((old & CON0_EN) && !(value & CON0_EN)) {
+				i2c_disable();
+			} else if (!(old & CON0_S) && (value & CON0_S)) {
+				i2c_start_request();
+			}
+			break;
+		}
+		case PIC18_SIM_I2C1CON1:
+			set(r, (value & static_cast<std::uint8_t>(~CON1_ACKSTAT)) | (old & CON1_ACKSTAT));
+			break;
+		case PIC18_SIM_I2C1STAT0:
+			set(r, old);
+			break;
+		case PIC18_SIM_PORTC:
+			set(r, old);
+			break;
+		case PIC18_SIM_T1CON:
+		case PIC18_SIM_T1CLK: {
+			std::uint16_t value16 = timer1_value();
+			set(r, value);
+			timer1_rebase(value16);
+			break;
+		}
+		case PIC18_SIM_TMR1:
+			timer1_rebase(get16(r));
+			break;
+		case PIC18_SIM_T0CON0:
+		case PIC18_SIM_T0CON1: {
+			std::uint32_t count = counter_value(timer0);
+			set(r, value);
+			timer0_configure(count);
+			break;
+		}
+		case PIC18_SIM_TMR0L:
+			if (has(PIC18_SIM_T0CON0, T0CON0_MD16)) {
+				counter_set(timer0, (get(PIC18_SIM_TMR0H) << 8) | value);
+			} else {
+				counter_set(timer0, value);
+			}
+			break;
+		case PIC18_SIM_TMR0H:
+			// Period register in 8-bit mode, buffer of the high byte in 16-bit mode
+			if (!has(PIC18_SIM_T0CON0, T0CON0_MD16)) {
+				std::uint32_t count = counter_value(timer0);
+				set(r, value);
+				timer0_configure(count);
+			}
+			break;
+		case PIC18_SIM_T2CON:
+		case PIC18_SIM_T2CLKCON:
+		case PIC18_SIM_T2PR: {
+			std::uint32_t count = counter_value(timer2);
+			set(r, value);
+			timer2_configure(count);
+			break;
+		}
+		case PIC18_SIM_T2TMR:
+			counter_set(timer2, value);
+			break;
+		case PIC18_SIM_PRLOCK:
+			dma_lock_write(value);
+			break;
+		case PIC18_SIM_DMA1CON0:
+			set(r, value);
+			if (!(old & DMACON0_EN) && (value & DMACON0_EN)) {
+				dma_reload_source();
+				dma_reload_destination();
+			}
+			break;
+		case PIC18_SIM_DMA1SSA:
+		case PIC18_SIM_DMA1SSZ:
+			dma_reload_source();
+			break;
+		case PIC18_SIM_DMA1DSA:
+		case PIC18_SIM_DMA1DSZ:
+			dma_reload_destination();
+			break;
+		case PIC18_SIM_I2C1STAT1: {
+			const std::uint8_t hw = STAT1_TXBE | STAT1_RXBF;
+			value = (value & static_cast<std::uint8_t>(~hw)) | (old & hw);
+			if (value & STAT1_CLRBF) {
+				value &= static_cast<std::uint8_t>(~(STAT1_CLRBF | STAT1_RXBF));
+				value |= STAT1_TXBE;
+			}
+			set(r, value);
+			break;
+		}
+		default:
+			set(r, value);
+			break;
+	}
+}
+
+void commit() {
+	if (pending_access == PIC18_SIM_I2C1TXB) {
+		shadow[PIC18_SIM_I2C1TXB] = slots[PIC18_SIM_I2C1TXB];
+		i2c_tx_written();
+	} else if (pending_access == PIC18_SIM_I2C1RXB) {
+		i2c_rx_read();
+	}
+	pending_access = PIC18_SIM_NUM_REGS;
+
+	for (int i = 0; i < PIC18_SIM_NUM_REGS; i++) {
+		pic18_sim_reg_t r = static_cast<pic18_sim_reg_t>(i);
+		if ((r == PIC18_SIM_I2C1TXB) || (r == PIC18_SIM_I2C1RXB) || (slots[r] == shadow[r])) {
+			continue;
+		}
+		if ((r == PIC18_SIM_DMA1SPTR) || (r == PIC18_SIM_DMA1SCNT) || (r == PIC18_SIM_DMA1DPTR) ||
+			(r == PIC18_SIM_DMA1DCNT)) {
+			// Read-only
+			slots[r] = shadow[r];
+			continue;
+		}
+		std::uint8_t old = static_cast<std::uint8_t>(shadow[r]);
+		shadow[r] = slots[r];
+		on_write(r, old, static_cast<std::uint8_t>(slots[r]));
+	}
+	update_irq();
+}
+
+void step_to(std::uint64_t target) {
+	for (;;) {
+		std::uint64_t next = std::min({i2c.next_event, timer0.next_event, timer2.next_event});
+		if (next > target) {
+			break;
+		}
+		now = std::max(now, next);
+		if (i2c.next_event == next) {
+			i2c.next_event = never;
+			i2c_event();
+		} else if (timer0.next_event == next) {
+			timer0_event();
+		} else {
+			timer2_event();
+		}
+		update_irq();
+		dispatch();
+	}
+	now = std::max(now, target);
+}
+
+void dispatch() {
+	if (inside_isr || !isr) {
+		return;
+	}
+
+	while (irq_pending()) {
+		std::uint64_t start = now;
+		inside_isr = true;
+		// Hardware clears GIE on entry and RETFIE sets it again
+		set_bits(PIC18_SIM_INTCON0, INTCON0_GIE, false);
+		step_to(now + pic18_sim::isr_entry_cycles);
+		isr();
+		commit();
+		step_to(now + pic18_sim::isr_exit_cycles);
+		set_bits(PIC18_SIM_INTCON0, INTCON0_GIE, true);
+		inside_isr = false;
+		isr_cycle_count += now - start;
+		isr_calls++;
+	}
+}
+
+void advance(std::uint64_t n) {
+	step_to(now + n);
+	dispatch();
+}
+
+} // namespace
+
+std::uint32_t pic18_sim::access_cycles = 4;
+std::uint32_t pic18_sim::isr_entry_cycles = 12;
+std::uint32_t pic18_sim::isr_exit_cycles = 8;
+
+extern "C" volatile void *pic18_sim_access(pic18_sim_reg_t reg) {
+	commit();
+	dispatch();
+	advance(pic18_sim::access_cycles);
+	if ((reg == PIC18_SIM_I2C1TXB) || (reg == PIC18_SIM_I2C1RXB)) {
+		pending_access = reg;
+	} else if (reg == PIC18_SIM_TMR1) {
+		set_wide(PIC18_SIM_TMR1, timer1_value());
+	} else if (reg == PIC18_SIM_TMR0L) {
+		timer0_read();
+	} else if (reg == PIC18_SIM_T2TMR) {
+		set(PIC18_SIM_T2TMR, static_cast<std::uint8_t>(counter_value(timer2)));
+	}
+	return &slots[reg];
+}
+
+extern "C" void pic18_sim_delay_us(uint32_t us) {
+	commit();
+	advance(pic18_sim::cycles_from_us(us));
+}
+
+extern "C" void pic18_sim_nop(void) {
+	commit();
+	advance(1);
+}
+
+void pic18_sim::reset(std::uint32_t fosc_hz) {
+	std::memset(slots, 0, sizeof(slots));
+	std::memset(shadow, 0, sizeof(shadow));
+	pending_access = PIC18_SIM_NUM_REGS;
+	fosc = fosc_hz;
+	now = 0;
+	isr = nullptr;
+	inside_isr = false;
+	isr_cycle_count = 0;
+	isr_calls = 0;
+	i2c = i2c_model{};
+	lines = bus_lines_model{};
+	timer1 = timer1_model{};
+	timer0 = counter_model{};
+	timer2 = counter_model{};
+	std::memset(ccp_duty, 0, sizeof(ccp_duty));
+	pwm_period_hook = nullptr;
+	dma = dma_model{};
+
+	set(PIC18_SIM_I2C1STAT0, STAT0_BFRE);
+	set(PIC18_SIM_I2C1STAT1, STAT1_TXBE);
+	set(PIC18_SIM_TRISA, 0xff);
+	set(PIC18_SIM_TRISB, 0xff);
+	set(PIC18_SIM_TRISC, 0xff);
+	set(PIC18_SIM_TMR0H, 0xff);
+	set(PIC18_SIM_T2PR, 0xff);
+	update_irq();
+}
+
+std::uint32_t pic18_sim::fosc_hz() {
+	return fosc;
+}
+
+std::uint64_t pic18_sim::cycles() {
+	return now;
+}
+
+double pic18_sim::now_us() {
+	return static_cast<double>(now) * 4e6 / fosc;
+}
+
+std::uint64_t pic18_sim::cycles_from_us(double us) {
+	return static_cast<std::uint64_t>(std::llround(us * fosc / 4e6));
+}
+
+void pic18_sim::set_isr(void (*handler)(void)) {
+	isr = handler;
+}
+
+bool pic18_sim::in_isr() {
+	return inside_isr;
+}
+
+std::uint64_t pic18_sim::isr_cycles() {
+	return isr_cycle_count;
+}
+
+std::uint32_t pic18_sim::isr_count() {
+	return isr_calls;
+}
+
+void pic18_sim::run_cycles(std::uint64_t n) {
+	commit();
+	dispatch();
+	advance(n);
+}
+
+void pic18_sim::run_us(double us) {
+	run_cycles(cycles_from_us(us));
+}
+
+bool pic18_sim::run_until(const std::function<bool()> &done, double timeout_us) {
+	std::uint64_t deadline = now + cycles_from_us(timeout_us);
+	commit();
+	dispatch();
+	while (!done()) {
+		if (now >= deadline) {
+			return false;
+		}
+		advance(access_cycles);
+	}
+	return true;
+}
+
+std::uint8_t pic18_sim::reg(pic18_sim_reg_t r) {
+	commit();
+	return get(r);
+}
+
+double pic18_sim::i2c_scl_hz() {
+	return i2c_clock_hz() / (has(PIC18_SIM_I2C1CON2, CON2_FME) ? 4.0 : 5.0);
+}
+
+std::uint32_t pic18_sim::i2c_starts() {
+	return i2c.starts;
+}
+
+std::uint32_t pic18_sim::i2c_restarts() {
+	return i2c.restarts;
+}
+
+std::uint32_t pic18_sim::i2c_stops() {
+	return i2c.stops;
+}
+
+std::uint32_t pic18_sim::i2c_bytes() {
+	return i2c.bytes;
+}
+
+std::uint32_t pic18_sim::i2c_scl_pulses() {
+	return lines.scl_pulses;
+}
+
+std::uint32_t pic18_sim::i2c_port_stops() {
+	return lines.stops;
+}
+
+std::uint64_t pic18_sim::dma_cycles() {
+	return dma.cycles;
+}
+
+std::uint32_t pic18_sim::dma_bytes() {
+	return dma.bytes;
+}
+
+std::uint32_t pic18_sim::timer0_interrupts() {
+	return timer0.flags;
+}
+
+double pic18_sim::pwm_hz() {
+	commit();
+	if (timer2.clk_hz == 0) {
+		return 0;
+	}
+	return static_cast<double>(timer2.clk_hz) / (timer2.prescale * timer2.period);
+}
+
+std::uint16_t pic18_sim::pwm_duty(std::uint8_t ccp) {
+	commit();
+	if ((ccp < 1) || (ccp > num_ccps) || !ccp_pwm(ccp - 1)) {
+		return 0;
+	}
+	return ccp_duty[ccp - 1];
+}
+
+void pic18_sim::set_pwm_period_hook(
+	std::function<void(const std::array<std::uint16_t, 4> &duty)> hook) {
+	pwm_period_hook = std::move(hook);
+}
+
+double pic18_sim::pwm_duty_ratio(std::uint8_t ccp) {
+	// The duty cycle counts Timer2 clocks with two more bits
+	double duty = pwm_duty(ccp);
+	return std::min(1.0, duty / (4.0 * (get(PIC18_SIM_T2PR) + 1)));
+}
+
+// I2C targets
+
+pic18_sim_i2c_device::pic18_sim_i2c_device(std::uint8_t address) : address(address) {
+	devices.push_back(this);
+}
+
+pic18_sim_i2c_device::~pic18_sim_i2c_device() {
+	devices.erase(std::find(devices.begin(), devices.end(), this));
+	if (i2c.target == this) {
+		i2c.target = nullptr;
+	}
+}
+
+bool pic18_sim_i2c_device::start(bool read) {
+	(void)read;
+	starts++;
+	return true;
+}
+
+bool pic18_sim_i2c_device::write(std::uint8_t byte) {
+	(void)byte;
+	return true;
+}
+
+std::uint8_t pic18_sim_i2c_device::read() {
+	return 0xff;
+}
+
+void pic18_sim_i2c_device::stop() {}
+
+pic18_sim_i2c_regs::pic18_sim_i2c_regs(std::uint8_t address) : pic18_sim_i2c_device(address) {}
+
+bool pic18_sim_i2c_regs::start(bool read) {
+	pointer_next = !read;
+	return pic18_sim_i2c_device::start(read);
+}
+
+bool pic18_sim_i2c_regs::write(std::uint8_t byte) {
+	if (pointer_next) {
+		pointer = byte;
+		pointer_next = false;
+	} else {
+		regs[pointer++] = byte;
+	}
+	return true;
+}
+
+std::uint8_t pic18_sim_i2c_regs::read() {
+	return regs[pointer++];
+}
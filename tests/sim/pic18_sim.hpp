@@ -0,0 +1,137 @@
+#ifndef ROCKETLIB_SIM_PIC18_SIM_HPP
+#define ROCKETLIB_SIM_PIC18_SIM_HPP
+
+#include <array>
+#include <cstdint>
+#include <functional>
+
+#include "xc.h"
+
+/**
+ * Simulated I2C target attached to the I2C1 bus
+ *
+ * The default implementation acknowledges everything, reads return 0xff. Devices attach themselves
+ * on construction and detach on destruction.
+ */
+class pic18_sim_i2c_device {
+public:
+	explicit pic18_sim_i2c_device(std::uint8_t address);
+	virtual ~pic18_sim_i2c_device();
+	pic18_sim_i2c_device(const pic18_sim_i2c_device &) = delete;
+	pic18_sim_i2c_device &operator=(const pic18_sim_i2c_device &) = delete;
+
+	// Address byte received (start or repeated start), return false to NACK it
+	virtual bool start(bool read);
+	// Data byte written by the host, return false to NACK it
+	virtual bool write(std::uint8_t byte);
+	// Data byte requested by the host
+	virtual std::uint8_t read();
+	// Stop condition
+	virtual void stop();
+
+	std::uint8_t address;
+
+	// Fault injection
+	bool nack_address = false;
+	// Another controller addressing the bus at the same time, the address byte collides
+	bool collide_address = false;
+	// Clock stretching added to every byte
+	std::uint32_t stretch_us = 0;
+	// Holds SDA low for this many more SCL clocks, as after a reset in the middle of a read
+	std::uint32_t hold_sda_clocks = 0;
+
+	// Statistics
+	std::uint32_t starts = 0;
+	std::uint32_t bytes_written = 0;
+	std::uint32_t bytes_read = 0;
+	std::uint32_t stops = 0;
+};
+
+/**
+ * Sensor style target with 256 byte registers, the first byte of a write sets the register
+ * pointer, reads and writes auto-increment it
+ */
+class pic18_sim_i2c_regs : public pic18_sim_i2c_device {
+public:
+	explicit pic18_sim_i2c_regs(std::uint8_t address);
+
+	bool start(bool read) override;
+	bool write(std::uint8_t byte) override;
+	std::uint8_t read() override;
+
+	std::array<std::uint8_t, 256> regs{};
+	std::uint8_t pointer = 0;
+
+private:
+	bool pointer_next = false;
+};
+
+/**
+ * Register level model of the PIC18F26K83 peripherals used by the drivers
+ *
+ * Time is counted in instruction cycles (Fosc / 4). Every register access costs `access_cycles`,
+ * `__delay_us()` costs its duration, and interrupts cost their handler's register accesses plus
+ * the entry and exit latency. Peripherals advance with the cycle counter.
+ */
+namespace pic18_sim {
+	constexpr std::uint32_t default_fosc_hz = 64000000;
+
+	// Cycles charged per register access, covering the access and the surrounding test, branch
+	// and loop counter instructions
+	extern std::uint32_t access_cycles;
+	// Interrupt latency and context save before the handler runs, and restore plus RETFIE after
+	extern std::uint32_t isr_entry_cycles;
+	extern std::uint32_t isr_exit_cycles;
+
+	// Reset all registers and peripherals to their power-on state, detached devices stay attached
+	void reset(std::uint32_t fosc_hz = default_fosc_hz);
+
+	std::uint32_t fosc_hz();
+	std::uint64_t cycles();
+	double now_us();
+	std::uint64_t cycles_from_us(double us);
+
+	// Top level interrupt handler of the firmware, called when an enabled flag is set and GIE
+	void set_isr(void (*isr)(void));
+	bool in_isr();
+	std::uint64_t isr_cycles();
+	std::uint32_t isr_count();
+
+	// Let time pass in the main context, e.g. while the firmware does unrelated work
+	void run_cycles(std::uint64_t n);
+	void run_us(double us);
+	// Run until `done` returns true, returns false on timeout
+	bool run_until(const std::function<bool()> &done, double timeout_us);
+
+	// Register value as seen by the firmware, without side effects
+	std::uint8_t reg(pic18_sim_reg_t r);
+
+	// I2C1 bus
+	double i2c_scl_hz();
+	std::uint32_t i2c_starts();
+	std::uint32_t i2c_restarts();
+	std::uint32_t i2c_stops();
+	std::uint32_t i2c_bytes();
+	// SCL pulses and stop conditions driven through the port pins
+	std::uint32_t i2c_scl_pulses();
+	std::uint32_t i2c_port_stops();
+
+	// Timer0 interrupt flags raised, one every OUTPS + 1 periods
+	std::uint32_t timer0_interrupts();
+
+	// PWM frequency of the Timer2 time base, 0 while stopped
+	double pwm_hz();
+	// Duty cycle latched by CCPx (1 to 4) at the last Timer2 period, 0 outside PWM mode
+	std::uint16_t pwm_duty(std::uint8_t ccp);
+	// Fraction of the period the output of CCPx is high
+	double pwm_duty_ratio(std::uint8_t ccp);
+	// Called at every Timer2 period with the duty cycles CCP1 to CCP4 latched for the next one,
+	// cleared by reset()
+	void set_pwm_period_hook(std::function<void(const std::array<std::uint16_t, 4> &duty)> hook);
+
+	// DMA1, every byte moved takes two bus cycles from the CPU
+	std::uint64_t dma_cycles();
+	std::uint32_t dma_bytes();
+} // namespace pic18_sim
+
+#endif
@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "sd_card_sim.hpp"
+#include "stm32_tim_sim.hpp"
+#include "stm32h7xx_hal.h"
+
+static std::uint64_t sim_now_us = 0;
+static std::vector<sd_card_sim *> sim_cards;
+
+std::uint64_t sd_sim_clock::now_us() {
+	return sim_now_us;
+}
+
+void sd_sim_clock::advance_us(std::uint64_t us) {
+	sim_now_us += us;
+	sd_card_sim::check_ready_all();
+	stm32_tim_sim::update();
+}
+
+void sd_sim_clock::reset() {
+	sim_now_us = 0;
+}
+
+sd_card_sim::sd_card_sim(std::uint32_t num_blocks, sd_card_sim_timing timing)
+	: timing(timing), num_blocks(num_blocks),
+	  data(static_cast<std::size_t>(num_blocks) * 512, 0xa5), erased(num_blocks, false) {
+	hsd.sim_card = this;
+	sim_cards.push_back(this);
+}
+
+sd_card_sim::~sd_card_sim() {
+	sim_cards.erase(std::find(sim_cards.begin(), sim_cards.end(), this));
+}
+
+bool sd_card_sim::busy() const {
+	return sim_now_us < busy_until_us;
+}
+
+void sd_card_sim::reset_stats() {
+	read_cmds = 0;
+	write_cmds = 0;
+	blocks_read = 0;
+	blocks_written = 0;
+	status_polls = 0;
+	status_poll_us = 0;
+	erases.clear();
+}
+
+void sd_card_sim::check_ready_all() {
+	// Callbacks may advance the clock again, iterate over a copy
+	std::vector<sd_card_sim *> cards = sim_cards;
+	for (sd_card_sim *card : cards) {
+		if (card->ready_pending && !card->busy()) {
+			card->ready_pending = false;
+			if (card->on_ready) {
+				card->on_ready(*card);
+			}
+		}
+	}
+}
+
+static void start_busy(sd_card_sim *card, std::uint64_t busy_us) {
+	card->busy_until_us = sim_now_us + busy_us;
+	card->ready_pending = true;
+}
+
+extern "C" uint32_t HAL_GetTick(void) {
+	return static_cast<uint32_t>(sim_now_us / 1000);
+}
+
+extern "C" {
+uint32_t SystemCoreClock = 480000000;
+}
+
+static DWT_Type sim_dwt_regs;
+static CoreDebug_Type sim_core_debug_regs;
+static std::uint64_t sim_dwt_last_us = 0;
+
+extern "C" DWT_Type *sim_dwt(void) {
+	// Counts only while enabled, software writes to CYCCNT are kept
+	if ((sim_core_debug_regs.DEMCR & CoreDebug_DEMCR_TRCENA_Msk) &&
+		(sim_dwt_regs.CTRL & DWT_CTRL_CYCCNTENA_Msk)) {
+		sim_dwt_regs.CYCCNT = sim_dwt_regs.CYCCNT +
+							  static_cast<uint32_t>((sim_now_us - sim_dwt_last_us) *
+													(SystemCoreClock / 1000000));
+	}
+	sim_dwt_last_us = sim_now_us;
+	return &sim_dwt_regs;
+}
+
+extern "C" CoreDebug_Type *sim_core_debug(void) {
+	sim_dwt(); // bring the counter up to date before it is enabled or stopped
+	return &sim_core_debug_regs;
+}
+
+extern "C" HAL_StatusTypeDef HAL_SD_ReadBlocks(SD_HandleTypeDef *hsd, uint8_t *pData,
+											   uint32_t BlockAdd, uint32_t NumberOfBlocks,
+											   uint32_t Timeout) {
+	(void)Timeout;
+	sd_card_sim *card = sd_card_sim::from_handle(hsd);
+	if (card->busy() || (NumberOfBlocks == 0) ||
+		(static_cast<std::uint64_t>(BlockAdd) + NumberOfBlocks > card->num_blocks)) {
+		return HAL_ERROR;
+	}
+
+	card->read_cmds++;
+	sd_sim_clock::advance_us(card->timing.cmd_overhead_us + card->timing.read_access_us +
+							 card->timing.transfer_us_per_block * NumberOfBlocks);
+	if (card->fail_reads) {
+		return HAL_ERROR;
+	}
+
+	card->blocks_read += NumberOfBlocks;
+	std::memcpy(pData, card->block(BlockAdd), static_cast<std::size_t>(NumberOfBlocks) * 512);
+	return HAL_OK;
+}
+
+extern "C" HAL_StatusTypeDef HAL_SD_WriteBlocks(SD_HandleTypeDef *hsd, uint8_t *pData,
+												uint32_t BlockAdd, uint32_t NumberOfBlocks,
+												uint32_t Timeout) {
+	(void)Timeout;
+	sd_card_sim *card = sd_card_sim::from_handle(hsd);
+	if (card->busy() || (NumberOfBlocks == 0) ||
+		(static_cast<std::uint64_t>(BlockAdd) + NumberOfBlocks > card->num_blocks)) {
+		return HAL_ERROR;
+	}
+
+	card->write_cmds++;
+	sd_sim_clock::advance_us(card->timing.cmd_overhead_us +
+							 card->timing.transfer_us_per_block * NumberOfBlocks);
+	if (card->fail_writes) {
+		return HAL_ERROR;
+	}
+
+	bool all_erased = true;
+	for (std::uint32_t i = 0; i < NumberOfBlocks; i++) {
+		all_erased = all_erased && card->erased[BlockAdd + i];
+		card->erased[BlockAdd + i] = false;
+	}
+
+	card->blocks_written += NumberOfBlocks;
+	std::memcpy(card->block(BlockAdd), pData, static_cast<std::size_t>(NumberOfBlocks) * 512);
+	std::uint32_t program_us =
+		all_erased ? card->timing.program_us_per_cmd_erased : card->timing.program_us_per_cmd;
+	start_busy(card,
+			   program_us +
+				   static_cast<std::uint64_t>(card->timing.program_us_per_block) * NumberOfBlocks);
+	return HAL_OK;
+}
+
+extern "C" HAL_StatusTypeDef HAL_SD_Erase(SD_HandleTypeDef *hsd, uint32_t BlockStartAdd,
+										  uint32_t BlockEndAdd) {
+	sd_card_sim *card = sd_card_sim::from_handle(hsd);
+	if (card->busy() || (BlockEndAdd < BlockStartAdd) || (BlockEndAdd >= card->num_blocks)) {
+		return HAL_ERROR;
+	}
+
+	sd_sim_clock::advance_us(card->timing.cmd_overhead_us * 3); // CMD32, CMD33, CMD38
+	if (card->fail_writes) {
+		return HAL_ERROR;
+	}
+
+	card->erases.push_back({BlockStartAdd, BlockEndAdd});
+	std::uint32_t count = BlockEndAdd - BlockStartAdd + 1;
+	std::memset(card->block(BlockStartAdd), 0, static_cast<std::size_t>(count) * 512);
+	for (std::uint32_t i = BlockStartAdd; i <= BlockEndAdd; i++) {
+		card->erased[i] = true;
+	}
+	start_busy(card, card->timing.erase_us_per_cmd);
+	return HAL_OK;
+}
+
+extern "C" HAL_SD_CardStateTypeDef HAL_SD_GetCardState(SD_HandleTypeDef *hsd) {
+	sd_card_sim *card = sd_card_sim::from_handle(hsd);
+	card->status_polls++;
+	card->status_poll_us += card->timing.status_poll_us;
+	sd_sim_clock::advance_us(card->timing.status_poll_us);
+	return card->busy() ? HAL_SD_CARD_PROGRAMMING : HAL_SD_CARD_TRANSFER;
+}
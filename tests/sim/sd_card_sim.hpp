@@ -0,0 +1,113 @@
+#ifndef ROCKETLIB_SIM_SD_CARD_SIM_HPP
+#define ROCKETLIB_SIM_SD_CARD_SIM_HPP
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "stm32h7xx_hal.h"
+
+/**
+ * Virtual time shared by all simulated STM32 peripherals, HAL_GetTick() is derived from it.
+ * Advancing the clock fires the ready notification of cards that finished programming and brings
+ * the simulated TIM2 up to date.
+ */
+namespace sd_sim_clock {
+	std::uint64_t now_us();
+	void advance_us(std::uint64_t us);
+	void reset();
+} // namespace sd_sim_clock
+
+/**
+ * Latency model of a card, all values in microseconds of virtual time
+ */
+struct sd_card_sim_timing {
+	// Command and response overhead of every read/write/erase command
+	std::uint32_t cmd_overhead_us = 50;
+	// Access latency of a read command before the first block arrives
+	std::uint32_t read_access_us = 200;
+	// Bus transfer time of one 512 byte block
+	std::uint32_t transfer_us_per_block = 12;
+	// Programming (busy) time after every write command
+	std::uint32_t program_us_per_cmd = 800;
+	// Additional programming time per written block
+	std::uint32_t program_us_per_block = 20;
+	// Programming time after a write command that only hits erased blocks, the card does not have
+	// to garbage collect before programming
+	std::uint32_t program_us_per_cmd_erased = 300;
+	// Busy time after every erase command
+	std::uint32_t erase_us_per_cmd = 2000;
+	// CPU time of one CMD13 status poll
+	std::uint32_t status_poll_us = 2;
+};
+
+/**
+ * One erase command received by a simulated card, sector addresses inclusive
+ */
+struct sd_card_sim_erase {
+	std::uint32_t start;
+	std::uint32_t end;
+};
+
+/**
+ * Simulated SD card, attached to a HAL SD handle
+ *
+ * The HAL SD functions of the host stand-in operate on the card attached to the handle. Blocking
+ * transfers advance the virtual clock by the transfer time, writes and erases leave the card busy
+ * (in programming state) for the modelled programming time. Writes that only hit erased blocks
+ * program faster.
+ */
+class sd_card_sim {
+public:
+	sd_card_sim(std::uint32_t num_blocks, sd_card_sim_timing timing = {});
+	~sd_card_sim();
+	sd_card_sim(const sd_card_sim &) = delete;
+	sd_card_sim &operator=(const sd_card_sim &) = delete;
+
+	SD_HandleTypeDef *handle() {
+		return &hsd;
+	}
+
+	bool busy() const;
+
+	std::uint8_t *block(std::uint32_t addr) {
+		return &data[static_cast<std::size_t>(addr) * 512];
+	}
+
+	sd_card_sim_timing timing;
+	std::uint32_t num_blocks;
+	std::vector<std::uint8_t> data;
+	std::vector<bool> erased;
+	std::uint64_t busy_until_us = 0;
+
+	// Fault injection
+	bool fail_reads = false;
+	bool fail_writes = false;
+
+	// Called when the card leaves programming state, models the SDMMC busy end interrupt
+	std::function<void(sd_card_sim &)> on_ready;
+	bool ready_pending = false;
+
+	// Statistics
+	std::uint32_t read_cmds = 0;
+	std::uint32_t write_cmds = 0;
+	std::uint32_t blocks_read = 0;
+	std::uint32_t blocks_written = 0;
+	std::uint32_t status_polls = 0;
+	std::uint64_t status_poll_us = 0;
+	std::vector<sd_card_sim_erase> erases;
+
+	void reset_stats();
+
+	static sd_card_sim *from_handle(SD_HandleTypeDef *hsd) {
+		return static_cast<sd_card_sim *>(hsd->sim_card);
+	}
+
+	// Fire the ready notification of every card that finished programming
+	static void check_ready_all();
+
+private:
+	SD_HandleTypeDef hsd;
+};
+
+#endif
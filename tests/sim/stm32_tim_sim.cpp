@@ -0,0 +1,126 @@
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+#include "sd_card_sim.hpp"
+#include "stm32_tim_sim.hpp"
+#include "stm32h7xx_hal.h"
+
+static TIM_TypeDef sim_tim_regs;
+// Update flag as last set by the model, software can only clear it
+static std::uint32_t sim_tim_sr = 0;
+// Prescaler in use, PSC is preloaded until the next update event
+static std::uint32_t sim_tim_psc = 0;
+static std::uint64_t sim_tim_last_us = 0;
+// Kernel clock cycles not yet counted by the prescaler
+static std::uint64_t sim_tim_remainder = 0;
+
+static void (*sim_tim_isr)(void) = nullptr;
+static bool sim_tim_masked = false;
+static bool sim_tim_in_isr = false;
+static std::uint32_t sim_tim_isr_count = 0;
+static std::function<void()> sim_tim_hook;
+static bool sim_tim_in_hook = false;
+static std::uint64_t sim_tim_accesses = 0;
+
+/**
+ * Apply the software writes since the last access and count up to the virtual clock
+ */
+static void sim_tim_sync() {
+	sim_tim_regs.SR = sim_tim_regs.SR & sim_tim_sr;
+	if (sim_tim_regs.EGR & TIM_EGR_UG) {
+		sim_tim_regs.EGR = 0;
+		sim_tim_regs.CNT = 0;
+		sim_tim_psc = sim_tim_regs.PSC;
+		sim_tim_remainder = 0;
+		if (!(sim_tim_regs.CR1 & TIM_CR1_URS)) {
+			sim_tim_regs.SR = sim_tim_regs.SR | TIM_SR_UIF;
+		}
+	}
+
+	std::uint64_t now = sd_sim_clock::now_us();
+	std::uint64_t elapsed_us = (now > sim_tim_last_us) ? now - sim_tim_last_us : 0;
+	sim_tim_last_us = now;
+	if (sim_tim_regs.CR1 & TIM_CR1_CEN) {
+		std::uint64_t cycles = elapsed_us * (stm32_tim_sim::clock_hz / 1000000) + sim_tim_remainder;
+		std::uint64_t counts = cycles / (sim_tim_psc + 1ULL);
+		sim_tim_remainder = cycles % (sim_tim_psc + 1ULL);
+		std::uint64_t cnt = sim_tim_regs.CNT + counts;
+		if (cnt > sim_tim_regs.ARR) {
+			cnt %= sim_tim_regs.ARR + 1ULL;
+			sim_tim_regs.SR = sim_tim_regs.SR | TIM_SR_UIF;
+			sim_tim_psc = sim_tim_regs.PSC;
+		}
+		sim_tim_regs.CNT = static_cast<std::uint32_t>(cnt);
+	}
+	sim_tim_sr = sim_tim_regs.SR;
+}
+
+/**
+ * Run the handler if the update interrupt is pending, enabled and not masked
+ */
+static void sim_tim_dispatch() {
+	if (!sim_tim_isr || sim_tim_masked || sim_tim_in_isr || !(sim_tim_regs.DIER & TIM_DIER_UIE) ||
+		!(sim_tim_regs.SR & TIM_SR_UIF)) {
+		return;
+	}
+	sim_tim_in_isr = true;
+	sim_tim_isr_count++;
+	sim_tim_isr();
+	sim_tim_in_isr = false;
+	sim_tim_sync();
+}
+
+extern "C" TIM_TypeDef *sim_tim2(void) {
+	if (sim_tim_hook && !sim_tim_in_hook) {
+		sim_tim_in_hook = true;
+		sim_tim_hook();
+		sim_tim_in_hook = false;
+	}
+	sim_tim_accesses++;
+	sim_tim_sync();
+	sim_tim_dispatch();
+	return &sim_tim_regs;
+}
+
+void stm32_tim_sim::reset() {
+	sim_tim_regs = TIM_TypeDef{};
+	sim_tim_regs.ARR = 0xffffffff;
+	sim_tim_sr = 0;
+	sim_tim_psc = 0;
+	sim_tim_last_us = sd_sim_clock::now_us();
+	sim_tim_remainder = 0;
+	sim_tim_masked = false;
+	sim_tim_isr_count = 0;
+	sim_tim_accesses = 0;
+}
+
+void stm32_tim_sim::set_isr(void (*isr)(void)) {
+	sim_tim_isr = isr;
+}
+
+void stm32_tim_sim::set_masked(bool masked) {
+	sim_tim_masked = masked;
+	update();
+}
+
+bool stm32_tim_sim::in_isr() {
+	return sim_tim_in_isr;
+}
+
+std::uint32_t stm32_tim_sim::isr_count() {
+	return sim_tim_isr_count;
+}
+
+void stm32_tim_sim::set_access_hook(std::function<void()> hook) {
+	sim_tim_hook = std::move(hook);
+}
+
+std::uint64_t stm32_tim_sim::accesses() {
+	return sim_tim_accesses;
+}
+
+void stm32_tim_sim::update() {
+	sim_tim_sync();
+	sim_tim_dispatch();
+}
@@ -0,0 +1,40 @@
+#ifndef ROCKETLIB_SIM_STM32_TIM_SIM_HPP
+#define ROCKETLIB_SIM_STM32_TIM_SIM_HPP
+
+#include <cstdint>
+#include <functional>
+
+#include "stm32h7xx_hal.h"
+
+/**
+ * Register level model of TIM2, counting with the virtual clock of sd_sim_clock
+ *
+ * Every register access through `TIM2` first calls the access hook, then brings the counter up to
+ * date and runs the interrupt handler if the update interrupt is pending and not masked, as if the
+ * interrupt landed right before the access. Advancing the virtual clock does the same. The update
+ * flag can only be cleared by software (rc_w0), writes of EGR.UG reset the counter and load the
+ * prescaler.
+ */
+namespace stm32_tim_sim {
+	// Kernel clock of the timer
+	constexpr std::uint32_t clock_hz = 240000000;
+
+	// Reset the timer registers, the handler and the hook stay set
+	void reset();
+
+	// Handler run for the update interrupt, NULL for none
+	void set_isr(void (*isr)(void));
+	// Masks the interrupt, e.g. while interrupts are disabled or a higher priority handler runs
+	void set_masked(bool masked);
+	bool in_isr();
+	std::uint32_t isr_count();
+
+	// Called before every register access, also from the handler, not while it runs itself
+	void set_access_hook(std::function<void()> hook);
+	std::uint64_t accesses();
+
+	// Bring the counter up to date and run the pending interrupt, called by sd_sim_clock
+	void update();
+} // namespace stm32_tim_sim
+
+#endif
@@ -0,0 +1,64 @@
+/**
+ * @file
+ * @brief Host stand-in for the STM32H7 HAL umbrella header
+ */
+
+#ifndef ROCKETLIB_SIM_STM32H7XX_HAL_H
+#define ROCKETLIB_SIM_STM32H7XX_HAL_H
+
+#include <stdint.h>
+
+#include "stm32h7xx_hal_sd.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t HAL_GetTick(void);
+
+extern uint32_t SystemCoreClock;
+
+// Cortex-M7 debug watchpoint and trace unit, the cycle counter follows the virtual clock
+typedef struct {
+	volatile uint32_t CTRL;
+	volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+	volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+DWT_Type *sim_dwt(void);
+CoreDebug_Type *sim_core_debug(void);
+
+#define DWT (sim_dwt())
+#define CoreDebug (sim_core_debug())
+#define DWT_CTRL_CYCCNTENA_Msk (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+
+// General purpose timer, brought up to date with the virtual clock on every access through the
+// instance macro, see stm32_tim_sim.hpp
+typedef struct {
+	volatile uint32_t CR1;
+	volatile uint32_t DIER;
+	volatile uint32_t SR;
+	volatile uint32_t EGR;
+	volatile uint32_t CNT;
+	volatile uint32_t PSC;
+	volatile uint32_t ARR;
+} TIM_TypeDef;
+
+TIM_TypeDef *sim_tim2(void);
+
+#define TIM2 (sim_tim2())
+#define TIM_CR1_CEN (1UL << 0)
+#define TIM_CR1_URS (1UL << 2)
+#define TIM_DIER_UIE (1UL << 0)
+#define TIM_SR_UIF (1UL << 0)
+#define TIM_EGR_UG (1UL << 0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
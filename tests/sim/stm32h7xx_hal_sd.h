@@ -0,0 +1,53 @@
+/**
+ * @file
+ * @brief Host stand-in for the STM32H7 HAL SD driver header
+ *
+ * Declares the subset of the HAL SD API used by rocketlib. The functions are implemented by the
+ * SD card simulator in sd_card_sim.cpp.
+ */
+
+#ifndef ROCKETLIB_SIM_STM32H7XX_HAL_SD_H
+#define ROCKETLIB_SIM_STM32H7XX_HAL_SD_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	HAL_OK = 0x00,
+	HAL_ERROR = 0x01,
+	HAL_BUSY = 0x02,
+	HAL_TIMEOUT = 0x03
+} HAL_StatusTypeDef;
+
+typedef uint32_t HAL_SD_CardStateTypeDef;
+
+#define HAL_SD_CARD_READY 0x00000001U
+#define HAL_SD_CARD_IDENTIFICATION 0x00000002U
+#define HAL_SD_CARD_STANDBY 0x00000003U
+#define HAL_SD_CARD_TRANSFER 0x00000004U
+#define HAL_SD_CARD_SENDING 0x00000005U
+#define HAL_SD_CARD_RECEIVING 0x00000006U
+#define HAL_SD_CARD_PROGRAMMING 0x00000007U
+#define HAL_SD_CARD_DISCONNECTED 0x00000008U
+#define HAL_SD_CARD_ERROR 0x000000FFU
+
+typedef struct {
+	/// @brief Simulated card attached to this handle, see sd_card_sim.hpp
+	void *sim_card;
+} SD_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_SD_ReadBlocks(SD_HandleTypeDef *hsd, uint8_t *pData, uint32_t BlockAdd,
+									uint32_t NumberOfBlocks, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SD_WriteBlocks(SD_HandleTypeDef *hsd, uint8_t *pData, uint32_t BlockAdd,
+									 uint32_t NumberOfBlocks, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SD_Erase(SD_HandleTypeDef *hsd, uint32_t BlockStartAdd, uint32_t BlockEndAdd);
+HAL_SD_CardStateTypeDef HAL_SD_GetCardState(SD_HandleTypeDef *hsd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,545 @@
+/**
+ * @file
+ * @brief Host stand-in for the XC8 device header of the PIC18F26K83
+ *
+ * Declares the special function registers used by the PIC18 drivers so they can be compiled into
+ * the unit test binary. Every register access goes through `pic18_sim_access()`, which commits the
+ * previous register writes to the peripheral models, advances the simulated instruction cycle
+ * counter and dispatches pending interrupts before returning the register storage. The models are
+ * implemented in pic18_sim.cpp, tests control them through pic18_sim.hpp.
+ *
+ * Each register has an 8 byte slot. 8-bit registers and their bitfield views alias the low byte,
+ * so pointers to registers (`&CCP1CON`) work as on the target, writes through them are committed
+ * at the next register access. DMA address registers hold host pointers (`uintptr_t`).
+ *
+ * Accessing I2C1TXB or I2C1RXB counts as a write or read of the data register, this includes taking
+ * their address for a DMA channel.
+ */
+
+#ifndef ROCKETLIB_SIM_XC_H
+#define ROCKETLIB_SIM_XC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Register list, X(name)
+#define PIC18_SIM_REGISTERS(X)                                                                     \
+	X(INTCON0)                                                                                     \
+	X(PIE3)                                                                                        \
+	X(PIR3)                                                                                        \
+	X(PIE4)                                                                                        \
+	X(PIR4)                                                                                        \
+	X(CLKRCON)                                                                                     \
+	X(CLKRCLK)                                                                                     \
+	X(I2C1CON0)                                                                                    \
+	X(I2C1CON1)                                                                                    \
+	X(I2C1CON2)                                                                                    \
+	X(I2C1ERR)                                                                                     \
+	X(I2C1STAT0)                                                                                   \
+	X(I2C1STAT1)                                                                                   \
+	X(I2C1PIR)                                                                                     \
+	X(I2C1PIE)                                                                                     \
+	X(I2C1CNT)                                                                                     \
+	X(I2C1ADB0)                                                                                    \
+	X(I2C1ADB1)                                                                                    \
+	X(I2C1TXB)                                                                                     \
+	X(I2C1RXB)                                                                                     \
+	X(I2C1CLK)                                                                                     \
+	X(RC3I2C)                                                                                      \
+	X(RC4I2C)                                                                                      \
+	X(TRISC)                                                                                       \
+	X(LATC)                                                                                        \
+	X(PORTC)                                                                                       \
+	X(ODCONC)                                                                                      \
+	X(PPSLOCK)                                                                                     \
+	X(RC3PPS)                                                                                      \
+	X(RC4PPS)                                                                                      \
+	X(TRISA)                                                                                       \
+	X(TRISB)                                                                                       \
+	X(RA0PPS)                                                                                      \
+	X(RB0PPS)                                                                                      \
+	X(RB1PPS)                                                                                      \
+	X(RB2PPS)                                                                                      \
+	X(RB3PPS)                                                                                      \
+	X(T0CON0)                                                                                      \
+	X(T0CON1)                                                                                      \
+	X(TMR0L)                                                                                       \
+	X(TMR0H)                                                                                       \
+	X(T1CON)                                                                                       \
+	X(T1CLK)                                                                                       \
+	X(TMR1)                                                                                        \
+	X(T2CON)                                                                                       \
+	X(T2CLKCON)                                                                                    \
+	X(T2TMR)                                                                                       \
+	X(T2PR)                                                                                        \
+	X(CCP1CON)                                                                                     \
+	X(CCPR1L)                                                                                      \
+	X(CCPR1H)                                                                                      \
+	X(CCP2CON)                                                                                     \
+	X(CCPR2L)                                                                                      \
+	X(CCPR2H)                                                                                      \
+	X(CCP3CON)                                                                                     \
+	X(CCPR3L)                                                                                      \
+	X(CCPR3H)                                                                                      \
+	X(CCP4CON)                                                                                     \
+	X(CCPR4L)                                                                                      \
+	X(CCPR4H)                                                                                      \
+	X(ISRPR)                                                                                       \
+	X(MAINPR)                                                                                      \
+	X(DMA1PR)                                                                                      \
+	X(PRLOCK)                                                                                      \
+	X(DMA1CON0)                                                                                    \
+	X(DMA1CON1)                                                                                    \
+	X(DMA1SSA)                                                                                     \
+	X(DMA1SSZ)                                                                                     \
+	X(DMA1SPTR)                                                                                    \
+	X(DMA1SCNT)                                                                                    \
+	X(DMA1DSA)                                                                                     \
+	X(DMA1DSZ)                                                                                     \
+	X(DMA1DPTR)                                                                                    \
+	X(DMA1DCNT)                                                                                    \
+	X(DMA1SIRQ)                                                                                    \
+	X(DMA1AIRQ)
+
+typedef enum {
+#define PIC18_SIM_REG_ID(name) PIC18_SIM_##name,
+	PIC18_SIM_REGISTERS(PIC18_SIM_REG_ID)
+#undef PIC18_SIM_REG_ID
+		PIC18_SIM_NUM_REGS
+} pic18_sim_reg_t;
+
+/**
+ * @brief Access a register, called by every register macro
+ *
+ * @param reg Register
+ * @return Storage of the register, valid until the next call
+ */
+volatile void *pic18_sim_access(pic18_sim_reg_t reg);
+
+/**
+ * @brief Busy wait, advances the simulated time
+ */
+void pic18_sim_delay_us(uint32_t us);
+
+/**
+ * @brief One instruction cycle of idle spinning, lets the peripherals and interrupts run
+ */
+void pic18_sim_nop(void);
+
+#define PIC18_SIM_SFR(type, name) (*(volatile type *)pic18_sim_access(PIC18_SIM_##name))
+
+#define __delay_us(x) pic18_sim_delay_us(x)
+#define __delay_ms(x) pic18_sim_delay_us((uint32_t)(x) * 1000UL)
+#define NOP() pic18_sim_nop()
+#define CLRWDT() pic18_sim_nop()
+
+// Interrupt control
+
+typedef struct {
+	unsigned INT0EDG : 1;
+	unsigned INT1EDG : 1;
+	unsigned INT2EDG : 1;
+	unsigned : 2;
+	unsigned IPEN : 1;
+	unsigned GIEL : 1;
+	unsigned GIE : 1;
+} INTCON0bits_t;
+#define INTCON0 PIC18_SIM_SFR(uint8_t, INTCON0)
+#define INTCON0bits PIC18_SIM_SFR(INTCON0bits_t, INTCON0)
+
+#define di() (INTCON0bits.GIE = 0)
+#define ei() (INTCON0bits.GIE = 1)
+
+typedef struct {
+	unsigned I2C1RXIE : 1;
+	unsigned I2C1TXIE : 1;
+	unsigned I2C1IE : 1;
+	unsigned I2C1EIE : 1;
+	unsigned TMR1IE : 1;
+	unsigned TMR1GIE : 1;
+	unsigned CCP1IE : 1;
+	unsigned TMR0IE : 1;
+} PIE3bits_t;
+#define PIE3 PIC18_SIM_SFR(uint8_t, PIE3)
+#define PIE3bits PIC18_SIM_SFR(PIE3bits_t, PIE3)
+
+// The I2C1 flags are read-only, they follow the module state
+typedef struct {
+	unsigned I2C1RXIF : 1;
+	unsigned I2C1TXIF : 1;
+	unsigned I2C1IF : 1;
+	unsigned I2C1EIF : 1;
+	unsigned TMR1IF : 1;
+	unsigned TMR1GIF : 1;
+	unsigned CCP1IF : 1;
+	unsigned TMR0IF : 1;
+} PIR3bits_t;
+#define PIR3 PIC18_SIM_SFR(uint8_t, PIR3)
+#define PIR3bits PIC18_SIM_SFR(PIR3bits_t, PIR3)
+
+// Only the Timer2 interrupt is modelled in the fourth bank
+typedef struct {
+	unsigned : 1;
+	unsigned TMR2IE : 1;
+	unsigned : 6;
+} PIE4bits_t;
+#define PIE4 PIC18_SIM_SFR(uint8_t, PIE4)
+#define PIE4bits PIC18_SIM_SFR(PIE4bits_t, PIE4)
+
+typedef struct {
+	unsigned : 1;
+	unsigned TMR2IF : 1;
+	unsigned : 6;
+} PIR4bits_t;
+#define PIR4 PIC18_SIM_SFR(uint8_t, PIR4)
+#define PIR4bits PIC18_SIM_SFR(PIR4bits_t, PIR4)
+
+// Reference clock output, drives the I2C clock in the default configuration
+
+typedef struct {
+	unsigned CLKRDIV : 3;
+	unsigned CLKRDC : 2;
+	unsigned : 2;
+	unsigned CLKREN : 1;
+} CLKRCONbits_t;
+#define CLKRCON PIC18_SIM_SFR(uint8_t, CLKRCON)
+#define CLKRCONbits PIC18_SIM_SFR(CLKRCONbits_t, CLKRCON)
+
+typedef struct {
+	unsigned CLKRCLK : 4;
+	unsigned : 4;
+} CLKRCLKbits_t;
+#define CLKRCLK PIC18_SIM_SFR(uint8_t, CLKRCLK)
+#define CLKRCLKbits PIC18_SIM_SFR(CLKRCLKbits_t, CLKRCLK)
+
+// I2C1
+
+typedef struct {
+	unsigned MODE : 3;
+	unsigned MDR : 1;
+	unsigned CSTR : 1;
+	unsigned S : 1;
+	unsigned RSEN : 1;
+	unsigned EN : 1;
+} I2C1CON0bits_t;
+#define I2C1CON0 PIC18_SIM_SFR(uint8_t, I2C1CON0)
+#define I2C1CON0bits PIC18_SIM_SFR(I2C1CON0bits_t, I2C1CON0)
+
+typedef struct {
+	unsigned CSD : 1;
+	unsigned TXU : 1;
+	unsigned RXO : 1;
+	unsigned : 1;
+	unsigned ACKT : 1;
+	unsigned ACKSTAT : 1;
+	unsigned ACKDT : 1;
+	unsigned ACKCNT : 1;
+} I2C1CON1bits_t;
+#define I2C1CON1 PIC18_SIM_SFR(uint8_t, I2C1CON1)
+#define I2C1CON1bits PIC18_SIM_SFR(I2C1CON1bits_t, I2C1CON1)
+
+typedef struct {
+	unsigned BFRET : 2;
+	unsigned SDAHT : 2;
+	unsigned ABD : 1;
+	unsigned FME : 1;
+	unsigned GCEN : 1;
+	unsigned ACNT : 1;
+} I2C1CON2bits_t;
+#define I2C1CON2 PIC18_SIM_SFR(uint8_t, I2C1CON2)
+#define I2C1CON2bits PIC18_SIM_SFR(I2C1CON2bits_t, I2C1CON2)
+
+typedef struct {
+	unsigned NACKIE : 1;
+	unsigned BCLIE : 1;
+	unsigned BTOIE : 1;
+	unsigned : 1;
+	unsigned NACKIF : 1;
+	unsigned BCLIF : 1;
+	unsigned BTOIF : 1;
+	unsigned : 1;
+} I2C1ERRbits_t;
+#define I2C1ERR PIC18_SIM_SFR(uint8_t, I2C1ERR)
+#define I2C1ERRbits PIC18_SIM_SFR(I2C1ERRbits_t, I2C1ERR)
+
+typedef struct {
+	unsigned : 3;
+	unsigned D : 1;
+	unsigned R : 1;
+	unsigned MMA : 1;
+	unsigned SMA : 1;
+	unsigned BFRE : 1;
+} I2C1STAT0bits_t;
+#define I2C1STAT0 PIC18_SIM_SFR(uint8_t, I2C1STAT0)
+#define I2C1STAT0bits PIC18_SIM_SFR(I2C1STAT0bits_t, I2C1STAT0)
+
+typedef struct {
+	unsigned RXBF : 1;
+	unsigned : 1;
+	unsigned CLRBF : 1;
+	unsigned RXRE : 1;
+	unsigned : 1;
+	unsigned TXBE : 1;
+	unsigned : 1;
+	unsigned TXWE : 1;
+} I2C1STAT1bits_t;
+#define I2C1STAT1 PIC18_SIM_SFR(uint8_t, I2C1STAT1)
+#define I2C1STAT1bits PIC18_SIM_SFR(I2C1STAT1bits_t, I2C1STAT1)
+
+typedef struct {
+	unsigned SCIF : 1;
+	unsigned RSCIF : 1;
+	unsigned PCIF : 1;
+	unsigned ADRIF : 1;
+	unsigned WRIF : 1;
+	unsigned : 1;
+	unsigned ACKTIF : 1;
+	unsigned CNTIF : 1;
+} I2C1PIRbits_t;
+#define I2C1PIR PIC18_SIM_SFR(uint8_t, I2C1PIR)
+#define I2C1PIRbits PIC18_SIM_SFR(I2C1PIRbits_t, I2C1PIR)
+
+typedef struct {
+	unsigned SCIE : 1;
+	unsigned RSCIE : 1;
+	unsigned PCIE : 1;
+	unsigned ADRIE : 1;
+	unsigned WRIE : 1;
+	unsigned : 1;
+	unsigned ACKTIE : 1;
+	unsigned CNTIE : 1;
+} I2C1PIEbits_t;
+#define I2C1PIE PIC18_SIM_SFR(uint8_t, I2C1PIE)
+#define I2C1PIEbits PIC18_SIM_SFR(I2C1PIEbits_t, I2C1PIE)
+
+#define I2C1CNT PIC18_SIM_SFR(uint8_t, I2C1CNT)
+#define I2C1ADB0 PIC18_SIM_SFR(uint8_t, I2C1ADB0)
+#define I2C1ADB1 PIC18_SIM_SFR(uint8_t, I2C1ADB1)
+#define I2C1TXB PIC18_SIM_SFR(uint8_t, I2C1TXB)
+#define I2C1RXB PIC18_SIM_SFR(uint8_t, I2C1RXB)
+#define I2C1CLK PIC18_SIM_SFR(uint8_t, I2C1CLK)
+
+// I2C pad control of the default I2C1 pins, RC3 (SCL) and RC4 (SDA)
+
+typedef struct {
+	unsigned TH : 2;
+	unsigned : 2;
+	unsigned PU : 2;
+	unsigned SLEW : 2;
+} RC3I2Cbits_t;
+#define RC3I2C PIC18_SIM_SFR(uint8_t, RC3I2C)
+#define RC3I2Cbits PIC18_SIM_SFR(RC3I2Cbits_t, RC3I2C)
+
+typedef RC3I2Cbits_t RC4I2Cbits_t;
+#define RC4I2C PIC18_SIM_SFR(uint8_t, RC4I2C)
+#define RC4I2Cbits PIC18_SIM_SFR(RC4I2Cbits_t, RC4I2C)
+
+// Port C, only RC3 (SCL) and RC4 (SDA) are modelled. With their PPS output cleared the pins are
+// driven by LATC, PORTC follows the bus lines.
+
+#define PIC18_SIM_PORTC_BITS(prefix)                                                               \
+	typedef struct {                                                                               \
+		unsigned prefix##0 : 1;                                                                    \
+		unsigned prefix##1 : 1;                                                                    \
+		unsigned prefix##2 : 1;                                                                    \
+		unsigned prefix##3 : 1;                                                                    \
+		unsigned prefix##4 : 1;                                                                    \
+		unsigned prefix##5 : 1;                                                                    \
+		unsigned prefix##6 : 1;                                                                    \
+		unsigned prefix##7 : 1;                                                                    \
+	}
+
+PIC18_SIM_PORTC_BITS(TRISC) TRISCbits_t;
+#define TRISC PIC18_SIM_SFR(uint8_t, TRISC)
+#define TRISCbits PIC18_SIM_SFR(TRISCbits_t, TRISC)
+
+PIC18_SIM_PORTC_BITS(LATC) LATCbits_t;
+#define LATC PIC18_SIM_SFR(uint8_t, LATC)
+#define LATCbits PIC18_SIM_SFR(LATCbits_t, LATC)
+
+PIC18_SIM_PORTC_BITS(RC) PORTCbits_t;
+#define PORTC PIC18_SIM_SFR(uint8_t, PORTC)
+#define PORTCbits PIC18_SIM_SFR(PORTCbits_t, PORTC)
+
+PIC18_SIM_PORTC_BITS(ODCC) ODCONCbits_t;
+#define ODCONC PIC18_SIM_SFR(uint8_t, ODCONC)
+#define ODCONCbits PIC18_SIM_SFR(ODCONCbits_t, ODCONC)
+
+typedef struct {
+	unsigned PPSLOCKED : 1;
+	unsigned : 7;
+} PPSLOCKbits_t;
+#define PPSLOCK PIC18_SIM_SFR(uint8_t, PPSLOCK)
+#define PPSLOCKbits PIC18_SIM_SFR(PPSLOCKbits_t, PPSLOCK)
+
+#define RC3PPS PIC18_SIM_SFR(uint8_t, RC3PPS)
+#define RC4PPS PIC18_SIM_SFR(uint8_t, RC4PPS)
+
+// Ports A and B have no modelled pins, they are PWM outputs of the tests
+
+PIC18_SIM_PORTC_BITS(TRISA) TRISAbits_t;
+#define TRISA PIC18_SIM_SFR(uint8_t, TRISA)
+#define TRISAbits PIC18_SIM_SFR(TRISAbits_t, TRISA)
+
+PIC18_SIM_PORTC_BITS(TRISB) TRISBbits_t;
+#define TRISB PIC18_SIM_SFR(uint8_t, TRISB)
+#define TRISBbits PIC18_SIM_SFR(TRISBbits_t, TRISB)
+
+#define RA0PPS PIC18_SIM_SFR(uint8_t, RA0PPS)
+#define RB0PPS PIC18_SIM_SFR(uint8_t, RB0PPS)
+#define RB1PPS PIC18_SIM_SFR(uint8_t, RB1PPS)
+#define RB2PPS PIC18_SIM_SFR(uint8_t, RB2PPS)
+#define RB3PPS PIC18_SIM_SFR(uint8_t, RB3PPS)
+
+// Timer0, 8-bit with TMR0H as period register or 16-bit with TMR0H buffered by TMR0L accesses.
+// Sets PIR3 TMR0IF every OUTPS + 1 periods.
+
+typedef struct {
+	unsigned OUTPS : 4;
+	unsigned MD16 : 1;
+	unsigned OUT : 1;
+	unsigned : 1;
+	unsigned EN : 1;
+} T0CON0bits_t;
+#define T0CON0 PIC18_SIM_SFR(uint8_t, T0CON0)
+#define T0CON0bits PIC18_SIM_SFR(T0CON0bits_t, T0CON0)
+
+typedef struct {
+	unsigned CKPS : 4;
+	unsigned ASYNC : 1;
+	unsigned CS : 3;
+} T0CON1bits_t;
+#define T0CON1 PIC18_SIM_SFR(uint8_t, T0CON1)
+#define T0CON1bits PIC18_SIM_SFR(T0CON1bits_t, T0CON1)
+
+#define TMR0L PIC18_SIM_SFR(uint8_t, TMR0L)
+#define TMR0H PIC18_SIM_SFR(uint8_t, TMR0H)
+
+// Timer1, counts when enabled with the Fosc/4 clock
+
+typedef struct {
+	unsigned ON : 1;
+	unsigned RD16 : 1;
+	unsigned nSYNC : 1;
+	unsigned : 1;
+	unsigned CKPS : 2;
+	unsigned : 2;
+} T1CONbits_t;
+#define T1CON PIC18_SIM_SFR(uint8_t, T1CON)
+#define T1CONbits PIC18_SIM_SFR(T1CONbits_t, T1CON)
+
+#define T1CLK PIC18_SIM_SFR(uint8_t, T1CLK)
+#define TMR1 PIC18_SIM_SFR(uint16_t, TMR1)
+
+// Timer2 in free running period mode, the time base of the CCP PWMs. Sets PIR4 TMR2IF every
+// T2OUTPS + 1 periods. Only the legacy bit names are declared.
+
+typedef struct {
+	unsigned T2OUTPS : 4;
+	unsigned T2CKPS : 3;
+	unsigned TMR2ON : 1;
+} T2CONbits_t;
+#define T2CON PIC18_SIM_SFR(uint8_t, T2CON)
+#define T2CONbits PIC18_SIM_SFR(T2CONbits_t, T2CON)
+
+typedef struct {
+	unsigned CS : 4;
+	unsigned : 4;
+} T2CLKCONbits_t;
+#define T2CLKCON PIC18_SIM_SFR(uint8_t, T2CLKCON)
+#define T2CLKCONbits PIC18_SIM_SFR(T2CLKCONbits_t, T2CLKCON)
+
+#define T2TMR PIC18_SIM_SFR(uint8_t, T2TMR)
+#define T2PR PIC18_SIM_SFR(uint8_t, T2PR)
+#define TMR2 T2TMR
+#define PR2 T2PR
+
+// CCP1 to CCP4, all on Timer2. In PWM mode the duty cycle in CCPRxH:L is latched at the end of
+// every Timer2 period.
+
+typedef struct {
+	unsigned MODE : 4;
+	unsigned FMT : 1;
+	unsigned OUT : 1;
+	unsigned : 1;
+	unsigned EN : 1;
+} CCP1CONbits_t;
+#define CCP1CON PIC18_SIM_SFR(uint8_t, CCP1CON)
+#define CCP1CONbits PIC18_SIM_SFR(CCP1CONbits_t, CCP1CON)
+#define CCPR1L PIC18_SIM_SFR(uint8_t, CCPR1L)
+#define CCPR1H PIC18_SIM_SFR(uint8_t, CCPR1H)
+
+typedef CCP1CONbits_t CCP2CONbits_t;
+#define CCP2CON PIC18_SIM_SFR(uint8_t, CCP2CON)
+#define CCP2CONbits PIC18_SIM_SFR(CCP2CONbits_t, CCP2CON)
+#define CCPR2L PIC18_SIM_SFR(uint8_t, CCPR2L)
+#define CCPR2H PIC18_SIM_SFR(uint8_t, CCPR2H)
+
+typedef CCP1CONbits_t CCP3CONbits_t;
+#define CCP3CON PIC18_SIM_SFR(uint8_t, CCP3CON)
+#define CCP3CONbits PIC18_SIM_SFR(CCP3CONbits_t, CCP3CON)
+#define CCPR3L PIC18_SIM_SFR(uint8_t, CCPR3L)
+#define CCPR3H PIC18_SIM_SFR(uint8_t, CCPR3H)
+
+typedef CCP1CONbits_t CCP4CONbits_t;
+#define CCP4CON PIC18_SIM_SFR(uint8_t, CCP4CON)
+#define CCP4CONbits PIC18_SIM_SFR(CCP4CONbits_t, CCP4CON)
+#define CCPR4L PIC18_SIM_SFR(uint8_t, CCPR4L)
+#define CCPR4H PIC18_SIM_SFR(uint8_t, CCPR4H)
+
+// System arbiter, DMA transfers only run once the priorities are locked
+
+#define ISRPR PIC18_SIM_SFR(uint8_t, ISRPR)
+#define MAINPR PIC18_SIM_SFR(uint8_t, MAINPR)
+#define DMA1PR PIC18_SIM_SFR(uint8_t, DMA1PR)
+
+typedef struct {
+	unsigned PRLOCKED : 1;
+	unsigned : 7;
+} PRLOCKbits_t;
+#define PRLOCK PIC18_SIM_SFR(uint8_t, PRLOCK)
+#define PRLOCKbits PIC18_SIM_SFR(PRLOCKbits_t, PRLOCK)
+
+// DMA1, triggered by the interrupt flag selected in DMA1SIRQ
+
+typedef struct {
+	unsigned XIP : 1;
+	unsigned : 1;
+	unsigned AIRQEN : 1;
+	unsigned : 2;
+	unsigned DGO : 1;
+	unsigned SIRQEN : 1;
+	unsigned EN : 1;
+} DMA1CON0bits_t;
+#define DMA1CON0 PIC18_SIM_SFR(uint8_t, DMA1CON0)
+#define DMA1CON0bits PIC18_SIM_SFR(DMA1CON0bits_t, DMA1CON0)
+
+typedef struct {
+	unsigned SSTP : 1;
+	unsigned SMODE : 2;
+	unsigned SMR : 2;
+	unsigned DSTP : 1;
+	unsigned DMODE : 2;
+} DMA1CON1bits_t;
+#define DMA1CON1 PIC18_SIM_SFR(uint8_t, DMA1CON1)
+#define DMA1CON1bits PIC18_SIM_SFR(DMA1CON1bits_t, DMA1CON1)
+
+#define DMA1SSA PIC18_SIM_SFR(uintptr_t, DMA1SSA)
+#define DMA1SSZ PIC18_SIM_SFR(uint16_t, DMA1SSZ)
+#define DMA1SPTR PIC18_SIM_SFR(uintptr_t, DMA1SPTR)
+#define DMA1SCNT PIC18_SIM_SFR(uint16_t, DMA1SCNT)
+#define DMA1DSA PIC18_SIM_SFR(uintptr_t, DMA1DSA)
+#define DMA1DSZ PIC18_SIM_SFR(uint16_t, DMA1DSZ)
+#define DMA1DPTR PIC18_SIM_SFR(uintptr_t, DMA1DPTR)
+#define DMA1DCNT PIC18_SIM_SFR(uint16_t, DMA1DCNT)
+#define DMA1SIRQ PIC18_SIM_SFR(uint8_t, DMA1SIRQ)
+#define DMA1AIRQ PIC18_SIM_SFR(uint8_t, DMA1AIRQ)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,728 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+
+#include "common.h"
+#include "pic18_sim.hpp"
+#include "pic18f26k83/i2c.h"
+#include "xc.h"
+
+#include "rockettest.hpp"
+
+#define SENSOR_ADDR 0x48
+#define OTHER_ADDR 0x1d
+
+// Top level ISR of the firmware
+static void i2c_test_isr(void) {
+	if (PIR3bits.I2C1IF || PIR3bits.I2C1EIF || PIR3bits.I2C1TXIF || PIR3bits.I2C1RXIF) {
+		i2c_handle_interrupt();
+	}
+}
+
+static void i2c_test_setup(void) {
+	pic18_sim::reset();
+	pic18_sim::set_isr(i2c_test_isr);
+	i2c_init(0);
+	ei();
+}
+
+class i2c_blocking_test : rockettest_test {
+public:
+	i2c_blocking_test() : rockettest_test("i2c_blocking_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		pic18_sim_i2c_regs sensor(SENSOR_ADDR);
+		i2c_test_setup();
+		rockettest_check_expr_true(pic18_sim::i2c_scl_hz() == 100000);
+
+		rockettest_check_expr_true(i2c_write_reg8(SENSOR_ADDR, 0x10, 0x5a) == W_SUCCESS);
+		rockettest_check_expr_true(sensor.regs[0x10] == 0x5a);
+		rockettest_check_expr_true(i2c_write_reg16(SENSOR_ADDR, 0x20, 0x1234) == W_SUCCESS);
+		rockettest_check_expr_true((sensor.regs[0x20] == 0x12) && (sensor.regs[0x21] == 0x34));
+
+		uint8_t value8 = 0;
+		rockettest_check_expr_true(i2c_read_reg8(SENSOR_ADDR, 0x10, &value8) == W_SUCCESS);
+		rockettest_check_expr_true(value8 == 0x5a);
+
+		// The caller is blocked for the whole bus transaction
+		uint16_t value16 = 0;
+		std::uint64_t start = pic18_sim::cycles();
+		rockettest_check_expr_true(i2c_read_reg16(SENSOR_ADDR, 0x20, &value16) == W_SUCCESS);
+		double blocked_us = (pic18_sim::cycles() - start) * 4e6 / pic18_sim::fosc_hz();
+		rockettest_check_expr_true(value16 == 0x1234);
+		rockettest_check_expr_true(blocked_us > 400);
+		printf("Blocking 16-bit register read at 100 kHz: caller blocked %.0f us\n", blocked_us);
+
+		// No device at the address
+		rockettest_check_expr_true(i2c_write_reg8(OTHER_ADDR, 0x10, 0x00) == W_IO_ERROR);
+
+		return test_passed;
+	}
+};
+
+i2c_blocking_test i2c_blocking_test_inst;
+
+class i2c_timer_test : rockettest_test {
+public:
+	i2c_timer_test() : rockettest_test("i2c_timer_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		pic18_sim_i2c_regs sensor(SENSOR_ADDR);
+		pic18_sim::reset();
+		pic18_sim::set_isr(i2c_test_isr);
+
+		// Timer1 already running for the application with another prescaler is left alone
+		T1CLK = 0x01;
+		T1CON = 0x03;
+		rockettest_check_expr_true(i2c_init(0) == W_FAILURE);
+		rockettest_check_expr_true(i2c_init_freq(400000, nullptr) == W_FAILURE);
+		rockettest_check_expr_true(T1CON == 0x03);
+		rockettest_check_expr_true(I2C1CON0bits.EN == 0);
+
+		// Another clock source
+		T1CLK = 0x02;
+		T1CON = I2C_TIMER_T1CON;
+		rockettest_check_expr_true(i2c_init(0) == W_FAILURE);
+
+		// Shared with the same configuration
+		T1CLK = I2C_TIMER_T1CLK;
+		rockettest_check_expr_true(i2c_init(0) == W_SUCCESS);
+		rockettest_check_expr_true(i2c_write_reg8(SENSOR_ADDR, 0x10, 0x5a) == W_SUCCESS);
+		rockettest_check_expr_true(sensor.regs[0x10] == 0x5a);
+
+		// A stopped Timer1 is taken over
+		T1CON = 0x00;
+		rockettest_check_expr_true(i2c_init(0) == W_SUCCESS);
+		rockettest_check_expr_true(T1CON == I2C_TIMER_T1CON);
+
+		return test_passed;
+	}
+};
+
+i2c_timer_test i2c_timer_test_inst;
+
+struct i2c_test_chain {
+	i2c_transaction_t *next;
+	int completions;
+};
+
+static void i2c_test_callback(i2c_transaction_t *transaction) {
+	i2c_test_chain *chain = static_cast<i2c_test_chain *>(transaction->arg);
+	chain->completions++;
+	if (chain->next) {
+		i2c_submit(chain->next);
+		chain->next = nullptr;
+	}
+}
+
+class i2c_engine_test : rockettest_test {
+public:
+	i2c_engine_test() : rockettest_test("i2c_engine_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		pic18_sim_i2c_regs sensor(SENSOR_ADDR);
+		sensor.regs[0x20] = 0x12;
+		sensor.regs[0x21] = 0x34;
+		i2c_test_setup();
+
+		// Register read: write the register address, then read two bytes
+		uint8_t reg = 0x20;
+		uint8_t data[2] = {0};
+		i2c_transaction_t read = {};
+		read.address = SENSOR_ADDR;
+		read.write_data = &reg;
+		read.write_len = 1;
+		read.read_data = data;
+		read.read_len = 2;
+
+		std::uint64_t start = pic18_sim::cycles();
+		rockettest_check_expr_true(i2c_submit(&read) == W_SUCCESS);
+		double submit_us = (pic18_sim::cycles() - start) * 4e6 / pic18_sim::fosc_hz();
+		rockettest_check_expr_true(!read.done);
+		rockettest_check_expr_true(!i2c_idle());
+		rockettest_check_expr_true(submit_us < 20);
+
+		std::uint64_t isr_before = pic18_sim::isr_cycles();
+		rockettest_check_expr_true(pic18_sim::run_until([&] { return read.done; }, 1000));
+		double busy_us = (pic18_sim::isr_cycles() - isr_before) * 4e6 / pic18_sim::fosc_hz();
+		rockettest_check_expr_true(read.status == W_SUCCESS);
+		rockettest_check_expr_true((data[0] == 0x12) && (data[1] == 0x34));
+		rockettest_check_expr_true(i2c_idle());
+		rockettest_check_expr_true(busy_us < 100);
+		printf("Queued 16-bit register read: submit %.1f us, interrupts %.1f us\n",
+			   submit_us,
+			   busy_us);
+
+		// Queue full
+		uint8_t payload[3] = {0x30, 1, 2};
+		i2c_transaction_t writes[I2C_QUEUE_SIZE + 1] = {};
+		for (int i = 0; i < I2C_QUEUE_SIZE + 1; i++) {
+			writes[i].address = SENSOR_ADDR;
+			writes[i].write_data = payload;
+			writes[i].write_len = 3;
+		}
+		for (int i = 0; i < I2C_QUEUE_SIZE; i++) {
+			rockettest_check_expr_true(i2c_submit(&writes[i]) == W_SUCCESS);
+		}
+		rockettest_check_expr_true(i2c_submit(&writes[I2C_QUEUE_SIZE]) == W_OVERFLOW);
+
+		// The blocking functions do not interfere with queued transactions
+		rockettest_check_expr_true(i2c_write_reg8(SENSOR_ADDR, 0x10, 0) == W_FAILURE);
+
+		rockettest_check_expr_true(
+			pic18_sim::run_until([&] { return writes[I2C_QUEUE_SIZE - 1].done; }, 10000));
+		for (int i = 0; i < I2C_QUEUE_SIZE; i++) {
+			rockettest_check_expr_true(writes[i].done && (writes[i].status == W_SUCCESS));
+		}
+		rockettest_check_expr_true(sensor.starts == 2 + I2C_QUEUE_SIZE);
+
+		// Missing device, the queue continues with the next transaction
+		i2c_transaction_t missing = {};
+		missing.address = OTHER_ADDR;
+		missing.write_data = payload;
+		missing.write_len = 3;
+		rockettest_check_expr_true(i2c_submit(&missing) == W_SUCCESS);
+		rockettest_check_expr_true(i2c_submit(&read) == W_SUCCESS);
+		rockettest_check_expr_true(pic18_sim::run_until([&] { return read.done; }, 2000));
+		rockettest_check_expr_true(missing.done && (missing.status == W_IO_ERROR));
+		rockettest_check_expr_true(read.status == W_SUCCESS);
+
+		// Address probe
+		i2c_transaction_t probe = {};
+		probe.address = SENSOR_ADDR;
+		rockettest_check_expr_true(i2c_submit(&probe) == W_SUCCESS);
+		rockettest_check_expr_true(pic18_sim::run_until([&] { return probe.done; }, 1000));
+		rockettest_check_expr_true(probe.status == W_SUCCESS);
+
+		// Completion callback chaining the next transaction
+		i2c_test_chain chain = {&read, 0};
+		writes[0].callback = i2c_test_callback;
+		writes[0].arg = &chain;
+		data[0] = data[1] = 0;
+		rockettest_check_expr_true(i2c_submit(&writes[0]) == W_SUCCESS);
+		rockettest_check_expr_true(pic18_sim::run_until(
+			[&] { return (chain.completions == 1) && read.done; }, 2000));
+		rockettest_check_expr_true((data[0] == 0x12) && (data[1] == 0x34));
+		rockettest_check_expr_true(i2c_idle());
+
+		// Blocking functions work again once the queue is empty
+		rockettest_check_expr_true(i2c_write_reg8(SENSOR_ADDR, 0x10, 0x77) == W_SUCCESS);
+		rockettest_check_expr_true(sensor.regs[0x10] == 0x77);
+
+		rockettest_check_expr_true(i2c_submit(nullptr) == W_INVALID_PARAM);
+		i2c_transaction_t bad = {};
+		bad.read_len = 1;
+		rockettest_check_expr_true(i2c_submit(&bad) == W_INVALID_PARAM);
+
+		return test_passed;
+	}
+};
+
+i2c_engine_test i2c_engine_test_inst;
+
+// CPU cycles of a queued register read, spent in interrupts or taken by the DMA
+static std::uint64_t i2c_test_burst_cycles(i2c_transaction_t *read) {
+	std::uint64_t before = pic18_sim::isr_cycles() + pic18_sim::dma_cycles();
+	if ((i2c_submit(read) != W_SUCCESS) ||
+		!pic18_sim::run_until([&] { return read->done; }, 5000)) {
+		return 0;
+	}
+	return pic18_sim::isr_cycles() + pic18_sim::dma_cycles() - before;
+}
+
+class i2c_dma_test : rockettest_test {
+public:
+	i2c_dma_test() : rockettest_test("i2c_dma_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		// IMU style FIFO dump, 32 bytes starting at register 0x40
+		pic18_sim_i2c_regs sensor(SENSOR_ADDR);
+		for (int i = 0; i < 32; i++) {
+			sensor.regs[0x40 + i] = static_cast<std::uint8_t>(0xa0 + i);
+		}
+		i2c_test_setup();
+
+		uint8_t reg = 0x40;
+		uint8_t data[32] = {0};
+		i2c_transaction_t read = {};
+		read.address = SENSOR_ADDR;
+		read.write_data = &reg;
+		read.write_len = 1;
+		read.read_data = data;
+		read.read_len = sizeof(data);
+
+		std::uint64_t irq_cycles = i2c_test_burst_cycles(&read);
+		rockettest_check_expr_true((irq_cycles > 0) && (read.status == W_SUCCESS));
+		rockettest_check_expr_true((data[0] == 0xa0) && (data[31] == 0xbf));
+		rockettest_check_expr_true(pic18_sim::dma_bytes() == 0);
+
+		rockettest_check_expr_true(i2c_dma_init(8) == W_SUCCESS);
+		rockettest_check_expr_true(pic18_sim::reg(PIC18_SIM_PRLOCK) == 1);
+
+		std::fill(std::begin(data), std::end(data), 0);
+		std::uint32_t isr_before = pic18_sim::isr_count();
+		std::uint64_t dma_cycles = i2c_test_burst_cycles(&read);
+		rockettest_check_expr_true((dma_cycles > 0) && (read.status == W_SUCCESS));
+		rockettest_check_expr_true((data[0] == 0xa0) && (data[31] == 0xbf));
+		// Only the register address byte is written by the CPU, the read phase is DMA only
+		rockettest_check_expr_true(pic18_sim::dma_bytes() == 32);
+		rockettest_check_expr_true(pic18_sim::isr_count() - isr_before == 2);
+		rockettest_check_expr_true(pic18_sim::reg(PIC18_SIM_DMA1CON0) == 0);
+		rockettest_check_expr_true(dma_cycles * 4 < irq_cycles);
+		printf("32-byte register read: %.1f CPU cycles/byte with interrupts, %.1f with DMA\n",
+			   irq_cycles / 33.0,
+			   dma_cycles / 33.0);
+
+		// Burst write on DMA
+		uint8_t burst[17] = {0x60};
+		for (int i = 1; i < 17; i++) {
+			burst[i] = static_cast<std::uint8_t>(i);
+		}
+		i2c_transaction_t write = {};
+		write.address = SENSOR_ADDR;
+		write.write_data = burst;
+		write.write_len = sizeof(burst);
+		rockettest_check_expr_true(i2c_submit(&write) == W_SUCCESS);
+		rockettest_check_expr_true(i2c_dma_init(0) == W_FAILURE);
+		rockettest_check_expr_true(pic18_sim::run_until([&] { return write.done; }, 5000));
+		rockettest_check_expr_true(write.status == W_SUCCESS);
+		rockettest_check_expr_true((sensor.regs[0x60] == 1) && (sensor.regs[0x6f] == 16));
+
+		// Missing device, the channel is released
+		i2c_transaction_t missing = write;
+		missing.address = OTHER_ADDR;
+		rockettest_check_expr_true(i2c_submit(&missing) == W_SUCCESS);
+		rockettest_check_expr_true(pic18_sim::run_until([&] { return missing.done; }, 5000));
+		rockettest_check_expr_true(missing.status == W_IO_ERROR);
+		rockettest_check_expr_true(pic18_sim::reg(PIC18_SIM_DMA1CON0) == 0);
+
+		// Blocking functions keep their behaviour on DMA
+		std::fill(std::begin(data), std::end(data), 0);
+		rockettest_check_expr_true(i2c_write_data(SENSOR_ADDR, &reg, 1) == W_SUCCESS);
+		rockettest_check_expr_true(i2c_read_data(SENSOR_ADDR, data, 32) == W_SUCCESS);
+		rockettest_check_expr_true((data[0] == 0xa0) && (data[31] == 0xbf));
+		rockettest_check_expr_true(i2c_write_data(SENSOR_ADDR, burst, 9) == W_SUCCESS);
+		rockettest_check_expr_true(sensor.regs[0x67] == 8);
+		// The write to the missing device moved its first byte to I2C1TXB before the address NACK
+		rockettest_check_expr_true(pic18_sim::dma_bytes() == 32 + 17 + 1 + 32 + 9);
+		rockettest_check_expr_true(i2c_read_data(OTHER_ADDR, data, 32) == W_IO_ERROR);
+
+		rockettest_check_expr_true(i2c_dma_init(0) == W_SUCCESS);
+		return test_passed;
+	}
+};
+
+i2c_dma_test i2c_dma_test_inst;
+
+// Target that forgets its register pointer on a stop, register reads need a repeated start
+class i2c_test_strict_sensor : public pic18_sim_i2c_regs {
+public:
+	explicit i2c_test_strict_sensor(std::uint8_t address) : pic18_sim_i2c_regs(address) {}
+
+	void stop() override {
+		pointer = 0;
+	}
+};
+
+class i2c_repeated_start_test : rockettest_test {
+public:
+	i2c_repeated_start_test() : rockettest_test("i2c_repeated_start_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		// 6-axis sample, three 16-bit registers starting at 0x3b
+		i2c_test_strict_sensor imu(SENSOR_ADDR);
+		for (int i = 0; i < 6; i++) {
+			imu.regs[0x3b + i] = static_cast<std::uint8_t>(0x10 + i);
+		}
+		i2c_test_setup();
+
+		// Separate write and read transactions lose the register pointer
+		uint8_t reg = 0x3b;
+		uint8_t sample[6] = {0};
+		rockettest_check_expr_true(i2c_write_data(SENSOR_ADDR, &reg, 1) == W_SUCCESS);
+		rockettest_check_expr_true(i2c_read_data(SENSOR_ADDR, sample, 6) == W_SUCCESS);
+		rockettest_check_expr_true(sample[0] != 0x10);
+
+		// One register per transaction
+		std::uint64_t start = pic18_sim::cycles();
+		for (int i = 0; i < 6; i++) {
+			uint8_t axis_reg = static_cast<uint8_t>(0x3b + i);
+			w_status_t status = i2c_read_reg8(SENSOR_ADDR, axis_reg, &sample[i]);
+			rockettest_check_expr_true(status == W_SUCCESS);
+			rockettest_check_expr_true(sample[i] == 0x10 + i);
+		}
+		double single_us = (pic18_sim::cycles() - start) * 4e6 / pic18_sim::fosc_hz();
+		rockettest_check_expr_true(pic18_sim::i2c_restarts() == 6);
+
+		// One transaction with a repeated start
+		std::uint32_t starts = pic18_sim::i2c_starts();
+		std::uint32_t stops = pic18_sim::i2c_stops();
+		start = pic18_sim::cycles();
+		rockettest_check_expr_true(i2c_read_regs(SENSOR_ADDR, 0x3b, sample, 6) == W_SUCCESS);
+		double combined_us = (pic18_sim::cycles() - start) * 4e6 / pic18_sim::fosc_hz();
+		for (int i = 0; i < 6; i++) {
+			rockettest_check_expr_true(sample[i] == 0x10 + i);
+		}
+		rockettest_check_expr_true(pic18_sim::i2c_starts() - starts == 1);
+		rockettest_check_expr_true(pic18_sim::i2c_restarts() == 7);
+		rockettest_check_expr_true(pic18_sim::i2c_stops() - stops == 1);
+		rockettest_check_expr_true(combined_us * 2 < single_us);
+		printf("6-axis sample: %.0f us as six register reads, %.0f us as one burst\n",
+			   single_us,
+			   combined_us);
+
+		uint16_t value16 = 0;
+		rockettest_check_expr_true(i2c_read_reg16(SENSOR_ADDR, 0x3d, &value16) == W_SUCCESS);
+		rockettest_check_expr_true(value16 == 0x1213);
+		uint8_t value8 = 0;
+		rockettest_check_expr_true(i2c_read_reg8(SENSOR_ADDR, 0x40, &value8) == W_SUCCESS);
+		rockettest_check_expr_true(value8 == 0x15);
+
+		uint8_t command[2] = {0x3c, 0x3f};
+		rockettest_check_expr_true(
+			i2c_write_read_data(SENSOR_ADDR, command, 1, sample, 2) == W_SUCCESS);
+		rockettest_check_expr_true((sample[0] == 0x11) && (sample[1] == 0x12));
+
+		// Queued transactions use the repeated start too
+		i2c_transaction_t read = {};
+		read.address = SENSOR_ADDR;
+		read.write_data = &command[1];
+		read.write_len = 1;
+		read.read_data = sample;
+		read.read_len = 3;
+		rockettest_check_expr_true(i2c_submit(&read) == W_SUCCESS);
+		rockettest_check_expr_true(pic18_sim::run_until([&] { return read.done; }, 1000));
+		rockettest_check_expr_true(read.status == W_SUCCESS);
+		rockettest_check_expr_true((sample[0] == 0x14) && (sample[2] == 0));
+
+		// Large bursts use the DMA for the read phase
+		rockettest_check_expr_true(i2c_dma_init(4) == W_SUCCESS);
+		std::fill(std::begin(sample), std::end(sample), 0);
+		rockettest_check_expr_true(i2c_read_regs(SENSOR_ADDR, 0x3b, sample, 6) == W_SUCCESS);
+		rockettest_check_expr_true((sample[0] == 0x10) && (sample[5] == 0x15));
+		rockettest_check_expr_true(pic18_sim::dma_bytes() == 6);
+		rockettest_check_expr_true(i2c_dma_init(0) == W_SUCCESS);
+
+		rockettest_check_expr_true(i2c_read_regs(SENSOR_ADDR, 0x3b, nullptr, 6) == W_INVALID_PARAM);
+		rockettest_check_expr_true(i2c_read_regs(SENSOR_ADDR, 0x3b, sample, 0) == W_INVALID_PARAM);
+		rockettest_check_expr_true(
+			i2c_write_read_data(SENSOR_ADDR, command, 0, sample, 1) == W_INVALID_PARAM);
+		rockettest_check_expr_true(i2c_read_regs(OTHER_ADDR, 0x3b, sample, 6) == W_IO_ERROR);
+
+		return test_passed;
+	}
+};
+
+i2c_repeated_start_test i2c_repeated_start_test_inst;
+
+class i2c_clock_test : rockettest_test {
+public:
+	i2c_clock_test() : rockettest_test("i2c_clock_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		pic18_sim_i2c_regs sensor(SENSOR_ADDR);
+		pic18_sim::reset();
+		uint32_t actual = 0;
+		double burst_us[3] = {0};
+		const uint32_t modes[3] = {100000, 400000, 1000000};
+
+		for (int i = 0; i < 3; i++) {
+			rockettest_check_expr_true(i2c_init_freq(modes[i], &actual) == W_SUCCESS);
+			rockettest_check_expr_true(actual == modes[i]);
+			rockettest_check_expr_true(pic18_sim::i2c_scl_hz() == modes[i]);
+
+			uint8_t sample[6];
+			std::uint64_t start = pic18_sim::cycles();
+			rockettest_check_expr_true(i2c_read_regs(SENSOR_ADDR, 0x3b, sample, 6) == W_SUCCESS);
+			burst_us[i] = (pic18_sim::cycles() - start) * 4e6 / pic18_sim::fosc_hz();
+		}
+		printf("6-byte register burst: %.0f us at 100 kHz, %.0f us at 400 kHz, %.0f us at 1 MHz\n",
+			   burst_us[0],
+			   burst_us[1],
+			   burst_us[2]);
+		rockettest_check_expr_true(burst_us[1] * 3.5 < burst_us[0]);
+		rockettest_check_expr_true(burst_us[2] * 2 < burst_us[1]);
+
+		// Fast mode plus timing and pads
+		std::uint8_t con2 = pic18_sim::reg(PIC18_SIM_I2C1CON2);
+		rockettest_check_expr_true((con2 & 0x20) && ((con2 & 0x0c) == 0x04));
+		rockettest_check_expr_true(pic18_sim::reg(PIC18_SIM_RC3I2C) == 0xc1);
+		rockettest_check_expr_true(pic18_sim::reg(PIC18_SIM_RC4I2C) == 0xc1);
+
+		rockettest_check_expr_true(i2c_init_freq(400000, nullptr) == W_SUCCESS);
+		rockettest_check_expr_true((pic18_sim::reg(PIC18_SIM_I2C1CON2) & 0x0c) == 0);
+		rockettest_check_expr_true(pic18_sim::reg(PIC18_SIM_RC3I2C) == 0x41);
+
+		// Rates in between round down
+		rockettest_check_expr_true(i2c_init_freq(300000, &actual) == W_SUCCESS);
+		rockettest_check_expr_true(actual == 250000);
+		rockettest_check_expr_true(pic18_sim::i2c_scl_hz() == 250000);
+		rockettest_check_expr_true(i2c_init_freq(10000, &actual) == W_SUCCESS);
+		rockettest_check_expr_true((actual <= 10000) && (actual > 7500));
+
+		rockettest_check_expr_true(i2c_init_freq(0, &actual) == W_INVALID_PARAM);
+		rockettest_check_expr_true(i2c_init_freq(1000001, &actual) == W_INVALID_PARAM);
+		rockettest_check_expr_true(i2c_init_freq(500, &actual) == W_INVALID_PARAM);
+
+		// The divider based init keeps its standard mode setup
+		rockettest_check_expr_true(i2c_init(0) == W_SUCCESS);
+		rockettest_check_expr_true(pic18_sim::i2c_scl_hz() == 100000);
+
+		return test_passed;
+	}
+};
+
+i2c_clock_test i2c_clock_test_inst;
+
+// Target that stops responding in the middle of a read: it stretches the clock and, once the
+// controller gives up, keeps SDA low until it was clocked through the rest of the byte
+class i2c_test_stuck_sensor : public pic18_sim_i2c_regs {
+public:
+	explicit i2c_test_stuck_sensor(std::uint8_t address) : pic18_sim_i2c_regs(address) {}
+
+	std::uint8_t read() override {
+		if (stuck) {
+			stretch_us = 1000000;
+			hold_sda_clocks = 5;
+			stuck = false;
+		}
+		return pic18_sim_i2c_regs::read();
+	}
+
+	bool stuck = false;
+};
+
+class i2c_fault_test : rockettest_test {
+public:
+	i2c_fault_test() : rockettest_test("i2c_fault_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		i2c_test_stuck_sensor sensor(SENSOR_ADDR);
+		pic18_sim_i2c_regs other(OTHER_ADDR);
+
+		// A target holding SDA since before the reset, init recovers the bus
+		pic18_sim::reset();
+		pic18_sim::set_isr(i2c_test_isr);
+		sensor.hold_sda_clocks = 5;
+		rockettest_check_expr_true(i2c_init(0) == W_SUCCESS);
+		rockettest_check_expr_true(sensor.hold_sda_clocks == 0);
+		// Five clocks release SDA, one more for the stop condition
+		rockettest_check_expr_true(pic18_sim::i2c_scl_pulses() == 6);
+		rockettest_check_expr_true(pic18_sim::i2c_port_stops() == 1);
+		rockettest_check_expr_true(pic18_sim::reg(PIC18_SIM_TRISC) == 0xff);
+		rockettest_check_expr_true(i2c_write_reg8(SENSOR_ADDR, 0x10, 0x5a) == W_SUCCESS);
+		rockettest_check_expr_true(sensor.regs[0x10] == 0x5a);
+		ei();
+
+		// Clock stretched forever, the write gives up after its timeout
+		sensor.stretch_us = 1000000;
+		std::uint64_t start = pic18_sim::cycles();
+		rockettest_check_expr_true(i2c_write_reg8(SENSOR_ADDR, 0x10, 0x00) == W_IO_TIMEOUT);
+		double write_us = (pic18_sim::cycles() - start) * 4e6 / pic18_sim::fosc_hz();
+		rockettest_check_expr_true((write_us >= 3000) && (write_us < 3100));
+		sensor.stretch_us = 0;
+		rockettest_check_expr_true(i2c_write_reg8(SENSOR_ADDR, 0x10, 0x66) == W_SUCCESS);
+		rockettest_check_expr_true(sensor.regs[0x10] == 0x66);
+
+		// Target stuck in the middle of a burst read, the bus is recovered after the timeout
+		uint8_t sample[6] = {0};
+		sensor.stuck = true;
+		start = pic18_sim::cycles();
+		rockettest_check_expr_true(i2c_read_regs(SENSOR_ADDR, 0x10, sample, 6) == W_IO_TIMEOUT);
+		double read_us = (pic18_sim::cycles() - start) * 4e6 / pic18_sim::fosc_hz();
+		rockettest_check_expr_true(pic18_sim::i2c_scl_pulses() == 12);
+		rockettest_check_expr_true(pic18_sim::i2c_port_stops() == 2);
+		printf("Stuck target: write timeout after %.0f us, burst read timeout and bus recovery "
+			   "after %.0f us\n",
+			   write_us,
+			   read_us);
+		rockettest_check_expr_true(read_us < 1000 + 7 * 1000 + 1000 + 200);
+		sensor.stretch_us = 0;
+		rockettest_check_expr_true(i2c_read_regs(SENSOR_ADDR, 0x10, sample, 6) == W_SUCCESS);
+		rockettest_check_expr_true(sample[0] == 0x66);
+
+		// Queued transaction to a stuck target times out, the queue continues
+		uint8_t reg = 0x10;
+		uint8_t data[2] = {0};
+		i2c_transaction_t stuck = {};
+		stuck.address = SENSOR_ADDR;
+		stuck.write_data = &reg;
+		stuck.write_len = 1;
+		stuck.read_data = data;
+		stuck.read_len = 2;
+		i2c_transaction_t probe = {};
+		probe.address = OTHER_ADDR;
+		sensor.stuck = true;
+		rockettest_check_expr_true(i2c_submit(&stuck) == W_SUCCESS);
+		rockettest_check_expr_true(i2c_submit(&probe) == W_SUCCESS);
+		rockettest_check_expr_true(i2c_check_timeout() == W_SUCCESS);
+		int aborted = 0;
+		rockettest_check_expr_true(pic18_sim::run_until(
+			[&] {
+				aborted += (i2c_check_timeout() == W_IO_TIMEOUT);
+				return probe.done;
+			},
+			10000));
+		rockettest_check_expr_true(aborted == 1);
+		rockettest_check_expr_true(stuck.done && (stuck.status == W_IO_TIMEOUT));
+		rockettest_check_expr_true(probe.status == W_SUCCESS);
+		rockettest_check_expr_true(pic18_sim::i2c_port_stops() == 3);
+		sensor.stretch_us = 0;
+
+		// Recovery needs the pins, it cannot remap them once PPS is locked
+		PPSLOCKbits.PPSLOCKED = 1;
+		rockettest_check_expr_true(i2c_recover_bus() == W_FAILURE);
+		sensor.hold_sda_clocks = 5;
+		rockettest_check_expr_true(i2c_init(0) == W_IO_TIMEOUT);
+
+		return test_passed;
+	}
+};
+
+i2c_fault_test i2c_fault_test_inst;
+
+class i2c_stats_test : rockettest_test {
+public:
+	i2c_stats_test() : rockettest_test("i2c_stats_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		pic18_sim_i2c_regs sensor(SENSOR_ADDR);
+		pic18_sim_i2c_regs other(OTHER_ADDR);
+		i2c_test_setup();
+		i2c_stats_t stats;
+		rockettest_check_expr_true(i2c_get_stats(nullptr, false) == W_INVALID_PARAM);
+		rockettest_check_expr_true(i2c_get_stats(&stats, true) == W_SUCCESS);
+
+		// Blocking transactions
+		uint8_t sample[6];
+		uint16_t value16;
+		uint8_t value8;
+		std::uint64_t start = pic18_sim::cycles();
+		rockettest_check_expr_true(i2c_write_reg8(SENSOR_ADDR, 0x10, 0x5a) == W_SUCCESS);
+		rockettest_check_expr_true(i2c_read_reg16(SENSOR_ADDR, 0x10, &value16) == W_SUCCESS);
+		rockettest_check_expr_true(i2c_read_regs(SENSOR_ADDR, 0x10, sample, 6) == W_SUCCESS);
+		double blocking_us = (pic18_sim::cycles() - start) * 4e6 / pic18_sim::fosc_hz();
+		sensor.stretch_us = 300;
+		rockettest_check_expr_true(i2c_read_reg8(SENSOR_ADDR, 0x10, &value8) == W_SUCCESS);
+		sensor.stretch_us = 1000000;
+		rockettest_check_expr_true(i2c_write_reg8(SENSOR_ADDR, 0x10, 0x00) == W_IO_TIMEOUT);
+		sensor.stretch_us = 0;
+		other.nack_address = true;
+		rockettest_check_expr_true(i2c_write_reg8(OTHER_ADDR, 0x10, 0x00) == W_IO_ERROR);
+		other.nack_address = false;
+		other.collide_address = true;
+		// The failed write returns before its stop condition ends
+		pic18_sim::run_us(100);
+
+		// Queued transactions, a collision and a read
+		uint8_t reg = 0x10;
+		uint8_t data[2];
+		i2c_transaction_t collide = {};
+		collide.address = OTHER_ADDR;
+		i2c_transaction_t read = {};
+		read.address = SENSOR_ADDR;
+		read.write_data = &reg;
+		read.write_len = 1;
+		read.read_data = data;
+		read.read_len = 2;
+		rockettest_check_expr_true(i2c_submit(&collide) == W_SUCCESS);
+		rockettest_check_expr_true(i2c_submit(&read) == W_SUCCESS);
+		rockettest_check_expr_true(pic18_sim::run_until([&] { return read.done; }, 2000));
+		rockettest_check_expr_true(collide.status == W_IO_ERROR);
+		other.collide_address = false;
+
+		// Not on the bus
+		rockettest_check_expr_true(i2c_read_regs(SENSOR_ADDR, 0x10, nullptr, 6) == W_INVALID_PARAM);
+
+		rockettest_check_expr_true(i2c_get_stats(&stats, false) == W_SUCCESS);
+		rockettest_check_expr_true(stats.transactions == 8);
+		rockettest_check_expr_true(stats.untracked == 0);
+		const i2c_device_stats_t &s = stats.devices[0];
+		rockettest_check_expr_true(s.address == SENSOR_ADDR);
+		rockettest_check_expr_true(s.transactions == 6);
+		rockettest_check_expr_true(s.bytes == 2 + 3 + 7 + 2 + 3);
+		rockettest_check_expr_true((s.nacks == 0) && (s.bus_collisions == 0));
+		rockettest_check_expr_true(s.timeouts == 1);
+		rockettest_check_expr_true(s.stretches == 1);
+		// The stretched 8-bit register read: 2 bytes at 300 us each on top of 400 us of bits
+		rockettest_check_expr_true((s.max_duration_us > 950) && (s.max_duration_us < 1050));
+		const i2c_device_stats_t &o = stats.devices[1];
+		rockettest_check_expr_true(o.address == OTHER_ADDR);
+		rockettest_check_expr_true(o.transactions == 2);
+		rockettest_check_expr_true((o.nacks == 1) && (o.bus_collisions == 1));
+		rockettest_check_expr_true((o.bytes == 0) && (o.stretches == 0));
+		rockettest_check_expr_true(stats.devices[2].transactions == 0);
+
+		// Bus time of the first three transactions, the timeout adds its 3 ms
+		rockettest_check_expr_true((stats.busy_us > blocking_us + 3000) &&
+								   (stats.busy_us < blocking_us + 3000 + 2000));
+		printf("I2C stats: %u transactions, bus busy %lu us, worst %lu us, %u timeout\n",
+			   stats.transactions,
+			   (unsigned long)stats.busy_us,
+			   (unsigned long)s.max_duration_us,
+			   s.timeouts);
+
+		// Transactions longer than a Timer1 period (32.8 ms) are measured in full
+		uint8_t burst[60];
+		sensor.stretch_us = 700;
+		rockettest_check_expr_true(i2c_get_stats(&stats, true) == W_SUCCESS);
+		rockettest_check_expr_true(i2c_read_regs(SENSOR_ADDR, 0x10, burst, 60) == W_SUCCESS);
+		rockettest_check_expr_true(i2c_get_stats(&stats, true) == W_SUCCESS);
+		std::uint32_t blocking_long_us = stats.devices[0].max_duration_us;
+		rockettest_check_expr_true((blocking_long_us > 61 * 700) && (blocking_long_us < 55000));
+		rockettest_check_expr_true(stats.busy_us == blocking_long_us);
+		read.read_data = burst;
+		read.read_len = 60;
+		rockettest_check_expr_true(i2c_submit(&read) == W_SUCCESS);
+		rockettest_check_expr_true(pic18_sim::run_until(
+			[&] {
+				i2c_check_timeout();
+				return read.done;
+			},
+			60000));
+		rockettest_check_expr_true(read.status == W_SUCCESS);
+		rockettest_check_expr_true(i2c_get_stats(&stats, true) == W_SUCCESS);
+		rockettest_check_expr_true((stats.devices[0].max_duration_us > 61 * 700) &&
+								   (stats.devices[0].max_duration_us < 55000));
+		sensor.stretch_us = 0;
+		printf("I2C stats: stretched 60-byte burst read %lu us blocking, %lu us queued\n",
+			   (unsigned long)blocking_long_us,
+			   (unsigned long)stats.devices[0].max_duration_us);
+
+		// Addresses beyond the table are counted together
+		rockettest_check_expr_true(i2c_get_stats(&stats, true) == W_SUCCESS);
+		for (uint8_t address = 0x50; address < 0x50 + I2C_STATS_MAX_DEVICES + 2; address++) {
+			i2c_transaction_t probe = {};
+			probe.address = address;
+			i2c_submit(&probe);
+			pic18_sim::run_until([&] { return probe.done; }, 1000);
+		}
+		rockettest_check_expr_true(i2c_get_stats(&stats, true) == W_SUCCESS);
+		rockettest_check_expr_true(stats.transactions == I2C_STATS_MAX_DEVICES + 2);
+		rockettest_check_expr_true(stats.untracked == 2);
+		rockettest_check_expr_true(stats.devices[I2C_STATS_MAX_DEVICES - 1].nacks == 1);
+		rockettest_check_expr_true(i2c_get_stats(&stats, false) == W_SUCCESS);
+		rockettest_check_expr_true((stats.transactions == 0) && (stats.busy_us == 0));
+
+		return test_passed;
+	}
+};
+
+i2c_stats_test i2c_stats_test_inst;
@@ -0,0 +1,178 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "common.h"
+#include "pic18_sim.hpp"
+#include "pic18f26k83/i2c.h"
+#include "pic18f26k83/i2c_poll.h"
+#include "timer.h"
+#include "xc.h"
+
+#include "rockettest.hpp"
+
+#define ACCEL_ADDR 0x1d
+#define BARO_ADDR 0x76
+#define TEMP_ADDR 0x48
+
+static void i2c_poll_test_isr(void) {
+	if (PIR3bits.TMR0IF) {
+		timer0_handle_interrupt();
+		PIR3bits.TMR0IF = 0;
+	}
+	if (PIR3bits.I2C1IF || PIR3bits.I2C1EIF || PIR3bits.I2C1TXIF || PIR3bits.I2C1RXIF) {
+		i2c_handle_interrupt();
+	}
+}
+
+struct i2c_poll_test_log {
+	std::vector<uint32_t> timestamps;
+	uint8_t first = 0;
+};
+
+static void i2c_poll_test_decode(const i2c_poll_device_t *device, const uint8_t *data,
+								 uint32_t timestamp_ms) {
+	i2c_poll_test_log *log = static_cast<i2c_poll_test_log *>(device->arg);
+	log->timestamps.push_back(timestamp_ms);
+	log->first = data[0];
+}
+
+static bool i2c_poll_test_periodic(const i2c_poll_test_log &log, uint32_t period_ms) {
+	for (size_t i = 1; i < log.timestamps.size(); i++) {
+		if (log.timestamps[i] - log.timestamps[i - 1] != period_ms) {
+			return false;
+		}
+	}
+	return true;
+}
+
+class i2c_poll_test : rockettest_test {
+public:
+	i2c_poll_test() : rockettest_test("i2c_poll_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		pic18_sim_i2c_regs accel(ACCEL_ADDR);
+		pic18_sim_i2c_regs baro(BARO_ADDR);
+		pic18_sim_i2c_regs temp(TEMP_ADDR);
+		accel.regs[0x28] = 0xa1;
+		baro.regs[0xf7] = 0xb2;
+		temp.regs[0x00] = 0xc3;
+
+		pic18_sim::reset();
+		pic18_sim::set_isr(i2c_poll_test_isr);
+		rockettest_check_expr_true(i2c_poll_run() == W_IO_ERROR);
+		timer0_init();
+		i2c_init(0);
+		ei();
+		uint32_t base_ms = millis();
+
+		uint8_t accel_data[6], baro_data[3], temp_data[2];
+		i2c_poll_test_log accel_log, baro_log, temp_log;
+		const i2c_poll_device_t devices[] = {
+			{ACCEL_ADDR, 0x28, 6, accel_data, 10, i2c_poll_test_decode, &accel_log},
+			{BARO_ADDR, 0xf7, 3, baro_data, 50, i2c_poll_test_decode, &baro_log},
+			{TEMP_ADDR, 0x00, 2, temp_data, 100, i2c_poll_test_decode, &temp_log},
+		};
+
+		// Invalid tables
+		i2c_poll_device_t bad = devices[0];
+		rockettest_check_expr_true(i2c_poll_init(nullptr, 1) == W_INVALID_PARAM);
+		rockettest_check_expr_true(i2c_poll_init(devices, 0) == W_INVALID_PARAM);
+		rockettest_check_expr_true(i2c_poll_init(devices, I2C_POLL_MAX_DEVICES + 1) ==
+								   W_INVALID_PARAM);
+		bad.len = 0;
+		rockettest_check_expr_true(i2c_poll_init(&bad, 1) == W_INVALID_PARAM);
+		bad = devices[0];
+		bad.period_ms = 0;
+		rockettest_check_expr_true(i2c_poll_init(&bad, 1) == W_INVALID_PARAM);
+		bad = devices[0];
+		bad.data = nullptr;
+		rockettest_check_expr_true(i2c_poll_init(&bad, 1) == W_INVALID_PARAM);
+
+		rockettest_check_expr_true(i2c_poll_init(devices, 3) == W_SUCCESS);
+
+		// All devices are due at once, their reads run back-to-back
+		std::uint64_t start = pic18_sim::cycles();
+		rockettest_check_expr_true(i2c_poll_run() == W_SUCCESS);
+		rockettest_check_expr_true(i2c_poll_init(devices, 3) == W_FAILURE);
+		rockettest_check_expr_true(pic18_sim::run_until([] { return i2c_idle(); }, 5000));
+		double batch_us = (pic18_sim::cycles() - start) * 4e6 / pic18_sim::fosc_hz();
+		rockettest_check_expr_true(pic18_sim::i2c_starts() == 3);
+		rockettest_check_expr_true(pic18_sim::i2c_restarts() == 3);
+		rockettest_check_expr_true(i2c_poll_run() == W_SUCCESS);
+		rockettest_check_expr_true((accel_log.first == 0xa1) && (baro_log.first == 0xb2) &&
+								   (temp_log.first == 0xc3));
+
+		// One second of polling from a main loop running every millisecond
+		std::uint64_t cpu_cycles = 0;
+		std::uint64_t isr_cycles = pic18_sim::isr_cycles();
+		while (millis() - base_ms <= 1000) {
+			pic18_sim::run_us(1000 - std::fmod(pic18_sim::now_us(), 1000));
+			start = pic18_sim::cycles();
+			i2c_poll_run();
+			cpu_cycles += pic18_sim::cycles() - start;
+		}
+		cpu_cycles += pic18_sim::isr_cycles() - isr_cycles;
+		rockettest_check_expr_true(pic18_sim::run_until([] { return i2c_idle(); }, 5000));
+		i2c_poll_run();
+
+		rockettest_check_expr_true(accel_log.timestamps.size() == 101);
+		rockettest_check_expr_true(baro_log.timestamps.size() == 21);
+		rockettest_check_expr_true(temp_log.timestamps.size() == 11);
+		rockettest_check_expr_true(i2c_poll_test_periodic(accel_log, 10));
+		rockettest_check_expr_true(i2c_poll_test_periodic(baro_log, 50));
+		rockettest_check_expr_true(i2c_poll_test_periodic(temp_log, 100));
+
+		i2c_poll_stats_t stats;
+		rockettest_check_expr_true(i2c_poll_get_stats(0, &stats) == W_SUCCESS);
+		rockettest_check_expr_true((stats.samples == 101) && (stats.errors == 0) &&
+								   (stats.deadline_misses == 0));
+		rockettest_check_expr_true(i2c_poll_get_stats(3, &stats) == W_INVALID_PARAM);
+		rockettest_check_expr_true(i2c_poll_get_stats(0, nullptr) == W_INVALID_PARAM);
+
+		// The same reads done with blocking calls keep the CPU for the whole bus time
+		double blocking_us = 0;
+		for (const i2c_poll_device_t &device : devices) {
+			uint8_t sample[6];
+			start = pic18_sim::cycles();
+			i2c_read_regs(device.address, device.reg, sample, device.len);
+			double read_us = (pic18_sim::cycles() - start) * 4e6 / pic18_sim::fosc_hz();
+			blocking_us += read_us * 1000 / device.period_ms;
+		}
+		double blocking_cpu_percent = blocking_us / 1e4;
+		double poll_cpu_percent = cpu_cycles * 4e6 / pic18_sim::fosc_hz() / 1e4;
+		printf("Polling 3 sensors at 100/20/10 Hz: batch of 3 reads %.0f us, CPU %.2f %% "
+			   "(blocking reads %.2f %%)\n",
+			   batch_us,
+			   poll_cpu_percent,
+			   blocking_cpu_percent);
+		rockettest_check_expr_true(poll_cpu_percent * 4 < blocking_cpu_percent);
+
+		// Main loop stalled until 35 ms after the accelerometer was due, three periods are skipped
+		rockettest_check_expr_true(
+			pic18_sim::run_until([base_ms] { return millis() - base_ms >= 1045; }, 50000));
+		i2c_poll_run();
+		rockettest_check_expr_true(pic18_sim::run_until([] { return i2c_idle(); }, 5000));
+		i2c_poll_run();
+		rockettest_check_expr_true(i2c_poll_get_stats(0, &stats) == W_SUCCESS);
+		rockettest_check_expr_true((stats.samples == 102) && (stats.deadline_misses == 3));
+
+		// Failed reads are counted, the other devices keep being polled
+		baro.nack_address = true;
+		uint32_t temp_samples = temp_log.timestamps.size();
+		for (int i = 0; i < 200; i++) {
+			pic18_sim::run_us(1000);
+			i2c_poll_run();
+		}
+		rockettest_check_expr_true(i2c_poll_get_stats(1, &stats) == W_SUCCESS);
+		rockettest_check_expr_true((stats.errors == 4) && (stats.deadline_misses == 0));
+		rockettest_check_expr_true(temp_log.timestamps.size() == temp_samples + 2);
+
+		return test_passed;
+	}
+};
+
+i2c_poll_test i2c_poll_test_inst;
@@ -0,0 +1,1172 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "common.h"
+#include "lfs.h"
+#include "lfs_sim.hpp"
+#include "sd_card_sim.hpp"
+#include "stm32/littlefs_sd_shim.h"
+#include "stm32/timebase.h"
+#include "stm32_tim_sim.hpp"
+
+#include "rockettest.hpp"
+
+#define SIM_CARD_BLOCKS 4096
+#define PARTITION_OFFSET 2048
+#define APP_SLICE_US 50
+
+// Application work done while the shim yields or between filesystem calls
+struct app_time {
+	std::uint64_t us = 0;
+};
+
+static void app_yield(void *arg) {
+	sd_sim_clock::advance_us(APP_SLICE_US);
+	static_cast<app_time *>(arg)->us += APP_SLICE_US;
+}
+
+static int prog_block(lfsshim_sd_ctx_t *ctx, lfs_block_t block, std::uint8_t fill) {
+	std::uint8_t buf[LFSSHIM_SD_SECTOR_SIZE];
+	std::memset(buf, fill, sizeof(buf));
+	return ctx->cfg.prog(&ctx->cfg, block, 0, buf, sizeof(buf));
+}
+
+class littlefs_sd_shim_mount_test : rockettest_test {
+public:
+	littlefs_sd_shim_mount_test() : rockettest_test("littlefs_sd_shim_mount_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		sd_card_sim card(SIM_CARD_BLOCKS);
+		static lfsshim_sd_ctx_t ctx;
+		lfs_t lfs;
+
+		rockettest_check_expr_true(lfsshim_sd_mount(nullptr, &lfs, card.handle(), 0) ==
+								   W_INVALID_PARAM);
+		rockettest_check_expr_true(lfsshim_sd_mount(&ctx, nullptr, card.handle(), 0) ==
+								   W_INVALID_PARAM);
+		rockettest_check_expr_true(lfsshim_sd_mount(&ctx, &lfs, nullptr, 0) == W_INVALID_PARAM);
+
+		rockettest_check_expr_true(lfsshim_sd_mount(&ctx, &lfs, card.handle(), PARTITION_OFFSET) ==
+								   W_SUCCESS);
+		rockettest_check_expr_true(ctx.cfg.context == &ctx);
+		rockettest_check_expr_true(ctx.cfg.read_buffer == ctx.read_buffer);
+		rockettest_check_expr_true(ctx.cfg.prog_buffer == ctx.prog_buffer);
+		rockettest_check_expr_true(ctx.cfg.lookahead_buffer == ctx.lookahead_buffer);
+
+		// littlefs blocks are offset by the partition start
+		rockettest_check_expr_true(prog_block(&ctx, 3, 0x42) == 0);
+		rockettest_check_expr_true(card.block(PARTITION_OFFSET + 3)[0] == 0x42);
+
+		std::uint8_t buf[LFSSHIM_SD_SECTOR_SIZE];
+		rockettest_check_expr_true(ctx.cfg.read(&ctx.cfg, 3, 0, buf, sizeof(buf)) == 0);
+		rockettest_check_expr_true(buf[LFSSHIM_SD_SECTOR_SIZE - 1] == 0x42);
+
+		// The card programs for longer than the timeout
+		card.timing.program_us_per_cmd = 200000;
+		rockettest_check_expr_true(prog_block(&ctx, 4, 0x43) == LFS_ERR_IO);
+		card.timing = sd_card_sim_timing{};
+		sd_sim_clock::advance_us(200000);
+
+		card.fail_reads = true;
+		rockettest_check_expr_true(ctx.cfg.read(&ctx.cfg, 3, 0, buf, sizeof(buf)) == LFS_ERR_IO);
+		rockettest_check_expr_true(lfsshim_sd_mount(&ctx, &lfs, card.handle(), 0) == W_IO_ERROR);
+
+		return test_passed;
+	}
+};
+
+littlefs_sd_shim_mount_test littlefs_sd_shim_mount_test_inst;
+
+class littlefs_sd_shim_partition_test : rockettest_test {
+public:
+	littlefs_sd_shim_partition_test() : rockettest_test("littlefs_sd_shim_partition_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		sd_card_sim card(SIM_CARD_BLOCKS);
+		static lfsshim_sd_ctx_t ctx;
+		lfs_t lfs;
+		std::uint32_t offset = 0;
+
+		// No partition table
+		rockettest_check_expr_true(lfsshim_sd_find_partition(card.handle(), &offset) == W_FAILURE);
+
+		// FAT primary partition and a Linux logical partition in an extended partition
+		auto put_entry = [](std::uint8_t *sector, int index, std::uint8_t type, std::uint32_t lba) {
+			std::uint8_t *entry = sector + 0x1BE + 16 * index;
+			entry[4] = type;
+			std::memcpy(entry + 8, &lba, sizeof(lba));
+			std::uint32_t size = 512;
+			std::memcpy(entry + 12, &size, sizeof(size));
+			sector[0x1FE] = 0x55;
+			sector[0x1FF] = 0xAA;
+		};
+		put_entry(card.block(0), 0, 0x0C, 512);
+		put_entry(card.block(0), 1, 0x0F, 1024);
+		put_entry(card.block(1024), 0, 0x83, PARTITION_OFFSET - 1024);
+
+		card.blocks_read = 0;
+		rockettest_check_expr_true(lfsshim_sd_find_partition(card.handle(), &offset) == W_SUCCESS);
+		rockettest_check_expr_true(offset == PARTITION_OFFSET);
+		// One command per partition table sector
+		rockettest_check_expr_true(card.blocks_read == 2);
+
+		rockettest_check_expr_true(lfsshim_sd_mount_mbr(&ctx, &lfs, card.handle()) == W_SUCCESS);
+		rockettest_check_expr_true(prog_block(&ctx, 0, 0x61) == 0);
+		rockettest_check_expr_true(card.block(PARTITION_OFFSET)[0] == 0x61);
+
+		card.fail_reads = true;
+		rockettest_check_expr_true(lfsshim_sd_find_partition(card.handle(), &offset) == W_IO_ERROR);
+		rockettest_check_expr_true(lfsshim_sd_find_partition(nullptr, &offset) == W_INVALID_PARAM);
+
+		return test_passed;
+	}
+};
+
+littlefs_sd_shim_partition_test littlefs_sd_shim_partition_test_inst;
+
+class littlefs_sd_shim_mirror_test : rockettest_test {
+public:
+	littlefs_sd_shim_mirror_test() : rockettest_test("littlefs_sd_shim_mirror_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		sd_card_sim primary(SIM_CARD_BLOCKS);
+		sd_card_sim secondary(SIM_CARD_BLOCKS);
+		static lfsshim_sd_ctx_t ctx;
+		lfs_t lfs;
+
+		rockettest_check_expr_true(lfsshim_sd_mount_mirrored(
+									   &ctx, &lfs, primary.handle(), 0, primary.handle(), 0) ==
+								   W_INVALID_PARAM);
+		rockettest_check_expr_true(lfsshim_sd_mount_mirrored(&ctx,
+															 &lfs,
+															 primary.handle(),
+															 PARTITION_OFFSET,
+															 secondary.handle(),
+															 16) == W_SUCCESS);
+
+		rockettest_check_expr_true(prog_block(&ctx, 7, 0x5a) == 0);
+		rockettest_check_expr_true(primary.block(PARTITION_OFFSET + 7)[0] == 0x5a);
+		rockettest_check_expr_true(secondary.block(16 + 7)[0] == 0x5a);
+
+		// Busy periods overlap, a mirrored write costs much less than two single writes
+		std::uint64_t start = sd_sim_clock::now_us();
+		rockettest_check_expr_true(prog_block(&ctx, 8, 0x5b) == 0);
+		std::uint64_t mirrored_us = sd_sim_clock::now_us() - start;
+
+		static lfsshim_sd_ctx_t single_ctx;
+		rockettest_check_expr_true(
+			lfsshim_sd_mount(&single_ctx, &lfs, primary.handle(), PARTITION_OFFSET) == W_SUCCESS);
+		start = sd_sim_clock::now_us();
+		rockettest_check_expr_true(prog_block(&single_ctx, 8, 0x5b) == 0);
+		std::uint64_t single_us = sd_sim_clock::now_us() - start;
+
+		printf("Single card write %llu us, mirrored write %llu us\n",
+			   static_cast<unsigned long long>(single_us),
+			   static_cast<unsigned long long>(mirrored_us));
+		rockettest_check_expr_true(mirrored_us < single_us * 5 / 4);
+
+		// Reads fall back to the secondary card without dropping the primary
+		std::uint8_t buf[LFSSHIM_SD_SECTOR_SIZE];
+		primary.fail_reads = true;
+		rockettest_check_expr_true(ctx.cfg.read(&ctx.cfg, 7, 0, buf, sizeof(buf)) == 0);
+		rockettest_check_expr_true(buf[0] == 0x5a);
+		rockettest_check_expr_true(!lfsshim_sd_is_degraded(&ctx));
+		primary.fail_reads = false;
+
+		// A card that misses a write is dropped, logging continues on the other card
+		secondary.fail_writes = true;
+		rockettest_check_expr_true(prog_block(&ctx, 9, 0x5c) == 0);
+		rockettest_check_expr_true(lfsshim_sd_is_degraded(&ctx));
+		secondary.fail_writes = false;
+		std::uint32_t secondary_writes = secondary.write_cmds;
+		rockettest_check_expr_true(prog_block(&ctx, 10, 0x5d) == 0);
+		rockettest_check_expr_true(secondary.write_cmds == secondary_writes);
+		rockettest_check_expr_true(primary.block(PARTITION_OFFSET + 10)[0] == 0x5d);
+
+		// Write failing on the remaining card is reported
+		primary.fail_writes = true;
+		rockettest_check_expr_true(prog_block(&ctx, 11, 0x5e) == LFS_ERR_IO);
+
+		// A failed mount, as of blank cards, still sets the context up for formatting both cards
+		sd_card_sim blank_primary(SIM_CARD_BLOCKS);
+		sd_card_sim blank_secondary(SIM_CARD_BLOCKS);
+		static lfsshim_sd_ctx_t format_ctx;
+		rockettest_check_expr_true(lfsshim_sd_format(&format_ctx, &lfs, 1024) == W_INVALID_PARAM);
+		blank_primary.fail_reads = true;
+		blank_secondary.fail_reads = true;
+		rockettest_check_expr_true(lfsshim_sd_mount_mirrored(&format_ctx,
+															 &lfs,
+															 blank_primary.handle(),
+															 PARTITION_OFFSET,
+															 blank_secondary.handle(),
+															 16) == W_IO_ERROR);
+		blank_primary.fail_reads = false;
+		blank_secondary.fail_reads = false;
+		rockettest_check_expr_true(lfsshim_sd_format(&format_ctx, nullptr, 1024) ==
+								   W_INVALID_PARAM);
+		rockettest_check_expr_true(lfsshim_sd_format(&format_ctx, &lfs, 0) == W_INVALID_PARAM);
+		rockettest_check_expr_true(lfsshim_sd_format(&format_ctx, &lfs, 1024) == W_SUCCESS);
+		rockettest_check_expr_true(format_ctx.cfg.block_count == 0);
+		for (std::uint32_t block = 0; block < 2; block++) {
+			const std::uint8_t *sb_primary = blank_primary.block(PARTITION_OFFSET + block);
+			const std::uint8_t *sb_secondary = blank_secondary.block(16 + block);
+			rockettest_check_expr_true(
+				std::memcmp(&sb_primary[lfs_sim::superblock_magic_offset], "littlefs", 8) == 0);
+			rockettest_check_expr_true(
+				std::memcmp(&sb_secondary[lfs_sim::superblock_magic_offset], "littlefs", 8) == 0);
+		}
+
+		// Either card mounts on its own with the formatted size
+		rockettest_check_expr_true(
+			lfsshim_sd_mount(&format_ctx, &lfs, blank_secondary.handle(), 16) == W_SUCCESS);
+		rockettest_check_expr_true(lfs.block_count == 1024);
+		rockettest_check_expr_true(lfsshim_sd_mount_mirrored(&format_ctx,
+															 &lfs,
+															 blank_primary.handle(),
+															 PARTITION_OFFSET,
+															 blank_secondary.handle(),
+															 16) == W_SUCCESS);
+		rockettest_check_expr_true(!lfsshim_sd_is_degraded(&format_ctx));
+		lfs_sim::superblock_block_count = 0;
+
+		return test_passed;
+	}
+};
+
+littlefs_sd_shim_mirror_test littlefs_sd_shim_mirror_test_inst;
+
+class littlefs_sd_shim_wait_test : rockettest_test {
+	static constexpr int num_writes = 64;
+	// Application work between two log flushes
+	static constexpr std::uint64_t app_work_us = 1000;
+
+	static lfsshim_sd_ctx_t *notify_ctx;
+
+	static void card_ready_isr(sd_card_sim &card) {
+		lfsshim_sd_notify_ready(notify_ctx, card.handle());
+	}
+
+	// Runs a logging workload, reports the share of CPU time available to the application in
+	// percent, the number of card status polls and the elapsed time
+	bool run_workload(const char *name, sd_card_sim &card, lfsshim_sd_ctx_t *ctx,
+					  const lfsshim_sd_wait_config_t &wait, std::uint64_t *app_pct,
+					  std::uint32_t *polls, std::uint64_t *elapsed_us) {
+		bool test_passed = true;
+		app_time app;
+
+		lfsshim_sd_wait_config_t config = wait;
+		if (config.yield) {
+			config.yield_arg = &app;
+		}
+		rockettest_check_expr_true(lfsshim_sd_set_wait_config(ctx, &config) == W_SUCCESS);
+		card.reset_stats();
+
+		std::uint64_t shim_us = 0;
+		std::uint64_t start = sd_sim_clock::now_us();
+		for (int i = 0; i < num_writes; i++) {
+			std::uint64_t call_start = sd_sim_clock::now_us();
+			rockettest_check_expr_true(prog_block(ctx, i, static_cast<std::uint8_t>(i)) == 0);
+			shim_us += sd_sim_clock::now_us() - call_start;
+
+			sd_sim_clock::advance_us(app_work_us);
+			app.us += app_work_us;
+		}
+		rockettest_check_expr_true(ctx->cfg.sync(&ctx->cfg) == 0);
+		*elapsed_us = sd_sim_clock::now_us() - start;
+		*polls = card.status_polls;
+		*app_pct = app.us * 100 / *elapsed_us;
+
+		for (int i = 0; i < num_writes; i++) {
+			rockettest_check_expr_true(card.block(i)[0] == static_cast<std::uint8_t>(i));
+		}
+
+		printf("%-9s elapsed %6llu us, in shim %6llu us, spinning %6llu us, %5u status polls, "
+			   "CPU available to application %3llu%%\n",
+			   name,
+			   static_cast<unsigned long long>(*elapsed_us),
+			   static_cast<unsigned long long>(shim_us),
+			   static_cast<unsigned long long>(card.status_poll_us),
+			   card.status_polls,
+			   static_cast<unsigned long long>(*app_pct));
+		return test_passed;
+	}
+
+public:
+	littlefs_sd_shim_wait_test() : rockettest_test("littlefs_sd_shim_wait_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		sd_card_sim card(SIM_CARD_BLOCKS);
+		static lfsshim_sd_ctx_t ctx;
+		lfs_t lfs;
+		rockettest_check_expr_true(lfsshim_sd_mount(&ctx, &lfs, card.handle(), 0) == W_SUCCESS);
+		rockettest_check_expr_true(lfsshim_sd_set_wait_config(&ctx, nullptr) == W_INVALID_PARAM);
+
+		notify_ctx = &ctx;
+		card.on_ready = card_ready_isr;
+
+		std::uint64_t app_pct;
+		std::uint32_t polls;
+		std::uint64_t poll_elapsed_us;
+		std::uint64_t elapsed_us;
+
+		lfsshim_sd_wait_config_t poll = {};
+		test_passed &= run_workload("poll", card, &ctx, poll, &app_pct, &polls, &poll_elapsed_us);
+		// Spinning: the application only runs between writes
+		rockettest_check_expr_true(app_pct < 60);
+
+		lfsshim_sd_wait_config_t yield = {};
+		yield.yield = app_yield;
+		test_passed &= run_workload("yield", card, &ctx, yield, &app_pct, &polls, &elapsed_us);
+		// Most of the programming time is handed to the application through the hook
+		rockettest_check_expr_true(app_pct > 90);
+
+		lfsshim_sd_wait_config_t deferred = {};
+		deferred.deferred_busy = true;
+		test_passed &=
+			run_workload("deferred", card, &ctx, deferred, &app_pct, &polls, &elapsed_us);
+		// Programming overlaps with the application work between writes
+		rockettest_check_expr_true(app_pct > 90);
+		rockettest_check_expr_true(polls <= num_writes);
+		rockettest_check_expr_true(elapsed_us < poll_elapsed_us * 2 / 3);
+
+		lfsshim_sd_wait_config_t notify = {};
+		notify.yield = app_yield;
+		notify.ready_notify = true;
+		test_passed &= run_workload("notify", card, &ctx, notify, &app_pct, &polls, &elapsed_us);
+		// The card state is only queried once the card signalled ready
+		rockettest_check_expr_true(app_pct > 90);
+		rockettest_check_expr_true(polls <= num_writes);
+
+		// A lost notification falls back to polling the card
+		card.on_ready = nullptr;
+		rockettest_check_expr_true(prog_block(&ctx, 0, 0) == 0);
+		card.on_ready = card_ready_isr;
+
+		return test_passed;
+	}
+};
+
+lfsshim_sd_ctx_t *littlefs_sd_shim_wait_test::notify_ctx = nullptr;
+
+littlefs_sd_shim_wait_test littlefs_sd_shim_wait_test_inst;
+
+class littlefs_sd_shim_discard_test : rockettest_test {
+	static bool erase_was(const sd_card_sim &card, std::size_t i, std::uint32_t start,
+						  std::uint32_t end) {
+		return (card.erases.size() > i) && (card.erases[i].start == start) &&
+			   (card.erases[i].end == end);
+	}
+
+public:
+	littlefs_sd_shim_discard_test() : rockettest_test("littlefs_sd_shim_discard_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		sd_card_sim card(SIM_CARD_BLOCKS);
+		static lfsshim_sd_ctx_t ctx;
+		lfs_t lfs;
+		rockettest_check_expr_true(lfsshim_sd_mount(&ctx, &lfs, card.handle(), PARTITION_OFFSET) ==
+								   W_SUCCESS);
+		rockettest_check_expr_true(lfsshim_sd_set_discard(nullptr, true) == W_INVALID_PARAM);
+
+		// Disabled by default, erase is a no-op
+		card.reset_stats();
+		rockettest_check_expr_true(ctx.cfg.erase(&ctx.cfg, 0) == 0);
+		rockettest_check_expr_true(ctx.cfg.sync(&ctx.cfg) == 0);
+		rockettest_check_expr_true(card.erases.empty());
+
+		rockettest_check_expr_true(lfsshim_sd_set_discard(&ctx, true) == W_SUCCESS);
+
+		// Consecutive erases are sent as one command on sync
+		for (lfs_block_t block = 100; block < 200; block++) {
+			rockettest_check_expr_true(ctx.cfg.erase(&ctx.cfg, block) == 0);
+		}
+		rockettest_check_expr_true(card.erases.empty());
+		rockettest_check_expr_true(ctx.cfg.sync(&ctx.cfg) == 0);
+		rockettest_check_expr_true(card.erases.size() == 1);
+		rockettest_check_expr_true(
+			erase_was(card, 0, PARTITION_OFFSET + 100, PARTITION_OFFSET + 199));
+
+		// A gap starts a new range
+		card.reset_stats();
+		rockettest_check_expr_true(ctx.cfg.erase(&ctx.cfg, 10) == 0);
+		rockettest_check_expr_true(ctx.cfg.erase(&ctx.cfg, 11) == 0);
+		rockettest_check_expr_true(ctx.cfg.erase(&ctx.cfg, 20) == 0);
+		rockettest_check_expr_true(card.erases.size() == 1);
+		rockettest_check_expr_true(ctx.cfg.sync(&ctx.cfg) == 0);
+		rockettest_check_expr_true(card.erases.size() == 2);
+		rockettest_check_expr_true(
+			erase_was(card, 0, PARTITION_OFFSET + 10, PARTITION_OFFSET + 11));
+		rockettest_check_expr_true(
+			erase_was(card, 1, PARTITION_OFFSET + 20, PARTITION_OFFSET + 20));
+
+		// Blocks that are written are not discarded, the part of the range in front of a write is
+		// erased before the write is issued
+		card.reset_stats();
+		for (lfs_block_t block = 0; block < 16; block++) {
+			rockettest_check_expr_true(ctx.cfg.erase(&ctx.cfg, block) == 0);
+		}
+		rockettest_check_expr_true(prog_block(&ctx, 0, 0x11) == 0);
+		rockettest_check_expr_true(card.erases.empty());
+		rockettest_check_expr_true(prog_block(&ctx, 8, 0x12) == 0);
+		rockettest_check_expr_true(erase_was(card, 0, PARTITION_OFFSET + 1, PARTITION_OFFSET + 7));
+		rockettest_check_expr_true(prog_block(&ctx, 15, 0x13) == 0);
+		rockettest_check_expr_true(ctx.cfg.sync(&ctx.cfg) == 0);
+		rockettest_check_expr_true(card.erases.size() == 2);
+		rockettest_check_expr_true(erase_was(card, 1, PARTITION_OFFSET + 9, PARTITION_OFFSET + 14));
+		rockettest_check_expr_true(card.block(PARTITION_OFFSET + 0)[0] == 0x11);
+		rockettest_check_expr_true(card.block(PARTITION_OFFSET + 8)[0] == 0x12);
+		rockettest_check_expr_true(card.block(PARTITION_OFFSET + 15)[0] == 0x13);
+
+		// littlefs erases a block right before programming it, nothing reaches the card
+		card.reset_stats();
+		for (lfs_block_t block = 32; block < 64; block++) {
+			rockettest_check_expr_true(ctx.cfg.erase(&ctx.cfg, block) == 0);
+			rockettest_check_expr_true(prog_block(&ctx, block, 0x14) == 0);
+		}
+		rockettest_check_expr_true(ctx.cfg.sync(&ctx.cfg) == 0);
+		rockettest_check_expr_true(card.erases.empty());
+
+		// Long ranges are split
+		card.reset_stats();
+		static sd_card_sim big_card(LFSSHIM_SD_DISCARD_MAX_BLOCKS * 2 + 16);
+		rockettest_check_expr_true(lfsshim_sd_mount(&ctx, &lfs, big_card.handle(), 0) == W_SUCCESS);
+		big_card.reset_stats();
+		for (lfs_block_t block = 0; block < LFSSHIM_SD_DISCARD_MAX_BLOCKS + 10; block++) {
+			rockettest_check_expr_true(ctx.cfg.erase(&ctx.cfg, block) == 0);
+		}
+		rockettest_check_expr_true(ctx.cfg.sync(&ctx.cfg) == 0);
+		rockettest_check_expr_true(big_card.erases.size() == 2);
+		rockettest_check_expr_true(erase_was(big_card, 0, 0, LFSSHIM_SD_DISCARD_MAX_BLOCKS - 1));
+		rockettest_check_expr_true(erase_was(
+			big_card, 1, LFSSHIM_SD_DISCARD_MAX_BLOCKS, LFSSHIM_SD_DISCARD_MAX_BLOCKS + 9));
+
+		// An erase rejected by the card is reported
+		rockettest_check_expr_true(ctx.cfg.erase(&ctx.cfg, 0) == 0);
+		big_card.fail_writes = true;
+		rockettest_check_expr_true(ctx.cfg.sync(&ctx.cfg) == LFS_ERR_IO);
+		big_card.fail_writes = false;
+
+		return test_passed;
+	}
+};
+
+littlefs_sd_shim_discard_test littlefs_sd_shim_discard_test_inst;
+
+class littlefs_sd_shim_pre_erase_test : rockettest_test {
+	static constexpr std::uint32_t card_blocks = 65536;
+	static constexpr std::uint32_t erase_unit = 8192;
+	static constexpr std::uint32_t offset = 100;
+
+public:
+	littlefs_sd_shim_pre_erase_test() : rockettest_test("littlefs_sd_shim_pre_erase_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		sd_card_sim card(card_blocks);
+		static lfsshim_sd_ctx_t ctx;
+		lfs_t lfs;
+		bool done = false;
+
+		rockettest_check_expr_true(lfsshim_sd_mount(&ctx, &lfs, card.handle(), offset) ==
+								   W_SUCCESS);
+		rockettest_check_expr_true(lfsshim_sd_pre_erase_start(&ctx, 0, 100, 0) == W_INVALID_PARAM);
+		rockettest_check_expr_true(lfsshim_sd_pre_erase_step(&ctx, nullptr) == W_INVALID_PARAM);
+
+		// Nothing to do when the region does not contain a whole erase unit
+		rockettest_check_expr_true(lfsshim_sd_pre_erase_start(&ctx, 0, erase_unit, erase_unit) ==
+								   W_SUCCESS);
+		rockettest_check_expr_true(lfsshim_sd_pre_erase_step(&ctx, &done) == W_SUCCESS);
+		rockettest_check_expr_true(done);
+
+		// Physical sectors 100 to 40099, only the erase units 8192 to 32767 are erased
+		card.reset_stats();
+		rockettest_check_expr_true(lfsshim_sd_pre_erase_start(&ctx, 0, 40000, erase_unit) ==
+								   W_SUCCESS);
+		int steps = 0;
+		app_time app;
+		std::uint64_t start = sd_sim_clock::now_us();
+		done = false;
+		while (!done && (steps < 10000)) {
+			rockettest_check_expr_true(lfsshim_sd_pre_erase_step(&ctx, &done) == W_SUCCESS);
+			steps++;
+			app_yield(&app);
+		}
+		std::uint64_t elapsed_us = sd_sim_clock::now_us() - start;
+
+		rockettest_check_expr_true(done);
+		rockettest_check_expr_true(card.erases.size() == 3);
+		for (std::size_t i = 0; i < card.erases.size(); i++) {
+			rockettest_check_expr_true(card.erases[i].start == erase_unit * (i + 1));
+			rockettest_check_expr_true(card.erases[i].end == erase_unit * (i + 2) - 1);
+		}
+		printf("Pre-erase of 3 erase units: %d steps, %llu us, CPU available to application "
+			   "%llu%%\n",
+			   steps,
+			   static_cast<unsigned long long>(elapsed_us),
+			   static_cast<unsigned long long>(app.us * 100 / elapsed_us));
+		rockettest_check_expr_true(app.us * 100 / elapsed_us > 85);
+
+		// Writes into the pre-erased region program faster
+		start = sd_sim_clock::now_us();
+		for (lfs_block_t block = 0; block < 32; block++) {
+			rockettest_check_expr_true(prog_block(&ctx, block, 0x21) == 0);
+		}
+		std::uint64_t plain_us = sd_sim_clock::now_us() - start;
+
+		start = sd_sim_clock::now_us();
+		for (lfs_block_t block = erase_unit - offset; block < erase_unit - offset + 32; block++) {
+			rockettest_check_expr_true(prog_block(&ctx, block, 0x22) == 0);
+		}
+		std::uint64_t erased_us = sd_sim_clock::now_us() - start;
+
+		printf("32 writes: %llu us, into pre-erased region: %llu us\n",
+			   static_cast<unsigned long long>(plain_us),
+			   static_cast<unsigned long long>(erased_us));
+		rockettest_check_expr_true(erased_us < plain_us * 3 / 4);
+		rockettest_check_expr_true(card.block(erase_unit)[0] == 0x22);
+
+		// A filesystem call made during the pre-erase waits for the erase
+		rockettest_check_expr_true(lfsshim_sd_pre_erase_start(
+									   &ctx, 0, card_blocks - offset, erase_unit) == W_SUCCESS);
+		rockettest_check_expr_true(lfsshim_sd_pre_erase_step(&ctx, &done) == W_SUCCESS);
+		rockettest_check_expr_true(!done && card.busy());
+		std::uint8_t buf[LFSSHIM_SD_SECTOR_SIZE];
+		rockettest_check_expr_true(ctx.cfg.read(&ctx.cfg, 0, 0, buf, sizeof(buf)) == 0);
+
+		// Erase rejected by the card
+		card.fail_writes = true;
+		rockettest_check_expr_true(lfsshim_sd_pre_erase_step(&ctx, &done) == W_SUCCESS);
+		rockettest_check_expr_true(lfsshim_sd_pre_erase_step(&ctx, &done) == W_IO_ERROR);
+		card.fail_writes = false;
+
+		return test_passed;
+	}
+};
+
+littlefs_sd_shim_pre_erase_test littlefs_sd_shim_pre_erase_test_inst;
+
+class littlefs_sd_shim_readahead_test : rockettest_test {
+	static constexpr std::uint32_t download_blocks = 2048; // 1 MiB
+
+	// Reads the log sequentially like a download over USB and returns the throughput in kB/s
+	bool download(lfsshim_sd_ctx_t *ctx, std::uint64_t *kbytes_per_s) {
+		bool test_passed = true;
+		std::uint8_t buf[LFSSHIM_SD_SECTOR_SIZE];
+
+		std::uint64_t start = sd_sim_clock::now_us();
+		for (lfs_block_t block = 0; block < download_blocks; block++) {
+			rockettest_check_expr_true(ctx->cfg.read(&ctx->cfg, block, 0, buf, sizeof(buf)) == 0);
+			rockettest_check_expr_true(buf[0] == static_cast<std::uint8_t>(block));
+		}
+		std::uint64_t elapsed_us = sd_sim_clock::now_us() - start;
+		*kbytes_per_s = static_cast<std::uint64_t>(download_blocks) * LFSSHIM_SD_SECTOR_SIZE *
+						1000 / elapsed_us;
+		return test_passed;
+	}
+
+public:
+	littlefs_sd_shim_readahead_test() : rockettest_test("littlefs_sd_shim_readahead_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		sd_card_sim card(SIM_CARD_BLOCKS);
+		static lfsshim_sd_ctx_t ctx;
+		lfs_t lfs;
+		std::uint8_t buf[LFSSHIM_SD_SECTOR_SIZE];
+
+		for (std::uint32_t block = 0; block < SIM_CARD_BLOCKS; block++) {
+			std::memset(
+				card.block(block), static_cast<std::uint8_t>(block), LFSSHIM_SD_SECTOR_SIZE);
+		}
+		rockettest_check_expr_true(lfsshim_sd_mount(&ctx, &lfs, card.handle(), 0) == W_SUCCESS);
+		rockettest_check_expr_true(lfsshim_sd_set_readahead(nullptr, true) == W_INVALID_PARAM);
+
+		std::uint64_t plain_rate;
+		card.reset_stats();
+		test_passed &= download(&ctx, &plain_rate);
+		std::uint32_t plain_cmds = card.read_cmds;
+
+		std::uint64_t readahead_rate;
+		rockettest_check_expr_true(lfsshim_sd_set_readahead(&ctx, true) == W_SUCCESS);
+		card.reset_stats();
+		test_passed &= download(&ctx, &readahead_rate);
+
+		printf("Log download: %llu kB/s (%u read commands), with read-ahead %llu kB/s (%u read "
+			   "commands)\n",
+			   static_cast<unsigned long long>(plain_rate),
+			   plain_cmds,
+			   static_cast<unsigned long long>(readahead_rate),
+			   card.read_cmds);
+		// The first read is not known to be sequential yet
+		rockettest_check_expr_true(card.read_cmds <=
+								   download_blocks / LFSSHIM_SD_READAHEAD_BLOCKS + 1);
+		rockettest_check_expr_true(readahead_rate > plain_rate * 4);
+
+		// Random reads are not prefetched
+		card.reset_stats();
+		rockettest_check_expr_true(ctx.cfg.read(&ctx.cfg, 3000, 0, buf, sizeof(buf)) == 0);
+		rockettest_check_expr_true(ctx.cfg.read(&ctx.cfg, 100, 0, buf, sizeof(buf)) == 0);
+		rockettest_check_expr_true(card.blocks_read == 2);
+
+		// A write into the buffered range is visible to the next read
+		rockettest_check_expr_true(ctx.cfg.read(&ctx.cfg, 101, 0, buf, sizeof(buf)) == 0);
+		rockettest_check_expr_true(card.blocks_read == 2 + LFSSHIM_SD_READAHEAD_BLOCKS);
+		rockettest_check_expr_true(prog_block(&ctx, 105, 0xee) == 0);
+		rockettest_check_expr_true(ctx.cfg.read(&ctx.cfg, 102, 0, buf, sizeof(buf)) == 0);
+		rockettest_check_expr_true(ctx.cfg.read(&ctx.cfg, 103, 0, buf, sizeof(buf)) == 0);
+		rockettest_check_expr_true(ctx.cfg.read(&ctx.cfg, 104, 0, buf, sizeof(buf)) == 0);
+		rockettest_check_expr_true(ctx.cfg.read(&ctx.cfg, 105, 0, buf, sizeof(buf)) == 0);
+		rockettest_check_expr_true(buf[0] == 0xee);
+
+		// Near the end of the card only the requested block is read
+		rockettest_check_expr_true(
+			ctx.cfg.read(&ctx.cfg, SIM_CARD_BLOCKS - 2, 0, buf, sizeof(buf)) == 0);
+		rockettest_check_expr_true(
+			ctx.cfg.read(&ctx.cfg, SIM_CARD_BLOCKS - 1, 0, buf, sizeof(buf)) == 0);
+		rockettest_check_expr_true(buf[0] == static_cast<std::uint8_t>(SIM_CARD_BLOCKS - 1));
+
+		// A filesystem smaller than the card, its size comes from the superblock
+		lfs_sim::superblock_block_count = 1024;
+		rockettest_check_expr_true(lfsshim_sd_mount(&ctx, &lfs, card.handle(), 0) == W_SUCCESS);
+		rockettest_check_expr_true(lfsshim_sd_set_readahead(&ctx, true) == W_SUCCESS);
+		card.reset_stats();
+		rockettest_check_expr_true(ctx.cfg.read(&ctx.cfg, 1022, 0, buf, sizeof(buf)) == 0);
+		rockettest_check_expr_true(ctx.cfg.read(&ctx.cfg, 1023, 0, buf, sizeof(buf)) == 0);
+		rockettest_check_expr_true(buf[0] == static_cast<std::uint8_t>(1023));
+		rockettest_check_expr_true(card.blocks_read == 2);
+		lfs_sim::superblock_block_count = 0;
+
+		return test_passed;
+	}
+};
+
+littlefs_sd_shim_readahead_test littlefs_sd_shim_readahead_test_inst;
+
+class littlefs_sd_shim_stats_test : rockettest_test {
+public:
+	littlefs_sd_shim_stats_test() : rockettest_test("littlefs_sd_shim_stats_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		sd_card_sim card(SIM_CARD_BLOCKS);
+		static lfsshim_sd_ctx_t ctx;
+		lfs_t lfs;
+		lfsshim_sd_stats_t stats;
+		std::uint8_t buf[LFSSHIM_SD_SECTOR_SIZE];
+
+		rockettest_check_expr_true(lfsshim_sd_mount(&ctx, &lfs, card.handle(), 0) == W_SUCCESS);
+		rockettest_check_expr_true(lfsshim_sd_get_stats(nullptr, &stats) == W_INVALID_PARAM);
+		rockettest_check_expr_true(lfsshim_sd_get_stats(&ctx, nullptr) == W_INVALID_PARAM);
+		rockettest_check_expr_true(lfsshim_sd_reset_stats(nullptr) == W_INVALID_PARAM);
+		rockettest_check_expr_true(lfsshim_sd_reset_stats(&ctx) == W_SUCCESS);
+
+		for (lfs_block_t block = 0; block < 10; block++) {
+			rockettest_check_expr_true(prog_block(&ctx, block, 0x31) == 0);
+			rockettest_check_expr_true(ctx.cfg.read(&ctx.cfg, block, 0, buf, sizeof(buf)) == 0);
+		}
+
+		// One slow write, the card does some garbage collection
+		card.timing.program_us_per_cmd = 30000;
+		rockettest_check_expr_true(prog_block(&ctx, 10, 0x32) == 0);
+		card.timing = sd_card_sim_timing{};
+
+		rockettest_check_expr_true(lfsshim_sd_get_stats(&ctx, &stats) == W_SUCCESS);
+		rockettest_check_expr_true(stats.read_us.count == 10);
+		rockettest_check_expr_true(stats.read_bytes == 10 * LFSSHIM_SD_SECTOR_SIZE);
+		rockettest_check_expr_true(stats.prog_us.count == 11);
+		rockettest_check_expr_true(stats.prog_bytes == 11 * LFSSHIM_SD_SECTOR_SIZE);
+		rockettest_check_expr_true(stats.busy_wait_us.count == 11);
+		rockettest_check_expr_true(stats.timeout_us.count == 0);
+
+		// Latencies match the card model: read access + transfer, programming + transfer
+		rockettest_check_expr_true(stats.read_us.min >= 262 && stats.read_us.max < 300);
+		rockettest_check_expr_true(stats.prog_us.min >= 882 && stats.prog_us.min < 1000);
+		rockettest_check_expr_true(stats.prog_us.max >= 30000 && stats.prog_us.max < 31000);
+		rockettest_check_expr_true(stats.prog_us.buckets[log2_hist_bucket(30000)] == 1);
+		rockettest_check_expr_true(stats.prog_us.buckets[log2_hist_bucket(900)] == 10);
+
+		printf("prog: %u calls, min %u us, mean %u us, max %u us\n",
+			   stats.prog_us.count,
+			   stats.prog_us.min,
+			   log2_hist_mean(&stats.prog_us),
+			   stats.prog_us.max);
+
+		// Timeouts are recorded with the time waited
+		card.timing.program_us_per_cmd = 200000;
+		rockettest_check_expr_true(prog_block(&ctx, 11, 0x33) == LFS_ERR_IO);
+		card.timing = sd_card_sim_timing{};
+		sd_sim_clock::advance_us(200000);
+		rockettest_check_expr_true(lfsshim_sd_get_stats(&ctx, &stats) == W_SUCCESS);
+		rockettest_check_expr_true(stats.timeout_us.count == 1);
+		rockettest_check_expr_true(stats.timeout_us.min > 50000);
+		rockettest_check_expr_true(stats.prog_us.count == 11);
+
+		rockettest_check_expr_true(lfsshim_sd_reset_stats(&ctx) == W_SUCCESS);
+		rockettest_check_expr_true(lfsshim_sd_get_stats(&ctx, &stats) == W_SUCCESS);
+		rockettest_check_expr_true(stats.prog_us.count == 0 && stats.read_bytes == 0);
+
+		return test_passed;
+	}
+};
+
+littlefs_sd_shim_stats_test littlefs_sd_shim_stats_test_inst;
+
+class littlefs_sd_shim_clock_test : rockettest_test {
+public:
+	littlefs_sd_shim_clock_test() : rockettest_test("littlefs_sd_shim_clock_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		sd_card_sim card(SIM_CARD_BLOCKS);
+		static lfsshim_sd_ctx_t ctx;
+		lfs_t lfs;
+
+		stm32_tim_sim::reset();
+		stm32_tim_sim::set_isr(timebase_handle_interrupt);
+		rockettest_check_expr_true(timebase_init(240000000) == W_SUCCESS);
+		rockettest_check_expr_true(lfsshim_sd_mount(&ctx, &lfs, card.handle(), 0) == W_SUCCESS);
+
+		// A write that never finishes times out after 50 ms with either clock, the millisecond
+		// tick only notices up to two ticks later
+		double timeout_ms[2];
+		for (int i = 0; i < 2; i++) {
+			lfsshim_sd_wait_config_t wait = {};
+			wait.clock_us = (i == 0) ? nullptr : timebase_us;
+			rockettest_check_expr_true(lfsshim_sd_set_wait_config(&ctx, &wait) == W_SUCCESS);
+
+			card.timing.program_us_per_cmd = 200000;
+			std::uint64_t start = sd_sim_clock::now_us();
+			rockettest_check_expr_true(prog_block(&ctx, 1, 0x34) == LFS_ERR_IO);
+			timeout_ms[i] = (sd_sim_clock::now_us() - start) / 1000.0;
+			card.timing = sd_card_sim_timing{};
+			sd_sim_clock::advance_us(200000);
+		}
+		rockettest_check_expr_true((timeout_ms[0] > 50) && (timeout_ms[0] <= 52.1));
+		rockettest_check_expr_true((timeout_ms[1] > 50) && (timeout_ms[1] <= 50.1));
+
+		// Successful writes are not affected
+		lfsshim_sd_wait_config_t wait = {};
+		wait.clock_us = timebase_us;
+		rockettest_check_expr_true(lfsshim_sd_set_wait_config(&ctx, &wait) == W_SUCCESS);
+		rockettest_check_expr_true(prog_block(&ctx, 2, 0x35) == 0);
+
+		printf("Write timeout: %.3f ms with HAL_GetTick(), %.3f ms with timebase_us()\n",
+			   timeout_ms[0],
+			   timeout_ms[1]);
+
+		return test_passed;
+	}
+};
+
+littlefs_sd_shim_clock_test littlefs_sd_shim_clock_test_inst;
+
+class littlefs_sd_shim_geometry_test : rockettest_test {
+	static constexpr std::uint32_t log_bytes = 256 * 1024;
+	static constexpr std::uint64_t card_32gb_sectors = 32ULL * 1000 * 1000 * 1000 / 512;
+
+	// Writes a log the way littlefs appends file data: each block is erased, then filled through
+	// the prog cache, which is flushed whenever it is full. Returns the throughput in kB/s.
+	bool write_log(lfsshim_sd_ctx_t *ctx, std::uint64_t *kbytes_per_s) {
+		bool test_passed = true;
+		static std::uint8_t chunk[LFSSHIM_SD_CACHE_SIZE];
+		const struct lfs_config *c = &ctx->cfg;
+
+		std::uint64_t start = sd_sim_clock::now_us();
+		for (lfs_block_t block = 0; block < log_bytes / c->block_size; block++) {
+			rockettest_check_expr_true(c->erase(c, block) == 0);
+			for (lfs_off_t off = 0; off < c->block_size; off += c->cache_size) {
+				std::memset(chunk, static_cast<std::uint8_t>(block), c->cache_size);
+				rockettest_check_expr_true(c->prog(c, block, off, chunk, c->cache_size) == 0);
+			}
+		}
+		rockettest_check_expr_true(c->sync(c) == 0);
+		*kbytes_per_s = log_bytes * 1000ULL / (sd_sim_clock::now_us() - start);
+		return test_passed;
+	}
+
+	// Reads the log back through the read cache, returns the throughput in kB/s
+	bool read_log(lfsshim_sd_ctx_t *ctx, std::uint64_t *kbytes_per_s) {
+		bool test_passed = true;
+		static std::uint8_t chunk[LFSSHIM_SD_CACHE_SIZE];
+		const struct lfs_config *c = &ctx->cfg;
+
+		std::uint64_t start = sd_sim_clock::now_us();
+		for (lfs_block_t block = 0; block < log_bytes / c->block_size; block++) {
+			for (lfs_off_t off = 0; off < c->block_size; off += c->cache_size) {
+				rockettest_check_expr_true(c->read(c, block, off, chunk, c->cache_size) == 0);
+				rockettest_check_expr_true(chunk[c->cache_size - 1] ==
+										   static_cast<std::uint8_t>(block));
+			}
+		}
+		*kbytes_per_s = log_bytes * 1000ULL / (sd_sim_clock::now_us() - start);
+		return test_passed;
+	}
+
+public:
+	littlefs_sd_shim_geometry_test() : rockettest_test("littlefs_sd_shim_geometry_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		sd_card_sim card(SIM_CARD_BLOCKS);
+		static lfsshim_sd_ctx_t ctx;
+		lfs_t lfs;
+
+		rockettest_check_expr_true(lfsshim_sd_set_geometry(nullptr, &lfsshim_sd_geometry_4k) ==
+								   W_INVALID_PARAM);
+		rockettest_check_expr_true(lfsshim_sd_set_geometry(&ctx, nullptr) == W_INVALID_PARAM);
+		lfsshim_sd_geometry_t bad = lfsshim_sd_geometry_4k;
+		bad.cache_size = 3 * LFSSHIM_SD_SECTOR_SIZE; // does not divide the block
+		rockettest_check_expr_true(lfsshim_sd_set_geometry(&ctx, &bad) == W_INVALID_PARAM);
+		bad = lfsshim_sd_geometry_4k;
+		bad.block_size = 1000;
+		rockettest_check_expr_true(lfsshim_sd_set_geometry(&ctx, &bad) == W_INVALID_PARAM);
+		bad = lfsshim_sd_geometry_4k;
+		bad.lookahead_size = LFSSHIM_SD_LOOKAHEAD_SIZE * 2; // larger than the buffer
+		rockettest_check_expr_true(lfsshim_sd_set_geometry(&ctx, &bad) == W_INVALID_PARAM);
+
+		// A geometry exceeding the buffers is refused at mount as well
+		ctx.geometry = &bad;
+		rockettest_check_expr_true(lfsshim_sd_mount(&ctx, &lfs, card.handle(), 0) ==
+								   W_INVALID_PARAM);
+		ctx.geometry = nullptr;
+
+		// So is a flush size larger than the cache buffers
+		lfsshim_sd_probe_result_t probe = {};
+		probe.flush_size = 2 * LFSSHIM_SD_CACHE_SIZE;
+		rockettest_check_expr_true(lfsshim_sd_apply_probe(&ctx, &probe) == W_INVALID_PARAM);
+		probe.flush_size = LFSSHIM_SD_SECTOR_SIZE + 1;
+		rockettest_check_expr_true(lfsshim_sd_apply_probe(&ctx, &probe) == W_INVALID_PARAM);
+
+		// littlefs blocks and offsets map onto groups of sectors
+		rockettest_check_expr_true(lfsshim_sd_set_geometry(&ctx, &lfsshim_sd_geometry_4k) ==
+								   W_SUCCESS);
+		rockettest_check_expr_true(lfsshim_sd_mount(&ctx, &lfs, card.handle(), PARTITION_OFFSET) ==
+								   W_SUCCESS);
+		rockettest_check_expr_true(ctx.cfg.block_size == 4096);
+		std::uint8_t buf[LFSSHIM_SD_SECTOR_SIZE];
+		std::memset(buf, 0x77, sizeof(buf));
+		rockettest_check_expr_true(ctx.cfg.prog(&ctx.cfg, 2, 1024, buf, sizeof(buf)) == 0);
+		rockettest_check_expr_true(card.block(PARTITION_OFFSET + 2 * 8 + 2)[0] == 0x77);
+		rockettest_check_expr_true(ctx.cfg.read(&ctx.cfg, 2, 1024, buf, sizeof(buf)) == 0);
+		rockettest_check_expr_true(buf[0] == 0x77);
+
+		// A discarded block covers all of its sectors
+		rockettest_check_expr_true(lfsshim_sd_set_discard(&ctx, true) == W_SUCCESS);
+		card.reset_stats();
+		rockettest_check_expr_true(ctx.cfg.erase(&ctx.cfg, 5) == 0);
+		rockettest_check_expr_true(ctx.cfg.erase(&ctx.cfg, 6) == 0);
+		rockettest_check_expr_true(ctx.cfg.sync(&ctx.cfg) == 0);
+		rockettest_check_expr_true(card.erases.size() == 1);
+		rockettest_check_expr_true(card.erases[0].start == PARTITION_OFFSET + 5 * 8);
+		rockettest_check_expr_true(card.erases[0].end == PARTITION_OFFSET + 7 * 8 - 1);
+		rockettest_check_expr_true(lfsshim_sd_set_discard(&ctx, false) == W_SUCCESS);
+
+		// The context is sized for the largest geometry of the build, smaller ones leave part of
+		// its buffers unused
+		printf("lfsshim_sd_ctx_t %zu bytes (cache %u, lookahead %u bytes), stand-in lfs_t %zu "
+			   "bytes\n",
+			   sizeof(lfsshim_sd_ctx_t),
+			   static_cast<unsigned>(LFSSHIM_SD_CACHE_SIZE),
+			   static_cast<unsigned>(LFSSHIM_SD_LOOKAHEAD_SIZE),
+			   sizeof(lfs_t));
+		const lfsshim_sd_geometry_t *profiles[] = {&lfsshim_sd_geometry_sector,
+												   &lfsshim_sd_geometry_4k,
+												   &lfsshim_sd_geometry_4k_large_card};
+		std::uint64_t sector_write_rate = 0;
+		for (const lfsshim_sd_geometry_t *profile : profiles) {
+			rockettest_check_expr_true(lfsshim_sd_set_geometry(&ctx, profile) == W_SUCCESS);
+			std::uint64_t start = sd_sim_clock::now_us();
+			rockettest_check_expr_true(lfsshim_sd_mount(&ctx, &lfs, card.handle(), 0) ==
+									   W_SUCCESS);
+			std::uint64_t mount_us = sd_sim_clock::now_us() - start;
+
+			std::uint64_t write_rate;
+			std::uint64_t read_rate;
+			test_passed &= write_log(&ctx, &write_rate);
+			test_passed &= read_log(&ctx, &read_rate);
+
+			std::size_t buffers = 2 * profile->cache_size + profile->lookahead_size;
+			std::uint64_t blocks_32gb = card_32gb_sectors * 512 / profile->block_size;
+			std::uint64_t scans_32gb = blocks_32gb / (profile->lookahead_size * 8);
+			printf("%-14s mount %4llu us, write %5llu kB/s, read %5llu kB/s, buffers used %5zu "
+				   "bytes, %llu lookahead scans to cover 32 GB\n",
+				   profile->name,
+				   static_cast<unsigned long long>(mount_us),
+				   static_cast<unsigned long long>(write_rate),
+				   static_cast<unsigned long long>(read_rate),
+				   buffers,
+				   static_cast<unsigned long long>(scans_32gb));
+
+			if (profile == &lfsshim_sd_geometry_sector) {
+				sector_write_rate = write_rate;
+			} else {
+				// The full prog cache reaches the card as one multi-block write
+				rockettest_check_expr_true(write_rate > sector_write_rate * 4);
+			}
+		}
+
+		return test_passed;
+	}
+};
+
+littlefs_sd_shim_geometry_test littlefs_sd_shim_geometry_test_inst;
+
+class littlefs_sd_shim_checkpoint_test : rockettest_test {
+	static constexpr std::uint32_t card_blocks = 65536;
+	static constexpr std::uint32_t checkpoint_sector = 8;
+	static constexpr lfs_size_t fs_blocks = 60000;
+
+	static bool is_used(lfs_block_t block) {
+		return (block % 20) == 0;
+	}
+
+	// Mounts, then times the first allocation. Returns the time from the start of the mount.
+	bool mount_and_alloc(lfsshim_sd_ctx_t *ctx, lfs_t *lfs, sd_card_sim &card, lfs_block_t *block,
+						 std::uint64_t *boot_us, std::uint32_t *alloc_reads) {
+		bool test_passed = true;
+		std::uint64_t start = sd_sim_clock::now_us();
+		rockettest_check_expr_true(lfsshim_sd_mount(ctx, lfs, card.handle(), 2048) == W_SUCCESS);
+		std::uint32_t reads = card.read_cmds;
+		rockettest_check_expr_true(lfs_sim::alloc(lfs, block) == LFS_ERR_OK);
+		*alloc_reads = card.read_cmds - reads;
+		*boot_us = sd_sim_clock::now_us() - start;
+		return test_passed;
+	}
+
+public:
+	littlefs_sd_shim_checkpoint_test() : rockettest_test("littlefs_sd_shim_checkpoint_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		sd_card_sim card(card_blocks);
+		static lfsshim_sd_ctx_t ctx;
+		lfs_t lfs;
+		lfs_block_t block = 0;
+		std::uint64_t scan_boot_us;
+		std::uint64_t boot_us;
+		std::uint32_t reads;
+
+		lfs_sim::superblock_block_count = fs_blocks;
+		lfs_sim::used_blocks.clear();
+		for (lfs_block_t b = 0; b < fs_blocks; b++) {
+			if (is_used(b)) {
+				lfs_sim::used_blocks.push_back(b);
+			}
+		}
+
+		rockettest_check_expr_true(lfsshim_sd_set_checkpoint(nullptr, true, 0) == W_INVALID_PARAM);
+		rockettest_check_expr_true(lfsshim_sd_unmount(nullptr, &lfs) == W_INVALID_PARAM);
+		rockettest_check_expr_true(lfsshim_sd_set_checkpoint(&ctx, true, checkpoint_sector) ==
+								   W_SUCCESS);
+
+		// First boot: no checkpoint, the first allocation traverses the filesystem
+		std::memset(card.block(checkpoint_sector), 0, LFSSHIM_SD_SECTOR_SIZE);
+		test_passed &= mount_and_alloc(&ctx, &lfs, card, &block, &scan_boot_us, &reads);
+		rockettest_check_expr_true(!lfsshim_sd_checkpoint_restored(&ctx));
+		rockettest_check_expr_true(reads == lfs_sim::used_blocks.size());
+		for (int i = 0; i < 100; i++) {
+			rockettest_check_expr_true(lfs_sim::alloc(&lfs, &block) == LFS_ERR_OK);
+			rockettest_check_expr_true(!is_used(block));
+		}
+		rockettest_check_expr_true(lfsshim_sd_unmount(&ctx, &lfs) == W_SUCCESS);
+
+		// Next free block after the last allocation
+		lfs_block_t expected = block + 1;
+		while (is_used(expected)) {
+			expected++;
+		}
+
+		// Clean reboot: the allocator continues where it stopped without reading the filesystem
+		test_passed &= mount_and_alloc(&ctx, &lfs, card, &block, &boot_us, &reads);
+		rockettest_check_expr_true(lfsshim_sd_checkpoint_restored(&ctx));
+		rockettest_check_expr_true(reads == 0);
+		rockettest_check_expr_true(block == expected);
+		// The prog cache is left erased for littlefs
+		bool prog_cache_erased = true;
+		for (lfs_size_t i = 0; i < ctx.cfg.cache_size; i++) {
+			prog_cache_erased = prog_cache_erased && (ctx.prog_buffer[i] == 0xff);
+		}
+		rockettest_check_expr_true(prog_cache_erased);
+		printf("Boot to first allocation: %llu us with full scan, %llu us with checkpoint\n",
+			   static_cast<unsigned long long>(scan_boot_us),
+			   static_cast<unsigned long long>(boot_us));
+		rockettest_check_expr_true(boot_us * 20 < scan_boot_us);
+
+		// Power loss: the checkpoint was invalidated when it was used
+		test_passed &= mount_and_alloc(&ctx, &lfs, card, &block, &boot_us, &reads);
+		rockettest_check_expr_true(!lfsshim_sd_checkpoint_restored(&ctx));
+		rockettest_check_expr_true(reads == lfs_sim::used_blocks.size());
+
+		// Corrupt bitmap
+		rockettest_check_expr_true(lfsshim_sd_unmount(&ctx, &lfs) == W_SUCCESS);
+		card.block(checkpoint_sector + 1)[17] ^= 0x01;
+		test_passed &= mount_and_alloc(&ctx, &lfs, card, &block, &boot_us, &reads);
+		rockettest_check_expr_true(!lfsshim_sd_checkpoint_restored(&ctx));
+		rockettest_check_expr_true(!is_used(block));
+
+		// Filesystem geometry changed
+		rockettest_check_expr_true(lfsshim_sd_unmount(&ctx, &lfs) == W_SUCCESS);
+		lfs_sim::superblock_block_count = fs_blocks - 8;
+		test_passed &= mount_and_alloc(&ctx, &lfs, card, &block, &boot_us, &reads);
+		rockettest_check_expr_true(!lfsshim_sd_checkpoint_restored(&ctx));
+		lfs_sim::superblock_block_count = fs_blocks;
+		test_passed &= mount_and_alloc(&ctx, &lfs, card, &block, &boot_us, &reads);
+
+		// Checkpoint cannot be invalidated, it is not used
+		rockettest_check_expr_true(lfsshim_sd_unmount(&ctx, &lfs) == W_SUCCESS);
+		card.fail_writes = true;
+		test_passed &= mount_and_alloc(&ctx, &lfs, card, &block, &boot_us, &reads);
+		rockettest_check_expr_true(!lfsshim_sd_checkpoint_restored(&ctx));
+		rockettest_check_expr_true(reads == lfs_sim::used_blocks.size());
+		card.fail_writes = false;
+
+		// Filesystem modified after the checkpoint was written, e.g. by another host
+		rockettest_check_expr_true(lfsshim_sd_unmount(&ctx, &lfs) == W_SUCCESS);
+		card.block(2048)[100] ^= 0x01;
+		test_passed &= mount_and_alloc(&ctx, &lfs, card, &block, &boot_us, &reads);
+		rockettest_check_expr_true(!lfsshim_sd_checkpoint_restored(&ctx));
+		rockettest_check_expr_true(reads == lfs_sim::used_blocks.size());
+
+		// A mount with the checkpoint disabled invalidates it, it may modify the filesystem
+		rockettest_check_expr_true(lfsshim_sd_unmount(&ctx, &lfs) == W_SUCCESS);
+		rockettest_check_expr_true(lfsshim_sd_set_checkpoint(&ctx, false, checkpoint_sector) ==
+								   W_SUCCESS);
+		test_passed &= mount_and_alloc(&ctx, &lfs, card, &block, &boot_us, &reads);
+		rockettest_check_expr_true(lfsshim_sd_unmount(&ctx, &lfs) == W_SUCCESS);
+		rockettest_check_expr_true(lfsshim_sd_set_checkpoint(&ctx, true, checkpoint_sector) ==
+								   W_SUCCESS);
+		test_passed &= mount_and_alloc(&ctx, &lfs, card, &block, &boot_us, &reads);
+		rockettest_check_expr_true(!lfsshim_sd_checkpoint_restored(&ctx));
+		rockettest_check_expr_true(reads == lfs_sim::used_blocks.size());
+
+		// Disabled: the checkpoint is neither written nor read
+		rockettest_check_expr_true(lfsshim_sd_set_checkpoint(&ctx, false, 0) == W_SUCCESS);
+		std::uint32_t writes = card.write_cmds;
+		rockettest_check_expr_true(lfsshim_sd_unmount(&ctx, &lfs) == W_SUCCESS);
+		rockettest_check_expr_true(card.write_cmds == writes);
+
+		lfs_sim::superblock_block_count = 0;
+		lfs_sim::used_blocks.clear();
+		return test_passed;
+	}
+};
+
+littlefs_sd_shim_checkpoint_test littlefs_sd_shim_checkpoint_test_inst;
+
+class littlefs_sd_shim_probe_test : rockettest_test {
+	static constexpr std::uint32_t scratch_sector = 64;
+	static constexpr std::uint32_t scratch_sectors = 64;
+
+	bool probe(const char *name, const sd_card_sim_timing &timing,
+			   lfsshim_sd_probe_result_t *result) {
+		bool test_passed = true;
+		sd_card_sim card(SIM_CARD_BLOCKS, timing);
+		static lfsshim_sd_ctx_t ctx;
+
+		rockettest_check_expr_true(lfsshim_sd_probe(&ctx,
+													card.handle(),
+													scratch_sector,
+													scratch_sectors,
+													result) == W_SUCCESS);
+		// Only the scratch area is written
+		rockettest_check_expr_true(card.block(scratch_sector - 1)[0] == 0xa5);
+		rockettest_check_expr_true(card.block(scratch_sector + scratch_sectors)[0] == 0xa5);
+
+		printf("%s:", name);
+		for (std::uint8_t i = 0; i < result->num_sizes; i++) {
+			printf(" %u sectors %u us %u kB/s,",
+				   result->sectors[i],
+				   result->mean_us[i],
+				   result->kbytes_per_s[i]);
+		}
+		printf(" flush %u bytes, timeout %u ms\n", result->flush_size, result->write_timeout_ms);
+		return test_passed;
+	}
+
+public:
+	littlefs_sd_shim_probe_test() : rockettest_test("littlefs_sd_shim_probe_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+		lfsshim_sd_probe_result_t result;
+		static lfsshim_sd_ctx_t ctx;
+		sd_card_sim card(SIM_CARD_BLOCKS);
+
+		rockettest_check_expr_true(lfsshim_sd_probe(nullptr, card.handle(), 0, 64, &result) ==
+								   W_INVALID_PARAM);
+		rockettest_check_expr_true(lfsshim_sd_probe(&ctx, nullptr, 0, 64, &result) ==
+								   W_INVALID_PARAM);
+		rockettest_check_expr_true(lfsshim_sd_probe(&ctx, card.handle(), 0, 64, nullptr) ==
+								   W_INVALID_PARAM);
+		rockettest_check_expr_true(lfsshim_sd_probe(&ctx, card.handle(), 0, 1, &result) ==
+								   W_INVALID_PARAM);
+		rockettest_check_expr_true(lfsshim_sd_apply_probe(nullptr, &result) == W_INVALID_PARAM);
+
+		// Latency dominated by a fixed cost per write command: flush as much as possible at once
+		sd_card_sim_timing per_cmd;
+		test_passed &= probe("per-command card", per_cmd, &result);
+		rockettest_check_expr_true(result.sectors[result.num_sizes - 1] ==
+								   LFSSHIM_SD_CACHE_SIZE / LFSSHIM_SD_SECTOR_SIZE);
+		rockettest_check_expr_true(result.flush_size == LFSSHIM_SD_CACHE_SIZE);
+		rockettest_check_expr_true(result.write_timeout_ms == 10);
+
+		// Latency proportional to the size: larger flushes buy nothing
+		sd_card_sim_timing per_block;
+		per_block.program_us_per_cmd = 50;
+		per_block.program_us_per_block = 400;
+		test_passed &= probe("per-block card", per_block, &result);
+		rockettest_check_expr_true(result.flush_size == 2 * LFSSHIM_SD_SECTOR_SIZE);
+
+		// Slow card gets a longer timeout
+		sd_card_sim_timing slow;
+		slow.program_us_per_cmd = 30000;
+		test_passed &= probe("slow card", slow, &result);
+		rockettest_check_expr_true(result.write_timeout_ms >= 120 && result.write_timeout_ms < 130);
+
+		// The tuned cache size and timeout are used at the next mount
+		lfs_t lfs;
+		rockettest_check_expr_true(lfsshim_sd_set_geometry(&ctx, &lfsshim_sd_geometry_4k) ==
+								   W_SUCCESS);
+		result.flush_size = 1024;
+		rockettest_check_expr_true(lfsshim_sd_apply_probe(&ctx, &result) == W_SUCCESS);
+		rockettest_check_expr_true(lfsshim_sd_mount(&ctx, &lfs, card.handle(), 0) == W_SUCCESS);
+		rockettest_check_expr_true(ctx.cfg.cache_size == 1024);
+
+		// A write taking 100 ms succeeds with the tuned timeout, it would fail with the default
+		card.timing.program_us_per_cmd = 100000;
+		rockettest_check_expr_true(prog_block(&ctx, 0, 0x44) == 0);
+		rockettest_check_expr_true(lfsshim_sd_apply_probe(&ctx, nullptr) == W_SUCCESS);
+		rockettest_check_expr_true(prog_block(&ctx, 0, 0x44) == LFS_ERR_IO);
+		card.timing = sd_card_sim_timing{};
+		sd_sim_clock::advance_us(100000);
+
+		// A failing card is reported
+		card.fail_writes = true;
+		rockettest_check_expr_true(lfsshim_sd_probe(&ctx, card.handle(), 0, 64, &result) ==
+								   W_IO_ERROR);
+		card.fail_writes = false;
+
+		rockettest_check_expr_true(lfsshim_sd_set_geometry(&ctx, &lfsshim_sd_geometry_sector) ==
+								   W_SUCCESS);
+		return test_passed;
+	}
+};
+
+littlefs_sd_shim_probe_test littlefs_sd_shim_probe_test_inst;
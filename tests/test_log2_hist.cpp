@@ -0,0 +1,57 @@
+#include <cstdint>
+
+#include "common.h"
+#include "log2_hist.h"
+
+#include "rockettest.hpp"
+
+class log2_hist_test : rockettest_test {
+public:
+	log2_hist_test() : rockettest_test("log2_hist_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		rockettest_check_assert_triggered([] { log2_hist_add(nullptr, 0); });
+		rockettest_check_assert_triggered([] { log2_hist_reset(nullptr); });
+		rockettest_check_assert_triggered([] { log2_hist_mean(nullptr); });
+
+		rockettest_check_expr_true(log2_hist_bucket(0) == 0);
+		rockettest_check_expr_true(log2_hist_bucket(1) == 1);
+		rockettest_check_expr_true(log2_hist_bucket(2) == 2);
+		rockettest_check_expr_true(log2_hist_bucket(3) == 2);
+		rockettest_check_expr_true(log2_hist_bucket(4) == 3);
+		rockettest_check_expr_true(log2_hist_bucket(1023) == 10);
+		rockettest_check_expr_true(log2_hist_bucket(1024) == 11);
+		rockettest_check_expr_true(log2_hist_bucket(UINT32_MAX) == LOG2_HIST_BUCKETS - 1);
+
+		log2_hist_t hist = {};
+		rockettest_check_expr_true(log2_hist_mean(&hist) == 0);
+
+		log2_hist_add(&hist, 100);
+		log2_hist_add(&hist, 5);
+		log2_hist_add(&hist, 6);
+		log2_hist_add(&hist, 1000);
+		rockettest_check_expr_true(hist.count == 4);
+		rockettest_check_expr_true(hist.min == 5);
+		rockettest_check_expr_true(hist.max == 1000);
+		rockettest_check_expr_true(log2_hist_mean(&hist) == 277);
+		rockettest_check_expr_true(hist.buckets[3] == 2);
+		rockettest_check_expr_true(hist.buckets[7] == 1);
+		rockettest_check_expr_true(hist.buckets[10] == 1);
+
+		log2_hist_add(&hist, UINT32_MAX);
+		rockettest_check_expr_true(hist.max == UINT32_MAX);
+		rockettest_check_expr_true(hist.sum == 1111ULL + UINT32_MAX);
+
+		log2_hist_reset(&hist);
+		rockettest_check_expr_true(hist.count == 0);
+		rockettest_check_expr_true(hist.buckets[3] == 0);
+		log2_hist_add(&hist, 7);
+		rockettest_check_expr_true(hist.min == 7 && hist.max == 7);
+
+		return test_passed;
+	}
+};
+
+log2_hist_test log2_hist_test_inst;
@@ -0,0 +1,296 @@
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include "common.h"
+#include "partition.h"
+
+#include "rockettest.hpp"
+
+// In-memory disk that records the sectors and bytes read through the partition callback
+struct partition_test_disk {
+	std::vector<std::uint8_t> data;
+	std::set<std::uint64_t> sectors_read;
+	std::uint32_t bytes_read = 0;
+	std::uint32_t calls = 0;
+	std::int64_t fail_lba = -1;
+
+	explicit partition_test_disk(std::uint32_t num_sectors) : data(num_sectors * 512, 0) {}
+
+	std::uint8_t *sector(std::uint64_t lba) {
+		return &data[lba * 512];
+	}
+};
+
+static w_status_t partition_test_disk_read(void *arg, std::uint64_t lba, std::uint16_t offset,
+										   std::uint8_t *buffer, std::uint16_t size) {
+	partition_test_disk *disk = static_cast<partition_test_disk *>(arg);
+	if ((static_cast<std::int64_t>(lba) == disk->fail_lba) || (offset + size > 512) ||
+		((lba + 1) * 512 > disk->data.size())) {
+		return W_IO_ERROR;
+	}
+	std::memcpy(buffer, disk->sector(lba) + offset, size);
+	disk->sectors_read.insert(lba);
+	disk->bytes_read += size;
+	disk->calls++;
+	return W_SUCCESS;
+}
+
+static void partition_test_put_le32(std::uint8_t *p, std::uint32_t value) {
+	for (int i = 0; i < 4; i++) {
+		p[i] = static_cast<std::uint8_t>(value >> (8 * i));
+	}
+}
+
+static void partition_test_put_le64(std::uint8_t *p, std::uint64_t value) {
+	partition_test_put_le32(p, static_cast<std::uint32_t>(value));
+	partition_test_put_le32(p + 4, static_cast<std::uint32_t>(value >> 32));
+}
+
+static std::uint32_t partition_test_crc32(const std::uint8_t *data, std::size_t size) {
+	std::uint32_t crc = 0xFFFFFFFF;
+	for (std::size_t i = 0; i < size; i++) {
+		crc ^= data[i];
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 1) ? ((crc >> 1) ^ 0xEDB88320) : (crc >> 1);
+		}
+	}
+	return ~crc;
+}
+
+// Write an MBR/EBR table entry and the boot signature
+static void partition_test_put_mbr_entry(std::uint8_t *sector, int index, std::uint8_t type,
+										 std::uint32_t lba, std::uint32_t size) {
+	std::uint8_t *entry = sector + 0x1BE + 16 * index;
+	entry[4] = type;
+	partition_test_put_le32(entry + 8, lba);
+	partition_test_put_le32(entry + 12, size);
+	sector[0x1FE] = 0x55;
+	sector[0x1FF] = 0xAA;
+}
+
+// Write a protective MBR and a primary GPT with 128 entries of 128 bytes at LBA 2
+static void partition_test_put_gpt(partition_test_disk &disk,
+								   const std::vector<std::pair<int, std::uint64_t>> &parts,
+								   std::uint64_t part_sectors) {
+	partition_test_put_mbr_entry(disk.sector(0), 0, 0xEE, 1, 0xFFFFFFFF);
+
+	for (const auto &[index, start] : parts) {
+		std::uint8_t *entry = disk.sector(2) + 128 * index;
+		std::memcpy(entry, partition_gpt_type_linux, PARTITION_GUID_SIZE);
+		entry[16] = static_cast<std::uint8_t>(index + 1);
+		partition_test_put_le64(entry + 32, start);
+		partition_test_put_le64(entry + 40, start + part_sectors - 1);
+	}
+
+	std::uint8_t *header = disk.sector(1);
+	std::memcpy(header, "EFI PART", 8);
+	partition_test_put_le32(header + 8, 0x00010000);
+	partition_test_put_le32(header + 12, 92);
+	partition_test_put_le64(header + 72, 2);
+	partition_test_put_le32(header + 80, 128);
+	partition_test_put_le32(header + 84, 128);
+	partition_test_put_le32(header + 88, partition_test_crc32(disk.sector(2), 128 * 128));
+	partition_test_put_le32(header + 16, 0);
+	partition_test_put_le32(header + 16, partition_test_crc32(header, 92));
+}
+
+
+class partition_mbr_test : rockettest_test {
+public:
+	partition_mbr_test() : rockettest_test("partition_mbr_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+		partition_entry_t entries[8];
+		uint8_t count = 0;
+
+		// Primary FAT partition, extended partition with two logical Linux partitions, primary
+		// Linux partition that is not aligned to the 8192 sector allocation unit
+		partition_test_disk disk(70000);
+		partition_test_put_mbr_entry(disk.sector(0), 0, 0x0C, 8192, 8192);
+		partition_test_put_mbr_entry(disk.sector(0), 1, 0x0F, 16384, 32768);
+		partition_test_put_mbr_entry(disk.sector(0), 2, 0x83, 49153, 1000);
+		partition_test_put_mbr_entry(disk.sector(16384), 0, 0x83, 8192, 4096);
+		partition_test_put_mbr_entry(disk.sector(16384), 1, 0x05, 16384, 16384);
+		partition_test_put_mbr_entry(disk.sector(32768), 0, 0x83, 2048, 8192);
+
+		rockettest_check_expr_true(partition_enumerate(partition_test_disk_read, &disk, 8192,
+													   entries, 8, &count) == W_SUCCESS);
+		rockettest_check_expr_true(count == 4);
+
+		rockettest_check_expr_true(entries[0].scheme == PARTITION_SCHEME_MBR);
+		rockettest_check_expr_true(entries[0].mbr_type == 0x0C);
+		rockettest_check_expr_true(entries[0].start_lba == 8192);
+		rockettest_check_expr_true(entries[0].num_sectors == 8192);
+		rockettest_check_expr_true(entries[0].aligned);
+
+		rockettest_check_expr_true(entries[1].scheme == PARTITION_SCHEME_EBR);
+		rockettest_check_expr_true(entries[1].start_lba == 16384 + 8192);
+		rockettest_check_expr_true(entries[1].num_sectors == 4096);
+		rockettest_check_expr_true(entries[1].aligned);
+		rockettest_check_expr_true(partition_is_linux(&entries[1]));
+
+		rockettest_check_expr_true(entries[2].scheme == PARTITION_SCHEME_EBR);
+		rockettest_check_expr_true(entries[2].start_lba == 32768 + 2048);
+		rockettest_check_expr_true(!entries[2].aligned);
+		rockettest_check_expr_true(entries[2].align_offset == 2048);
+
+		rockettest_check_expr_true(entries[3].scheme == PARTITION_SCHEME_MBR);
+		rockettest_check_expr_true(entries[3].start_lba == 49153);
+		rockettest_check_expr_true(entries[3].align_offset == 1);
+		rockettest_check_expr_true(!partition_is_linux(&entries[0]));
+
+		// Only the MBR and the two EBRs are touched, and only their partition tables
+		rockettest_check_expr_true(disk.sectors_read == std::set<std::uint64_t>({0, 16384, 32768}));
+		rockettest_check_expr_true(disk.bytes_read == 3 * 66);
+
+		// Alignment check disabled
+		rockettest_check_expr_true(partition_enumerate(partition_test_disk_read, &disk, 0, entries,
+													   8, &count) == W_SUCCESS);
+		rockettest_check_expr_true(entries[3].aligned && (entries[3].align_offset == 0));
+
+		// More partitions than entries, the first ones are still returned
+		rockettest_check_expr_true(partition_enumerate(partition_test_disk_read, &disk, 8192,
+													   entries, 2, &count) == W_OVERFLOW);
+		rockettest_check_expr_true(count == 2);
+		rockettest_check_expr_true(entries[1].start_lba == 16384 + 8192);
+
+		// Read errors are passed through
+		disk.fail_lba = 32768;
+		rockettest_check_expr_true(partition_enumerate(partition_test_disk_read, &disk, 8192,
+													   entries, 8, &count) == W_IO_ERROR);
+		disk.fail_lba = -1;
+
+		// EBR chain that links back to itself
+		partition_test_put_mbr_entry(disk.sector(32768), 1, 0x05, 16384, 16384);
+		rockettest_check_expr_true(partition_enumerate(partition_test_disk_read, &disk, 8192,
+													   entries, 8, &count) == W_DATA_FORMAT_ERROR);
+
+		// Missing boot signature
+		disk.sector(0)[0x1FF] = 0;
+		rockettest_check_expr_true(partition_enumerate(partition_test_disk_read, &disk, 8192,
+													   entries, 8, &count) == W_DATA_FORMAT_ERROR);
+		rockettest_check_expr_true(count == 0);
+
+		rockettest_check_expr_true(
+			partition_enumerate(nullptr, &disk, 8192, entries, 8, &count) == W_INVALID_PARAM);
+		rockettest_check_expr_true(partition_enumerate(partition_test_disk_read, &disk, 8192,
+													   nullptr, 8, &count) == W_INVALID_PARAM);
+		rockettest_check_expr_true(partition_enumerate(partition_test_disk_read, &disk, 8192,
+													   entries, 8, nullptr) == W_INVALID_PARAM);
+
+		return test_passed;
+	}
+};
+
+partition_mbr_test partition_mbr_test_inst;
+
+class partition_gpt_test : rockettest_test {
+public:
+	partition_gpt_test() : rockettest_test("partition_gpt_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+		partition_entry_t entries[8];
+		uint8_t count = 0;
+
+		// Used entries with a gap, the last entry of the array is used too
+		partition_test_disk disk(64);
+		partition_test_put_gpt(disk, {{0, 2048}, {3, 0x100000000ULL}, {127, 12345}}, 0x1000);
+
+		rockettest_check_expr_true(partition_enumerate(partition_test_disk_read, &disk, 8192,
+													   entries, 8, &count) == W_SUCCESS);
+		rockettest_check_expr_true(count == 3);
+
+		rockettest_check_expr_true(entries[0].scheme == PARTITION_SCHEME_GPT);
+		rockettest_check_expr_true(entries[0].mbr_type == 0);
+		rockettest_check_expr_true(partition_is_linux(&entries[0]));
+		rockettest_check_expr_true(entries[0].start_lba == 2048);
+		rockettest_check_expr_true(entries[0].num_sectors == 0x1000);
+		rockettest_check_expr_true(entries[0].align_offset == 2048);
+
+		// Beyond 32 bit sector addresses
+		rockettest_check_expr_true(entries[1].start_lba == 0x100000000ULL);
+		rockettest_check_expr_true(entries[1].aligned);
+
+		rockettest_check_expr_true(entries[2].start_lba == 12345);
+		rockettest_check_expr_true(entries[2].align_offset == 12345 % 8192);
+
+		// MBR, header and the 32 sectors of the entry array, 48 bytes of each entry
+		rockettest_check_expr_true(disk.sectors_read.size() == 34);
+		rockettest_check_expr_true(disk.bytes_read == 66 + 92 + 128 * 48);
+		printf("GPT enumeration: %u callback reads, %u bytes, %zu sectors\n",
+			   disk.calls,
+			   disk.bytes_read,
+			   disk.sectors_read.size());
+
+		// Non Linux type
+		disk.sector(2)[0] ^= 0xFF;
+		partition_test_put_le32(disk.sector(1) + 16, 0);
+		partition_test_put_le32(disk.sector(1) + 16, partition_test_crc32(disk.sector(1), 92));
+		rockettest_check_expr_true(partition_enumerate(partition_test_disk_read, &disk, 8192,
+													   entries, 8, &count) == W_SUCCESS);
+		rockettest_check_expr_true(!partition_is_linux(&entries[0]));
+		rockettest_check_expr_true(partition_is_linux(&entries[1]));
+
+		// Corrupt header
+		disk.sector(1)[80] ^= 1;
+		rockettest_check_expr_true(partition_enumerate(partition_test_disk_read, &disk, 8192,
+													   entries, 8, &count) == W_DATA_FORMAT_ERROR);
+		disk.sector(1)[80] ^= 1;
+
+		// Header larger than the known fields, the extra bytes are covered by the CRC
+		partition_test_put_le32(disk.sector(1) + 12, 120);
+		partition_test_put_le32(disk.sector(1) + 16, 0);
+		partition_test_put_le32(disk.sector(1) + 16, partition_test_crc32(disk.sector(1), 120));
+		rockettest_check_expr_true(partition_enumerate(partition_test_disk_read, &disk, 8192,
+													   entries, 8, &count) == W_SUCCESS);
+		disk.sector(1)[110] = 1;
+		rockettest_check_expr_true(partition_enumerate(partition_test_disk_read, &disk, 8192,
+													   entries, 8, &count) == W_DATA_FORMAT_ERROR);
+
+		// Enumeration stops at the first partition that does not fit, in the first entry sector
+		partition_test_disk table(64);
+		partition_test_put_gpt(table, {{0, 2048}, {3, 8192}, {127, 16384}}, 0x1000);
+		rockettest_check_expr_true(partition_enumerate(partition_test_disk_read, &table, 8192,
+													   entries, 1, &count) == W_OVERFLOW);
+		rockettest_check_expr_true(count == 1);
+		rockettest_check_expr_true(*table.sectors_read.rbegin() == 2);
+
+		// Entry count of a corrupt header is bounded by the 16 KiB array
+		auto put_header_crc = [](partition_test_disk &d) {
+			partition_test_put_le32(d.sector(1) + 16, 0);
+			partition_test_put_le32(d.sector(1) + 16, partition_test_crc32(d.sector(1), 92));
+		};
+		partition_test_put_le32(table.sector(1) + 80, 0xFFFFFFFF);
+		put_header_crc(table);
+		table.sectors_read.clear();
+		rockettest_check_expr_true(partition_enumerate(partition_test_disk_read, &table, 8192,
+													   entries, 8, &count) == W_SUCCESS);
+		rockettest_check_expr_true(count == 3);
+		rockettest_check_expr_true(*table.sectors_read.rbegin() == 33);
+
+		// Entries ending before they start or overlapping the MBR, the entries before are kept
+		partition_test_put_le64(table.sector(2) + 128 * 3 + 40, 8191);
+		rockettest_check_expr_true(partition_enumerate(partition_test_disk_read, &table, 8192,
+													   entries, 8, &count) == W_DATA_FORMAT_ERROR);
+		rockettest_check_expr_true(count == 1);
+		partition_test_put_le64(table.sector(2) + 128 * 3 + 32, 0);
+		partition_test_put_le64(table.sector(2) + 128 * 3 + 40, 0x1000);
+		rockettest_check_expr_true(partition_enumerate(partition_test_disk_read, &table, 8192,
+													   entries, 8, &count) == W_DATA_FORMAT_ERROR);
+		rockettest_check_expr_true(count == 1);
+
+		// Bad signature
+		partition_test_disk empty(64);
+		partition_test_put_mbr_entry(empty.sector(0), 0, 0xEE, 1, 63);
+		rockettest_check_expr_true(partition_enumerate(partition_test_disk_read, &empty, 8192,
+													   entries, 8, &count) == W_DATA_FORMAT_ERROR);
+
+		return test_passed;
+	}
+};
+
+partition_gpt_test partition_gpt_test_inst;
@@ -0,0 +1,73 @@
+#include <cstdint>
+#include <cstdio>
+
+#include "common.h"
+
+#include "rockettest.hpp"
+
+enum { PROFILE_TEST_SHORT, PROFILE_TEST_LONG, PROFILE_TEST_UNUSED };
+
+static volatile uint32_t profile_test_sink = 0;
+
+static void profile_test_work(uint32_t iterations) {
+	for (uint32_t i = 0; i < iterations; i++) {
+		profile_test_sink = profile_test_sink + i;
+	}
+}
+
+class profile_test : rockettest_test {
+public:
+	profile_test() : rockettest_test("profile_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		w_profile_init();
+		for (int i = 0; i < 10; i++) {
+			W_PROFILE_BEGIN(PROFILE_TEST_SHORT);
+			profile_test_work(100);
+			W_PROFILE_END(PROFILE_TEST_SHORT);
+
+			W_PROFILE_BEGIN(PROFILE_TEST_LONG);
+			profile_test_work(100000);
+			W_PROFILE_END(PROFILE_TEST_LONG);
+		}
+
+		w_profile_stats_t short_stats, long_stats, unused_stats;
+		rockettest_check_expr_true(w_profile_get(PROFILE_TEST_SHORT, &short_stats) == W_SUCCESS);
+		rockettest_check_expr_true(w_profile_get(PROFILE_TEST_LONG, &long_stats) == W_SUCCESS);
+		rockettest_check_expr_true(w_profile_get(PROFILE_TEST_UNUSED, &unused_stats) == W_SUCCESS);
+		rockettest_check_expr_true((short_stats.count == 10) && (long_stats.count == 10));
+		rockettest_check_expr_true(short_stats.min <= short_stats.max);
+		rockettest_check_expr_true(short_stats.total >= 10ULL * short_stats.min);
+		rockettest_check_expr_true(short_stats.total <= 10ULL * short_stats.max);
+		rockettest_check_expr_true(long_stats.min > short_stats.max);
+		rockettest_check_expr_true((unused_stats.count == 0) && (unused_stats.total == 0));
+		rockettest_check_expr_true(w_profile_table[PROFILE_TEST_LONG].max == long_stats.max);
+
+		rockettest_check_expr_true(w_profile_get(W_PROFILE_SCOPES, &short_stats) ==
+								   W_INVALID_PARAM);
+		rockettest_check_expr_true(w_profile_get(PROFILE_TEST_SHORT, nullptr) == W_INVALID_PARAM);
+		w_profile_record(W_PROFILE_SCOPES, 1);
+
+		// The scope itself, two counter reads and the record
+		for (int i = 0; i < 1000; i++) {
+			W_PROFILE_BEGIN(PROFILE_TEST_UNUSED);
+			W_PROFILE_END(PROFILE_TEST_UNUSED);
+		}
+		rockettest_check_expr_true(w_profile_get(PROFILE_TEST_UNUSED, &unused_stats) == W_SUCCESS);
+		printf("Profiling scope on the host: empty scope %u ns min, %u ns mean\n",
+			   static_cast<unsigned>(unused_stats.min),
+			   static_cast<unsigned>(unused_stats.total / unused_stats.count));
+
+		// Host durations are nanoseconds
+		rockettest_check_expr_true(w_profile_counter_hz() == 1000000000u);
+
+		w_profile_init();
+		rockettest_check_expr_true(w_profile_table[PROFILE_TEST_LONG].count == 0);
+
+		return test_passed;
+	}
+};
+
+profile_test profile_test_inst;
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+
+#include "common.h"
+#include "pic18_sim.hpp"
+#include "pic18f26k83/pwm.h"
+#include "xc.h"
+
+#include "rockettest.hpp"
+
+class pwm_test : rockettest_test {
+public:
+	pwm_test() : rockettest_test("pwm_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		pic18_sim::reset();
+		pwm_pin_config_t pin_b0 = {&TRISB, &RB0PPS, 0};
+		pwm_pin_config_t pin_b1 = {&TRISB, &RB1PPS, 1};
+
+		rockettest_check_expr_true(pwm_init(0, pin_b0, 255) == W_INVALID_PARAM);
+		rockettest_check_expr_true(pwm_init(5, pin_b0, 255) == W_INVALID_PARAM);
+		rockettest_check_expr_true(pic18_sim::reg(PIC18_SIM_TRISB) == 0xff);
+
+		// Returns once the first period is over, 256 Fosc/4 clocks at 64 MHz
+		std::uint64_t start = pic18_sim::cycles();
+		rockettest_check_expr_true(pwm_init(1, pin_b0, 255) == W_SUCCESS);
+		std::uint64_t init_cycles = pic18_sim::cycles() - start;
+		rockettest_check_expr_true(pic18_sim::reg(PIC18_SIM_TRISB) == 0xfe);
+		rockettest_check_expr_true(pic18_sim::reg(PIC18_SIM_RB0PPS) == 1);
+		rockettest_check_expr_true(pic18_sim::reg(PIC18_SIM_CCP1CON) == 0x8c);
+		rockettest_check_expr_true(pic18_sim::pwm_hz() == 62500);
+		rockettest_check_expr_true(PIR4bits.TMR2IF == 0);
+
+		rockettest_check_expr_true(pwm_update_duty_cycle(0, 0) == W_INVALID_PARAM);
+		rockettest_check_expr_true(pwm_update_duty_cycle(5, 0) == W_INVALID_PARAM);
+		rockettest_check_expr_true(pwm_update_duty_cycle(1, 1024) == W_INVALID_PARAM);
+
+		// The new duty cycle is latched at the end of the period
+		start = pic18_sim::cycles();
+		rockettest_check_expr_true(pwm_update_duty_cycle(1, 512) == W_SUCCESS);
+		std::uint64_t update_cycles = pic18_sim::cycles() - start;
+		rockettest_check_expr_true(pic18_sim::reg(PIC18_SIM_CCPR1L) == 0x00);
+		rockettest_check_expr_true(pic18_sim::reg(PIC18_SIM_CCPR1H) == 0x02);
+		pic18_sim::run_us(16);
+		rockettest_check_expr_true(pic18_sim::pwm_duty(1) == 512);
+		rockettest_check_expr_true(pic18_sim::pwm_duty_ratio(1) == 0.5);
+
+		// A second channel shares the Timer2 time base
+		rockettest_check_expr_true(pwm_init(2, pin_b1, 255) == W_SUCCESS);
+		rockettest_check_expr_true(pic18_sim::reg(PIC18_SIM_TRISB) == 0xfc);
+		rockettest_check_expr_true(pwm_update_duty_cycle(2, 1023) == W_SUCCESS);
+		pic18_sim::run_us(16);
+		rockettest_check_expr_true(pic18_sim::pwm_duty(2) == 1023);
+		rockettest_check_expr_true(pic18_sim::pwm_duty(1) == 512);
+		rockettest_check_expr_true(pic18_sim::pwm_duty(3) == 0);
+
+		printf("PWM: pwm_init() %u cycles, pwm_update_duty_cycle() %u cycles\n",
+			   static_cast<unsigned>(init_cycles),
+			   static_cast<unsigned>(update_cycles));
+
+		return test_passed;
+	}
+};
+
+pwm_test pwm_test_inst;
+
+class pwm_batch_test : rockettest_test {
+public:
+	pwm_batch_test() : rockettest_test("pwm_batch_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		pic18_sim::reset();
+		rockettest_check_expr_true(pwm_init(1, {&TRISB, &RB0PPS, 0}, 255) == W_SUCCESS);
+		rockettest_check_expr_true(pwm_init(2, {&TRISB, &RB1PPS, 1}, 255) == W_SUCCESS);
+		rockettest_check_expr_true(pwm_init(3, {&TRISB, &RB2PPS, 2}, 255) == W_SUCCESS);
+		rockettest_check_expr_true(pwm_init(4, {&TRISB, &RB3PPS, 3}, 255) == W_SUCCESS);
+
+		const std::uint16_t invalid[PWM_CCP_MODULES] = {0, 0, 1024, 0};
+		rockettest_check_expr_true(pwm_update_duty_cycles(nullptr) == W_INVALID_PARAM);
+		rockettest_check_expr_true(pwm_update_duty_cycles(invalid) == W_INVALID_PARAM);
+		rockettest_check_expr_true(pic18_sim::reg(PIC18_SIM_CCPR1L) == 0);
+
+		// Every channel goes from 0x0ff to 0x300, a half written duty cycle is 0x000 or 0x3ff
+		const std::uint16_t before[PWM_CCP_MODULES] = {0x0ff, 0x0ff, 0x0ff, 0x0ff};
+		const std::uint16_t after[PWM_CCP_MODULES] = {0x300, 0x300, 0x300, 0x300};
+		std::uint32_t periods = 0;
+		std::uint32_t glitches = 0;
+		pic18_sim::set_pwm_period_hook([&](const std::array<std::uint16_t, 4> &duty) {
+			periods++;
+			bool same = (duty[0] == duty[1]) && (duty[1] == duty[2]) && (duty[2] == duty[3]);
+			if (!same || ((duty[0] != 0x0ff) && (duty[0] != 0x300))) {
+				glitches++;
+			}
+		});
+
+		// Updates starting at every cycle of the 256 cycle period
+		std::uint32_t single_glitches = 0;
+		std::uint64_t single_cycles = 0;
+		std::uint64_t batch_min_cycles = UINT64_MAX;
+		std::uint64_t batch_max_cycles = 0;
+		bool batch_latched = true;
+		for (bool batch : {false, true}) {
+			glitches = 0;
+			for (std::uint64_t offset = 0; offset < 256; offset++) {
+				rockettest_check_expr_true(pwm_update_duty_cycles(before) == W_SUCCESS);
+				pic18_sim::run_us(40);
+				std::uint32_t start_periods = periods;
+				pic18_sim::run_until([&] { return periods != start_periods; }, 100);
+				pic18_sim::run_cycles(offset);
+
+				std::uint64_t start = pic18_sim::cycles();
+				if (batch) {
+					rockettest_check_expr_true(pwm_update_duty_cycles(after) == W_SUCCESS);
+				} else {
+					for (std::uint8_t ccp = 1; ccp <= PWM_CCP_MODULES; ccp++) {
+						rockettest_check_expr_true(pwm_update_duty_cycle(ccp, after[ccp - 1]) ==
+												   W_SUCCESS);
+					}
+				}
+				std::uint64_t cycles = pic18_sim::cycles() - start;
+				if (batch) {
+					batch_min_cycles = std::min(batch_min_cycles, cycles);
+					batch_max_cycles = std::max(batch_max_cycles, cycles);
+				} else {
+					single_cycles = std::max(single_cycles, cycles);
+				}
+				pic18_sim::run_us(40);
+				batch_latched = batch_latched && (pic18_sim::pwm_duty(4) == 0x300);
+			}
+			if (!batch) {
+				single_glitches = glitches;
+			}
+		}
+		// Separate updates straddle the period boundary, the batch never does
+		rockettest_check_expr_true(single_glitches > 0);
+		rockettest_check_expr_true(glitches == 0);
+		rockettest_check_expr_true(batch_latched);
+		rockettest_check_expr_true(INTCON0bits.GIE == 0);
+
+		// The Timer2 interrupt flag belongs to the application, in both halves of the period
+		for (std::uint64_t offset : {16, 240}) {
+			std::uint32_t start_periods = periods;
+			pic18_sim::run_until([&] { return periods != start_periods; }, 100);
+			pic18_sim::run_cycles(offset);
+			PIR4bits.TMR2IF = 0;
+			rockettest_check_expr_true(pwm_update_duty_cycles(before) == W_SUCCESS);
+			// Set again by the wrap around the update waited for
+			rockettest_check_expr_true(PIR4bits.TMR2IF == (offset == 240));
+			PIR4bits.TMR2IF = 1;
+			rockettest_check_expr_true(pwm_update_duty_cycles(after) == W_SUCCESS);
+			rockettest_check_expr_true(PIR4bits.TMR2IF == 1);
+		}
+
+		// No room for the writes before the end of a period of 64 counts
+		pic18_sim::set_pwm_period_hook(nullptr);
+		rockettest_check_expr_true(pwm_init(1, {&TRISB, &RB0PPS, 0}, 64) == W_SUCCESS);
+		std::uint8_t ccpr1l = pic18_sim::reg(PIC18_SIM_CCPR1L);
+		rockettest_check_expr_true(pwm_update_duty_cycles(before) == W_INVALID_PARAM);
+		rockettest_check_expr_true(pic18_sim::reg(PIC18_SIM_CCPR1L) == ccpr1l);
+		rockettest_check_expr_true(pwm_init(1, {&TRISB, &RB0PPS, 0}, 65) == W_SUCCESS);
+		rockettest_check_expr_true(pwm_update_duty_cycles(before) == W_SUCCESS);
+
+		printf("PWM 4 channels: %u of 256 separate updates glitched (%u cycles), batch updates "
+			   "none (%u to %u cycles)\n",
+			   static_cast<unsigned>(single_glitches),
+			   static_cast<unsigned>(single_cycles),
+			   static_cast<unsigned>(batch_min_cycles),
+			   static_cast<unsigned>(batch_max_cycles));
+
+		return test_passed;
+	}
+};
+
+pwm_batch_test pwm_batch_test_inst;
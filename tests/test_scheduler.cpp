@@ -0,0 +1,176 @@
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "common.h"
+#include "scheduler.h"
+#include "timer_wheel.h"
+
+#include "rockettest.hpp"
+
+// Simulated time, the clock counts microseconds and tasks consume it
+static uint32_t scheduler_test_us = 0;
+
+static uint32_t scheduler_test_clock(void) {
+	return scheduler_test_us;
+}
+
+struct scheduler_test_task {
+	scheduler_task_t task;
+	uint32_t run_us;
+	std::vector<uint32_t> *order;
+	int id;
+};
+
+static void scheduler_test_fn(void *arg) {
+	scheduler_test_task *t = static_cast<scheduler_test_task *>(arg);
+	t->order->push_back(t->id);
+	scheduler_test_us += t->run_us;
+}
+
+class scheduler_test : rockettest_test {
+public:
+	scheduler_test() : rockettest_test("scheduler_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		scheduler_t sched;
+		std::vector<uint32_t> order;
+		scheduler_test_task fast = {{}, 100, &order, 1};
+		scheduler_test_task medium = {{}, 300, &order, 2};
+		scheduler_test_task slow = {{}, 2500, &order, 3};
+
+		scheduler_init(&sched, 0, scheduler_test_clock);
+		rockettest_check_expr_true(
+			scheduler_add(nullptr, &fast.task, scheduler_test_fn, &fast, 1, 1) == W_INVALID_PARAM);
+		rockettest_check_expr_true(scheduler_add(&sched, &fast.task, nullptr, &fast, 1, 1) ==
+								   W_INVALID_PARAM);
+		rockettest_check_expr_true(
+			scheduler_add(&sched, &fast.task, scheduler_test_fn, &fast, 0, 1) == W_INVALID_PARAM);
+		rockettest_check_expr_true(
+			scheduler_add(&sched, &fast.task, scheduler_test_fn, &fast, 1, 0) == W_INVALID_PARAM);
+
+		// 1 ms, 10 ms and 100 ms tasks from a main loop polling a millisecond tick
+		rockettest_check_expr_true(
+			scheduler_add(&sched, &fast.task, scheduler_test_fn, &fast, 1, 1) == W_SUCCESS);
+		rockettest_check_expr_true(
+			scheduler_add(&sched, &medium.task, scheduler_test_fn, &medium, 10, 1) == W_SUCCESS);
+		rockettest_check_expr_true(
+			scheduler_add(&sched, &slow.task, scheduler_test_fn, &slow, 100, 5) == W_SUCCESS);
+
+		rockettest_check_expr_true(scheduler_run(&sched, 1) == 2);
+		rockettest_check_expr_true((order == std::vector<uint32_t>{1, 2}));
+		uint32_t runs = 0;
+		for (uint32_t ms = 2; ms <= 1000; ms++) {
+			runs += scheduler_run(&sched, ms);
+		}
+
+		// No drift: 1000, 100 and 10 releases. The slow task makes the fast one miss releases.
+		scheduler_stats_t fast_stats, medium_stats, slow_stats;
+		rockettest_check_expr_true(scheduler_get_stats(&fast.task, &fast_stats) == W_SUCCESS);
+		rockettest_check_expr_true(scheduler_get_stats(&medium.task, &medium_stats) == W_SUCCESS);
+		rockettest_check_expr_true(scheduler_get_stats(&slow.task, &slow_stats) == W_SUCCESS);
+		rockettest_check_expr_true(scheduler_get_stats(nullptr, &fast_stats) == W_INVALID_PARAM);
+		rockettest_check_expr_true(scheduler_get_stats(&fast.task, nullptr) == W_INVALID_PARAM);
+		rockettest_check_expr_true(fast_stats.runs + fast_stats.overruns == 1000);
+		rockettest_check_expr_true(medium_stats.runs == 100);
+		rockettest_check_expr_true(slow_stats.runs == 10);
+		rockettest_check_expr_true(runs + 2 == fast_stats.runs + 100 + 10);
+		rockettest_check_expr_true((fast_stats.max_run_time == 100) &&
+								   (fast_stats.total_run_time == 100ULL * fast_stats.runs));
+		rockettest_check_expr_true(slow_stats.max_run_time == 2500);
+		rockettest_check_expr_true(medium_stats.overruns == 0);
+		rockettest_check_expr_true(slow_stats.overruns == 0);
+
+		// A stalled main loop, a single run per task and the dropped releases as overruns
+		rockettest_check_expr_true(scheduler_run(&sched, 1050) == 3);
+		rockettest_check_expr_true(scheduler_get_stats(&fast.task, &fast_stats) == W_SUCCESS);
+		rockettest_check_expr_true(fast_stats.runs + fast_stats.overruns == 1050);
+		rockettest_check_expr_true(scheduler_get_stats(&medium.task, &medium_stats) == W_SUCCESS);
+		rockettest_check_expr_true((medium_stats.runs == 101) && (medium_stats.overruns == 4));
+
+		// Removing a released task drops it
+		order.clear();
+		scheduler_remove(&sched, &medium.task);
+		rockettest_check_expr_true(scheduler_run(&sched, 1060) == 1);
+		rockettest_check_expr_true((order == std::vector<uint32_t>{1}));
+		rockettest_check_expr_true(scheduler_add(&sched, &medium.task, scheduler_test_fn, &medium,
+												 10, 1) == W_SUCCESS);
+		rockettest_check_expr_true(scheduler_run(&sched, 1061) == 2);
+		scheduler_remove(&sched, &fast.task);
+		rockettest_check_expr_true(scheduler_run(&sched, 1070) == 0);
+
+		return test_passed;
+	}
+};
+
+scheduler_test scheduler_test_inst;
+
+class scheduler_readd_test : rockettest_test {
+public:
+	scheduler_readd_test() : rockettest_test("scheduler_readd_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		scheduler_t sched;
+		std::vector<uint32_t> order;
+		scheduler_test_task a = {{}, 0, &order, 1};
+		scheduler_test_task b = {{}, 0, &order, 2};
+		scheduler_test_task c = {{}, 0, &order, 3};
+		std::memset(&c.task, 0xa5, sizeof(c.task));
+		scheduler_task_init(&c.task);
+
+		scheduler_init(&sched, 0, nullptr);
+		rockettest_check_expr_true(
+			scheduler_add(&sched, &a.task, scheduler_test_fn, &a, 10, 1) == W_SUCCESS);
+		rockettest_check_expr_true(
+			scheduler_add(&sched, &b.task, scheduler_test_fn, &b, 10, 1) == W_SUCCESS);
+		rockettest_check_expr_true(
+			scheduler_add(&sched, &c.task, scheduler_test_fn, &c, 10, 1) == W_SUCCESS);
+
+		// Invalid delays leave the added task as it was
+		rockettest_check_expr_true(
+			scheduler_add(&sched, &b.task, scheduler_test_fn, &b, 10, 0) == W_INVALID_PARAM);
+		rockettest_check_expr_true(scheduler_add(&sched, &b.task, scheduler_test_fn, &b, 10,
+												 0x80000000UL) == W_INVALID_PARAM);
+		rockettest_check_expr_true(timer_wheel_running(&b.task.timer));
+
+		// Added again while queued in the middle of the ready queue: dropped from the queue
+		rockettest_check_expr_true(timer_wheel_advance(&sched.wheel, 1) == 3);
+		rockettest_check_expr_true(
+			scheduler_add(&sched, &b.task, scheduler_test_fn, &b, 10, 5) == W_SUCCESS);
+		rockettest_check_expr_true(scheduler_run(&sched, 1) == 2);
+		rockettest_check_expr_true((order == std::vector<uint32_t>{1, 3}));
+		rockettest_check_expr_true((sched.ready_head == nullptr) && (sched.ready_tail == nullptr));
+
+		// Added again while waiting in the wheel: linked once, with the new delay
+		order.clear();
+		rockettest_check_expr_true(scheduler_run(&sched, 6) == 1);
+		rockettest_check_expr_true(
+			scheduler_add(&sched, &a.task, scheduler_test_fn, &a, 10, 2) == W_SUCCESS);
+		for (uint32_t tick = 7; tick <= 30; tick++) {
+			scheduler_run(&sched, tick);
+		}
+		// b at 6, 16 and 26, a at 8, 18 and 28, c at 11 and 21
+		rockettest_check_expr_true((order == std::vector<uint32_t>{2, 1, 3, 2, 1, 3, 2, 1}));
+
+		scheduler_stats_t stats;
+		rockettest_check_expr_true(scheduler_get_stats(&a.task, &stats) == W_SUCCESS);
+		rockettest_check_expr_true((stats.runs == 3) && (stats.overruns == 0));
+
+		// Removed tasks are not run and can be added again
+		scheduler_remove(&sched, &a.task);
+		scheduler_remove(&sched, &b.task);
+		scheduler_remove(&sched, &c.task);
+		rockettest_check_expr_true(scheduler_run(&sched, 100) == 0);
+		rockettest_check_expr_true(
+			scheduler_add(&sched, &c.task, scheduler_test_fn, &c, 10, 1) == W_SUCCESS);
+		rockettest_check_expr_true(scheduler_run(&sched, 101) == 1);
+
+		return test_passed;
+	}
+};
+
+scheduler_readd_test scheduler_readd_test_inst;
@@ -0,0 +1,157 @@
+#include <cstdint>
+#include <cstdio>
+
+#include "sd_card_sim.hpp"
+#include "stm32/timebase.h"
+#include "stm32_tim_sim.hpp"
+#include "stm32h7xx_hal.h"
+
+#include "rockettest.hpp"
+
+// Moves TIM2 to a few microseconds before its overflow
+static void timebase_test_near_overflow(std::uint32_t us) {
+	TIM2->CNT = 0xffffffff - us + 1;
+}
+
+class timebase_test : rockettest_test {
+public:
+	timebase_test() : rockettest_test("timebase_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		stm32_tim_sim::reset();
+		stm32_tim_sim::set_isr(timebase_handle_interrupt);
+		rockettest_check_expr_true(timebase_init(0) == W_INVALID_PARAM);
+		rockettest_check_expr_true(timebase_init(500000) == W_INVALID_PARAM);
+		rockettest_check_expr_true(timebase_init(240500000) == W_INVALID_PARAM);
+		rockettest_check_expr_true(timebase_init(240000000) == W_SUCCESS);
+
+		// 1 MHz up to the full 32-bit range, update interrupt on overflows only
+		rockettest_check_expr_true(TIM2->PSC == 239);
+		rockettest_check_expr_true(TIM2->ARR == 0xffffffff);
+		rockettest_check_expr_true(TIM2->DIER == TIM_DIER_UIE);
+		rockettest_check_expr_true(TIM2->CR1 == (TIM_CR1_CEN | TIM_CR1_URS));
+		rockettest_check_expr_true(TIM2->SR == 0);
+		rockettest_check_expr_true(timebase_us() == 0);
+
+		sd_sim_clock::advance_us(123456);
+		rockettest_check_expr_true(timebase_us() == 123456);
+		rockettest_check_expr_true(timebase_ms() == 123);
+
+		// Read cost in timer register accesses
+		std::uint64_t accesses = stm32_tim_sim::accesses();
+		timebase_us();
+		std::uint64_t read_accesses = stm32_tim_sim::accesses() - accesses;
+		rockettest_check_expr_true(read_accesses == 2);
+
+		// The overflow interrupt extends the count past 32 bits
+		timebase_test_near_overflow(100);
+		sd_sim_clock::advance_us(250);
+		rockettest_check_expr_true(stm32_tim_sim::isr_count() == 1);
+		rockettest_check_expr_true(timebase_us() == (1ULL << 32) + 150);
+		rockettest_check_expr_true(TIM2->SR == 0);
+
+		// A pending overflow is accounted for while the interrupt is masked
+		timebase_test_near_overflow(100);
+		stm32_tim_sim::set_masked(true);
+		sd_sim_clock::advance_us(250);
+		accesses = stm32_tim_sim::accesses();
+		rockettest_check_expr_true(timebase_us() == (2ULL << 32) + 150);
+		std::uint64_t pending_accesses = stm32_tim_sim::accesses() - accesses;
+		rockettest_check_expr_true(stm32_tim_sim::isr_count() == 1);
+		rockettest_check_expr_true(timebase_ms() == ((2ULL << 32) + 150) / 1000);
+		stm32_tim_sim::set_masked(false);
+		rockettest_check_expr_true(stm32_tim_sim::isr_count() == 2);
+		rockettest_check_expr_true(timebase_us() == (2ULL << 32) + 150);
+
+		printf("timebase_us(): %u timer register reads, %u with an overflow pending\n",
+			   static_cast<unsigned>(read_accesses),
+			   static_cast<unsigned>(pending_accesses));
+
+		return test_passed;
+	}
+};
+
+timebase_test timebase_test_inst;
+
+class timebase_concurrency_test : rockettest_test {
+public:
+	timebase_concurrency_test() : rockettest_test("timebase_concurrency_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		stm32_tim_sim::reset();
+		stm32_tim_sim::set_isr(timebase_handle_interrupt);
+		rockettest_check_expr_true(timebase_init(240000000) == W_SUCCESS);
+
+		// The overflow lands before each register access of a read, with the interrupt running
+		// there or held off. The result must be a time between the start and the end of the read.
+		bool accurate = true;
+		bool monotonic = true;
+		std::uint64_t previous = timebase_us();
+		std::uint32_t interrupted = 0;
+		for (bool masked : {false, true}) {
+			for (std::uint64_t k = 0; k < 4; k++) {
+				timebase_test_near_overflow(5);
+				std::uint64_t start = timebase_us();
+				std::uint32_t isr_count = stm32_tim_sim::isr_count();
+				stm32_tim_sim::set_masked(masked);
+
+				std::uint64_t access = 0;
+				stm32_tim_sim::set_access_hook([&access, k] {
+					if (access++ == k) {
+						sd_sim_clock::advance_us(10);
+					}
+				});
+				std::uint64_t now = timebase_us();
+				stm32_tim_sim::set_access_hook(nullptr);
+				if (access <= k) {
+					sd_sim_clock::advance_us(10); // the read had fewer accesses
+				}
+				if (stm32_tim_sim::isr_count() != isr_count) {
+					interrupted++;
+				}
+				stm32_tim_sim::set_masked(false);
+
+				accurate = accurate && (now >= start) && (now <= start + 10);
+				monotonic = monotonic && (now >= previous) && (timebase_us() >= now);
+				previous = now;
+			}
+		}
+		rockettest_check_expr_true(accurate);
+		rockettest_check_expr_true(monotonic);
+		rockettest_check_expr_true(interrupted > 0);
+
+		// Reads from a higher priority interrupt preempting the handler between its accesses
+		bool preempted_accurate = true;
+		std::uint32_t preempted_reads = 0;
+		for (std::uint64_t k = 0; k < 3; k++) {
+			timebase_test_near_overflow(5);
+			std::uint64_t start = timebase_us();
+			stm32_tim_sim::set_masked(true);
+			sd_sim_clock::advance_us(10);
+
+			std::uint64_t access = 0;
+			stm32_tim_sim::set_access_hook([&] {
+				if (stm32_tim_sim::in_isr() && (access++ == k)) {
+					preempted_reads++;
+					preempted_accurate = preempted_accurate && (timebase_us() == start + 10);
+				}
+			});
+			stm32_tim_sim::set_masked(false);
+			stm32_tim_sim::set_access_hook(nullptr);
+			preempted_accurate = preempted_accurate && (timebase_us() == start + 10);
+		}
+		rockettest_check_expr_true(preempted_accurate);
+		rockettest_check_expr_true(preempted_reads == 2);
+
+		printf("timebase_us(): %u of 8 reads interrupted by the overflow\n",
+			   static_cast<unsigned>(interrupted));
+
+		return test_passed;
+	}
+};
+
+timebase_concurrency_test timebase_concurrency_test_inst;
@@ -0,0 +1,268 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+#include "pic18_sim.hpp"
+#include "timer.h"
+#include "xc.h"
+
+#include "rockettest.hpp"
+
+static void timer_test_isr(void) {
+	if (PIR3bits.TMR0IF) {
+		timer0_handle_interrupt();
+		PIR3bits.TMR0IF = 0;
+	}
+}
+
+class timer_test : rockettest_test {
+public:
+	timer_test() : rockettest_test("timer_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		pic18_sim::reset();
+		pic18_sim::set_isr(timer_test_isr);
+		timer0_init();
+		ei();
+		// The count carries on from earlier tests, the driver has no way to reset it
+		uint32_t base = millis();
+
+		// 8-bit mode on the 500 kHz MFINTOSC, no prescaler or postscaler
+		rockettest_check_expr_true(pic18_sim::reg(PIC18_SIM_T0CON0) == 0x80);
+		rockettest_check_expr_true(pic18_sim::reg(PIC18_SIM_T0CON1) == 0xa0);
+		rockettest_check_expr_true(PIE3bits.TMR0IE == 1);
+		rockettest_check_expr_true(millis() == base);
+
+		// The timer rolls over every 512 us, millis() follows real time over long runs
+		pic18_sim::run_us(1000);
+		rockettest_check_expr_true(pic18_sim::timer0_interrupts() == 1);
+		pic18_sim::run_us(999000);
+		uint32_t ms = millis() - base;
+		rockettest_check_expr_true((ms >= 999) && (ms <= 1000));
+		uint32_t interrupts = pic18_sim::timer0_interrupts();
+		rockettest_check_expr_true(interrupts == 1953);
+		double isr_percent = pic18_sim::isr_cycles() * 100.0 / pic18_sim::cycles();
+		double isr_cycles = static_cast<double>(pic18_sim::isr_cycles()) /
+							pic18_sim::isr_count();
+
+		pic18_sim::run_us(9000000);
+		ms = millis() - base;
+		rockettest_check_expr_true((ms >= 9999) && (ms <= 10000));
+
+		printf("Timer0 millis: %u interrupts per second, %.0f cycles each (%.2f %% CPU)\n",
+			   static_cast<unsigned>(interrupts),
+			   isr_cycles,
+			   isr_percent);
+		rockettest_check_expr_true(isr_percent < 1);
+
+		return test_passed;
+	}
+};
+
+timer_test timer_test_inst;
+
+class timer_micros_test : rockettest_test {
+public:
+	timer_micros_test() : rockettest_test("timer_micros_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		pic18_sim::reset();
+		pic18_sim::set_isr(timer_test_isr);
+		timer0_init();
+		ei();
+		uint32_t base = micros();
+		double base_us = pic18_sim::now_us();
+
+		// Reads landing at every cycle around a rollover, including the interrupt hitting in the
+		// middle of micros()
+		bool accurate = true;
+		bool monotonic = true;
+		uint32_t interrupted = 0;
+		uint32_t previous = base;
+		for (std::uint64_t offset = 0; offset < 64; offset++) {
+			uint32_t interrupts = pic18_sim::timer0_interrupts();
+			pic18_sim::run_until(
+				[interrupts] { return pic18_sim::timer0_interrupts() != interrupts; }, 1000);
+			pic18_sim::run_cycles(8192 - 48 + offset);
+
+			interrupts = pic18_sim::timer0_interrupts();
+			uint32_t now = micros();
+			double elapsed_us = pic18_sim::now_us() - base_us;
+			if (pic18_sim::timer0_interrupts() != interrupts) {
+				interrupted++;
+			}
+			accurate = accurate && (std::fabs((now - base) - elapsed_us) <= 4);
+			monotonic = monotonic && (now - previous < 0x80000000u);
+			previous = now;
+		}
+		rockettest_check_expr_true(accurate);
+		rockettest_check_expr_true(monotonic);
+		rockettest_check_expr_true(interrupted > 0);
+
+		// With interrupts disabled the pending rollover is counted, and interrupts stay disabled
+		di();
+		uint32_t before = micros();
+		uint32_t millis_before = millis();
+		pic18_sim::run_us(600);
+		uint32_t disabled = micros();
+		rockettest_check_expr_true(INTCON0bits.GIE == 0);
+		rockettest_check_expr_true(PIR3bits.TMR0IF == 1);
+		rockettest_check_expr_true((disabled - before >= 598) && (disabled - before <= 606));
+		rockettest_check_expr_true(millis() == millis_before);
+		ei();
+		uint32_t enabled = micros();
+		rockettest_check_expr_true(PIR3bits.TMR0IF == 0);
+		rockettest_check_expr_true((enabled - disabled > 0) && (enabled - disabled <= 8));
+		printf("Timer0 micros(): %u of 64 reads interrupted by the rollover\n",
+			   static_cast<unsigned>(interrupted));
+
+		return test_passed;
+	}
+};
+
+timer_micros_test timer_micros_test_inst;
+
+class timer_tick_test : rockettest_test {
+public:
+	timer_tick_test() : rockettest_test("timer_tick_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		pic18_sim::reset();
+		rockettest_check_expr_true(timer0_init_tick(0) == W_INVALID_PARAM);
+		rockettest_check_expr_true(timer0_init_tick(3) == W_INVALID_PARAM);
+		rockettest_check_expr_true(timer0_init_tick(64) == W_INVALID_PARAM);
+
+		// Interrupt cost of one second of timekeeping with the Bresenham rollover and with ticks
+		double bresenham_percent = 0;
+		for (uint8_t period_ms : {0, 1, 8, 32}) {
+			pic18_sim::reset();
+			pic18_sim::set_isr(timer_test_isr);
+			double start_us = pic18_sim::now_us();
+			if (period_ms == 0) {
+				timer0_init();
+			} else {
+				rockettest_check_expr_true(timer0_init_tick(period_ms) == W_SUCCESS);
+			}
+			ei();
+			uint32_t base_ms = millis();
+			uint32_t base_us = micros();
+			// Resolution of the interpolation, plus the time taken by the init
+			double resolution_us = 4.0 * period_ms + 20;
+
+			// Sampled every 100 us, millis() never runs ahead of real time or lags by a millisecond
+			bool accurate = true;
+			bool monotonic = true;
+			uint32_t previous = base_ms;
+			for (int i = 0; i < 10000; i++) {
+				pic18_sim::run_us(100);
+				uint32_t ms = millis();
+				double elapsed_us = pic18_sim::now_us() - start_us;
+				accurate = accurate && (ms - base_ms <= elapsed_us / 1000) &&
+						   (ms - base_ms + 1 > (elapsed_us - resolution_us) / 1000);
+				monotonic = monotonic && (ms >= previous);
+				previous = ms;
+			}
+			// The Bresenham millis() only moves at rollovers, up to 512 us late
+			rockettest_check_expr_true(accurate || (period_ms == 0));
+			rockettest_check_expr_true(monotonic);
+			double elapsed_us = pic18_sim::now_us() - start_us;
+			double micros_error_us = std::fabs((micros() - base_us) - elapsed_us);
+			rockettest_check_expr_true(micros_error_us <= resolution_us);
+
+			double isr_percent = pic18_sim::isr_cycles() * 100.0 / pic18_sim::cycles();
+			double interrupts = pic18_sim::isr_count() * 1e6 / elapsed_us;
+			if (period_ms == 0) {
+				bresenham_percent = isr_percent;
+				printf("Timer0 512 us rollover: %.0f interrupts per second, %.3f %% CPU\n",
+					   interrupts,
+					   isr_percent);
+			} else {
+				rockettest_check_expr_true(std::fabs(interrupts - 1000.0 / period_ms) <= 1);
+				rockettest_check_expr_true(isr_percent < bresenham_percent);
+				printf("Timer0 %u ms tick: %.0f interrupts per second, %.3f %% CPU (%.1fx less "
+					   "than the rollover)\n",
+					   static_cast<unsigned>(period_ms),
+					   interrupts,
+					   isr_percent,
+					   bresenham_percent / isr_percent);
+			}
+		}
+
+		return test_passed;
+	}
+};
+
+timer_tick_test timer_tick_test_inst;
+
+class timer_latency_test : rockettest_test {
+public:
+	timer_latency_test() : rockettest_test("timer_latency_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		pic18_sim::reset();
+		pic18_sim::set_isr(timer_test_isr);
+		timer0_init();
+		ei();
+		rockettest_check_expr_true(timer0_get_latency_stats(nullptr, false) == W_INVALID_PARAM);
+
+		// Undisturbed, the handler runs within a Timer0 count of the rollover
+		timer0_latency_stats_t stats;
+		pic18_sim::run_us(100000);
+		rockettest_check_expr_true(timer0_get_latency_stats(&stats, true) == W_SUCCESS);
+		rockettest_check_expr_true(stats.latency.count == pic18_sim::timer0_interrupts());
+		rockettest_check_expr_true(stats.jitter.count == stats.latency.count - 1);
+		rockettest_check_expr_true(stats.latency.max <= 2);
+		rockettest_check_expr_true(stats.jitter.max <= 2);
+		rockettest_check_expr_true(timer0_get_latency_stats(&stats, false) == W_SUCCESS);
+		rockettest_check_expr_true(stats.latency.count == 0);
+
+		// Every other rollover lands 50 us into a 150 us critical section
+		for (int i = 0; i < 50; i++) {
+			uint32_t interrupts = pic18_sim::timer0_interrupts();
+			pic18_sim::run_until(
+				[interrupts] { return pic18_sim::timer0_interrupts() != interrupts; }, 1000);
+			pic18_sim::run_cycles(8192 - pic18_sim::cycles_from_us(50));
+			di();
+			pic18_sim::run_us(150);
+			ei();
+		}
+		rockettest_check_expr_true(timer0_get_latency_stats(&stats, false) == W_SUCCESS);
+		rockettest_check_expr_true(stats.latency.count == 100);
+		uint32_t undisturbed = 0;
+		for (uint8_t i = 0; i <= log2_hist_bucket(2); i++) {
+			undisturbed += stats.latency.buckets[i];
+		}
+		rockettest_check_expr_true(undisturbed == 50);
+		rockettest_check_expr_true(stats.latency.buckets[log2_hist_bucket(100)] == 50);
+		rockettest_check_expr_true((stats.latency.max >= 96) && (stats.latency.max <= 104));
+		// Delayed and undisturbed interrupts alternate, both intervals deviate by the delay
+		rockettest_check_expr_true(stats.jitter.buckets[log2_hist_bucket(100)] >= 98);
+		rockettest_check_expr_true((stats.jitter.max >= 94) && (stats.jitter.max <= 104));
+
+		// millis() does not lose the delayed rollovers
+		uint32_t base = millis();
+		double base_us = pic18_sim::now_us();
+		pic18_sim::run_us(10000);
+		uint32_t ms = millis() - base;
+		rockettest_check_expr_true(std::fabs(ms - (pic18_sim::now_us() - base_us) / 1000) <= 1);
+
+		printf("Timer0 latency with 150 us critical sections: %u interrupts, mean %u us, max %u "
+			   "us, jitter max %u us\n",
+			   static_cast<unsigned>(stats.latency.count),
+			   static_cast<unsigned>(log2_hist_mean(&stats.latency)),
+			   static_cast<unsigned>(stats.latency.max),
+			   static_cast<unsigned>(stats.jitter.max));
+
+		return test_passed;
+	}
+};
+
+timer_latency_test timer_latency_test_inst;
@@ -0,0 +1,121 @@
+#include <cstdint>
+#include <vector>
+
+#include "common.h"
+#include "timer_wheel.h"
+
+#include "rockettest.hpp"
+
+struct timer_wheel_test_log {
+	std::vector<uint32_t> ticks;
+	std::vector<int> ids;
+	timer_wheel_t *wheel = nullptr;
+};
+
+struct timer_wheel_test_timer {
+	timer_wheel_timer_t timer;
+	int id;
+	timer_wheel_test_log *log;
+};
+
+static void timer_wheel_test_expired(timer_wheel_timer_t *timer) {
+	timer_wheel_test_timer *t = static_cast<timer_wheel_test_timer *>(timer->arg);
+	t->log->ticks.push_back(t->log->wheel->now);
+	t->log->ids.push_back(t->id);
+}
+
+class timer_wheel_test : rockettest_test {
+public:
+	timer_wheel_test() : rockettest_test("timer_wheel_test") {}
+
+	bool run_test() override {
+		bool test_passed = true;
+
+		timer_wheel_t wheel;
+		timer_wheel_test_log log;
+		log.wheel = &wheel;
+		timer_wheel_test_timer a = {{}, 1, &log};
+		timer_wheel_test_timer b = {{}, 2, &log};
+		timer_wheel_test_timer c = {{}, 3, &log};
+		timer_wheel_test_timer none = {{}, 4, &log};
+
+		// Starts near the wrap of the tick count
+		timer_wheel_init(&wheel, UINT32_MAX - 10);
+		timer_wheel_timer_init(&a.timer, timer_wheel_test_expired, &a);
+		timer_wheel_timer_init(&b.timer, timer_wheel_test_expired, &b);
+		timer_wheel_timer_init(&c.timer, timer_wheel_test_expired, &c);
+		timer_wheel_timer_init(&none.timer, nullptr, &none);
+
+		rockettest_check_expr_true(timer_wheel_start(nullptr, &a.timer, 1, 0) == W_INVALID_PARAM);
+		rockettest_check_expr_true(timer_wheel_start(&wheel, nullptr, 1, 0) == W_INVALID_PARAM);
+		rockettest_check_expr_true(timer_wheel_start(&wheel, &a.timer, 0, 0) == W_INVALID_PARAM);
+		rockettest_check_expr_true(timer_wheel_start(&wheel, &a.timer, 0x80000000u, 0) ==
+								   W_INVALID_PARAM);
+		rockettest_check_expr_true(timer_wheel_start(&wheel, &none.timer, 1, 0) ==
+								   W_INVALID_PARAM);
+		rockettest_check_expr_true(!timer_wheel_running(&a.timer));
+
+		// One-shot, periodic and a timer one revolution away in the same slot
+		rockettest_check_expr_true(timer_wheel_start(&wheel, &a.timer, 5, 0) == W_SUCCESS);
+		rockettest_check_expr_true(timer_wheel_start(&wheel, &b.timer, 3, 7) == W_SUCCESS);
+		rockettest_check_expr_true(
+			timer_wheel_start(&wheel, &c.timer, 5 + TIMER_WHEEL_SLOTS, 0) == W_SUCCESS);
+		rockettest_check_expr_true(timer_wheel_running(&a.timer));
+
+		uint32_t expired = 0;
+		uint32_t start = wheel.now;
+		for (uint32_t i = 1; i <= 40; i++) {
+			expired += timer_wheel_advance(&wheel, start + i);
+		}
+		std::vector<uint32_t> ticks = {start + 3,
+									   start + 5,
+									   start + 10,
+									   start + 17,
+									   start + 24,
+									   start + 31,
+									   start + 5 + TIMER_WHEEL_SLOTS,
+									   start + 38};
+		std::vector<int> ids = {2, 1, 2, 2, 2, 2, 3, 2};
+		rockettest_check_expr_true(log.ticks == ticks);
+		rockettest_check_expr_true(log.ids == ids);
+		rockettest_check_expr_true(expired == 8);
+		rockettest_check_expr_true(!timer_wheel_running(&a.timer));
+		rockettest_check_expr_true(timer_wheel_running(&b.timer));
+
+		// Stopping and restarting
+		timer_wheel_stop(&b.timer);
+		timer_wheel_stop(&b.timer);
+		rockettest_check_expr_true(!timer_wheel_running(&b.timer));
+		rockettest_check_expr_true(timer_wheel_advance(&wheel, wheel.now + 20) == 0);
+		rockettest_check_expr_true(timer_wheel_start(&wheel, &a.timer, 4, 0) == W_SUCCESS);
+		rockettest_check_expr_true(timer_wheel_start(&wheel, &a.timer, 2, 0) == W_SUCCESS);
+		rockettest_check_expr_true(timer_wheel_advance(&wheel, wheel.now + 4) == 1);
+		rockettest_check_expr_true(log.ticks.back() == wheel.now - 2);
+
+		// Timers due at the same tick expire in the order they were started
+		log.ids.clear();
+		rockettest_check_expr_true(timer_wheel_start(&wheel, &c.timer, 3, 0) == W_SUCCESS);
+		rockettest_check_expr_true(timer_wheel_start(&wheel, &a.timer, 3, 0) == W_SUCCESS);
+		rockettest_check_expr_true(timer_wheel_start(&wheel, &b.timer, 3, 0) == W_SUCCESS);
+		rockettest_check_expr_true(timer_wheel_advance(&wheel, wheel.now + 3) == 3);
+		rockettest_check_expr_true((log.ids == std::vector<int>{3, 1, 2}));
+
+		// A jump over many periods expires a periodic timer once and reports the skipped periods
+		log.ticks.clear();
+		rockettest_check_expr_true(timer_wheel_start(&wheel, &b.timer, 10, 10) == W_SUCCESS);
+		rockettest_check_expr_true(timer_wheel_start(&wheel, &a.timer, 1000, 0) == W_SUCCESS);
+		start = wheel.now;
+		rockettest_check_expr_true(timer_wheel_advance(&wheel, start + 105) == 1);
+		rockettest_check_expr_true(b.timer.missed == 9);
+		rockettest_check_expr_true(b.timer.expiry == start + 110);
+		rockettest_check_expr_true(timer_wheel_running(&a.timer));
+		rockettest_check_expr_true(timer_wheel_advance(&wheel, start + 110) == 1);
+		rockettest_check_expr_true(b.timer.missed == 0);
+		rockettest_check_expr_true(timer_wheel_advance(&wheel, start + 1000) == 2);
+		rockettest_check_expr_true(!timer_wheel_running(&a.timer));
+
+		return test_passed;
+	}
+};
+
+timer_wheel_test timer_wheel_test_inst;
@@ -0,0 +1,511 @@
+/**
+ * @file
+ * @brief Extract the littlefs logs from a raw SD card image
+ *
+ * Host tool for Linux. The image is mapped read-only, the first Linux partition is found with the
+ * rocketlib partition parser and mounted with the geometry profiles of the STM32H7 SD shim. Every
+ * file is copied to the output directory, then the CRC8 of each fixed size record is checked on
+ * all cores.
+ *
+ * Usage: sdextract [-r record_size] [-j threads] image output_dir
+ *
+ * Records end with the CRC8 (rocketlib `crc8_checksum()`, initial value 0) of the bytes before it.
+ * A trailing partial record is reported as truncated, not as a checksum error.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "crc8.h"
+#include "lfs.h"
+#include "partition.h"
+#include "stm32/littlefs_sd_geometry.h"
+
+#define SECTOR_SIZE LFSSHIM_SD_SECTOR_SIZE
+#define MAX_PARTITIONS 16
+#define COPY_BUFFER_SIZE (1024 * 1024)
+// Records verified per job, large enough to amortise the queue lock
+#define VERIFY_JOB_BYTES (4 * 1024 * 1024)
+
+// Geometry profiles of the SD shim, tried in order until one mounts
+static const lfsshim_sd_geometry_t geometries[] = {
+	LFSSHIM_SD_GEOMETRY_4K,
+	LFSSHIM_SD_GEOMETRY_4K_LARGE_CARD,
+	LFSSHIM_SD_GEOMETRY_SECTOR,
+};
+
+typedef struct {
+	const uint8_t *base;
+	uint64_t size;
+} image_t;
+
+typedef struct {
+	char *path;
+	const uint8_t *data;
+	uint64_t size;
+	uint64_t bad_records;
+	uint64_t first_bad_offset;
+	bool truncated;
+} extracted_file_t;
+
+typedef struct {
+	size_t file;
+	uint64_t offset;
+	uint64_t size;
+	uint64_t bad_records;
+	uint64_t first_bad_offset;
+} verify_job_t;
+
+typedef struct {
+	extracted_file_t *files;
+	verify_job_t *jobs;
+	size_t num_jobs;
+	size_t next_job;
+	uint32_t record_size;
+	pthread_mutex_t lock;
+} verify_queue_t;
+
+typedef struct {
+	extracted_file_t *files;
+	size_t num_files;
+	size_t capacity;
+	uint64_t bytes;
+} file_list_t;
+
+static w_status_t image_read(void *arg, uint64_t lba, uint16_t offset, uint8_t *buffer,
+							 uint16_t size) {
+	const image_t *image = (const image_t *)arg;
+	if ((lba * SECTOR_SIZE + offset + size) > image->size) {
+		return W_IO_ERROR;
+	}
+	memcpy(buffer, image->base + lba * SECTOR_SIZE + offset, size);
+	return W_SUCCESS;
+}
+
+// littlefs block device on the mapped partition, read-only
+static int bd_read(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer,
+				   lfs_size_t size) {
+	const image_t *part = (const image_t *)c->context;
+	uint64_t pos = (uint64_t)block * c->block_size + off;
+	if (pos + size > part->size) {
+		return LFS_ERR_IO;
+	}
+	memcpy(buffer, part->base + pos, size);
+	return LFS_ERR_OK;
+}
+
+static int bd_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_t off,
+				   const void *buffer, lfs_size_t size) {
+	(void)c;
+	(void)block;
+	(void)off;
+	(void)buffer;
+	(void)size;
+	return LFS_ERR_IO;
+}
+
+static int bd_erase(const struct lfs_config *c, lfs_block_t block) {
+	(void)c;
+	(void)block;
+	return LFS_ERR_IO;
+}
+
+static int bd_sync(const struct lfs_config *c) {
+	(void)c;
+	return LFS_ERR_OK;
+}
+
+static bool block_size_tried(size_t count, lfs_size_t block_size) {
+	for (size_t i = 0; i < count; i++) {
+		if (geometries[i].block_size == block_size) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static int mount_partition(lfs_t *lfs, struct lfs_config *cfg, image_t *part) {
+	for (size_t i = 0; i < sizeof(geometries) / sizeof(geometries[0]); i++) {
+		// Only the block size decides whether the superblock is found
+		if (block_size_tried(i, geometries[i].block_size)) {
+			continue;
+		}
+
+		memset(cfg, 0, sizeof(*cfg));
+		cfg->context = part;
+		cfg->read = bd_read;
+		cfg->prog = bd_prog;
+		cfg->erase = bd_erase;
+		cfg->sync = bd_sync;
+		cfg->read_size = SECTOR_SIZE;
+		cfg->prog_size = SECTOR_SIZE;
+		cfg->block_size = geometries[i].block_size;
+		// Taken from the superblock like the shim does, needs littlefs 2.7 or newer
+		cfg->block_count = 0;
+		cfg->block_cycles = geometries[i].block_cycles;
+		cfg->cache_size = geometries[i].cache_size;
+		cfg->lookahead_size = geometries[i].lookahead_size;
+
+		if (lfs_mount(lfs, cfg) == LFS_ERR_OK) {
+			printf("mounted with the %s geometry, %u byte blocks\n",
+				   geometries[i].name,
+				   (unsigned)cfg->block_size);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static char *join_path(const char *dir, const char *name) {
+	size_t dir_len = strlen(dir);
+	const char *sep = ((dir_len > 0) && (dir[dir_len - 1] == '/')) ? "" : "/";
+	size_t len = dir_len + strlen(name) + 2;
+	char *path = malloc(len);
+	if (path) {
+		snprintf(path, len, "%s%s%s", dir, sep, name);
+	}
+	return path;
+}
+
+static int copy_file(lfs_t *lfs, const char *lfs_path, const char *out_path, file_list_t *list,
+					 uint8_t *buffer) {
+	lfs_file_t file;
+	if (lfs_file_open(lfs, &file, lfs_path, LFS_O_RDONLY) < 0) {
+		fprintf(stderr, "%s: cannot open\n", lfs_path);
+		return -1;
+	}
+
+	int fd = open(out_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", out_path, strerror(errno));
+		lfs_file_close(lfs, &file);
+		return -1;
+	}
+
+	uint64_t size = 0;
+	int err = 0;
+	while (true) {
+		lfs_ssize_t n = lfs_file_read(lfs, &file, buffer, COPY_BUFFER_SIZE);
+		if (n <= 0) {
+			err = (int)n;
+			break;
+		}
+		if (write(fd, buffer, (size_t)n) != n) {
+			err = -1;
+			break;
+		}
+		size += (uint64_t)n;
+	}
+	lfs_file_close(lfs, &file);
+
+	if (err < 0) {
+		fprintf(stderr, "%s: copy failed\n", lfs_path);
+		close(fd);
+		return -1;
+	}
+
+	// Keep a read-only mapping of the copy for the verification pass
+	const uint8_t *data = NULL;
+	if (size > 0) {
+		void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (map == MAP_FAILED) {
+			close(fd);
+			return -1;
+		}
+		data = map;
+	}
+	close(fd);
+
+	if (list->num_files == list->capacity) {
+		size_t capacity = list->capacity ? 2 * list->capacity : 64;
+		extracted_file_t *files = realloc(list->files, capacity * sizeof(*files));
+		if (!files) {
+			return -1;
+		}
+		list->files = files;
+		list->capacity = capacity;
+	}
+
+	extracted_file_t *entry = &list->files[list->num_files++];
+	memset(entry, 0, sizeof(*entry));
+	entry->path = strdup(out_path);
+	entry->data = data;
+	entry->size = size;
+	list->bytes += size;
+	return 0;
+}
+
+static int extract_dir(lfs_t *lfs, const char *lfs_path, const char *out_dir, file_list_t *list,
+					   uint8_t *buffer) {
+	if ((mkdir(out_dir, 0755) < 0) && (errno != EEXIST)) {
+		fprintf(stderr, "%s: %s\n", out_dir, strerror(errno));
+		return -1;
+	}
+
+	lfs_dir_t dir;
+	if (lfs_dir_open(lfs, &dir, lfs_path) < 0) {
+		fprintf(stderr, "%s: cannot open directory\n", lfs_path);
+		return -1;
+	}
+
+	int result = 0;
+	struct lfs_info info;
+	int err;
+	while ((err = lfs_dir_read(lfs, &dir, &info)) > 0) {
+		if ((strcmp(info.name, ".") == 0) || (strcmp(info.name, "..") == 0)) {
+			continue;
+		}
+
+		char *child = join_path(lfs_path, info.name);
+		char *out_child = join_path(out_dir, info.name);
+		if (!child || !out_child) {
+			result = -1;
+		} else if (info.type == LFS_TYPE_DIR) {
+			result |= extract_dir(lfs, child, out_child, list, buffer);
+		} else {
+			result |= copy_file(lfs, child, out_child, list, buffer);
+		}
+		free(child);
+		free(out_child);
+	}
+	if (err < 0) {
+		fprintf(stderr, "%s: cannot read directory\n", lfs_path);
+		result = -1;
+	}
+
+	lfs_dir_close(lfs, &dir);
+	return result;
+}
+
+static void *verify_worker(void *arg) {
+	verify_queue_t *queue = (verify_queue_t *)arg;
+
+	while (true) {
+		pthread_mutex_lock(&queue->lock);
+		size_t index = queue->next_job++;
+		pthread_mutex_unlock(&queue->lock);
+		if (index >= queue->num_jobs) {
+			return NULL;
+		}
+
+		verify_job_t *job = &queue->jobs[index];
+		const uint8_t *data = queue->files[job->file].data;
+		uint32_t payload = queue->record_size - 1;
+		for (uint64_t off = job->offset; off < job->offset + job->size;
+			 off += queue->record_size) {
+			if (crc8_checksum(&data[off], payload, 0) != data[off + payload]) {
+				if (job->bad_records++ == 0) {
+					job->first_bad_offset = off;
+				}
+			}
+		}
+	}
+}
+
+/**
+ * @brief Check the record CRCs of all extracted files, split into jobs across threads
+ */
+static int verify_files(file_list_t *list, uint32_t record_size, unsigned threads) {
+	uint64_t job_bytes = (VERIFY_JOB_BYTES / record_size) * record_size;
+	if (job_bytes == 0) {
+		job_bytes = record_size;
+	}
+
+	size_t num_jobs = 0;
+	for (size_t i = 0; i < list->num_files; i++) {
+		uint64_t whole = (list->files[i].size / record_size) * record_size;
+		num_jobs += (size_t)((whole + job_bytes - 1) / job_bytes);
+	}
+
+	verify_queue_t queue = {
+		.files = list->files, .record_size = record_size, .num_jobs = num_jobs, .next_job = 0};
+	queue.jobs = calloc(num_jobs ? num_jobs : 1, sizeof(verify_job_t));
+	if (!queue.jobs) {
+		return -1;
+	}
+
+	size_t job = 0;
+	for (size_t i = 0; i < list->num_files; i++) {
+		extracted_file_t *file = &list->files[i];
+		uint64_t whole = (file->size / record_size) * record_size;
+		file->truncated = (whole != file->size);
+		for (uint64_t off = 0; off < whole; off += job_bytes) {
+			queue.jobs[job].file = i;
+			queue.jobs[job].offset = off;
+			queue.jobs[job].size = (whole - off < job_bytes) ? (whole - off) : job_bytes;
+			job++;
+		}
+	}
+
+	pthread_mutex_init(&queue.lock, NULL);
+	pthread_t *workers = calloc(threads, sizeof(pthread_t));
+	unsigned started = 0;
+	if (workers) {
+		for (; started < threads; started++) {
+			if (pthread_create(&workers[started], NULL, verify_worker, &queue) != 0) {
+				break;
+			}
+		}
+	}
+	// Without any worker thread the main thread does all the jobs
+	if (started == 0) {
+		verify_worker(&queue);
+	}
+	for (unsigned i = 0; i < started; i++) {
+		pthread_join(workers[i], NULL);
+	}
+	free(workers);
+	pthread_mutex_destroy(&queue.lock);
+
+	// Jobs of a file are in offset order, the first failing job has the first bad record
+	for (size_t j = 0; j < num_jobs; j++) {
+		extracted_file_t *file = &list->files[queue.jobs[j].file];
+		if ((queue.jobs[j].bad_records > 0) && (file->bad_records == 0)) {
+			file->first_bad_offset = queue.jobs[j].first_bad_offset;
+		}
+		file->bad_records += queue.jobs[j].bad_records;
+	}
+	free(queue.jobs);
+
+	int result = 0;
+	for (size_t i = 0; i < list->num_files; i++) {
+		const extracted_file_t *file = &list->files[i];
+		if (file->bad_records > 0) {
+			printf("%s: %llu bad records, first at byte %llu\n",
+				   file->path,
+				   (unsigned long long)file->bad_records,
+				   (unsigned long long)file->first_bad_offset);
+			result = -1;
+		}
+		if (file->truncated) {
+			printf("%s: truncated record at the end\n", file->path);
+		}
+	}
+	return result;
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-r record_size] [-j threads] image output_dir\n", prog);
+}
+
+int main(int argc, char **argv) {
+	uint32_t record_size = 0;
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	int opt;
+	while ((opt = getopt(argc, argv, "r:j:")) != -1) {
+		switch (opt) {
+			case 'r':
+				record_size = (uint32_t)strtoul(optarg, NULL, 0);
+				break;
+			case 'j':
+				threads = strtol(optarg, NULL, 0);
+				break;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+	}
+	if ((argc - optind != 2) || (record_size == 1)) {
+		usage(argv[0]);
+		return 2;
+	}
+	if (threads < 1) {
+		threads = 1;
+	}
+
+	const char *image_path = argv[optind];
+	const char *out_dir = argv[optind + 1];
+
+	int fd = open(image_path, O_RDONLY);
+	struct stat st;
+	if ((fd < 0) || (fstat(fd, &st) < 0)) {
+		fprintf(stderr, "%s: %s\n", image_path, strerror(errno));
+		return 1;
+	}
+
+	image_t image = {.size = (uint64_t)st.st_size};
+	void *map = mmap(NULL, image.size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "%s: %s\n", image_path, strerror(errno));
+		return 1;
+	}
+	image.base = map;
+
+	partition_entry_t entries[MAX_PARTITIONS];
+	uint8_t num_entries = 0;
+	w_status_t status =
+		partition_enumerate(image_read, &image, 0, entries, MAX_PARTITIONS, &num_entries);
+	if ((status != W_SUCCESS) && (status != W_OVERFLOW)) {
+		fprintf(stderr, "%s: no valid partition table\n", image_path);
+		return 1;
+	}
+
+	image_t part = {0};
+	for (uint8_t i = 0; i < num_entries; i++) {
+		uint64_t start = entries[i].start_lba * SECTOR_SIZE;
+		uint64_t size = entries[i].num_sectors * SECTOR_SIZE;
+		if (partition_is_linux(&entries[i]) && (start + size <= image.size)) {
+			part.base = image.base + start;
+			part.size = size;
+			printf("littlefs partition at sector %llu, %llu MiB\n",
+				   (unsigned long long)entries[i].start_lba,
+				   (unsigned long long)(size >> 20));
+			break;
+		}
+	}
+	if (!part.base) {
+		fprintf(stderr, "%s: no Linux partition\n", image_path);
+		return 1;
+	}
+
+	// littlefs jumps between metadata and data blocks, let the kernel read ahead anyway
+	size_t page_off = (size_t)((uintptr_t)part.base % (uintptr_t)sysconf(_SC_PAGESIZE));
+	posix_madvise(
+		(void *)(part.base - page_off), (size_t)part.size + page_off, POSIX_MADV_WILLNEED);
+
+	lfs_t lfs;
+	struct lfs_config cfg;
+	if (mount_partition(&lfs, &cfg, &part) != 0) {
+		fprintf(stderr, "%s: cannot mount littlefs\n", image_path);
+		return 1;
+	}
+
+	uint8_t *buffer = malloc(COPY_BUFFER_SIZE);
+	file_list_t list = {0};
+	int result = buffer ? extract_dir(&lfs, "/", out_dir, &list, buffer) : -1;
+	lfs_unmount(&lfs);
+	free(buffer);
+	printf("extracted %zu files, %llu bytes\n", list.num_files, (unsigned long long)list.bytes);
+
+	if (record_size > 0) {
+		if (verify_files(&list, record_size, (unsigned)threads) == 0) {
+			printf("all records valid\n");
+		} else {
+			result = -1;
+		}
+	}
+
+	for (size_t i = 0; i < list.num_files; i++) {
+		if (list.files[i].data) {
+			munmap((void *)list.files[i].data, list.files[i].size);
+		}
+		free(list.files[i].path);
+	}
+	free(list.files);
+	munmap(map, image.size);
+	return (result == 0) ? 0 : 1;
+}